@@ -33,7 +33,7 @@
 
 /* Within 'USER CODE' section, code will be kept by default at each generation */
 /* USER CODE BEGIN 0 */
-
+#include "lwip/igmp.h"
 /* USER CODE END 0 */
 
 /* Private define ------------------------------------------------------------*/
@@ -113,7 +113,9 @@ ETH_DMADescTypeDef DMATxDscrTab[ETH_TX_DESC_CNT] __attribute__((section(".TxDecr
 #endif
 
 /* USER CODE BEGIN 2 */
-
+/* Frames handed to lwIP and RX_POOL exhaustion events, read by the UDP benchmark */
+uint32_t RxPacketCount = 0;
+uint32_t RxAllocErrorCount = 0;
 /* USER CODE END 2 */
 
 /* Global Ethernet handle */
@@ -135,14 +137,19 @@ lan8742_IOCtx_t  LAN8742_IOCtx = {ETH_PHY_IO_Init,
                                   ETH_PHY_IO_GetTick};
 
 /* USER CODE BEGIN 3 */
-
+#if LWIP_IGMP
+/* Number of joined groups per bin of the 64-bit MAC multicast hash table */
+static uint8_t MulticastHashCount[64];
+#endif /* LWIP_IGMP */
 /* USER CODE END 3 */
 
 /* Private functions ---------------------------------------------------------*/
 void pbuf_free_custom(struct pbuf *p);
 
 /* USER CODE BEGIN 4 */
-
+#if LWIP_IGMP
+static err_t low_level_igmp_mac_filter(struct netif *netif, const ip4_addr_t *group, enum netif_mac_filter_action action);
+#endif /* LWIP_IGMP */
 /* USER CODE END 4 */
 
 /*******************************************************************************
@@ -235,7 +242,11 @@ static void low_level_init(struct netif *netif)
 #endif /* LWIP_ARP || LWIP_ETHERNET */
 
 /* USER CODE BEGIN LOW_LEVEL_INIT */
-
+#if LWIP_IGMP
+  /* Multicast frames go through the MAC hash filter, programmed as groups are joined */
+  netif->flags |= NETIF_FLAG_IGMP;
+  netif_set_igmp_mac_filter(netif, low_level_igmp_mac_filter);
+#endif /* LWIP_IGMP */
 /* USER CODE END LOW_LEVEL_INIT */
 }
 
@@ -714,6 +725,10 @@ void HAL_ETH_RxAllocateCallback(uint8_t **buff)
   }
   else
   {
+    if (RxAllocStatus == RX_ALLOC_OK)
+    {
+      RxAllocErrorCount++;
+    }
     RxAllocStatus = RX_ALLOC_ERROR;
     *buff = NULL;
   }
@@ -739,6 +754,7 @@ void HAL_ETH_RxLinkCallback(void **pStart, void **pEnd, uint8_t *buff, uint16_t
   {
     /* The first buffer of the packet. */
     *ppStart = p;
+    RxPacketCount++;
   }
   else
   {
@@ -770,6 +786,76 @@ void HAL_ETH_TxFreeCallback(uint32_t * buff)
 }
 
 /* USER CODE BEGIN 8 */
+#if LWIP_IGMP
+/**
+  * @brief  Add or remove an IPv4 multicast group in the MAC hash filter.
+  *         The hash bin is the upper 6 bits of the bit-reversed Ethernet
+  *         CRC32 of the group's MAC address (01:00:5E + lower 23 bits of the
+  *         group address). Bins are reference counted since groups may share one.
+  * @param  netif the lwip network interface structure for this ethernetif
+  * @param  group the multicast group address
+  * @param  action NETIF_ADD_MAC_FILTER or NETIF_DEL_MAC_FILTER
+  * @retval ERR_OK
+  */
+static err_t low_level_igmp_mac_filter(struct netif *netif, const ip4_addr_t *group, enum netif_mac_filter_action action)
+{
+  ETH_MACFilterConfigTypeDef filter;
+  uint32_t hash_table[2] = {0, 0};
+  uint8_t mac[6];
+  uint32_t crc = 0xFFFFFFFFU;
+  uint32_t addr = lwip_ntohl(ip4_addr_get_u32(group));
+  uint32_t bin;
+  uint32_t i;
+  uint32_t bit;
+
+  LWIP_UNUSED_ARG(netif);
+
+  mac[0] = 0x01;
+  mac[1] = 0x00;
+  mac[2] = 0x5E;
+  mac[3] = (uint8_t)((addr >> 16) & 0x7F);
+  mac[4] = (uint8_t)(addr >> 8);
+  mac[5] = (uint8_t)addr;
+
+  for (i = 0; i < sizeof(mac); i++)
+  {
+    crc ^= mac[i];
+    for (bit = 0; bit < 8; bit++)
+    {
+      crc = (crc >> 1) ^ (0xEDB88320U & (0U - (crc & 1U)));
+    }
+  }
+  bin = __RBIT(~crc) >> 26;
 
+  if (action == NETIF_ADD_MAC_FILTER)
+  {
+    MulticastHashCount[bin]++;
+  }
+  else if (MulticastHashCount[bin] > 0)
+  {
+    MulticastHashCount[bin]--;
+  }
+
+  /* HAL order: high register (bins 32..63) first */
+  for (i = 0; i < 64; i++)
+  {
+    if (MulticastHashCount[i] > 0)
+    {
+      hash_table[(i < 32) ? 1 : 0] |= 1U << (i & 31);
+    }
+  }
+  HAL_ETH_SetHashTable(&heth, hash_table);
+
+  HAL_ETH_GetMACFilterConfig(&heth, &filter);
+  if (filter.HashMulticast != ENABLE)
+  {
+    filter.HashMulticast = ENABLE;
+    filter.PassAllMulticast = DISABLE;
+    HAL_ETH_SetMACFilterConfig(&heth, &filter);
+  }
+
+  return ERR_OK;
+}
+#endif /* LWIP_IGMP */
 /* USER CODE END 8 */
 
@@ -40,6 +40,9 @@ u32_t sys_jiffies(void);
 u32_t sys_now(void);
 
 /* USER CODE BEGIN 1 */
-
+/* Number of received frames handed to lwIP */
+extern uint32_t RxPacketCount;
+/* Number of times the RX_POOL ran out of buffers (RxAllocStatus set to error) */
+extern uint32_t RxAllocErrorCount;
 /* USER CODE END 1 */
 #endif
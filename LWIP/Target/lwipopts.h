@@ -97,7 +97,8 @@
 #define CHECKSUM_CHECK_ICMP6 0
 /*-----------------------------------------------------------------------------*/
 /* USER CODE BEGIN 1 */
-
+/* IGMP: the UDP server joins the fleet's multicast command group */
+#define LWIP_IGMP 1
 /* USER CODE END 1 */
 
 #ifdef __cplusplus
@@ -12,7 +12,7 @@
 #ifndef INC_ADC_TEST_H_
 #define INC_ADC_TEST_H_
 
-#include "RTG.h"
+#include "UdpUut.h"
 
 /**
  * @brief ADC handler for ADC1 peripheral.
@@ -20,14 +20,12 @@
 extern ADC_HandleTypeDef hadc1;
 
 /**
- * @brief Test the ADC by reading values over a specified number of iterations.
+ * @brief Callback for ADC conversion complete.
  *
- * This function reads ADC values for the given number of iterations and
- * verifies the ADC's functionality by outputting the values for debugging.
+ * Latches the converted value for the ADC test engine (`adc_test_driver`).
  *
- * @param[in] iterations Number of ADC readings to perform.
- * @return Status of the ADC test (1 for success, 0xFF for failure).
+ * @param[in] hadc Pointer to the ADC handle that triggered the interrupt.
  */
-uint8_t test_adc(uint16_t iterations);
+void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc);
 
 #endif /* INC_ADC_TEST_H_ */
@@ -0,0 +1,90 @@
+/**
+ * @file Bench.h
+ * @brief Header file for the UDP throughput self-benchmark.
+ *
+ * This file declares the benchmark that measures what the board can push
+ * through `ethernetif_input()` -> `udp_input()` -> `low_level_output()`:
+ * a blast mode in which the board generates datagrams as fast as the
+ * Ethernet driver takes them, an echo mode that reflects datagrams back,
+ * and a set of counters (MAC frames, missed frames, RX_POOL exhaustion and
+ * CPU load of the main loop) reported with the BENCH opcode.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#ifndef INC_BENCH_H_
+#define INC_BENCH_H_
+
+#include "UdpUut.h"
+
+/** @brief Largest UDP payload of a benchmark datagram (one Ethernet frame). */
+#define BENCH_MAX_PAYLOAD 1472
+
+/** @brief Smallest BLAST datagram: header and sequence number. */
+#define BENCH_MIN_PAYLOAD (PROTOCOL_HEADER_SIZE + 4)
+
+/** @brief Largest datagram count of a BLAST, about 12 s of full-size frames at 100 Mbit/s; a blast cannot be cancelled. */
+#define BENCH_MAX_COUNT 100000
+
+/** @brief Number of BLAST datagrams sent per main-loop pass, so reception keeps being serviced. */
+#define BENCH_BURST 16
+
+/**
+ * @brief Initialize the benchmark buffer and start a counter window.
+ */
+void Bench_Init(void);
+
+/**
+ * @brief Start sending a burst of BLAST datagrams.
+ *
+ * The datagrams are sent by Bench_Poll(); a BENCH report follows the last one.
+ *
+ * @param[in] pcb Pointer to the UDP control block to send on.
+ * @param[in] addr Pointer to the destination IP address.
+ * @param[in] port Destination UDP port.
+ * @param[in] count Number of datagrams to send, at most BENCH_MAX_COUNT.
+ * @param[in] size UDP payload size of each datagram.
+ * @return uint8_t Returns 1 if the blast was started, 0 if another one is running.
+ */
+uint8_t Bench_StartBlast(struct udp_pcb* pcb, const ip_addr_t* addr, u16_t port, uint32_t count, uint16_t size);
+
+/**
+ * @brief Reflect an ECHO datagram back to its sender.
+ *
+ * @param[in] pcb Pointer to the UDP control block.
+ * @param[in] p Pointer to the received datagram.
+ * @param[in] addr Pointer to the sender's IP address.
+ * @param[in] port Port number of the sender.
+ */
+void Bench_Echo(struct udp_pcb* pcb, const struct pbuf* p, const ip_addr_t* addr, u16_t port);
+
+/**
+ * @brief Restart the counters and the CPU load window.
+ */
+void Bench_Reset(void);
+
+/**
+ * @brief Encode the counters of the current window.
+ *
+ * @param[out] buf Buffer of at least PROTOCOL_BENCH_REPORT_SIZE bytes.
+ * @return uint16_t Number of bytes written.
+ */
+uint16_t Bench_EncodeReport(uint8_t* buf);
+
+/**
+ * @brief Send the next datagrams of a running blast. Must be called from the main loop.
+ */
+void Bench_Poll(void);
+
+/**
+ * @brief Account one pass of the main loop for the CPU load.
+ *
+ * A pass that received no frame, ran no job and sent no blast datagram
+ * counts as idle time.
+ *
+ * @param[in] start Cycle counter at the start of the pass.
+ */
+void Bench_Account(uint32_t start);
+
+#endif /* INC_BENCH_H_ */
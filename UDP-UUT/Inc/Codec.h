@@ -0,0 +1,186 @@
+/**
+ * @file Codec.h
+ * @brief Header file for the wire protocol encoder and decoder.
+ *
+ * This file declares the functions that translate between the packed,
+ * little-endian wire format described in Protocol.h and the structures
+ * used by the server.
+ *
+ * @details The decoder works directly on the received pbuf chain: every
+ * length is checked against `p->tot_len` before a field is read, and fields
+ * are read in place whenever they lie in a single pbuf.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#ifndef INC_CODEC_H_
+#define INC_CODEC_H_
+
+#include "UdpUut.h"
+#include "Protocol.h"
+
+/**
+ * @brief Decoded packet header.
+ */
+typedef struct {
+    uint8_t version;  /**< Protocol version. */
+    uint8_t opcode;   /**< PROTOCOL_OPCODE_* value. */
+    uint8_t flags;    /**< Header flags. */
+    uint8_t targets;  /**< Bitmap of the addressed boards, PROTOCOL_TARGETS_ALL for every board. */
+} PacketHeader;
+
+/**
+ * @brief Read a little-endian 16-bit field.
+ *
+ * @param[in] buf Pointer to the first byte of the field.
+ * @return uint16_t Field value.
+ */
+static inline uint16_t Codec_GetLe16(const uint8_t* buf) {
+    return (uint16_t)(buf[0] | (buf[1] << 8));
+}
+
+/**
+ * @brief Read a little-endian 32-bit field.
+ *
+ * @param[in] buf Pointer to the first byte of the field.
+ * @return uint32_t Field value.
+ */
+static inline uint32_t Codec_GetLe32(const uint8_t* buf) {
+    return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+/**
+ * @brief Write a little-endian 16-bit field.
+ *
+ * @param[out] buf Pointer to the first byte of the field.
+ * @param[in] value Field value.
+ */
+static inline void Codec_PutLe16(uint8_t* buf, uint16_t value) {
+    buf[0] = (uint8_t)value;
+    buf[1] = (uint8_t)(value >> 8);
+}
+
+/**
+ * @brief Write a little-endian 32-bit field.
+ *
+ * @param[out] buf Pointer to the first byte of the field.
+ * @param[in] value Field value.
+ */
+static inline void Codec_PutLe32(uint8_t* buf, uint32_t value) {
+    buf[0] = (uint8_t)value;
+    buf[1] = (uint8_t)(value >> 8);
+    buf[2] = (uint8_t)(value >> 16);
+    buf[3] = (uint8_t)(value >> 24);
+}
+
+/**
+ * @brief Write a little-endian 64-bit field.
+ *
+ * @param[out] buf Pointer to the first byte of the field.
+ * @param[in] value Field value.
+ */
+static inline void Codec_PutLe64(uint8_t* buf, uint64_t value) {
+    Codec_PutLe32(&buf[0], (uint32_t)value);
+    Codec_PutLe32(&buf[4], (uint32_t)(value >> 32));
+}
+
+/**
+ * @brief Write an unsigned LEB128 varint: 7 bits per byte, lowest first.
+ *
+ * @param[out] buf Buffer of at least PROTOCOL_VARINT_MAX_SIZE bytes.
+ * @param[in] value Value to write.
+ * @return uint16_t Number of bytes written.
+ */
+static inline uint16_t Codec_PutVarint(uint8_t* buf, uint32_t value) {
+    uint16_t length = 0;
+
+    while (value >= 0x80) {
+        buf[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    buf[length++] = (uint8_t)value;
+    return length;
+}
+
+/**
+ * @brief Zig-zag encode the difference of two values, so small deltas of either sign stay small.
+ *
+ * @param[in] value New value.
+ * @param[in] previous Previous value.
+ * @return uint32_t Encoded delta: 0, -1, 1, -2, ... map to 0, 1, 2, 3, ...
+ */
+static inline uint32_t Codec_ZigZagDelta(uint32_t value, uint32_t previous) {
+    int32_t delta = (int32_t)(value - previous);
+
+    return ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+}
+
+/**
+ * @brief Decode the header of a received packet.
+ *
+ * @param[in] p Pointer to the received datagram.
+ * @param[out] header Pointer to the header to fill.
+ * @return uint8_t Returns 0 if the header is valid, otherwise a PROTOCOL_ERROR_* code.
+ */
+uint8_t Codec_DecodeHeader(const struct pbuf* p, PacketHeader* header);
+
+/**
+ * @brief Decode one test request body.
+ *
+ * The fixed fields and every TLV are validated against the pbuf length.
+ * The pattern is not copied; its offset in the datagram is returned in
+ * `command->pattern_offset`.
+ *
+ * @param[in] p Pointer to the received datagram.
+ * @param[in] offset Offset of the test request body in the datagram.
+ * @param[out] command Pointer to the TestCommand to fill.
+ * @return uint16_t Offset just past the request body, or 0 if it is malformed.
+ */
+uint16_t Codec_DecodeTest(const struct pbuf* p, uint16_t offset, TestCommand* command);
+
+/**
+ * @brief Get a pointer to the pattern of a decoded test command.
+ *
+ * Returns a pointer into the pbuf payload when the pattern lies in a single
+ * pbuf, which is always the case for a datagram received in one Ethernet
+ * frame. A pattern spanning several pbufs of a chain is gathered into the
+ * scratch buffer instead.
+ *
+ * @param[in] p Pointer to the datagram the command was decoded from.
+ * @param[in] command Pointer to the decoded command; its pattern_length must not be 0.
+ * @param[out] scratch Buffer of TEST_PATTERN_MAX_LENGTH bytes used for chained patterns.
+ * @return const uint8_t* Pointer to the pattern, or NULL if it lies outside the pbuf.
+ */
+const uint8_t* Codec_GetPattern(const struct pbuf* p, const TestCommand* command, uint8_t* scratch);
+
+/**
+ * @brief Encode a packet header.
+ *
+ * @param[out] buf Pointer to at least PROTOCOL_HEADER_SIZE bytes.
+ * @param[in] opcode PROTOCOL_OPCODE_* value.
+ * @param[in] flags Header flags.
+ * @return uint16_t Number of bytes written.
+ */
+uint16_t Codec_EncodeHeader(uint8_t* buf, uint8_t opcode, uint8_t flags);
+
+/**
+ * @brief Encode a test result.
+ *
+ * @param[out] buf Pointer to at least PROTOCOL_RESULT_SIZE bytes.
+ * @param[in] result Pointer to the result to encode.
+ * @return uint16_t Number of bytes written.
+ */
+uint16_t Codec_EncodeResult(uint8_t* buf, const TestResult* result);
+
+/**
+ * @brief Encode a complete error reply.
+ *
+ * @param[out] buf Pointer to at least PROTOCOL_HEADER_SIZE + PROTOCOL_ERROR_SIZE bytes.
+ * @param[in] error PROTOCOL_ERROR_* code.
+ * @param[in] opcode Opcode of the rejected request.
+ * @return uint16_t Number of bytes written.
+ */
+uint16_t Codec_EncodeError(uint8_t* buf, uint8_t error, uint8_t opcode);
+
+#endif /* INC_CODEC_H_ */
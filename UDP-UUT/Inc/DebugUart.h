@@ -0,0 +1,60 @@
+/**
+ * @file DebugUart.h
+ * @brief Header file for the buffered output of the debug UART.
+ *
+ * printf() sends its text to the debug UART (Tools.c). The UART runs at
+ * 115200 baud, so a blocking transmit held the main loop for 87 us per
+ * character, 3.5 ms for a 40-character line. The text is instead copied
+ * into a transmit ring, and DebugUart_Poll() moves one character to the
+ * UART whenever its transmit data register is empty, once per main-loop
+ * pass; printf() returns as soon as the text is queued.
+ *
+ * @details The ring is only used from the main loop: printf() must not be
+ * called from interrupt handlers. Text that does not fit in the ring is
+ * dropped and counted, so a burst of debug lines never stalls the loop.
+ * The main loop passes far more often than once per character time, so
+ * the ring drains at the line rate of the UART.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#ifndef INC_DEBUG_UART_H_
+#define INC_DEBUG_UART_H_
+
+#include "UdpUut.h"
+
+/** @brief Size of the transmit ring in bytes (a power of two). */
+#define DEBUG_UART_BUFFER_SIZE 2048
+
+/**
+ * @brief Queue text for the debug UART without waiting.
+ *
+ * @param[in] data Pointer to the text.
+ * @param[in] length Length of the text.
+ * @return uint16_t Number of bytes queued; the rest did not fit and was dropped.
+ */
+uint16_t DebugUart_Write(const uint8_t* data, uint16_t length);
+
+/**
+ * @brief Send the next queued character if the UART can take it.
+ *
+ * Called once per main-loop pass; never waits.
+ */
+void DebugUart_Poll(void);
+
+/**
+ * @brief Number of queued characters not sent yet.
+ *
+ * @return uint16_t Number of characters in the ring.
+ */
+uint16_t DebugUart_Pending(void);
+
+/**
+ * @brief Number of characters dropped because the ring was full.
+ *
+ * @return uint32_t Characters dropped since reset.
+ */
+uint32_t DebugUart_Dropped(void);
+
+#endif /* INC_DEBUG_UART_H_ */
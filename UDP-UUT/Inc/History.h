@@ -0,0 +1,56 @@
+/**
+ * @file History.h
+ * @brief Header file for the result history ring.
+ *
+ * This file declares a RAM ring of the final replies of the last completed
+ * tests and plan runs, indexed by client IP address and test ID. A client
+ * whose reply was lost, or evicted from the reply cache, fetches it with a
+ * HISTORY request instead of running the hardware test again.
+ *
+ * @note Replies are kept encoded, header included, exactly as they were sent,
+ * so the SUMMARY, TIMING and SCHEDULE TLVs come back with the result.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#ifndef INC_HISTORY_H_
+#define INC_HISTORY_H_
+
+#include "UdpUut.h"
+#include "Protocol.h"
+
+/** @brief Number of replies kept; the oldest is overwritten first. */
+#define HISTORY_SIZE 32
+
+/** @brief Largest encoded reply kept in an entry (a TEST reply with one full sweep table fits). */
+#define HISTORY_REPLY_SIZE 384
+
+/**
+ * @brief Keep the final reply of a test or plan run.
+ *
+ * Replies larger than HISTORY_REPLY_SIZE are not kept.
+ *
+ * @param[in] addr Pointer to the client IP address.
+ * @param[in] test_id Test ID (or plan run ID) of the request.
+ * @param[in] reply Pointer to the encoded reply.
+ * @param[in] length Length of the encoded reply.
+ */
+void History_Add(const ip_addr_t* addr, uint32_t test_id, const uint8_t* reply, uint16_t length);
+
+/**
+ * @brief Encode the kept replies of a client within a test ID range.
+ *
+ * Replies are written in ascending test ID order as HISTORY entries until
+ * the buffer is full.
+ *
+ * @param[out] buf Buffer receiving the HISTORY reply body.
+ * @param[in] size Size of the buffer (at least PROTOCOL_HISTORY_REPLY_SIZE).
+ * @param[in] addr Pointer to the client IP address.
+ * @param[in] first First test ID of the range.
+ * @param[in] last Last test ID of the range (inclusive).
+ * @return uint16_t Number of bytes written.
+ */
+uint16_t History_Encode(uint8_t* buf, uint16_t size, const ip_addr_t* addr, uint32_t first, uint32_t last);
+
+#endif /* INC_HISTORY_H_ */
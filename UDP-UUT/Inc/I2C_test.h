@@ -34,27 +34,98 @@ extern I2C_HandleTypeDef hi2c2;
 #define I2C_2 &hi2c2
 
 /**
- * @brief Test the I2C communication with a specific bit pattern.
+ * @brief 7-bit address of I2C2 (Slave). CubeMX leaves its own address at 0,
+ * so the test engine sets this one before the first transfer.
+ */
+#define I2C_SLAVE_ADDRESS 0x42
+
+/** @brief Largest number of devices kept in the device table. */
+#define I2C_DEVICE_MAX 8
+
+/** @brief Timeout of each address probed by a bus scan, in ms. */
+#define I2C_SCAN_TIMEOUT 2
+
+/**
+ * @brief Addresses probed per main-loop pass by a bus scan. A probe takes
+ * about 100 us in Standard mode, so the 127 addresses take 32 passes.
+ */
+#define I2C_SCAN_BATCH 4
+
+/** @brief Address after the last one a bus scan probes. */
+#define I2C_SCAN_END 128
+
+/**
+ * @brief Timing value for Standard mode (100 kHz) with a 36 MHz I2C clock
+ * (PCLK1), as generated by CubeMX.
+ */
+#define I2C_TIMING_STANDARD 0x00808CD2
+
+/**
+ * @brief Timing value for Fast mode (400 kHz) with a 36 MHz I2C clock:
+ * PRESC 2, SCLDEL 4, SDADEL 2, SCLH 7, SCLL 16 (tLOW 1.42 us, tHIGH 0.67 us).
+ */
+#define I2C_TIMING_FAST 0x20420710
+
+/**
+ * @brief Timing value for Fast-mode Plus (1 MHz) with a 36 MHz I2C clock:
+ * PRESC 0, SCLDEL 6, SDADEL 0, SCLH 9, SCLL 18 (tLOW 0.53 us, tHIGH 0.28 us),
+ * above the 0.5 us and 0.26 us minimums of the mode.
+ * Needs the Fast-mode Plus drive of both I2Cs' pins.
+ */
+#define I2C_TIMING_FAST_PLUS 0x00600912
+
+/** @brief Bytes of PRBS data sent by each transfer of the speed sweep. */
+#define I2C_SWEEP_BLOCK_SIZE 256
+
+/** @brief Transfers run at each speed of the sweep when a request asks for 0 iterations. */
+#define I2C_SWEEP_DEFAULT_TRANSFERS 8
+
+/**
+ * @brief Devices found on a bus by the last scan.
+ */
+typedef struct {
+    I2C_HandleTypeDef* bus;                 /**< Bus that was scanned, NULL until the first scan. */
+    uint8_t count;                          /**< Number of devices found (at most I2C_DEVICE_MAX are kept). */
+    uint8_t addresses[I2C_DEVICE_MAX];      /**< 7-bit addresses of the devices, lowest first. */
+    uint8_t next;                           /**< Next address to probe; I2C_SCAN_END once the scan is complete. */
+} I2cDeviceTable;
+
+/**
+ * @brief Get the devices of an I2C bus, scanning it only if it has not been scanned yet.
  *
- * This function sends a specified bit pattern to test the
- * functionality of the I2C communication.
+ * A scan probes I2C_SCAN_BATCH addresses per call, prints the devices that
+ * answer on the debug UART and stores them in the device table, so the
+ * caller polls again on the next main-loop pass until the table is ready.
+ *
+ * @param[in] hi2c Pointer to the I2C handler.
+ * @return const I2cDeviceTable* Pointer to the device table, or NULL while the scan goes on.
+ */
+const I2cDeviceTable* I2C_GetDevices(I2C_HandleTypeDef *hi2c);
+
+/**
+ * @brief Forget the device table, so the next I2C_GetDevices() scans the bus again.
+ */
+void I2C_ForgetDevices(void);
+
+/**
+ * @brief Callback function for I2C Master Transmit Complete event.
  *
- * @param[in] bit_pattern Pointer to the bit pattern to send.
- * @param[in] pattern_length Length of the bit pattern.
- * @param[in] iterations Number of times to send the pattern.
- * @return Status of the I2C test (0 for success, non-zero for failure).
+ * @param[in] hi2c Pointer to the I2C handler.
  */
-uint8_t test_i2c(char *bit_pattern, uint8_t pattern_length, uint16_t iterations);
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c);
 
 /**
- * @brief Scan for devices on the specified I2C bus.
+ * @brief Callback function for I2C Slave Receive Complete event.
  *
- * This function scans the I2C bus for connected devices
- * and prints their addresses using the debug UART.
+ * @param[in] hi2c Pointer to the I2C handler.
+ */
+void HAL_I2C_SlaveRxCpltCallback(I2C_HandleTypeDef *hi2c);
+
+/**
+ * @brief Callback function for I2C errors.
  *
  * @param[in] hi2c Pointer to the I2C handler.
- * @return Status of the scan (0 for success, non-zero for failure).
  */
-uint8_t I2C_Scan(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c);
 
 #endif /* INC_I2C_TEST_H_ */
@@ -0,0 +1,184 @@
+/**
+ * @file JobQueue.h
+ * @brief Header file for the test job queue.
+ *
+ * This file declares the bounded queue that decouples the UDP receive
+ * callback from test execution. The callback only enqueues commands;
+ * the main loop drains the queue one resumable step at a time, so the
+ * network stack keeps being serviced while a test is running. Jobs of
+ * different clients are scheduled fairly (see Session.h).
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#ifndef INC_JOB_QUEUE_H_
+#define INC_JOB_QUEUE_H_
+
+#include "UdpUut.h"
+#include "Protocol.h"
+#include "Codec.h"
+#include "Session.h"
+#include "Plan.h"
+
+/** @brief Maximum number of test commands waiting for execution. */
+#define JOB_QUEUE_DEPTH 8
+
+/**
+ * @brief Maximum number of received datagrams held by queued jobs.
+ *
+ * Held datagrams are zero-copy RX_POOL buffers (12 in total), so only part
+ * of the pool may be used as pattern storage or Ethernet reception stalls.
+ */
+#define JOB_QUEUE_MAX_PACKETS 4
+
+/**
+ * @brief Lifecycle state of a queued test job.
+ */
+typedef enum {
+    JOB_STATE_FREE = 0,     /**< Slot not in use. */
+    JOB_STATE_QUEUED,       /**< Waiting in the queue. */
+    JOB_STATE_RUNNING,      /**< Currently stepped by the main loop. */
+    JOB_STATE_SUSPENDED     /**< Preempted at an iteration boundary, waiting to resume. */
+} JobState;
+
+/**
+ * @brief A test command together with the client that requested it.
+ */
+typedef struct {
+    TestCommand command;      /**< Decoded test command (current command of a batch). */
+    struct pbuf* packet;      /**< Referenced datagram holding the pattern(s), or NULL if no pattern is needed. */
+    uint8_t batch;            /**< Set if the job runs the requests of a BATCH datagram. */
+    uint8_t flags;            /**< PROTOCOL_FLAG_* header flags of the request. */
+    uint16_t batch_offset;    /**< Offset of the next compact command in the batch datagram. */
+    uint8_t batch_remaining;  /**< Number of batch commands not started yet. */
+    uint8_t plan;             /**< Set if the job runs a stored test plan (the test ID is the run ID). */
+    PlanCursor cursor;        /**< Progress through the plan of a plan job. */
+    struct udp_pcb* pcb;      /**< UDP control block used to send the result. */
+    ip_addr_t addr;           /**< Client IP address. */
+    u16_t port;               /**< Client UDP port. */
+    uint8_t session;          /**< Index of the client's session. */
+    uint8_t priority;         /**< PROTOCOL_PRIORITY_* class (batches run as PROTOCOL_PRIORITY_NORMAL). */
+    uint8_t cancel;           /**< Set by a CANCEL request; the job stops at its next step. */
+    uint32_t cost;            /**< Iterations charged to the session's deficit when the job starts. */
+    uint32_t enqueued;        /**< Tick at which the job was queued. */
+    uint32_t sequence;        /**< Arrival order, to keep each client's jobs in FIFO order. */
+    uint32_t wait;            /**< Time spent queued before the first start, in ms. */
+    uint32_t started;         /**< Tick at which the job first started. */
+    uint32_t preempted;       /**< Time spent suspended by urgent jobs, in ms. */
+    uint32_t suspended;       /**< Tick at which the job was last suspended. */
+    JobState state;           /**< Current job state. */
+} TestJob;
+
+/**
+ * @brief Enqueue a test command for execution.
+ *
+ * Safe to call from the UDP receive callback: no test code is executed.
+ * The pattern is not copied; if the command has one, the job takes its own
+ * reference on the datagram and releases it when the job completes.
+ *
+ * @param[in] command Pointer to the decoded test command.
+ * @param[in] flags PROTOCOL_FLAG_* header flags of the request.
+ * @param[in] p Pointer to the datagram holding the command's pattern.
+ * @param[in] pcb Pointer to the UDP control block to reply on.
+ * @param[in] addr Pointer to the client IP address.
+ * @param[in] port Client UDP port.
+ * @return uint8_t Returns 1 if the job was queued, 0 if the queue or the client's share of it is full.
+ */
+uint8_t JobQueue_Push(const TestCommand* command, uint8_t flags, struct pbuf* p, struct udp_pcb* pcb,
+                      const ip_addr_t* addr, u16_t port);
+
+/**
+ * @brief Enqueue a batch datagram for execution.
+ *
+ * The job takes its own reference on the datagram and decodes the requests
+ * out of it one at a time when they are started, so no copy is made. All
+ * results are sent back in a single reply once the last command has
+ * finished. The commands must have been validated with Codec_DecodeTest().
+ *
+ * @param[in] p Pointer to the batch datagram.
+ * @param[in] count Number of compact commands in the batch.
+ * @param[in] cost Total number of iterations of the batch's commands.
+ * @param[in] pcb Pointer to the UDP control block to reply on.
+ * @param[in] addr Pointer to the client IP address.
+ * @param[in] port Client UDP port.
+ * @return uint8_t Returns 1 if the batch was queued, 0 if the queue or the client's share of it is full.
+ */
+uint8_t JobQueue_PushBatch(struct pbuf* p, uint8_t count, uint32_t cost, struct udp_pcb* pcb,
+                           const ip_addr_t* addr, u16_t port);
+
+/**
+ * @brief Enqueue a run of a stored test plan.
+ *
+ * The steps run one after the other as a single job of the client; each
+ * run of a step is reported in its own datagram, and a done report with
+ * the totals follows the last one. The plan cannot be replaced until the
+ * job completes.
+ *
+ * @param[in] slot Store entry of the plan (see Plan_Find()).
+ * @param[in] run_id Run ID of the request, used as the job's test ID.
+ * @param[in] pcb Pointer to the UDP control block to reply on.
+ * @param[in] addr Pointer to the client IP address.
+ * @param[in] port Client UDP port.
+ * @return uint8_t Returns 1 if the plan was queued, 0 if the queue or the client's share of it is full.
+ */
+uint8_t JobQueue_PushPlan(uint8_t slot, uint32_t run_id, struct udp_pcb* pcb, const ip_addr_t* addr, u16_t port);
+
+/**
+ * @brief Advance the job queue by one step.
+ *
+ * Starts the next queued job if none is running, otherwise runs one
+ * resumable step of the current job. When a job completes, its result
+ * is sent back to the client. Must be called from the main loop.
+ *
+ * The next job is picked by deficit round robin over the client sessions:
+ * every client with queued jobs earns SESSION_QUANTUM iterations per round
+ * and a job starts once its client has earned the job's iterations, so a
+ * client queueing long tests cannot starve the short tests of the others.
+ * Each client's own jobs run in arrival order within a priority class, and
+ * a higher class always goes first.
+ *
+ * When a PROTOCOL_PRIORITY_URGENT job is queued while a lower-class job
+ * runs on other peripherals, the running job stops arming iterations; once
+ * none of its iterations is in flight it is suspended, the urgent job runs,
+ * and the suspended job resumes where it stopped. One job can be suspended
+ * at a time.
+ */
+void JobQueue_Poll(void);
+
+/**
+ * @brief Cancel a queued or running test.
+ *
+ * A queued test is removed and answered right away. A running test is
+ * stopped by the next JobQueue_Poll(): its engines are aborted, which
+ * releases their IT/DMA transfers and peripherals, and the test is answered
+ * with result TEST_CANCELLED. A suspended test is stopped when it resumes.
+ * A plan run is cancelled the same way by its run ID and answered with a
+ * PROTOCOL_PLAN_CANCELLED done report.
+ *
+ * @param[in] test_id Test ID of the TEST request to cancel.
+ * @param[in] addr Pointer to the IP address of the client that sent the TEST request.
+ * @param[out] completed Receives the iterations completed by every tested peripheral.
+ * @return uint8_t PROTOCOL_CANCEL_* status.
+ */
+uint8_t JobQueue_Cancel(uint32_t test_id, const ip_addr_t* addr, uint32_t* completed);
+
+/**
+ * @brief Get the number of jobs in the queue, including the running one.
+ *
+ * @return uint8_t Number of pending jobs.
+ */
+uint8_t JobQueue_Depth(void);
+
+/**
+ * @brief Encode the per-client queue statistics.
+ *
+ * Writes the total queue depth, the number of sessions and one
+ * PROTOCOL_SESSION_STATS_SIZE entry per client (see Protocol.h).
+ *
+ * @param[out] buf Buffer of at least 2 + SESSION_TABLE_SIZE * PROTOCOL_SESSION_STATS_SIZE bytes.
+ * @return uint16_t Number of bytes written.
+ */
+uint16_t JobQueue_EncodeStats(uint8_t* buf);
+
+#endif /* INC_JOB_QUEUE_H_ */
@@ -0,0 +1,132 @@
+/**
+ * @file Plan.h
+ * @brief Header file for the board-resident test plan store.
+ *
+ * This file declares a small RAM store of test plans uploaded with the
+ * PLAN_UPLOAD request. A plan is a list of steps, each a test command with
+ * a repeat count, a delay and a stop-on-fail rule; a PLAN_RUN request queues
+ * a job that walks the plan with a PlanCursor, so a whole suite costs one
+ * round trip.
+ *
+ * @note Plans are stored in their wire format (see Protocol.h), validated
+ * once on upload; patterns are read in place from the store when a step runs.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#ifndef INC_PLAN_H_
+#define INC_PLAN_H_
+
+#include "UdpUut.h"
+#include "Protocol.h"
+
+/** @brief Number of plans kept at the same time. */
+#define PLAN_STORE_SIZE 4
+
+/** @brief Maximum size of the encoded steps of one plan. */
+#define PLAN_MAX_SIZE 1024
+
+/** @brief Maximum number of steps of one plan. */
+#define PLAN_MAX_STEPS 64
+
+/** @brief Returned by Plan_Find() when no plan has the given ID. */
+#define PLAN_NONE 0xFF
+
+/**
+ * @brief A stored plan.
+ */
+typedef struct {
+    uint8_t id;                  /**< Plan ID chosen by the client. */
+    uint8_t used;                /**< Set while the entry holds a plan. */
+    uint8_t steps;               /**< Number of steps. */
+    uint8_t users;               /**< Queued or running jobs of the plan; it cannot be replaced meanwhile. */
+    uint8_t peripherals;         /**< Union of the peripherals of every step. */
+    uint16_t size;               /**< Size of the encoded steps. */
+    uint32_t cost;               /**< Iterations of the whole plan, charged to the client's session. */
+    uint8_t data[PLAN_MAX_SIZE]; /**< Encoded steps. */
+} Plan;
+
+/**
+ * @brief Progress of a job through a plan.
+ */
+typedef struct {
+    uint8_t slot;        /**< Store entry of the plan. */
+    uint8_t step;        /**< Index of the current step. */
+    uint16_t offset;     /**< Offset of the current step in the plan data. */
+    uint16_t run;        /**< Runs of the current step already completed. */
+    uint16_t executed;   /**< Step runs completed. */
+    uint16_t passed;     /**< Step runs that passed. */
+    uint16_t failed;     /**< Step runs that failed. */
+    uint8_t stopped;     /**< Set when a failing stop-on-fail step ended the plan. */
+    uint32_t resume;     /**< Tick before which the next step must not start. */
+} PlanCursor;
+
+/**
+ * @brief Validate and store an uploaded plan.
+ *
+ * The plan replaces a stored plan with the same ID. A plan without steps
+ * deletes it.
+ *
+ * @param[in] p Pointer to the received PLAN_UPLOAD datagram.
+ * @param[in] offset Offset of the upload body in the datagram.
+ * @param[out] slot Store entry of the plan, or PLAN_NONE if it was deleted.
+ * @return uint8_t Returns 0 on success, otherwise a PROTOCOL_ERROR_* code.
+ */
+uint8_t Plan_Store(const struct pbuf* p, uint16_t offset, uint8_t* slot);
+
+/**
+ * @brief Find a stored plan.
+ *
+ * @param[in] id Plan ID.
+ * @return uint8_t Store entry of the plan, or PLAN_NONE.
+ */
+uint8_t Plan_Find(uint8_t id);
+
+/**
+ * @brief Get a stored plan.
+ *
+ * @param[in] slot Store entry (below PLAN_STORE_SIZE).
+ * @return const Plan* Pointer to the plan.
+ */
+const Plan* Plan_Get(uint8_t slot);
+
+/**
+ * @brief Start walking a plan, which cannot be replaced until Plan_Release().
+ *
+ * @param[out] cursor Pointer to the cursor to initialize.
+ * @param[in] slot Store entry of the plan.
+ */
+void Plan_Begin(PlanCursor* cursor, uint8_t slot);
+
+/**
+ * @brief Release a plan taken by Plan_Begin().
+ *
+ * @param[in] cursor Pointer to the cursor of the plan.
+ */
+void Plan_Release(const PlanCursor* cursor);
+
+/**
+ * @brief Decode the current step of a plan.
+ *
+ * Only the peripheral, iterations, options and pattern length of the
+ * command are written; the test ID is left alone.
+ *
+ * @param[in] cursor Pointer to the cursor of the plan.
+ * @param[out] command Pointer to the command to fill.
+ * @return const uint8_t* Pointer to the step's pattern in the store, or NULL if it has none.
+ */
+const uint8_t* Plan_Step(const PlanCursor* cursor, TestCommand* command);
+
+/**
+ * @brief Record the result of the current step and move to the next one.
+ *
+ * Applies the step's repeat count, stop-on-fail rule and delay.
+ *
+ * @param[in,out] cursor Pointer to the cursor of the plan.
+ * @param[in] passed Set if the step passed.
+ * @return uint8_t Returns 1 if a step remains to be run, 0 if the plan has ended.
+ */
+uint8_t Plan_Advance(PlanCursor* cursor, uint8_t passed);
+
+#endif /* INC_PLAN_H_ */
@@ -27,12 +27,327 @@
 /** @brief Bitfield for testing the ADC peripheral. */
 #define TEST_PERIPHERAL_ADC   16
 
+/** @brief Number of TEST_PERIPHERAL_* bitfields. */
+#define TEST_PERIPHERAL_COUNT 5
+
+/** @brief All TEST_PERIPHERAL_* bitfields; several may be combined to run tests in parallel. */
+#define TEST_PERIPHERAL_ALL   0x1F
+
 /** @brief Return code indicating success. */
 #define TEST_SUCCESS 1
 
 /** @brief Return code indicating failure. */
 #define TEST_FAILURE 0xFF
 
+/** @brief Return code of a test stopped by a CANCEL request. */
+#define TEST_CANCELLED 0xFE
+
+/** @brief Return code of a test step that has not completed yet. */
+#define TEST_IN_PROGRESS 0
+
+/** @brief Version of the wire protocol carried in every packet header. */
+#define PROTOCOL_VERSION 1
+
+/** @brief Size of the packet header: version (1) + opcode (1) + flags (1) + targets (1). */
+#define PROTOCOL_HEADER_SIZE 4
+
+/** @brief Target bitmap of a request addressed to every board that receives it. */
+#define PROTOCOL_TARGETS_ALL 0x00
+
+/** @brief Number of boards a request can address through the target bitmap. */
+#define PROTOCOL_MAX_BOARDS 8
+
+/** @brief Opcode of a single test request. */
+#define PROTOCOL_OPCODE_TEST  0x01
+
+/** @brief Opcode of a batch of test requests answered with one reply. */
+#define PROTOCOL_OPCODE_BATCH 0x02
+
+/** @brief Opcode of a telemetry datagram streamed while a test runs. */
+#define PROTOCOL_OPCODE_TELEMETRY 0x03
+
+/** @brief Opcode of a request for the per-client queue statistics. */
+#define PROTOCOL_OPCODE_STATS 0x04
+
+/** @brief Opcode of a request to cancel a queued or running test. */
+#define PROTOCOL_OPCODE_CANCEL 0x05
+
+/** @brief Opcode of a no-op latency probe answered from the receive callback. */
+#define PROTOCOL_OPCODE_PING 0x06
+
+/** @brief Opcode of a request for a burst of benchmark datagrams sent by the board. */
+#define PROTOCOL_OPCODE_BLAST 0x07
+
+/** @brief Opcode of a benchmark datagram reflected by the board. */
+#define PROTOCOL_OPCODE_ECHO 0x08
+
+/** @brief Opcode of a request for the benchmark counters. */
+#define PROTOCOL_OPCODE_BENCH 0x09
+
+/** @brief Opcode of a request for the table of test engines and their parameters. */
+#define PROTOCOL_OPCODE_CAPS 0x0A
+
+/** @brief Opcode of a request storing a test plan on the board. */
+#define PROTOCOL_OPCODE_PLAN_UPLOAD 0x0B
+
+/** @brief Opcode of a request running a stored test plan. */
+#define PROTOCOL_OPCODE_PLAN_RUN 0x0C
+
+/** @brief Opcode of a request for completed results kept in the board's history. */
+#define PROTOCOL_OPCODE_HISTORY 0x0D
+
+/** @brief Opcode of an error reply. */
+#define PROTOCOL_OPCODE_ERROR 0x7F
+
+/** @brief Bit set in the opcode of every reply. */
+#define PROTOCOL_OPCODE_REPLY 0x80
+
+/** @brief Header flag of a TEST request: stream per-iteration records while the test runs. */
+#define PROTOCOL_FLAG_STREAM 0x01
+
+/** @brief Header flag of a streamed TEST request and its TELEMETRY datagrams: compact entries instead of records. */
+#define PROTOCOL_FLAG_COMPACT 0x02
+
+/** @brief Error code: the packet is shorter than its declared contents. */
+#define PROTOCOL_ERROR_LENGTH  1
+
+/** @brief Error code: unsupported protocol version. */
+#define PROTOCOL_ERROR_VERSION 2
+
+/** @brief Error code: unknown opcode. */
+#define PROTOCOL_ERROR_OPCODE  3
+
+/** @brief Error code: the job queue, or the client's share of it, cannot take the request. */
+#define PROTOCOL_ERROR_BUSY    4
+
+/** @brief Error code: no stored plan has the requested ID. */
+#define PROTOCOL_ERROR_NO_PLAN 5
+
+/** @brief Error code: PROTOCOL_OPTION_SWEEP was requested on more than one peripheral. */
+#define PROTOCOL_ERROR_SWEEP   6
+
+/** @brief Mask of the priority class in the options of a TEST request. */
+#define PROTOCOL_OPTION_PRIORITY_MASK 0x03
+
+/** @brief Priority class of ordinary tests (options sent as 0). */
+#define PROTOCOL_PRIORITY_NORMAL 0
+
+/** @brief Priority class of tests that run before queued normal ones. */
+#define PROTOCOL_PRIORITY_HIGH   1
+
+/** @brief Priority class of tests that also preempt a running lower-class test. */
+#define PROTOCOL_PRIORITY_URGENT 2
+
+/** @brief Option of a TEST request: run the sweep mode of the single named peripheral instead of its test. */
+#define PROTOCOL_OPTION_SWEEP 0x04
+
+/** @brief Option of a TEST request: rediscover cached bus devices before the test. */
+#define PROTOCOL_OPTION_RESCAN 0x08
+
+/** @brief Size of the fixed part of a test request: test_id (4) + iterations (4) + peripheral (1) + options (1) + tlv_length (2). */
+#define PROTOCOL_TEST_SIZE 12
+
+/** @brief Size of a TLV header: type (1) + length (2). */
+#define PROTOCOL_TLV_HEADER_SIZE 3
+
+/** @brief TLV type carrying the data pattern of a test. */
+#define PROTOCOL_TLV_PATTERN 0x01
+
+/** @brief TLV type of a compact streamed test carrying its sample interval (u32). */
+#define PROTOCOL_TLV_SAMPLE 0x02
+
+/** @brief Size of a sample TLV value: sample interval (4). */
+#define PROTOCOL_SAMPLE_SIZE 4
+
+/** @brief Size of an encoded test result: test_id (4) + result (1) + peripheral (1) + per-bit results. */
+#define PROTOCOL_RESULT_SIZE (6 + TEST_PERIPHERAL_COUNT)
+
+/** @brief TLV type of a TEST reply carrying the totals of a streamed test. */
+#define PROTOCOL_TLV_SUMMARY 0x10
+
+/** @brief Size of the fixed part of a summary TLV: datagrams (4) + records (4) + dropped records (4). */
+#define PROTOCOL_SUMMARY_SIZE 12
+
+/** @brief Size of the per-peripheral part of a summary TLV: passed iterations (4) + errors (4). */
+#define PROTOCOL_SUMMARY_PERIPHERAL_SIZE 8
+
+/** @brief TLV type of a TEST reply carrying cycle-counter timing per tested peripheral. */
+#define PROTOCOL_TLV_TIMING 0x11
+
+/** @brief Size of the fixed part of a timing TLV: core clock in Hz (4). */
+#define PROTOCOL_TIMING_SIZE 4
+
+/** @brief Size of the per-peripheral part of a timing TLV. */
+#define PROTOCOL_TIMING_PERIPHERAL_SIZE 32
+
+/** @brief TLV type of a TEST reply carrying the scheduling times of the test. */
+#define PROTOCOL_TLV_SCHEDULE 0x12
+
+/** @brief Size of a schedule TLV: queue wait ms (4) + wall time ms (4) + preempted time ms (4). */
+#define PROTOCOL_SCHEDULE_SIZE 12
+
+/** @brief TLV type of a TEST reply carrying the step table of each swept peripheral. */
+#define PROTOCOL_TLV_SWEEP 0x13
+
+/** @brief Size of the per-peripheral part of a sweep TLV: type (1) + step count (1). */
+#define PROTOCOL_SWEEP_SIZE 2
+
+/** @brief Number of engine-specific error counters of a sweep step. */
+#define PROTOCOL_SWEEP_ERROR_COUNT 3
+
+/** @brief Size of a sweep step: rate (4) + mode (1) + transfers (4) + bytes (4) + bit errors (4) + bytes/s (4) + error counters. */
+#define PROTOCOL_SWEEP_STEP_SIZE (21 + 2 * PROTOCOL_SWEEP_ERROR_COUNT)
+
+/** @brief Size of the telemetry body header: test_id (4) + sequence (4) + record count (1). */
+#define PROTOCOL_TELEMETRY_HEADER_SIZE 9
+
+/** @brief Size of a telemetry record: peripheral (1) + code (1) + iteration (4) + value (4) + cycles (4). */
+#define PROTOCOL_RECORD_SIZE 14
+
+/** @brief Size of the compact telemetry body header: test_id (4) + sequence (4). */
+#define PROTOCOL_TELEMETRY_COMPACT_HEADER_SIZE 8
+
+/** @brief Largest encoded varint (a u32 in 7-bit groups). */
+#define PROTOCOL_VARINT_MAX_SIZE 5
+
+/** @brief Position of the kind in the tag of a compact entry. */
+#define PROTOCOL_COMPACT_KIND_SHIFT 6
+
+/** @brief Position of the record code in the tag of a compact entry. */
+#define PROTOCOL_COMPACT_CODE_SHIFT 3
+
+/** @brief Mask of the record code, once shifted down. */
+#define PROTOCOL_COMPACT_CODE_MASK  0x03
+
+/** @brief Mask of the peripheral bit index in the tag of a compact entry. */
+#define PROTOCOL_COMPACT_LANE_MASK  0x07
+
+/** @brief Compact entry: first iteration of a peripheral in the datagram; the deltas restart from 0. */
+#define PROTOCOL_COMPACT_START  0
+
+/** @brief Compact entry: a run of consecutive iterations with the same code and no values. */
+#define PROTOCOL_COMPACT_RUN    1
+
+/** @brief Compact entry: one iteration with its value and cycles as zig-zag deltas. */
+#define PROTOCOL_COMPACT_SAMPLE 2
+
+/** @brief Record code: the iteration passed. */
+#define PROTOCOL_RECORD_PASSED       0
+
+/** @brief Record code: the iteration completed with wrong data. */
+#define PROTOCOL_RECORD_FAILED       1
+
+/** @brief Record code: the iteration did not complete in time. */
+#define PROTOCOL_RECORD_TIMEOUT      2
+
+/** @brief Record code: the iteration could not be started. */
+#define PROTOCOL_RECORD_START_FAILED 3
+
+/** @brief Size of a CANCEL request body: test_id (4). */
+#define PROTOCOL_CANCEL_SIZE 4
+
+/** @brief Size of a CANCEL reply body: test_id (4) + status (1) + completed iterations (4). */
+#define PROTOCOL_CANCEL_REPLY_SIZE 9
+
+/** @brief Cancel status: no queued or running test of the client has this ID. */
+#define PROTOCOL_CANCEL_NOT_FOUND 0
+
+/** @brief Cancel status: the test was removed from the queue before it started. */
+#define PROTOCOL_CANCEL_DEQUEUED  1
+
+/** @brief Cancel status: the running test was stopped. */
+#define PROTOCOL_CANCEL_STOPPED   2
+
+/** @brief Size of the fixed part of a PING reply: rx cycles (4) + tx cycles (4) + core clock (4) + queue depth (1). */
+#define PROTOCOL_PING_REPLY_SIZE 13
+
+/** @brief Maximum payload of a PING request echoed back in its reply. */
+#define PROTOCOL_PING_MAX_PAYLOAD 256
+
+/** @brief Size of a BLAST request body: datagram count (4) + datagram size (2). */
+#define PROTOCOL_BLAST_SIZE 6
+
+/** @brief Size of a BENCH request body: flags (1). */
+#define PROTOCOL_BENCH_SIZE 1
+
+/** @brief BENCH request flag: restart the counters and the CPU load window. */
+#define PROTOCOL_BENCH_RESET 0x01
+
+/** @brief Size of a BENCH report body. */
+#define PROTOCOL_BENCH_REPORT_SIZE 50
+
+/** @brief Size of the name field of a CAPS entry (NUL-padded). */
+#define PROTOCOL_CAPS_NAME_SIZE 8
+
+/** @brief Size of a CAPS entry: type (1) + peripheral (1) + parameters (1) + max pattern (2) + default iterations (4) + estimated us (4) + name. */
+#define PROTOCOL_CAPS_ENTRY_SIZE (13 + PROTOCOL_CAPS_NAME_SIZE)
+
+/** @brief CAPS parameter flag: the test takes a data pattern. */
+#define PROTOCOL_PARAM_PATTERN 0x01
+
+/** @brief CAPS parameter flag: the test cannot run without a data pattern. */
+#define PROTOCOL_PARAM_PATTERN_REQUIRED 0x02
+
+/** @brief CAPS parameter flag: the engine has a sweep mode (PROTOCOL_OPTION_SWEEP). */
+#define PROTOCOL_PARAM_SWEEP 0x04
+
+/** @brief Size of the fixed part of a PLAN_UPLOAD body: plan ID (1) + step count (1). */
+#define PROTOCOL_PLAN_UPLOAD_SIZE 2
+
+/** @brief Size of the fixed part of a plan step: peripheral (1) + flags (1) + repeat (2) + iterations (4) + delay (2) + pattern length (2). */
+#define PROTOCOL_PLAN_STEP_SIZE 12
+
+/** @brief Plan step flag: a failing run of the step ends the plan. */
+#define PROTOCOL_PLAN_STOP_ON_FAIL 0x01
+
+/** @brief Size of a PLAN_UPLOAD reply body: plan ID (1) + step count (1) + size (2) + iterations (4). */
+#define PROTOCOL_PLAN_UPLOAD_REPLY_SIZE 8
+
+/** @brief Size of a PLAN_RUN body: run ID (4) + plan ID (1). */
+#define PROTOCOL_PLAN_RUN_SIZE 5
+
+/** @brief PLAN_RUN report kind: result of one run of a step. */
+#define PROTOCOL_PLAN_REPORT_STEP 0
+
+/** @brief PLAN_RUN report kind: end of the plan. */
+#define PROTOCOL_PLAN_REPORT_DONE 1
+
+/** @brief Size of the fixed part of a step report: run ID (4) + kind (1) + step (1) + run (2). */
+#define PROTOCOL_PLAN_STEP_REPORT_SIZE 8
+
+/** @brief Size of a done report: run ID (4) + kind (1) + status (1) + runs (2) + passed (2) + failed (2) + elapsed ms (4). */
+#define PROTOCOL_PLAN_DONE_SIZE 16
+
+/** @brief Plan status: every step was run. */
+#define PROTOCOL_PLAN_COMPLETED 0
+
+/** @brief Plan status: a stop-on-fail step failed. */
+#define PROTOCOL_PLAN_STOPPED   1
+
+/** @brief Plan status: the plan was cancelled. */
+#define PROTOCOL_PLAN_CANCELLED 2
+
+/** @brief Size of a HISTORY request body: first test_id (4) + last test_id (4). */
+#define PROTOCOL_HISTORY_SIZE 8
+
+/** @brief Size of the fixed part of a HISTORY reply: count (1) + more (1). */
+#define PROTOCOL_HISTORY_REPLY_SIZE 2
+
+/** @brief Size of the fixed part of a HISTORY entry: reply length (2). */
+#define PROTOCOL_HISTORY_ENTRY_SIZE 2
+
+/** @brief Size of an error reply body: error code (1) + offending opcode (1). */
+#define PROTOCOL_ERROR_SIZE 2
+
+/** @brief Size of a client entry of a STATS reply. */
+#define PROTOCOL_SESSION_STATS_SIZE 28
+
+/** @brief Maximum number of test requests carried by one batch. */
+#define PROTOCOL_BATCH_MAX_COMMANDS 64
+
+/** @brief Maximum length of a test data pattern. */
+#define TEST_PATTERN_MAX_LENGTH 1024
+
 /** @brief Enumeration for buffer sizes used in UART communication. */
 typedef enum {
     UART_BUFFER_SIZE_SMALL = 64,
@@ -41,26 +356,191 @@ typedef enum {
 } UartBufferSize;
 
 /**
- * @brief Structure defining a test command.
+ * @brief Structure defining a decoded test command.
  *
- * This structure is used to send commands to test a specific peripheral.
+ * This structure is filled by the decoder from a test request; it is not a
+ * wire format. The pattern is not copied: its location in the received
+ * datagram is recorded instead.
  */
 typedef struct {
     uint32_t test_id;         /**< Unique test ID to identify the command. */
-    uint8_t peripheral;       /**< Peripheral to test (use one of the TEST_PERIPHERAL_* bitfields). */
-    uint8_t iterations;       /**< Number of iterations to run the test. */
-    uint8_t pattern_length;   /**< Length of the bit pattern (for data transmission tests). */
-    char bit_pattern[100];    /**< Bit pattern to be transmitted during the test. */
+    uint32_t iterations;      /**< Number of iterations to run the test. */
+    uint8_t peripheral;       /**< Peripherals to test (one or more TEST_PERIPHERAL_* bitfields, run in parallel). */
+    uint8_t options;          /**< Test options: priority class in PROTOCOL_OPTION_PRIORITY_MASK, PROTOCOL_OPTION_SWEEP, PROTOCOL_OPTION_RESCAN. */
+    uint16_t pattern_length;  /**< Length of the bit pattern (for data transmission tests). */
+    uint16_t pattern_offset;  /**< Offset of the bit pattern in the datagram, 0 if there is none. */
+    uint32_t sample_interval; /**< Sample interval of compact telemetry (SAMPLE TLV, 1 without it). */
 } TestCommand;
 
 /**
  * @brief Structure defining a test result.
  *
  * This structure is used to send the result of a test back to the requester.
+ * `peripheral_results[i]` holds the result of the peripheral with bitfield
+ * `1 << i`, or 0 if that peripheral was not part of the command.
  */
 typedef struct {
     uint32_t test_id;         /**< Test ID corresponding to the original command. */
-    uint8_t result;           /**< Test result: 1 for success, 0xFF for failure. */
+    uint8_t result;           /**< Test result: 1 if every requested peripheral passed, 0xFF otherwise. */
+    uint8_t peripheral;       /**< Peripherals that were tested (TEST_PERIPHERAL_* bitfields). */
+    uint8_t peripheral_results[TEST_PERIPHERAL_COUNT]; /**< Per-bit result vector. */
 } TestResult;
 
+/*
+ * Wire format, version 1. All fields are little-endian and packed, no
+ * field relies on compiler struct layout.
+ *
+ *   header:  version (u8) | opcode (u8) | flags (u8, 0) | targets (u8, 0)
+ *
+ *   TEST request:   header | test_id (u32) | iterations (u32) | peripheral (u8) |
+ *                   options (u8) | tlv_length (u16) | TLVs (tlv_length bytes)
+ *   TLV:            type (u8) | length (u16) | value (length bytes)
+ *   BATCH request:  header | count (u8) | count x TEST request body
+ *
+ *   TEST reply:     header | test_id (u32) | result (u8) | peripheral (u8) |
+ *                   peripheral_results (TEST_PERIPHERAL_COUNT x u8) | TLVs
+ *   SUMMARY TLV:    datagrams (u32) | records (u32) | dropped records (u32) |
+ *                   per tested peripheral, lowest bit first:
+ *                   passed iterations (u32) | errors (u32)
+ *   TIMING TLV:     core clock Hz (u32) | per tested peripheral, lowest bit first:
+ *                   iterations (u32) | min cycles (u32) | max cycles (u32) |
+ *                   mean cycles (u32) | total cycles (u64) | bytes (u32) |
+ *                   throughput bytes/s (u32)
+ *   SCHEDULE TLV:   queue wait ms (u32) | wall time ms (u32) | preempted ms (u32)
+ *   SWEEP TLV:      per swept peripheral, lowest bit first:
+ *                   type (u8) | count (u8) | count x [rate (u32) | mode (u8) |
+ *                   transfers (u32) | bytes (u32) | bit errors (u32) |
+ *                   throughput bytes/s (u32) |
+ *                   error counters (PROTOCOL_SWEEP_ERROR_COUNT x u16)]
+ *   TELEMETRY:      header | test_id (u32) | sequence (u32) | count (u8) |
+ *                   count x [peripheral (u8) | code (u8) | iteration (u32) |
+ *                   value (u32) | cycles (u32)]
+ *   compact TELEMETRY: header (flags PROTOCOL_FLAG_COMPACT) | test_id (u32) |
+ *                   sequence (u32) | entries up to the end of the datagram
+ *   compact entry:  tag (u8: kind << 6 | code << 3 | peripheral bit index) |
+ *                   START: first iteration (varint)
+ *                   RUN:   iterations (varint)
+ *                   SAMPLE: value delta (zig-zag varint) | cycles delta (zig-zag varint)
+ *   SAMPLE TLV:     sample interval (u32)
+ *   BATCH reply:    header | count (u8) | count x TEST reply body
+ *   STATS request:  header
+ *   STATS reply:    header | queue depth (u8) | count (u8) |
+ *                   count x [IPv4 address (4 bytes, network order) | port (u16) |
+ *                   jobs incl. running (u8) | running (u8) | started jobs (u32) |
+ *                   rejected requests (u32) | mean wait ms (u32) |
+ *                   max wait ms (u32) | wait of the oldest queued job ms (u32)]
+ *   CANCEL request: header | test_id (u32)
+ *   CANCEL reply:   header | test_id (u32) | status (u8) | completed iterations (u32)
+ *   PING request:   header | payload (up to PROTOCOL_PING_MAX_PAYLOAD bytes)
+ *   PING reply:     header | rx cycles (u32) | tx cycles (u32) | core clock Hz (u32) |
+ *                   queue depth (u8) | payload echoed
+ *   BLAST request:  header | count (u32) | size (u16, UDP payload bytes)
+ *   BLAST datagram: header | sequence (u32) | filler up to size
+ *   ECHO:           header | payload, reflected unchanged with the reply opcode
+ *   BENCH request:  header | flags (u8, PROTOCOL_BENCH_RESET)
+ *   BENCH report:   header | window ms (u32) | core clock Hz (u32) |
+ *                   MAC tx frames (u32) | MAC rx frames (u32) | rx frames to lwIP (u32) |
+ *                   rx frames missed (u32) | rx CRC errors (u32) | RX_POOL exhausted (u32) |
+ *                   blast sent (u32) | blast failed (u32) | blast cycles (u32) |
+ *                   echoed (u32) | CPU busy permille (u16)
+ *   CAPS request:   header
+ *   CAPS reply:     header | count (u8) | count x [type (u8) | peripheral (u8) |
+ *                   parameters (u8, PROTOCOL_PARAM_*) | max pattern bytes (u16) |
+ *                   default iterations (u32) | estimated us per iteration (u32) |
+ *                   name (PROTOCOL_CAPS_NAME_SIZE bytes, NUL-padded)]
+ *   PLAN_UPLOAD:    header | plan ID (u8) | step count (u8) | count x step
+ *   plan step:      peripheral (u8) | flags (u8, PROTOCOL_PLAN_STOP_ON_FAIL) |
+ *                   repeat (u16) | iterations (u32) | delay ms (u16) |
+ *                   pattern length (u16) | pattern
+ *   PLAN_UPLOAD reply: header | plan ID (u8) | step count (u8) | size (u16) |
+ *                   iterations (u32)
+ *   PLAN_RUN:       header | run ID (u32) | plan ID (u8)
+ *   step report:    header | run ID (u32) | kind (u8, PROTOCOL_PLAN_REPORT_STEP) |
+ *                   step (u8) | run (u16) | TEST reply body | TIMING TLV
+ *   done report:    header | run ID (u32) | kind (u8, PROTOCOL_PLAN_REPORT_DONE) |
+ *                   status (u8) | runs (u16) | passed (u16) | failed (u16) |
+ *                   elapsed ms (u32)
+ *   HISTORY request: header | first test_id (u32) | last test_id (u32)
+ *   HISTORY reply:  header | count (u8) | more (u8) |
+ *                   count x [length (u16) | stored reply (length bytes, header included)]
+ *   ERROR reply:    header | error code (u8) | offending opcode (u8)
+ *
+ * Replies carry the request opcode with PROTOCOL_OPCODE_REPLY set. Unknown
+ * TLV types are skipped, so new TLVs can be added without a version bump.
+ * A TEST request with PROTOCOL_FLAG_STREAM set is answered with TELEMETRY
+ * datagrams, numbered from sequence 0, while it runs; its TEST reply is
+ * sent last and carries a SUMMARY TLV. Every TEST reply carries a TIMING
+ * TLV measured with the DWT cycle counter, and a SCHEDULE TLV.
+ * The options byte of a TEST request carries its priority class; queued
+ * tests of a higher class run first, and a PROTOCOL_PRIORITY_URGENT test
+ * suspends a running lower-class test at its next iteration boundary when
+ * their peripherals do not overlap. The wall time of the SCHEDULE TLV runs
+ * from the start of the test to its reply and includes the preempted time.
+ * A CANCEL request stops the TEST of the same client IP address with that
+ * test_id; the TEST is answered with result TEST_CANCELLED and the
+ * iterations it completed, and the CANCEL reply carries the number of
+ * iterations that all of its peripherals completed. Batches cannot be cancelled.
+ * A PING is answered from the receive callback: rx cycles is the DWT cycle
+ * counter when the callback was entered and tx cycles when the reply was
+ * handed to lwIP, so (tx - rx) / core clock is the firmware service time.
+ * A BLAST is answered with count BLAST datagrams, sent as fast as the
+ * Ethernet driver takes them, followed by a BENCH report. A blast cannot
+ * be cancelled, so a count above BENCH_MAX_COUNT is rejected with
+ * PROTOCOL_ERROR_LENGTH.
+ * A CAPS reply lists every test engine by type, the bit index of its
+ * peripheral. A TEST request with 0 iterations runs each engine's default
+ * iterations; engines without PROTOCOL_PARAM_PATTERN ignore the pattern.
+ * The estimated duration is that of one iteration with the largest pattern.
+ * A PLAN_UPLOAD stores a plan in RAM, replacing the plan with the same ID;
+ * a plan without steps deletes it. A PLAN_RUN queues the plan as one job:
+ * each step runs repeat times (0 counts as 1), each run is followed by its
+ * delay and answered with a step report, and the done report comes last.
+ * The run ID shares the test ID space: a retried PLAN_RUN gets the cached
+ * done report, and a CANCEL with the run ID stops the plan.
+ * Requests may be sent unicast to one board or to the fleet's multicast
+ * group. The targets byte of a request is a bitmap of board indexes; a
+ * board whose bit is clear drops the request silently, and
+ * PROTOCOL_TARGETS_ALL addresses every board. A request with a malformed
+ * header sent to the group is dropped silently by every board. Replies are always sent
+ * unicast to the requester, with targets 0.
+ * A streamed TEST with PROTOCOL_FLAG_COMPACT also set is answered with
+ * compact TELEMETRY datagrams: pass/fail is run-length encoded, and the
+ * value and cycles of sampled iterations are zig-zag deltas from the
+ * previous sample of the same peripheral, as LEB128 varints. Every
+ * iteration that is a multiple of the sample interval, and every iteration
+ * that did not pass, is sampled; interval 0 sends no values, and a request
+ * without a SAMPLE TLV samples every iteration. Each datagram starts every
+ * peripheral afresh, so a lost datagram loses only its own iterations.
+ * Compact datagrams are up to 1472 bytes and are sent when full and when
+ * the test ends, never on a timer.
+ * The board keeps the final replies of the last tests and plan runs (TEST
+ * replies with their TLVs, plan done reports) in a history ring. A HISTORY
+ * request returns those of the requester's IP address whose test_id lies
+ * in [first, last], in ascending test_id order; more is 1 when the rest did
+ * not fit, and is fetched by asking again from the last returned ID + 1.
+ * A TEST request with PROTOCOL_OPTION_SWEEP runs the sweep mode of its
+ * peripheral (CAPS flag PROTOCOL_PARAM_SWEEP), and must name exactly one
+ * (PROTOCOL_ERROR_SWEEP otherwise): the engine generates its own
+ * data and runs the requested iterations at each step of a list of line
+ * rates. A step passes as long as its transfers complete; line errors are
+ * counted instead of ending the run, and the TEST reply carries a SWEEP
+ * TLV. The rate is the one actually set, in bit/s; rates the peripheral
+ * clock cannot produce are left out. Bytes counts the data received and
+ * compared, so the bit-error rate is bit errors / (8 x bytes), and the
+ * throughput is measured over the completed transfers. The mode and error
+ * counters are engine-specific:
+ * UART: mode is the oversampling (16 or 8), counters are framing, noise
+ * and overrun errors.
+ * SPI: the rate is the master's SCK, mode is the prescaler exponent (SCK =
+ * PCLK2 / 2^mode), counters are overrun, DMA and other SPI errors; a burst
+ * with an error is not compared.
+ * I2C: the rate is the nominal bus speed, mode is 0 (Standard), 1 (Fast) or
+ * 2 (Fast-mode Plus), counters are transfers ended by a NACK, by an
+ * arbitration loss and by any other bus error; such transfers are not
+ * compared, so transfers/s is bytes/s x transfers / bytes for a clean step.
+ * Engines that cache what they found on a bus (the I2C device table) keep
+ * it across tests; PROTOCOL_OPTION_RESCAN makes them rediscover it first.
+ * A test without a pattern is 16 bytes on the wire.
+ */
+
 #endif // PROTOCOL_H
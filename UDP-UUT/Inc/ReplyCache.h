@@ -0,0 +1,91 @@
+/**
+ * @file ReplyCache.h
+ * @brief Header file for the idempotent request cache.
+ *
+ * This file declares a small fixed-size hash table of recent test requests,
+ * keyed by client endpoint (IP address, UDP port) and test ID. A retried
+ * request whose test has completed is answered with the cached reply, and a
+ * retry of a test that is still queued or running is coalesced with it, so
+ * a lost reply never makes the board run a test twice.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#ifndef INC_REPLY_CACHE_H_
+#define INC_REPLY_CACHE_H_
+
+#include "UdpUut.h"
+
+/** @brief Number of entries in the cache (power of two). */
+#define REPLY_CACHE_SIZE 16
+
+/** @brief Number of consecutive slots searched for a key. */
+#define REPLY_CACHE_PROBES 4
+
+/** @brief Largest encoded reply kept in an entry (a TEST reply with one full sweep table fits). */
+#define REPLY_CACHE_REPLY_SIZE 384
+
+/**
+ * @brief Outcome of a cache lookup.
+ */
+typedef enum {
+    REPLY_CACHE_MISS = 0,   /**< New request; an in-flight entry was reserved if possible. */
+    REPLY_CACHE_IN_FLIGHT,  /**< The same request is queued or running. */
+    REPLY_CACHE_HIT         /**< The request has completed; its reply is returned. */
+} ReplyCacheStatus;
+
+/**
+ * @brief Usage counters of the cache.
+ */
+typedef struct {
+    uint32_t hits;        /**< Retries answered from the cache. */
+    uint32_t coalesced;   /**< Retries dropped because the test was still in flight. */
+    uint32_t misses;      /**< New requests. */
+    uint32_t evictions;   /**< Completed entries replaced by newer requests. */
+} ReplyCacheStats;
+
+/**
+ * @brief Look up a request and reserve an entry for it if it is new.
+ *
+ * @param[in] addr Pointer to the client IP address.
+ * @param[in] port Client UDP port.
+ * @param[in] test_id Test ID of the request.
+ * @param[out] reply Receives a pointer to the cached reply on a hit.
+ * @param[out] length Receives the length of the cached reply on a hit.
+ * @return ReplyCacheStatus Outcome of the lookup.
+ */
+ReplyCacheStatus ReplyCache_Begin(const ip_addr_t* addr, u16_t port, uint32_t test_id,
+                                  const uint8_t** reply, uint16_t* length);
+
+/**
+ * @brief Store the reply of a completed request.
+ *
+ * Replies larger than REPLY_CACHE_REPLY_SIZE are not cached; the entry is
+ * released instead.
+ *
+ * @param[in] addr Pointer to the client IP address.
+ * @param[in] port Client UDP port.
+ * @param[in] test_id Test ID of the request.
+ * @param[in] reply Pointer to the encoded reply.
+ * @param[in] length Length of the encoded reply.
+ */
+void ReplyCache_Complete(const ip_addr_t* addr, u16_t port, uint32_t test_id, const uint8_t* reply, uint16_t length);
+
+/**
+ * @brief Release the entry of a request that will not produce a reply.
+ *
+ * @param[in] addr Pointer to the client IP address.
+ * @param[in] port Client UDP port.
+ * @param[in] test_id Test ID of the request.
+ */
+void ReplyCache_Cancel(const ip_addr_t* addr, u16_t port, uint32_t test_id);
+
+/**
+ * @brief Get a snapshot of the cache usage counters.
+ *
+ * @param[out] stats Pointer to the structure receiving the counters.
+ */
+void ReplyCache_GetStats(ReplyCacheStats* stats);
+
+#endif /* INC_REPLY_CACHE_H_ */
@@ -0,0 +1,62 @@
+/**
+ * @file ResponsePool.h
+ * @brief Header file for the preallocated UDP response buffer pool.
+ *
+ * This file declares a fixed pool of response buffers that replies are
+ * encoded into directly and sent as custom pbufs. The lwIP heap is never
+ * used for a reply, so reply latency does not depend on heap state.
+ *
+ * @details Each buffer keeps headroom for the UDP, IP and Ethernet headers
+ * in front of its payload, so lwIP prepends them in place. A buffer returns
+ * to the pool from its pbuf release callback once the last reference to it
+ * (lwIP, ARP queue or Ethernet driver) is dropped.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#ifndef INC_RESPONSE_POOL_H_
+#define INC_RESPONSE_POOL_H_
+
+#include "UdpUut.h"
+
+/** @brief Number of response buffers in the pool. */
+#define RESPONSE_POOL_COUNT 4
+
+/** @brief Maximum UDP payload of a response buffer. */
+#define RESPONSE_POOL_PAYLOAD_SIZE 768
+
+/**
+ * @brief Usage counters of the response pool.
+ */
+typedef struct {
+    uint32_t allocated;   /**< Number of buffers handed out. */
+    uint32_t exhausted;   /**< Number of requests that found the pool empty. */
+    uint32_t oversized;   /**< Number of requests larger than RESPONSE_POOL_PAYLOAD_SIZE. */
+    uint8_t in_use;       /**< Buffers currently held by lwIP or the driver. */
+    uint8_t in_use_peak;  /**< Highest value reached by in_use. */
+} ResponsePoolStats;
+
+/**
+ * @brief Initialize the response pool.
+ *
+ * Must be called once before the first response is allocated.
+ */
+void ResponsePool_Init(void);
+
+/**
+ * @brief Take a response buffer from the pool.
+ *
+ * @param[in] length UDP payload length of the response.
+ * @return struct pbuf* pbuf whose payload the response is encoded into, or NULL if the pool is exhausted.
+ */
+struct pbuf* ResponsePool_Alloc(u16_t length);
+
+/**
+ * @brief Get a snapshot of the pool usage counters.
+ *
+ * @param[out] stats Pointer to the structure receiving the counters.
+ */
+void ResponsePool_GetStats(ResponsePoolStats* stats);
+
+#endif /* INC_RESPONSE_POOL_H_ */
@@ -13,7 +13,7 @@
 #define INC_SPI_TEST_H_
 
 #include "main.h"
-#include "RTG.h"
+#include "UdpUut.h"
 #include "Protocol.h"
 #include "stm32f7xx_hal.h"
 #include <stdio.h>
@@ -44,31 +44,34 @@ extern SPI_HandleTypeDef hspi2;
 /** @brief SPI2 configured as Slave. */
 #define SPI_2 &hspi2
 
+/**
+ * @brief Bytes of PRBS data moved in each direction by one SPI burst when no
+ * pattern is given, and by every burst of the prescaler sweep.
+ */
+#define SPI_BURST_SIZE 4096
+
+/** @brief Transfers run at each prescaler of the sweep when a request asks for 0 iterations. */
+#define SPI_SWEEP_DEFAULT_TRANSFERS 4
+
 // Function Prototypes
 
 /**
- * @brief Runs an SPI test between SPI1 (Master) and SPI2 (Slave).
+ * @brief Callback for SPI full-duplex transfer complete.
  *
- * This function transmits a specified bit pattern from SPI1 to SPI2
- * and verifies the received data. The test is repeated for the given
- * number of iterations.
+ * This function is triggered upon completion of an SPI exchange on SPI1
+ * or SPI2 and flags it for the SPI test engine (`spi_test_driver`).
  *
- * @param[in] bit_pattern Pointer to the bit pattern to transmit.
- * @param[in] pattern_length Length of the bit pattern.
- * @param[in] iterations Number of iterations for the test.
- * @return uint8_t Returns SPI_SUCCESS (1) on success, SPI_FAILURE (0xFF) on failure.
+ * @param[in] hspi Pointer to the SPI handle that triggered the interrupt.
  */
-uint8_t test_spi(const char *bit_pattern, size_t pattern_length, int iterations);
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi);
 
 /**
- * @brief Callback for SPI reception complete.
+ * @brief Callback for SPI errors.
  *
- * This function is triggered upon completion of SPI data reception
- * on SPI2. It reinitializes the receive process to enable continuous
- * reception in the slave mode.
+ * Records the HAL_SPI_ERROR_* bits of SPI1 or SPI2 for the SPI test engine.
  *
- * @param[in] hspi Pointer to the SPI handle that triggered the interrupt.
+ * @param[in] hspi Pointer to the SPI handle that reported the error.
  */
-void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi);
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi);
 
 #endif /* INC_SPI_TEST_H_ */
@@ -0,0 +1,76 @@
+/**
+ * @file Session.h
+ * @brief Header file for the client session table.
+ *
+ * This file declares a small table of the clients currently using the
+ * board, keyed by client endpoint (IP address, UDP port). Every queued job
+ * belongs to a session; the session bounds how many jobs a client may have
+ * queued, holds its deficit for the fair scheduler of the job queue and
+ * collects the wait-time statistics returned by the STATS request.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#ifndef INC_SESSION_H_
+#define INC_SESSION_H_
+
+#include "UdpUut.h"
+
+/** @brief Number of clients tracked at the same time. */
+#define SESSION_TABLE_SIZE 4
+
+/** @brief Maximum number of jobs one client may have queued, including its running one. */
+#define SESSION_MAX_JOBS 4
+
+/** @brief Iterations credited to every waiting client per scheduling round. */
+#define SESSION_QUANTUM 100
+
+/** @brief Returned by Session_Open() when the table is full. */
+#define SESSION_NONE 0xFF
+
+/**
+ * @brief State and statistics of one client.
+ */
+typedef struct {
+    ip_addr_t addr;         /**< Client IP address. */
+    u16_t port;             /**< Client UDP port. */
+    uint8_t used;           /**< Set while the entry belongs to a client. */
+    uint8_t jobs;           /**< Jobs of the client in the queue, including the running one. */
+    uint64_t deficit;       /**< Iterations the client may run before the other clients get their turn. */
+    uint32_t started;       /**< Jobs started for the client. */
+    uint32_t rejected;      /**< Requests rejected because the queue or the client limit was full. */
+    uint32_t total_wait;    /**< Sum of the queueing delays of the started jobs, in ms. */
+    uint32_t max_wait;      /**< Longest queueing delay of a started job, in ms. */
+    uint32_t last_active;   /**< Tick of the client's last request. */
+} Session;
+
+/**
+ * @brief Find the session of a client, opening one if it is new.
+ *
+ * A new client takes a free entry, or the entry of the least recently
+ * active client that has no job queued.
+ *
+ * @param[in] addr Pointer to the client IP address.
+ * @param[in] port Client UDP port.
+ * @return uint8_t Index of the session, or SESSION_NONE if every entry has jobs queued.
+ */
+uint8_t Session_Open(const ip_addr_t* addr, u16_t port);
+
+/**
+ * @brief Get a session by index.
+ *
+ * @param[in] index Index of the session (below SESSION_TABLE_SIZE).
+ * @return Session* Pointer to the session entry.
+ */
+Session* Session_Get(uint8_t index);
+
+/**
+ * @brief Account for a job of the session leaving the queue for execution.
+ *
+ * @param[in] index Index of the session.
+ * @param[in] wait Time the job spent queued, in ms.
+ */
+void Session_RecordWait(uint8_t index, uint32_t wait);
+
+#endif /* INC_SESSION_H_ */
@@ -0,0 +1,86 @@
+/**
+ * @file Telemetry.h
+ * @brief Header file for per-iteration telemetry streaming.
+ *
+ * This file declares the stream that packs the record of every completed
+ * test iteration into sequence-numbered TELEMETRY datagrams while a test
+ * requested with PROTOCOL_FLAG_STREAM is running.
+ *
+ * @details Records are encoded straight into a response pool buffer. The
+ * datagram is sent when it is full, when TELEMETRY_FLUSH_INTERVAL has passed
+ * since its first record, and when the test ends. If the pool is exhausted
+ * the records are dropped and counted, the test itself is never delayed.
+ *
+ * A stream requested with PROTOCOL_FLAG_COMPACT carries compact entries
+ * instead (see Protocol.h): runs of iterations with the same code, and
+ * sampled values as zig-zag delta varints. Pending runs are kept per
+ * peripheral and only written when they end, so a long passing run costs
+ * a few bytes. Compact datagrams fill one Ethernet frame, in buffers of
+ * their own rather than the response pool, and are sent only when full
+ * and when the test ends: the datagram count follows the entries written,
+ * not the duration of the run.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#ifndef INC_TELEMETRY_H_
+#define INC_TELEMETRY_H_
+
+#include "UdpUut.h"
+#include "Protocol.h"
+#include "TestDriver.h"
+
+/** @brief Maximum time in milliseconds a record waits before its datagram is sent. */
+#define TELEMETRY_FLUSH_INTERVAL 20
+
+/** @brief Largest compact datagram: the UDP payload of one Ethernet frame. */
+#define TELEMETRY_COMPACT_DATAGRAM_SIZE 1472
+
+/** @brief Buffers of compact datagrams, so that one is filled while the last one is sent. */
+#define TELEMETRY_COMPACT_BUFFERS 2
+
+/**
+ * @brief Counters of the current stream.
+ */
+typedef struct {
+    uint32_t datagrams;  /**< TELEMETRY datagrams sent. */
+    uint32_t records;    /**< Records sent (iterations covered, for a compact stream). */
+    uint32_t dropped;    /**< Records dropped because no response buffer was free. */
+} TelemetryCounters;
+
+/**
+ * @brief Start a new stream for a test.
+ *
+ * @param[in] command Pointer to the test command (test ID and sample interval).
+ * @param[in] flags Header flags of the request; PROTOCOL_FLAG_COMPACT selects compact entries.
+ * @param[in] pcb Pointer to the UDP control block to send on.
+ * @param[in] addr Pointer to the client IP address.
+ * @param[in] port Client UDP port.
+ */
+void Telemetry_Begin(const TestCommand* command, uint8_t flags, struct udp_pcb* pcb, const ip_addr_t* addr, u16_t port);
+
+/**
+ * @brief Append the record of a completed iteration to the stream.
+ *
+ * @param[in] peripheral TEST_PERIPHERAL_* bit of the engine that ran the iteration.
+ * @param[in] record Pointer to the iteration record.
+ */
+void Telemetry_Record(uint8_t peripheral, const TestRecord* record);
+
+/**
+ * @brief Send the pending datagram if its flush interval has expired.
+ *
+ * Compact datagrams are left to fill. Must be called regularly from the
+ * main loop while a stream is open.
+ */
+void Telemetry_Poll(void);
+
+/**
+ * @brief Send the pending datagram and close the stream.
+ *
+ * @param[out] counters Pointer to the structure receiving the stream totals.
+ */
+void Telemetry_End(TelemetryCounters* counters);
+
+#endif /* INC_TELEMETRY_H_ */
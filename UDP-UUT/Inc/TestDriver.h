@@ -0,0 +1,329 @@
+/**
+ * @file TestDriver.h
+ * @brief Header file for the non-blocking peripheral test driver contract.
+ *
+ * This file defines the interface every peripheral test engine implements,
+ * together with the per-test context block and the generic runner that
+ * drives an engine one iteration at a time.
+ *
+ * @details Driver life cycle, as executed by TestRun_Poll():
+ * - `setup`  validates the parameters and prepares the peripheral.
+ * - `start`  arms one iteration (IT/DMA transfers, timers, conversions).
+ * - `poll`   checks, without waiting, whether the armed iteration is done.
+ * - `abort`  cancels whatever the engine left armed on its handles.
+ * - `finish` releases the peripheral and reports the final status.
+ *
+ * `setup`, `start`, `poll` and `finish` return TEST_IN_PROGRESS,
+ * TEST_SUCCESS or TEST_FAILURE from Protocol.h. No callback may block or
+ * delay; engines record completion in their HAL callbacks and `poll` picks
+ * it up. Work that takes longer than a main-loop pass is split: `setup`
+ * and `finish` return TEST_IN_PROGRESS to be called again on the next
+ * pass, and TEST_SUCCESS (`setup`) or the final status (`finish`) once
+ * done. When
+ * `poll` completes an iteration it may store a measurement in `ctx->value`,
+ * which is streamed to the client with the iteration's record. `setup`
+ * sets `ctx->bytes` to the data moved per iteration, for throughput.
+ * The callbacks also take a cycle-counter stamp, which `poll` hands to
+ * TestRun_End(), so an iteration is timed to the peripheral's completion
+ * and not to the main-loop pass that noticed it.
+ *
+ * An engine may name a sweep variant in `sweep`, run instead of it for
+ * PROTOCOL_OPTION_SWEEP. A sweep engine steps its peripheral through a
+ * list of line rates and points `ctx->sweep` at its step table, which is
+ * reported in the SWEEP TLV of the TEST reply.
+ *
+ * Engines that discover their bus once and keep the result across runs
+ * provide `rescan`, which the job queue calls before the run when the
+ * request carries PROTOCOL_OPTION_RESCAN.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#ifndef INC_TEST_DRIVER_H_
+#define INC_TEST_DRIVER_H_
+
+#include "UdpUut.h"
+#include "Protocol.h"
+
+/** @brief Size in bytes of the engine-private area of a test context. */
+#define TEST_CONTEXT_PRIVATE_SIZE 320
+
+/** @brief Timeout in milliseconds for a single iteration that never completes. */
+#define TEST_ITERATION_TIMEOUT 1000
+
+/** @brief Largest number of steps of a sweep. */
+#define TEST_SWEEP_MAX_STEPS 8
+
+/** @brief Stage of a run: `setup` has not completed yet. */
+#define TEST_STAGE_SETUP 0
+
+/** @brief Stage of a run: the iterations are running. */
+#define TEST_STAGE_RUN 1
+
+/** @brief Stage of a run: `finish` has not completed yet. */
+#define TEST_STAGE_FINISH 2
+
+/** @brief Stage of a run: `finish` of a failed run has not completed yet. */
+#define TEST_STAGE_FAIL 3
+
+/** @brief Current value of the DWT cycle counter (enabled by TestDriver_Init()). */
+#define TEST_CYCLES() (DWT->CYCCNT)
+
+#ifndef TEST_VERBOSE
+/**
+ * @brief Nonzero to print a debug line for every iteration and sweep step.
+ *
+ * The debug UART sends about 11 characters per ms, so these lines then
+ * overflow its transmit ring (DebugUart.h) and are partly dropped;
+ * telemetry carries the same data.
+ */
+#define TEST_VERBOSE 0
+#endif
+
+/** @brief Print a per-iteration debug line; compiled out unless TEST_VERBOSE is set. */
+#define TEST_TRACE(...)             \
+    do {                            \
+        if (TEST_VERBOSE) {         \
+            printf(__VA_ARGS__);    \
+        }                           \
+    } while (0)
+
+struct TestDriver;
+
+/**
+ * @brief Cycle-counter statistics of a test run.
+ */
+typedef struct {
+    uint32_t count;          /**< Number of timed (completed) iterations. */
+    uint32_t min_cycles;     /**< Shortest iteration in CPU cycles. */
+    uint32_t max_cycles;     /**< Longest iteration in CPU cycles. */
+    uint64_t total_cycles;   /**< Sum of all iteration times in CPU cycles. */
+    uint32_t bytes;          /**< Bytes moved by the passed iterations. */
+} TestTiming;
+
+/**
+ * @brief Outcome of one completed iteration.
+ */
+typedef struct {
+    uint32_t iteration;   /**< Index of the iteration. */
+    uint32_t value;       /**< Engine-specific measurement (see each engine's `poll`). */
+    uint32_t cycles;      /**< CPU cycles from arming the iteration to its completion (see TestRun_End()). */
+    uint8_t code;         /**< PROTOCOL_RECORD_* outcome code. */
+} TestRecord;
+
+/**
+ * @brief Measurements of one step of a sweep.
+ */
+typedef struct {
+    uint32_t rate;                                  /**< Line rate of the step in bit/s. */
+    uint32_t transfers;                             /**< Completed transfers. */
+    uint32_t bytes;                                 /**< Bytes received and compared. */
+    uint32_t bit_errors;                            /**< Bits that differed from the sent data. */
+    uint64_t cycles;                                /**< CPU cycles spent in the completed transfers. */
+    uint16_t errors[PROTOCOL_SWEEP_ERROR_COUNT];    /**< Engine-specific error counters. */
+    uint8_t mode;                                   /**< Engine-specific setting of the step. */
+} TestSweepStep;
+
+/**
+ * @brief Step table of a sweep, filled by a sweep engine.
+ */
+typedef struct {
+    uint8_t count;                                  /**< Number of steps. */
+    TestSweepStep steps[TEST_SWEEP_MAX_STEPS];      /**< The steps, in the order they ran. */
+} TestSweep;
+
+/**
+ * @brief Per-test context block.
+ *
+ * Holds the parameters of one test run, the runner's progress and an
+ * opaque private area that the engine overlays with its own state.
+ */
+typedef struct {
+    const struct TestDriver* driver;  /**< Engine executing this test. */
+    const uint8_t* pattern;           /**< Data pattern (may be NULL if unused). */
+    uint16_t pattern_length;          /**< Length of the data pattern. */
+    uint32_t iterations;              /**< Number of iterations requested. */
+    uint32_t iteration;               /**< Index of the current iteration. */
+    uint32_t errors;                  /**< Number of failed iterations. */
+    uint32_t deadline;                /**< Tick at which the current iteration times out; `start` may extend it. */
+    uint32_t start_cycles;            /**< Cycle counter when the current iteration was armed. */
+    uint32_t end_cycles;              /**< Cycle counter when the current iteration completed, see TestRun_End(). */
+    uint32_t value;                   /**< Measurement of the current iteration, set by the engine. */
+    uint32_t bytes;                   /**< Bytes moved by one iteration, set by the engine's `setup`. */
+    TestTiming timing;                /**< Timing statistics of the run. */
+    TestRecord record;                /**< Outcome of the last completed iteration. */
+    uint8_t record_ready;             /**< Set by the runner when `record` is filled, cleared by its reader. */
+    uint8_t armed;                    /**< Set while an iteration is started and not yet complete. */
+    uint8_t ended;                    /**< Set once `end_cycles` holds a stamp of the current iteration. */
+    uint8_t stage;                    /**< TEST_STAGE_* the run is in. */
+    uint8_t status;                   /**< Final status once the run has finished. */
+    const TestSweep* sweep;           /**< Step table of a sweep engine, set by its `setup`, NULL otherwise. */
+    uint32_t priv[TEST_CONTEXT_PRIVATE_SIZE / sizeof(uint32_t)]; /**< Engine-private state. */
+} TestContext;
+
+/**
+ * @brief Descriptor of a peripheral test engine: its parameters and function table.
+ *
+ * The runner checks the pattern against `params` and `max_pattern` before
+ * `setup` is called, so engines only validate what is specific to them.
+ */
+typedef struct TestDriver {
+    uint8_t peripheral;                        /**< TEST_PERIPHERAL_* bit served by this engine. */
+    const char* name;                          /**< Human-readable engine name (at most PROTOCOL_CAPS_NAME_SIZE characters). */
+    uint8_t params;                            /**< Parameter schema: PROTOCOL_PARAM_* flags. */
+    uint16_t max_pattern;                      /**< Largest data pattern accepted, in bytes. */
+    uint32_t default_iterations;               /**< Iterations run when a request asks for 0. */
+    uint32_t estimated_us;                     /**< Estimated duration of one iteration with the largest pattern. */
+    uint8_t (*setup)(TestContext* ctx);        /**< Prepare the peripheral for a run, over one or more passes. */
+    uint8_t (*start)(TestContext* ctx);        /**< Arm one iteration. */
+    uint8_t (*poll)(TestContext* ctx);         /**< Check the armed iteration without blocking. */
+    void (*abort)(TestContext* ctx);           /**< Cancel any armed transfer. */
+    uint8_t (*finish)(TestContext* ctx);       /**< Release the peripheral, return the final status, over one or more passes. */
+    const struct TestDriver* sweep;            /**< Engine run for PROTOCOL_OPTION_SWEEP, NULL if there is none. */
+    void (*rescan)(void);                      /**< Drop what the engine cached about its bus, for PROTOCOL_OPTION_RESCAN; may be NULL. */
+} TestDriver;
+
+/**
+ * @brief Access the engine-private area of a context as the given type.
+ *
+ * @param ctx Pointer to the TestContext.
+ * @param type Engine state structure overlaid on the private area.
+ */
+#define TEST_CONTEXT_PRIVATE(ctx, type) ((type*)(void*)(ctx)->priv)
+
+/**
+ * @brief Compile-time check that an engine state fits the private area.
+ *
+ * @param type Engine state structure.
+ */
+#define TEST_CONTEXT_PRIVATE_CHECK(type) \
+    _Static_assert(sizeof(type) <= TEST_CONTEXT_PRIVATE_SIZE, #type " does not fit in TestContext")
+
+/** @brief Timer synchronization test engine. */
+extern const TestDriver timer_test_driver;
+
+/** @brief UART5 <-> UART2 loopback test engine. */
+extern const TestDriver uart_test_driver;
+
+/** @brief SPI1 (Master) <-> SPI2 (Slave) test engine. */
+extern const TestDriver spi_test_driver;
+
+/** @brief I2C4 (Master) -> I2C2 (Slave) test engine. */
+extern const TestDriver i2c_test_driver;
+
+/** @brief ADC1 <- DAC test engine. */
+extern const TestDriver adc_test_driver;
+
+/**
+ * @brief Enable the DWT cycle counter used to time iterations.
+ */
+void TestDriver_Init(void);
+
+/**
+ * @brief Find the engine serving a peripheral.
+ *
+ * The registry is indexed by test type, the bit index of the peripheral,
+ * so the lookup takes constant time.
+ *
+ * @param[in] peripheral One of the TEST_PERIPHERAL_* bitfields.
+ * @return const TestDriver* Pointer to the engine, or NULL if none serves it.
+ */
+const TestDriver* TestDriver_Find(uint8_t peripheral);
+
+/**
+ * @brief Encode the registry for a CAPS reply.
+ *
+ * @param[out] buf Buffer of at least 1 + TEST_PERIPHERAL_COUNT * PROTOCOL_CAPS_ENTRY_SIZE bytes.
+ * @return uint16_t Number of bytes written.
+ */
+uint16_t TestDriver_EncodeCapabilities(uint8_t* buf);
+
+/**
+ * @brief Set up a test run.
+ *
+ * The pattern is checked against the engine's descriptor, and a request
+ * for 0 iterations runs the engine's default iterations. The first pass
+ * of the engine's `setup` runs here; the rest run in TestRun_Poll().
+ *
+ * @param[out] ctx Pointer to the context to initialize.
+ * @param[in] driver Engine that executes the test.
+ * @param[in] pattern Data pattern; must stay valid until the run has finished.
+ * @param[in] pattern_length Length of the data pattern.
+ * @param[in] iterations Number of iterations to run.
+ * @return uint8_t Returns TEST_IN_PROGRESS if the run goes on, TEST_FAILURE otherwise.
+ */
+uint8_t TestRun_Begin(TestContext* ctx, const TestDriver* driver, const uint8_t* pattern,
+                      uint16_t pattern_length, uint32_t iterations);
+
+/**
+ * @brief Advance a test run without blocking.
+ *
+ * Continues the engine's `setup`, starts the next iteration, polls the
+ * one in flight, or continues the engine's `finish`. A failing or
+ * timed-out iteration aborts the engine and ends the run. Each completed
+ * iteration is described in `ctx->record` and flagged in `ctx->record_ready`.
+ *
+ * @param[in,out] ctx Pointer to the context of the run.
+ * @return uint8_t Returns TEST_IN_PROGRESS while running, otherwise the final status.
+ */
+uint8_t TestRun_Poll(TestContext* ctx);
+
+/**
+ * @brief Record when the armed iteration completed.
+ *
+ * Engines call this from `poll`, before any other work, with the stamps
+ * their HAL callbacks took with TEST_CYCLES(); of several stamps the
+ * latest is kept, and stamps taken before the iteration was armed are
+ * ignored. An iteration without a stamp is timed up to the poll that
+ * ended it.
+ *
+ * @param[in,out] ctx Pointer to the context of the run.
+ * @param[in] stamp Cycle counter at a completion event of the iteration.
+ */
+void TestRun_End(TestContext* ctx, uint32_t stamp);
+
+/**
+ * @brief Count the bytes that differ between a pattern and received data.
+ *
+ * Compares a word at a time and only looks at the bytes of differing words,
+ * so a clean buffer costs one load pair per four bytes; the buffers need
+ * no particular alignment.
+ *
+ * @param[in] expected Pointer to the expected data.
+ * @param[in] received Pointer to the received data.
+ * @param[in] length Number of bytes to compare.
+ * @return uint16_t Number of mismatching bytes.
+ */
+uint16_t TestRun_CountMismatches(const uint8_t* expected, const uint8_t* received, uint16_t length);
+
+/**
+ * @brief Count the bits that differ between sent and received data.
+ *
+ * @param[in] expected Pointer to the expected data.
+ * @param[in] received Pointer to the received data.
+ * @param[in] length Number of bytes to compare.
+ * @return uint32_t Number of differing bits.
+ */
+uint32_t TestRun_CountBitErrors(const uint8_t* expected, const uint8_t* received, uint16_t length);
+
+/**
+ * @brief Fill a buffer with a PRBS-15 sequence (x^15 + x^14 + 1), least significant bit first.
+ *
+ * @param[out] buf Buffer to fill.
+ * @param[in] length Length of the buffer.
+ * @param[in] seed Initial register state; 0 is replaced by all ones.
+ */
+void TestRun_FillPrbs(uint8_t* buf, uint16_t length, uint16_t seed);
+
+/**
+ * @brief Abort a test run and release its peripheral.
+ *
+ * The run ends before this returns: the engine's `finish` is called until
+ * it completes.
+ *
+ * @param[in,out] ctx Pointer to the context of the run.
+ */
+void TestRun_Abort(TestContext* ctx);
+
+#endif /* INC_TEST_DRIVER_H_ */
@@ -41,16 +41,13 @@ extern TIM_HandleTypeDef htim2;
 #define TIM2A &htim2
 
 /**
- * @brief Test the synchronization of TIM3 and TIM2.
+ * @brief Callback for Timer interrupt.
  *
- * This function tests the synchronization of two timers (TIM3 and TIM2)
- * over a specified number of iterations. Each iteration involves
- * generating a random duration and verifying that both timers
- * operate accurately for the duration.
+ * Counts elapsed seconds on TIM3 and TIM2 for the timer test engine
+ * (`timer_test_driver` in TestDriver.h).
  *
- * @param[in] iterations Number of iterations to run the test.
- * @return uint8_t Returns 1 on success, 0xFF on failure.
+ * @param[in] htim Pointer to the timer handle that triggered the interrupt.
  */
-uint8_t test_timer(uint16_t iterations);
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim);
 
 #endif // TIMER_TEST_H
@@ -67,13 +67,18 @@ extern uint8_t uart5_flag_calback;
  */
 #define UART_5 &huart5
 
-/// Timeout Definitions
+/** @brief Size of the DMA buffer of each UART receive ring of the loopback test (twice the largest pattern). */
+#define UART_RX_RING_SIZE 2048
 
 /**
- * @brief Short timeout duration in milliseconds for UART operations.
+ * @brief Bytes of PRBS data sent in each direction by one transfer of the
+ * baud-rate sweep: one full PRBS-15 period (32767 bits).
  */
-#define SHORT_TIMEOUT 1000
-#define SHORT_Delay 100
+#define UART_SWEEP_BLOCK_SIZE 4096
+
+/** @brief Transfers run at each rate of the sweep when a request asks for 0 iterations. */
+#define UART_SWEEP_DEFAULT_TRANSFERS 4
+
 /// UART Testing Flags and Status Variables
 
 /** @brief UART5 RX complete callback flag. */
@@ -82,26 +87,35 @@ extern volatile uint8_t UART_5_RX_Complete_Callback_Flag;
 /** @brief UART2 RX complete callback flag. */
 extern volatile uint8_t UART_2_RX_Complete_Callback_Flag;
 
+/** @brief UART5 TX complete callback flag. */
+extern volatile uint8_t UART_5_TX_Complete_Callback_Flag;
+
+/** @brief UART2 TX complete callback flag. */
+extern volatile uint8_t UART_2_TX_Complete_Callback_Flag;
+
 /** @brief UART5 error callback flag. */
 extern volatile uint8_t Uart_5_ErrorCallback_Flag;
 
 /** @brief UART2 error callback flag. */
 extern volatile uint8_t Uart_2_ErrorCallback_Flag;
 
+/** @brief HAL_UART_ERROR_* bits of the last UART5 error. */
+extern volatile uint32_t Uart_5_ErrorCode;
+
+/** @brief HAL_UART_ERROR_* bits of the last UART2 error. */
+extern volatile uint32_t Uart_2_ErrorCode;
+
 /// Function Declarations
 
 /**
- * @brief Tests UART communication with a specified bit pattern.
+ * @brief Callback for UART TX complete event.
  *
- * This function transmits and receives a bit pattern using the UART
- * interface and verifies communication over multiple iterations.
+ * This function is triggered when a UART TX operation completes.
+ * It sets the corresponding TX callback flags for UART2 or UART5.
  *
- * @param[in] bit_pattern Pointer to the bit pattern to transmit.
- * @param[in] pattern_length Length of the bit pattern.
- * @param[in] iterations Number of iterations for the test.
- * @return uint8_t Returns 1 on success, 0xFF on failure.
+ * @param[in] huart Pointer to the UART handle that triggered the interrupt.
  */
-uint8_t test_uart(const char* bit_pattern, uint8_t pattern_length, uint8_t iterations);
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef* huart);
 
 /**
  * @brief Callback for UART RX complete event.
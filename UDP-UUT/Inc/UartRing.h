@@ -0,0 +1,110 @@
+/**
+ * @file UartRing.h
+ * @brief Header file for the circular DMA UART receive ring.
+ *
+ * This file declares a receive ring that keeps a UART receiving into a
+ * circular DMA buffer with HAL_UARTEx_ReceiveToIdle_DMA. The DMA writes
+ * every byte in place; the half-transfer, transfer-complete and idle-line
+ * events only advance the write count, and readers look at the received
+ * bytes where the DMA put them, so a stream of any length is received
+ * without a CPU copy.
+ *
+ * @details The ring is single-producer, single-consumer: the write count is
+ * only advanced by HAL_UARTEx_RxEventCallback() and the read count only by
+ * the reader, both as 32-bit totals since the ring was started, so neither
+ * side needs a lock. A reader that falls more than a buffer behind loses
+ * the oldest bytes; they are counted in `overruns`.
+ *
+ * @note The UART's RX DMA stream must be configured in circular mode.
+ * Received bytes become visible at each half of the buffer and whenever the
+ * line goes idle, so a burst is readable one character time after it ends.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#ifndef INC_UART_RING_H_
+#define INC_UART_RING_H_
+
+#include "UdpUut.h"
+
+/** @brief Largest number of rings receiving at the same time. */
+#define UART_RING_MAX 3
+
+/**
+ * @brief A UART receive ring.
+ */
+typedef struct {
+    UART_HandleTypeDef* huart;   /**< UART receiving into the ring. */
+    uint8_t* buf;                /**< DMA buffer. */
+    uint16_t size;               /**< Size of the DMA buffer. */
+    uint16_t dma_position;       /**< DMA write offset at the last receive event. */
+    volatile uint32_t head;      /**< Bytes received since the start (advanced by the receive events only). */
+    uint32_t tail;               /**< Bytes read since the start (advanced by the reader only). */
+    uint32_t overruns;           /**< Bytes overwritten before they were read. */
+    volatile uint32_t event_cycles; /**< DWT cycle counter at the last receive event. */
+} UartRing;
+
+/**
+ * @brief Start receiving a UART into a ring.
+ *
+ * Bytes the UART held before the start are dropped, with its error flags.
+ *
+ * @param[out] ring Pointer to the ring.
+ * @param[in] huart Pointer to the UART handle; its RX DMA stream must be circular.
+ * @param[in] buf DMA buffer; must stay valid until the ring is stopped.
+ * @param[in] size Size of the DMA buffer (even, so both halves are equal).
+ * @return HAL_StatusTypeDef HAL_OK, HAL_BUSY if every ring is in use, or the status of the HAL.
+ */
+HAL_StatusTypeDef UartRing_Start(UartRing* ring, UART_HandleTypeDef* huart, uint8_t* buf, uint16_t size);
+
+/**
+ * @brief Stop receiving into a ring.
+ *
+ * @param[in,out] ring Pointer to the ring.
+ */
+void UartRing_Stop(UartRing* ring);
+
+/**
+ * @brief Number of received bytes waiting to be read.
+ *
+ * @param[in,out] ring Pointer to the ring; bytes overwritten by the DMA are skipped.
+ * @return uint32_t Number of readable bytes.
+ */
+uint32_t UartRing_Available(UartRing* ring);
+
+/**
+ * @brief Get the received bytes that lie in one piece at the read position.
+ *
+ * @param[in,out] ring Pointer to the ring.
+ * @param[out] data Receives a pointer to the bytes in the DMA buffer.
+ * @return uint16_t Number of contiguous readable bytes; the rest follows at the start of the buffer.
+ */
+uint16_t UartRing_Peek(UartRing* ring, const uint8_t** data);
+
+/**
+ * @brief Mark bytes as read.
+ *
+ * @param[in,out] ring Pointer to the ring.
+ * @param[in] length Number of bytes, at most UartRing_Available().
+ */
+void UartRing_Consume(UartRing* ring, uint32_t length);
+
+/**
+ * @brief Drop every byte received so far.
+ *
+ * @param[in,out] ring Pointer to the ring.
+ */
+void UartRing_Flush(UartRing* ring);
+
+/**
+ * @brief Callback for UART receive events (half transfer, transfer complete, idle line).
+ *
+ * Advances the write count of the ring receiving on the UART.
+ *
+ * @param[in] huart Pointer to the UART handle.
+ * @param[in] Size DMA write offset in the buffer.
+ */
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef* huart, uint16_t Size);
+
+#endif /* INC_UART_RING_H_ */
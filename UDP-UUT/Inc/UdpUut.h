@@ -39,6 +39,18 @@ extern UART_HandleTypeDef huart3;
 /** @brief UDP server port number. */
 #define SERVER_PORT 50007
 
+/** @brief Multicast group the fleet of boards listens on for commands (239.0.7.1). */
+#define MULTICAST_GROUP_ADDR LWIP_MAKEU32(239, 0, 7, 1)
+
+/**
+ * @brief Index of this board in the fleet: its bit in the header target bitmap.
+ *
+ * Every board of a fleet must be built with its own index, below PROTOCOL_MAX_BOARDS.
+ */
+#ifndef BOARD_INDEX
+#define BOARD_INDEX 0
+#endif
+
 /** @brief lwIP network interface for the RTG system. */
 extern struct netif gnetif;
 
@@ -173,4 +185,15 @@ err_t udp_sendto(struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* ipaddr, u
  */
 err_t send_packet(struct udp_pcb* pcb, const void* payload, u16_t payload_len, const ip_addr_t* ipaddr, u16_t port);
 
+/**
+ * @brief Send a response buffer and release it.
+ *
+ * @param[in] pcb Pointer to the UDP control block.
+ * @param[in] p Pointer to a pbuf obtained from ResponsePool_Alloc().
+ * @param[in] ipaddr Pointer to the destination IP address.
+ * @param[in] port Destination port number.
+ * @return err_t Returns ERR_OK on success, or an error code on failure.
+ */
+err_t send_response(struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* ipaddr, u16_t port);
+
 #endif /* INC_RTG_H_ */
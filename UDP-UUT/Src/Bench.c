@@ -0,0 +1,253 @@
+/**
+ * @file Bench.c
+ * @brief Implementation of the UDP throughput self-benchmark.
+ *
+ * This file sends and reflects benchmark datagrams from a single static
+ * buffer, laid out like a response pool buffer so lwIP prepends its headers
+ * in place. The Ethernet driver transmits synchronously, so the buffer is
+ * free again as soon as udp_sendto() returns (unless ARP queued it, in which
+ * case the blast waits for its release callback).
+ *
+ * @details Counters come from three places: the MAC's MMC and DMA
+ * missed-frame registers, the RX_POOL counters kept in `ethernetif.c`, and
+ * this module. Counters are reported relative to the last reset. The CPU
+ * load is the share of main-loop cycles spent in passes that did some work.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#include "Bench.h"
+#include "Codec.h"
+#include "JobQueue.h"
+#include "ResponsePool.h"
+#include "TestDriver.h"
+
+/**
+ * @brief The benchmark buffer: custom pbuf followed by its header room and payload.
+ */
+typedef struct {
+    struct pbuf_custom pbuf_custom;
+    uint8_t buff[LWIP_MEM_ALIGN_SIZE(PBUF_TRANSPORT) + BENCH_MAX_PAYLOAD];
+} BenchBuff_t;
+
+/**
+ * @brief State of the running blast.
+ */
+typedef struct {
+    struct udp_pcb* pcb;     /**< UDP control block to send on. */
+    ip_addr_t addr;          /**< Destination IP address. */
+    u16_t port;              /**< Destination UDP port. */
+    uint32_t count;          /**< Datagrams to send. */
+    uint32_t sequence;       /**< Sequence number of the next datagram. */
+    uint32_t start_cycles;   /**< Cycle counter when the first datagram was sent. */
+    uint16_t size;           /**< UDP payload size of each datagram. */
+    uint8_t active;          /**< Set while datagrams remain to be sent. */
+} BenchBlast;
+
+/**
+ * @brief Counters of the current window; MAC counters hold their value at the last reset.
+ */
+typedef struct {
+    uint32_t start_tick;      /**< Tick at which the window started. */
+    uint32_t mac_tx;          /**< ETH->MMCTGFCR at reset. */
+    uint32_t mac_rx;          /**< ETH->MMCRGUFCR at reset. */
+    uint32_t mac_crc;         /**< ETH->MMCRFCECR at reset. */
+    uint32_t rx_packets;      /**< RxPacketCount at reset. */
+    uint32_t rx_alloc_errors; /**< RxAllocErrorCount at reset. */
+    uint32_t missed;          /**< Frames missed by the DMA since reset (the register clears on read). */
+    uint32_t blast_sent;      /**< BLAST datagrams handed to lwIP. */
+    uint32_t blast_failed;    /**< BLAST datagrams lwIP refused. */
+    uint32_t blast_cycles;    /**< Cycles taken by the last blast. */
+    uint32_t echoed;          /**< ECHO datagrams reflected. */
+    uint32_t last_packets;    /**< RxPacketCount at the end of the last main-loop pass. */
+    uint64_t total_cycles;    /**< Main-loop cycles accounted. */
+    uint64_t idle_cycles;     /**< Main-loop cycles of passes that did nothing. */
+} BenchCounters;
+
+/** @brief Buffer of the benchmark datagrams. */
+static BenchBuff_t bench_buffer;
+
+/** @brief Set while lwIP holds the benchmark buffer. */
+static uint8_t bench_buffer_busy = 0;
+
+/** @brief UDP payload size already filled with the BLAST filler, 0 if the filler was overwritten. */
+static uint16_t bench_filled = 0;
+
+/** @brief The running blast. */
+static BenchBlast bench_blast;
+
+/** @brief Counters of the current window. */
+static BenchCounters bench_counters;
+
+/**
+ * @brief Release callback of the benchmark buffer.
+ *
+ * @param[in] p Pointer to the released pbuf.
+ */
+static void bench_buffer_free(struct pbuf* p) {
+    (void)p;
+    bench_buffer_busy = 0;
+}
+
+/**
+ * @brief Take the benchmark buffer.
+ *
+ * @param[in] length UDP payload size.
+ * @return struct pbuf* Pointer to the pbuf, or NULL if lwIP still holds the buffer.
+ */
+static struct pbuf* bench_buffer_alloc(u16_t length) {
+    if (bench_buffer_busy) {
+        return NULL;
+    }
+    bench_buffer_busy = 1;
+    bench_buffer.pbuf_custom.custom_free_function = bench_buffer_free;
+    return pbuf_alloced_custom(PBUF_TRANSPORT, length, PBUF_RAM, &bench_buffer.pbuf_custom,
+                               bench_buffer.buff, sizeof(bench_buffer.buff));
+}
+
+/**
+ * @brief Collect the frames missed by the Ethernet DMA.
+ *
+ * The register is cleared on read and its counters saturate, so it is
+ * drained on every main-loop pass.
+ */
+static void bench_collect_missed(void) {
+    uint32_t missed = ETH->DMAMFBOCR;
+
+    bench_counters.missed += (missed & ETH_DMAMFBOCR_MFC) +
+                             ((missed & ETH_DMAMFBOCR_MFA) >> ETH_DMAMFBOCR_MFA_Pos);
+}
+
+void Bench_Init(void) {
+    bench_buffer_busy = 0;
+    bench_filled = 0;
+    memset(&bench_blast, 0, sizeof(bench_blast));
+    Bench_Reset();
+}
+
+uint8_t Bench_StartBlast(struct udp_pcb* pcb, const ip_addr_t* addr, u16_t port, uint32_t count, uint16_t size) {
+    if (bench_blast.active) {
+        return 0;
+    }
+    bench_blast.pcb = pcb;
+    ip_addr_copy(bench_blast.addr, *addr);
+    bench_blast.port = port;
+    bench_blast.count = count;
+    bench_blast.sequence = 0;
+    bench_blast.size = size;
+    bench_blast.start_cycles = TEST_CYCLES();
+    bench_blast.active = 1;
+    return 1;
+}
+
+void Bench_Echo(struct udp_pcb* pcb, const struct pbuf* p, const ip_addr_t* addr, u16_t port) {
+    struct pbuf* reply;
+
+    if (p->tot_len > BENCH_MAX_PAYLOAD) {
+        return;
+    }
+    reply = bench_buffer_alloc(p->tot_len);
+    if (reply == NULL) {
+        return;
+    }
+    bench_filled = 0;
+    pbuf_copy_partial(p, reply->payload, p->tot_len, 0);
+    ((uint8_t*)reply->payload)[1] = PROTOCOL_OPCODE_ECHO | PROTOCOL_OPCODE_REPLY;
+    if (send_response(pcb, reply, addr, port) == ERR_OK) {
+        bench_counters.echoed++;
+    }
+}
+
+void Bench_Reset(void) {
+    bench_collect_missed();
+    memset(&bench_counters, 0, sizeof(bench_counters));
+    bench_counters.start_tick = HAL_GetTick();
+    bench_counters.mac_tx = ETH->MMCTGFCR;
+    bench_counters.mac_rx = ETH->MMCRGUFCR;
+    bench_counters.mac_crc = ETH->MMCRFCECR;
+    bench_counters.rx_packets = RxPacketCount;
+    bench_counters.rx_alloc_errors = RxAllocErrorCount;
+    bench_counters.last_packets = RxPacketCount;
+}
+
+uint16_t Bench_EncodeReport(uint8_t* buf) {
+    uint32_t busy = 0;
+
+    bench_collect_missed();
+    if (bench_counters.total_cycles > 0) {
+        busy = (uint32_t)(1000 - (bench_counters.idle_cycles * 1000) / bench_counters.total_cycles);
+    }
+
+    Codec_PutLe32(&buf[0], HAL_GetTick() - bench_counters.start_tick);
+    Codec_PutLe32(&buf[4], SystemCoreClock);
+    Codec_PutLe32(&buf[8], ETH->MMCTGFCR - bench_counters.mac_tx);
+    Codec_PutLe32(&buf[12], ETH->MMCRGUFCR - bench_counters.mac_rx);
+    Codec_PutLe32(&buf[16], RxPacketCount - bench_counters.rx_packets);
+    Codec_PutLe32(&buf[20], bench_counters.missed);
+    Codec_PutLe32(&buf[24], ETH->MMCRFCECR - bench_counters.mac_crc);
+    Codec_PutLe32(&buf[28], RxAllocErrorCount - bench_counters.rx_alloc_errors);
+    Codec_PutLe32(&buf[32], bench_counters.blast_sent);
+    Codec_PutLe32(&buf[36], bench_counters.blast_failed);
+    Codec_PutLe32(&buf[40], bench_counters.blast_cycles);
+    Codec_PutLe32(&buf[44], bench_counters.echoed);
+    Codec_PutLe16(&buf[48], (uint16_t)busy);
+    return PROTOCOL_BENCH_REPORT_SIZE;
+}
+
+void Bench_Poll(void) {
+    struct pbuf* p;
+    struct pbuf* report;
+    uint8_t* buf;
+    uint8_t burst;
+
+    if (!bench_blast.active) {
+        return;
+    }
+
+    for (burst = 0; burst < BENCH_BURST && bench_blast.sequence < bench_blast.count; burst++) {
+        p = bench_buffer_alloc(bench_blast.size);
+        if (p == NULL) {
+            // Still queued behind an ARP request, retry on the next pass
+            return;
+        }
+        buf = p->payload;
+        if (bench_filled != bench_blast.size) {
+            memset(buf, 0xA5, bench_blast.size);
+            bench_filled = bench_blast.size;
+        }
+        Codec_EncodeHeader(buf, PROTOCOL_OPCODE_BLAST | PROTOCOL_OPCODE_REPLY, 0);
+        Codec_PutLe32(&buf[PROTOCOL_HEADER_SIZE], bench_blast.sequence);
+        if (send_response(bench_blast.pcb, p, &bench_blast.addr, bench_blast.port) == ERR_OK) {
+            bench_counters.blast_sent++;
+        } else {
+            bench_counters.blast_failed++;
+        }
+        bench_blast.sequence++;
+    }
+    if (bench_blast.sequence < bench_blast.count) {
+        return;
+    }
+
+    // Blast done: close it with the counters
+    bench_counters.blast_cycles = TEST_CYCLES() - bench_blast.start_cycles;
+    bench_blast.active = 0;
+    report = ResponsePool_Alloc(PROTOCOL_HEADER_SIZE + PROTOCOL_BENCH_REPORT_SIZE);
+    if (report != NULL) {
+        buf = report->payload;
+        buf += Codec_EncodeHeader(buf, PROTOCOL_OPCODE_BENCH | PROTOCOL_OPCODE_REPLY, 0);
+        Bench_EncodeReport(buf);
+        send_response(bench_blast.pcb, report, &bench_blast.addr, bench_blast.port);
+    }
+}
+
+void Bench_Account(uint32_t start) {
+    uint32_t cycles = TEST_CYCLES() - start;
+
+    bench_collect_missed();
+    bench_counters.total_cycles += cycles;
+    if (RxPacketCount == bench_counters.last_packets && JobQueue_Depth() == 0 && !bench_blast.active) {
+        bench_counters.idle_cycles += cycles;
+    }
+    bench_counters.last_packets = RxPacketCount;
+}
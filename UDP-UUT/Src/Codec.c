@@ -0,0 +1,119 @@
+/**
+ * @file Codec.c
+ * @brief Implementation of the wire protocol encoder and decoder.
+ *
+ * This file converts received datagrams into TestCommand structures and
+ * results into reply payloads, using explicit little-endian field access
+ * so that the wire format does not depend on the compiler's struct layout.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#include "Codec.h"
+
+uint8_t Codec_DecodeHeader(const struct pbuf* p, PacketHeader* header) {
+    uint8_t copy[PROTOCOL_HEADER_SIZE];
+    const uint8_t* buf;
+
+    buf = pbuf_get_contiguous(p, copy, sizeof(copy), PROTOCOL_HEADER_SIZE, 0);
+    if (buf == NULL) {
+        return PROTOCOL_ERROR_LENGTH;
+    }
+    header->version = buf[0];
+    header->opcode = buf[1];
+    header->flags = buf[2];
+    header->targets = buf[3];
+    if (header->version != PROTOCOL_VERSION) {
+        return PROTOCOL_ERROR_VERSION;
+    }
+    return 0;
+}
+
+uint16_t Codec_DecodeTest(const struct pbuf* p, uint16_t offset, TestCommand* command) {
+    uint8_t copy[PROTOCOL_TEST_SIZE];
+    const uint8_t* buf;
+    uint32_t tlv_offset;
+    uint32_t end;
+    uint16_t tlv_length;
+
+    buf = pbuf_get_contiguous(p, copy, sizeof(copy), PROTOCOL_TEST_SIZE, offset);
+    if (buf == NULL) {
+        return 0;
+    }
+    command->test_id = Codec_GetLe32(&buf[0]);
+    command->iterations = Codec_GetLe32(&buf[4]);
+    command->peripheral = buf[8];
+    command->options = buf[9];
+    command->pattern_length = 0;
+    command->pattern_offset = 0;
+    command->sample_interval = 1;
+
+    tlv_offset = (uint32_t)offset + PROTOCOL_TEST_SIZE;
+    end = tlv_offset + Codec_GetLe16(&buf[10]);
+    if (end > p->tot_len) {
+        return 0;
+    }
+
+    while (tlv_offset < end) {
+        if (tlv_offset + PROTOCOL_TLV_HEADER_SIZE > end) {
+            return 0;
+        }
+        buf = pbuf_get_contiguous(p, copy, sizeof(copy), PROTOCOL_TLV_HEADER_SIZE, (u16_t)tlv_offset);
+        if (buf == NULL) {
+            return 0;
+        }
+        tlv_length = Codec_GetLe16(&buf[1]);
+        if (tlv_offset + PROTOCOL_TLV_HEADER_SIZE + tlv_length > end) {
+            return 0;
+        }
+        if (buf[0] == PROTOCOL_TLV_PATTERN) {
+            if (tlv_length > TEST_PATTERN_MAX_LENGTH) {
+                return 0;
+            }
+            command->pattern_length = tlv_length;
+            command->pattern_offset = (uint16_t)(tlv_offset + PROTOCOL_TLV_HEADER_SIZE);
+        } else if (buf[0] == PROTOCOL_TLV_SAMPLE) {
+            if (tlv_length != PROTOCOL_SAMPLE_SIZE) {
+                return 0;
+            }
+            buf = pbuf_get_contiguous(p, copy, sizeof(copy), PROTOCOL_SAMPLE_SIZE,
+                                      (u16_t)(tlv_offset + PROTOCOL_TLV_HEADER_SIZE));
+            if (buf == NULL) {
+                return 0;
+            }
+            command->sample_interval = Codec_GetLe32(buf);
+        }
+        // Unknown TLV types are skipped
+        tlv_offset += PROTOCOL_TLV_HEADER_SIZE + tlv_length;
+    }
+    return (uint16_t)end;
+}
+
+const uint8_t* Codec_GetPattern(const struct pbuf* p, const TestCommand* command, uint8_t* scratch) {
+    return pbuf_get_contiguous(p, scratch, TEST_PATTERN_MAX_LENGTH, command->pattern_length, command->pattern_offset);
+}
+
+uint16_t Codec_EncodeHeader(uint8_t* buf, uint8_t opcode, uint8_t flags) {
+    buf[0] = PROTOCOL_VERSION;
+    buf[1] = opcode;
+    buf[2] = flags;
+    buf[3] = 0;
+    return PROTOCOL_HEADER_SIZE;
+}
+
+uint16_t Codec_EncodeResult(uint8_t* buf, const TestResult* result) {
+    Codec_PutLe32(&buf[0], result->test_id);
+    buf[4] = result->result;
+    buf[5] = result->peripheral;
+    memcpy(&buf[6], result->peripheral_results, TEST_PERIPHERAL_COUNT);
+    return PROTOCOL_RESULT_SIZE;
+}
+
+uint16_t Codec_EncodeError(uint8_t* buf, uint8_t error, uint8_t opcode) {
+    uint16_t length = Codec_EncodeHeader(buf, PROTOCOL_OPCODE_ERROR | PROTOCOL_OPCODE_REPLY, 0);
+
+    buf[length++] = error;
+    buf[length++] = opcode;
+    return length;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file DebugUart.c
+ * @brief Implementation of the buffered output of the debug UART.
+ *
+ * The ring keeps 32-bit totals of the bytes queued and sent, as the UART
+ * receive rings do, so it is full when they differ by its size. The UART
+ * is driven through its registers: HAL_UART_Transmit would wait for the
+ * end of the character, and the debug UART has no TX interrupt or DMA
+ * stream configured.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#include "DebugUart.h"
+
+_Static_assert((DEBUG_UART_BUFFER_SIZE & (DEBUG_UART_BUFFER_SIZE - 1)) == 0,
+               "DEBUG_UART_BUFFER_SIZE must be a power of two");
+
+/** @brief Transmit ring of the debug UART. */
+static struct {
+    uint8_t buf[DEBUG_UART_BUFFER_SIZE];   /**< Queued text. */
+    uint32_t head;                         /**< Bytes queued since reset. */
+    uint32_t tail;                         /**< Bytes sent since reset. */
+    uint32_t dropped;                      /**< Bytes that did not fit. */
+} debug_uart;
+
+uint16_t DebugUart_Write(const uint8_t* data, uint16_t length) {
+    uint32_t room = DEBUG_UART_BUFFER_SIZE - (debug_uart.head - debug_uart.tail);
+    uint16_t i;
+
+    if (length > room) {
+        debug_uart.dropped += length - room;
+        length = (uint16_t)room;
+    }
+    for (i = 0; i < length; i++) {
+        debug_uart.buf[debug_uart.head++ & (DEBUG_UART_BUFFER_SIZE - 1)] = data[i];
+    }
+    return length;
+}
+
+void DebugUart_Poll(void) {
+    UART_HandleTypeDef* huart = UART_DEBUG;
+
+    if (debug_uart.head != debug_uart.tail && __HAL_UART_GET_FLAG(huart, UART_FLAG_TXE)) {
+        huart->Instance->TDR = debug_uart.buf[debug_uart.tail++ & (DEBUG_UART_BUFFER_SIZE - 1)];
+    }
+}
+
+uint16_t DebugUart_Pending(void) {
+    return (uint16_t)(debug_uart.head - debug_uart.tail);
+}
+
+uint32_t DebugUart_Dropped(void) {
+    return debug_uart.dropped;
+}
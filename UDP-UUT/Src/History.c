@@ -0,0 +1,95 @@
+/**
+ * @file History.c
+ * @brief Implementation of the result history ring.
+ *
+ * This file keeps the replies in a fixed array written round robin. The
+ * ring is small, so lookups are linear scans; a range is returned in test
+ * ID order by repeatedly picking the smallest ID above the last one sent.
+ *
+ * @note The ring is only used from the UDP receive callback and the main
+ * loop (lwIP runs with NO_SYS=1), so it needs no locking.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#include "History.h"
+#include "Codec.h"
+
+/**
+ * @brief A kept reply.
+ */
+typedef struct {
+    ip_addr_t addr;                      /**< Client IP address. */
+    uint32_t test_id;                    /**< Test ID of the request. */
+    uint16_t length;                     /**< Length of the reply, 0 if the entry is unused. */
+    uint8_t reply[HISTORY_REPLY_SIZE];   /**< Encoded reply. */
+} HistoryEntry;
+
+/** @brief The ring. */
+static HistoryEntry history[HISTORY_SIZE];
+
+/** @brief Entry written next. */
+static uint8_t history_next = 0;
+
+/**
+ * @brief Find the kept reply of a client with the smallest test ID in a range.
+ *
+ * @param[in] addr Pointer to the client IP address.
+ * @param[in] first First test ID of the range.
+ * @param[in] last Last test ID of the range (inclusive).
+ * @return const HistoryEntry* Pointer to the entry, or NULL if the range holds none.
+ */
+static const HistoryEntry* history_lowest(const ip_addr_t* addr, uint32_t first, uint32_t last) {
+    const HistoryEntry* lowest = NULL;
+    uint8_t i;
+
+    for (i = 0; i < HISTORY_SIZE; i++) {
+        if (history[i].length > 0 && history[i].test_id >= first && history[i].test_id <= last &&
+            ip_addr_cmp(&history[i].addr, addr) && (lowest == NULL || history[i].test_id < lowest->test_id)) {
+            lowest = &history[i];
+        }
+    }
+    return lowest;
+}
+
+void History_Add(const ip_addr_t* addr, uint32_t test_id, const uint8_t* reply, uint16_t length) {
+    HistoryEntry* entry;
+
+    if (length > HISTORY_REPLY_SIZE) {
+        return;
+    }
+    // A test run again after its cache entry was evicted replaces its old reply
+    entry = (HistoryEntry*)history_lowest(addr, test_id, test_id);
+    if (entry == NULL) {
+        entry = &history[history_next];
+        history_next = (history_next + 1) % HISTORY_SIZE;
+    }
+    ip_addr_copy(entry->addr, *addr);
+    entry->test_id = test_id;
+    entry->length = length;
+    memcpy(entry->reply, reply, length);
+}
+
+uint16_t History_Encode(uint8_t* buf, uint16_t size, const ip_addr_t* addr, uint32_t first, uint32_t last) {
+    const HistoryEntry* entry;
+    uint16_t length = PROTOCOL_HISTORY_REPLY_SIZE;
+
+    buf[0] = 0;
+    buf[1] = 0;
+    while (first <= last && (entry = history_lowest(addr, first, last)) != NULL) {
+        if (length + PROTOCOL_HISTORY_ENTRY_SIZE + entry->length > size) {
+            buf[1] = 1;
+            break;
+        }
+        Codec_PutLe16(&buf[length], entry->length);
+        memcpy(&buf[length + PROTOCOL_HISTORY_ENTRY_SIZE], entry->reply, entry->length);
+        length += PROTOCOL_HISTORY_ENTRY_SIZE + entry->length;
+        buf[0]++;
+        if (entry->test_id == UINT32_MAX) {
+            break;
+        }
+        first = entry->test_id + 1;
+    }
+    return length;
+}
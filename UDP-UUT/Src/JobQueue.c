@@ -0,0 +1,1064 @@
+/**
+ * @file JobQueue.c
+ * @brief Implementation of the test job queue.
+ *
+ * This file contains a bounded pool of queued test commands. The UDP
+ * receive callback pushes commands into it and returns immediately;
+ * `UDP_main()` calls JobQueue_Poll() on every pass of its loop, which runs
+ * one resumable step of the current test and sends the result once the test
+ * has finished. Whenever no test is running, the next job is picked by
+ * priority class, then by deficit round robin over the client sessions
+ * (see job_schedule()). An urgent job suspends the running one at its next
+ * iteration boundary (see job_suspend()).
+ *
+ * @details Every test engine implements the non-blocking TestDriver
+ * contract and is advanced with TestRun_Poll(), which returns
+ * TEST_IN_PROGRESS until the test has completed. Between two steps the main
+ * loop drains received frames and runs the lwIP timers, so ARP and ICMP stay
+ * responsive while a long test is running.
+ *
+ * Patterns are never copied: a job keeps a reference to the received
+ * datagram (a zero-copy RX_POOL buffer, see `HAL_ETH_RxAllocateCallback()`)
+ * and the test engines read the pattern straight out of it until the job
+ * completes. Batch jobs decode their requests out of the same datagram one
+ * after the other, collecting the results into a single reply. Plan jobs
+ * take their commands and patterns from the plan store instead, reporting
+ * every step as it finishes.
+ *
+ * @note lwIP runs with NO_SYS=1 and the receive callback is invoked from
+ * `ethernetif_input()` in the main loop, so the queue needs no locking.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#include "JobQueue.h"
+#include "TestDriver.h"
+#include "ResponsePool.h"
+#include "Telemetry.h"
+#include "ReplyCache.h"
+#include "History.h"
+
+/**
+ * @brief Largest TEST reply of a job testing the given number of peripherals, streamed,
+ * with the sweep tables of the given number of them.
+ */
+#define JOB_TEST_REPLY_SIZE(tested, swept)                                                        \
+    (PROTOCOL_HEADER_SIZE + PROTOCOL_RESULT_SIZE +                                                \
+     PROTOCOL_TLV_HEADER_SIZE + PROTOCOL_TIMING_SIZE + (tested) * PROTOCOL_TIMING_PERIPHERAL_SIZE + \
+     PROTOCOL_TLV_HEADER_SIZE + PROTOCOL_SCHEDULE_SIZE +                                          \
+     ((swept) ? PROTOCOL_TLV_HEADER_SIZE : 0) +                                                   \
+     (swept) * (PROTOCOL_SWEEP_SIZE + TEST_SWEEP_MAX_STEPS * PROTOCOL_SWEEP_STEP_SIZE) +          \
+     PROTOCOL_TLV_HEADER_SIZE + PROTOCOL_SUMMARY_SIZE + (tested) * PROTOCOL_SUMMARY_PERIPHERAL_SIZE)
+
+// Every TEST reply must fit the response pool, the reply cache and the history;
+// the server accepts the sweep option on a single peripheral only
+_Static_assert(JOB_TEST_REPLY_SIZE(TEST_PERIPHERAL_COUNT, 0) <= REPLY_CACHE_REPLY_SIZE &&
+               JOB_TEST_REPLY_SIZE(1, 1) <= REPLY_CACHE_REPLY_SIZE,
+               "TEST reply does not fit REPLY_CACHE_REPLY_SIZE");
+_Static_assert(JOB_TEST_REPLY_SIZE(TEST_PERIPHERAL_COUNT, 0) <= HISTORY_REPLY_SIZE &&
+               JOB_TEST_REPLY_SIZE(1, 1) <= HISTORY_REPLY_SIZE,
+               "TEST reply does not fit HISTORY_REPLY_SIZE");
+_Static_assert(JOB_TEST_REPLY_SIZE(TEST_PERIPHERAL_COUNT, 0) <= RESPONSE_POOL_PAYLOAD_SIZE &&
+               JOB_TEST_REPLY_SIZE(1, 1) <= RESPONSE_POOL_PAYLOAD_SIZE,
+               "TEST reply does not fit RESPONSE_POOL_PAYLOAD_SIZE");
+
+/** @brief Slots of the queued jobs, in no particular order. */
+static TestJob job_queue[JOB_QUEUE_DEPTH];
+
+/** @brief Job being executed, or NULL when the next one has to be scheduled. */
+static TestJob* job_running = NULL;
+
+/** @brief Number of jobs in the queue, including the running one. */
+static uint8_t job_count = 0;
+
+/** @brief Arrival number of the next queued job. */
+static uint32_t job_sequence = 0;
+
+/** @brief Session visited first by the next scheduling decision. */
+static uint8_t job_round_robin = 0;
+
+/** @brief Job suspended by an urgent job, or NULL. */
+static TestJob* job_suspended = NULL;
+
+/** @brief Set while the running job stops arming iterations so that it can be suspended. */
+static uint8_t job_preempting = 0;
+
+/** @brief Number of received datagrams referenced by queued jobs. */
+static uint8_t job_packets = 0;
+
+/** @brief Contiguous copy of a pattern that spans several pbufs of a chain. */
+static uint8_t job_pattern_scratch[TEST_PATTERN_MAX_LENGTH];
+
+/** @brief Packed reply of the running batch job. */
+static uint8_t job_batch_reply[PROTOCOL_HEADER_SIZE + 1 + PROTOCOL_BATCH_MAX_COMMANDS * PROTOCOL_RESULT_SIZE];
+
+/** @brief Number of bytes used in job_batch_reply. */
+static uint16_t job_batch_reply_length = 0;
+
+/** @brief Contexts of the running tests, indexed by peripheral bit number. */
+static TestContext job_lanes[TEST_PERIPHERAL_COUNT];
+
+/** @brief Peripherals of the running job whose test has not finished yet. */
+static uint8_t job_active_lanes = 0;
+
+/** @brief Per-bit results of the running job. */
+static uint8_t job_lane_results[TEST_PERIPHERAL_COUNT];
+
+/** @brief Set while the running job streams its iteration records. */
+static uint8_t job_streaming = 0;
+
+/**
+ * @brief Lane bookkeeping of the suspended job.
+ *
+ * The contexts themselves stay in job_lanes: the urgent job only uses
+ * peripherals that the suspended job does not.
+ */
+static struct {
+    uint8_t active_lanes;                          /**< Saved job_active_lanes. */
+    uint8_t lane_results[TEST_PERIPHERAL_COUNT];   /**< Saved job_lane_results. */
+    uint8_t streaming;                             /**< Saved job_streaming. */
+} job_saved;
+
+/**
+ * @brief Set up one test engine per peripheral bit of the given job.
+ *
+ * All requested peripherals are started together and then advanced side by
+ * side, each on its own IT/DMA path, so a multi-peripheral command takes
+ * about as long as its slowest test.
+ *
+ * @param[in] command Pointer to the TestCommand structure containing test parameters.
+ * @param[in] pattern Data pattern of the command; must stay valid until the job completes.
+ * @return uint8_t Returns TEST_IN_PROGRESS if at least one test is running, otherwise the final status.
+ */
+static uint8_t job_begin(const TestCommand* command, const uint8_t* pattern) {
+    const TestDriver* driver;
+    uint8_t bit;
+
+    printf("Executing test for Peripheral: %u, Test-ID: %u\r\n",
+           (unsigned int)command->peripheral,
+           (unsigned int)command->test_id);
+
+    memset(job_lane_results, 0, sizeof(job_lane_results));
+    job_active_lanes = 0;
+
+    if (command->peripheral == 0 || (command->peripheral & ~TEST_PERIPHERAL_ALL) != 0) {
+        printf("Invalid peripheral for testing: %d\r\n", command->peripheral);
+        return TEST_FAILURE;
+    }
+
+    for (bit = 0; bit < TEST_PERIPHERAL_COUNT; bit++) {
+        if (!(command->peripheral & (1U << bit))) {
+            continue;
+        }
+        driver = TestDriver_Find(1U << bit);
+        if ((command->options & PROTOCOL_OPTION_RESCAN) && driver->rescan != NULL) {
+            driver->rescan();
+        }
+        if (command->options & PROTOCOL_OPTION_SWEEP) {
+            driver = driver->sweep;
+            if (driver == NULL) {
+                printf("Peripheral %u has no sweep mode\r\n", 1U << bit);
+                job_lane_results[bit] = TEST_FAILURE;
+                continue;
+            }
+        }
+        if (TestRun_Begin(&job_lanes[bit], driver, pattern,
+                          command->pattern_length, command->iterations) == TEST_IN_PROGRESS) {
+            job_active_lanes |= (1U << bit);
+        } else {
+            job_lane_results[bit] = TEST_FAILURE;
+        }
+    }
+    return job_active_lanes ? TEST_IN_PROGRESS : TEST_FAILURE;
+}
+
+/**
+ * @brief Advance every running test of the current job by one step.
+ *
+ * @return uint8_t Returns TEST_IN_PROGRESS while a test is running, otherwise the combined status.
+ */
+static uint8_t job_step(void) {
+    uint8_t bit;
+    uint8_t status;
+
+    for (bit = 0; bit < TEST_PERIPHERAL_COUNT; bit++) {
+        if (!(job_active_lanes & (1U << bit))) {
+            continue;
+        }
+        if (job_preempting && job_lanes[bit].stage == TEST_STAGE_RUN && !job_lanes[bit].armed) {
+            // Hold the lane at its iteration boundary until the job is suspended
+            continue;
+        }
+        status = TestRun_Poll(&job_lanes[bit]);
+        if (job_lanes[bit].record_ready) {
+            job_lanes[bit].record_ready = 0;
+            if (job_streaming) {
+                Telemetry_Record(1U << bit, &job_lanes[bit].record);
+            }
+        }
+        if (status != TEST_IN_PROGRESS) {
+            job_lane_results[bit] = status;
+            job_active_lanes &= ~(1U << bit);
+        }
+    }
+    if (job_active_lanes) {
+        return TEST_IN_PROGRESS;
+    }
+    for (bit = 0; bit < TEST_PERIPHERAL_COUNT; bit++) {
+        if (job_lane_results[bit] == TEST_FAILURE) {
+            return TEST_FAILURE;
+        }
+    }
+    return TEST_SUCCESS;
+}
+
+/**
+ * @brief Encode the summary TLV of a streamed job.
+ *
+ * @param[out] buf Buffer receiving the TLV.
+ * @param[in] counters Pointer to the totals of the stream.
+ * @return uint16_t Number of bytes written.
+ */
+static uint16_t job_encode_summary(uint8_t* buf, const TelemetryCounters* counters) {
+    uint16_t length = PROTOCOL_TLV_HEADER_SIZE;
+    uint8_t bit;
+
+    Codec_PutLe32(&buf[length], counters->datagrams);
+    Codec_PutLe32(&buf[length + 4], counters->records);
+    Codec_PutLe32(&buf[length + 8], counters->dropped);
+    length += PROTOCOL_SUMMARY_SIZE;
+
+    for (bit = 0; bit < TEST_PERIPHERAL_COUNT; bit++) {
+        if (job_lane_results[bit] == 0) {
+            continue;
+        }
+        Codec_PutLe32(&buf[length], job_lanes[bit].iteration);
+        Codec_PutLe32(&buf[length + 4], job_lanes[bit].errors);
+        length += PROTOCOL_SUMMARY_PERIPHERAL_SIZE;
+    }
+
+    buf[0] = PROTOCOL_TLV_SUMMARY;
+    Codec_PutLe16(&buf[1], length - PROTOCOL_TLV_HEADER_SIZE);
+    return length;
+}
+
+/**
+ * @brief Encode the timing TLV of the finished job.
+ *
+ * Reports the cycle-counter statistics of every tested peripheral, and the
+ * throughput derived from them and the core clock.
+ *
+ * @param[out] buf Buffer receiving the TLV.
+ * @return uint16_t Number of bytes written.
+ */
+static uint16_t job_encode_timing(uint8_t* buf) {
+    const TestTiming* timing;
+    uint16_t length = PROTOCOL_TLV_HEADER_SIZE;
+    uint32_t mean;
+    uint32_t throughput;
+    uint8_t bit;
+
+    Codec_PutLe32(&buf[length], SystemCoreClock);
+    length += PROTOCOL_TIMING_SIZE;
+
+    for (bit = 0; bit < TEST_PERIPHERAL_COUNT; bit++) {
+        if (job_lane_results[bit] == 0) {
+            continue;
+        }
+        timing = &job_lanes[bit].timing;
+        mean = 0;
+        throughput = 0;
+        if (timing->count > 0) {
+            mean = (uint32_t)(timing->total_cycles / timing->count);
+        }
+        if (timing->total_cycles > 0) {
+            throughput = (uint32_t)(((uint64_t)timing->bytes * SystemCoreClock) / timing->total_cycles);
+        }
+        Codec_PutLe32(&buf[length], timing->count);
+        Codec_PutLe32(&buf[length + 4], timing->min_cycles);
+        Codec_PutLe32(&buf[length + 8], timing->max_cycles);
+        Codec_PutLe32(&buf[length + 12], mean);
+        Codec_PutLe64(&buf[length + 16], timing->total_cycles);
+        Codec_PutLe32(&buf[length + 24], timing->bytes);
+        Codec_PutLe32(&buf[length + 28], throughput);
+        length += PROTOCOL_TIMING_PERIPHERAL_SIZE;
+    }
+
+    buf[0] = PROTOCOL_TLV_TIMING;
+    Codec_PutLe16(&buf[1], length - PROTOCOL_TLV_HEADER_SIZE);
+    return length;
+}
+
+/**
+ * @brief Size of the sweep TLV of the current job.
+ *
+ * @return uint16_t Size of the TLV, 0 if no peripheral was swept.
+ */
+static uint16_t job_sweep_length(void) {
+    uint16_t length = 0;
+    uint8_t bit;
+
+    for (bit = 0; bit < TEST_PERIPHERAL_COUNT; bit++) {
+        if (job_lane_results[bit] != 0 && job_lanes[bit].sweep != NULL) {
+            length += PROTOCOL_SWEEP_SIZE + job_lanes[bit].sweep->count * PROTOCOL_SWEEP_STEP_SIZE;
+        }
+    }
+    return (length > 0) ? PROTOCOL_TLV_HEADER_SIZE + length : 0;
+}
+
+/**
+ * @brief Encode the sweep TLV of the current job: the step table of every swept peripheral.
+ *
+ * @param[out] buf Buffer receiving the TLV.
+ * @return uint16_t Number of bytes written, 0 if no peripheral was swept.
+ */
+static uint16_t job_encode_sweep(uint8_t* buf) {
+    const TestSweepStep* step;
+    const TestSweep* sweep;
+    uint16_t length = PROTOCOL_TLV_HEADER_SIZE;
+    uint32_t throughput;
+    uint8_t bit;
+    uint8_t i;
+    uint8_t j;
+
+    for (bit = 0; bit < TEST_PERIPHERAL_COUNT; bit++) {
+        sweep = job_lanes[bit].sweep;
+        if (job_lane_results[bit] == 0 || sweep == NULL) {
+            continue;
+        }
+        buf[length] = bit;
+        buf[length + 1] = sweep->count;
+        length += PROTOCOL_SWEEP_SIZE;
+        for (i = 0; i < sweep->count; i++) {
+            step = &sweep->steps[i];
+            throughput = 0;
+            if (step->cycles > 0) {
+                throughput = (uint32_t)(((uint64_t)step->bytes * SystemCoreClock) / step->cycles);
+            }
+            Codec_PutLe32(&buf[length], step->rate);
+            buf[length + 4] = step->mode;
+            Codec_PutLe32(&buf[length + 5], step->transfers);
+            Codec_PutLe32(&buf[length + 9], step->bytes);
+            Codec_PutLe32(&buf[length + 13], step->bit_errors);
+            Codec_PutLe32(&buf[length + 17], throughput);
+            for (j = 0; j < PROTOCOL_SWEEP_ERROR_COUNT; j++) {
+                Codec_PutLe16(&buf[length + 21 + 2 * j], step->errors[j]);
+            }
+            length += PROTOCOL_SWEEP_STEP_SIZE;
+        }
+    }
+    if (length == PROTOCOL_TLV_HEADER_SIZE) {
+        return 0;
+    }
+
+    buf[0] = PROTOCOL_TLV_SWEEP;
+    Codec_PutLe16(&buf[1], length - PROTOCOL_TLV_HEADER_SIZE);
+    return length;
+}
+
+/**
+ * @brief Encode the schedule TLV of a finished job.
+ *
+ * @param[out] buf Buffer receiving the TLV.
+ * @param[in] job Pointer to the finished job.
+ * @return uint16_t Number of bytes written.
+ */
+static uint16_t job_encode_schedule(uint8_t* buf, const TestJob* job) {
+    buf[0] = PROTOCOL_TLV_SCHEDULE;
+    Codec_PutLe16(&buf[1], PROTOCOL_SCHEDULE_SIZE);
+    Codec_PutLe32(&buf[3], job->wait);
+    Codec_PutLe32(&buf[7], HAL_GetTick() - job->started);
+    Codec_PutLe32(&buf[11], job->preempted);
+    return PROTOCOL_TLV_HEADER_SIZE + PROTOCOL_SCHEDULE_SIZE;
+}
+
+/**
+ * @brief Start the next command of the current job.
+ *
+ * For a batch job the next request is decoded out of the datagram first;
+ * the batch reply header is written before its first request. A plan job
+ * takes its next step, and the step's pattern, from the plan store. The pattern
+ * is used in place, unless it spans two pbufs of a chain, in which case it
+ * is gathered into job_pattern_scratch.
+ *
+ * @param[in,out] job Pointer to the job to start.
+ * @return uint8_t Returns TEST_IN_PROGRESS if at least one test is running, otherwise the final status.
+ */
+static uint8_t job_start(TestJob* job) {
+    const uint8_t* pattern = NULL;
+
+    if (job->plan) {
+        job->state = JOB_STATE_RUNNING;
+        return job_begin(&job->command, Plan_Step(&job->cursor, &job->command));
+    }
+    if (job->batch) {
+        if (job->state == JOB_STATE_QUEUED) {
+            job_batch_reply_length = Codec_EncodeHeader(job_batch_reply,
+                                                        PROTOCOL_OPCODE_BATCH | PROTOCOL_OPCODE_REPLY, 0);
+            job_batch_reply[job_batch_reply_length++] = 0;
+        }
+        job->batch_offset = Codec_DecodeTest(job->packet, job->batch_offset, &job->command);
+        job->batch_remaining--;
+    } else if (job->flags & PROTOCOL_FLAG_STREAM) {
+        Telemetry_Begin(&job->command, job->flags, job->pcb, &job->addr, job->port);
+        job_streaming = 1;
+    }
+    if (job->command.pattern_length > 0) {
+        pattern = Codec_GetPattern(job->packet, &job->command, job_pattern_scratch);
+    }
+    job->state = JOB_STATE_RUNNING;
+    return job_begin(&job->command, pattern);
+}
+
+/**
+ * @brief Release a job slot, its datagram and its place in the client's session.
+ *
+ * @param[in] job Pointer to the job to release.
+ */
+static void job_release(TestJob* job) {
+    Session* session;
+
+    if (job->packet != NULL) {
+        pbuf_free(job->packet);
+        job->packet = NULL;
+        job_packets--;
+    }
+    if (job->plan) {
+        Plan_Release(&job->cursor);
+        job->plan = 0;
+    }
+
+    session = Session_Get(job->session);
+    session->jobs--;
+    if (session->jobs == 0) {
+        // An idle client does not keep credit for later
+        session->deficit = 0;
+    }
+    job->state = JOB_STATE_FREE;
+    job_count--;
+}
+
+/**
+ * @brief Send the done report of a plan job, which is also cached for retries of its PLAN_RUN.
+ *
+ * @param[in] job Pointer to the plan job.
+ * @param[in] status PROTOCOL_PLAN_* status.
+ */
+static void job_plan_done(const TestJob* job, uint8_t status) {
+    struct pbuf* reply;
+    uint16_t length = PROTOCOL_HEADER_SIZE + PROTOCOL_PLAN_DONE_SIZE;
+    uint8_t* buf;
+
+    printf("Plan run %u ended with status %u after %u step runs\r\n", (unsigned int)job->command.test_id, status,
+           job->cursor.executed);
+    reply = ResponsePool_Alloc(length);
+    if (reply == NULL) {
+        ReplyCache_Cancel(&job->addr, job->port, job->command.test_id);
+        return;
+    }
+    buf = reply->payload;
+    buf += Codec_EncodeHeader(buf, PROTOCOL_OPCODE_PLAN_RUN | PROTOCOL_OPCODE_REPLY, 0);
+    Codec_PutLe32(&buf[0], job->command.test_id);
+    buf[4] = PROTOCOL_PLAN_REPORT_DONE;
+    buf[5] = status;
+    Codec_PutLe16(&buf[6], job->cursor.executed);
+    Codec_PutLe16(&buf[8], job->cursor.passed);
+    Codec_PutLe16(&buf[10], job->cursor.failed);
+    Codec_PutLe32(&buf[12], (job->state == JOB_STATE_QUEUED) ? 0 : HAL_GetTick() - job->started);
+    ReplyCache_Complete(&job->addr, job->port, job->command.test_id, reply->payload, length);
+    History_Add(&job->addr, job->command.test_id, reply->payload, length);
+    send_response(job->pcb, reply, &job->addr, job->port);
+}
+
+/**
+ * @brief Report one finished run of a plan step and move the plan on.
+ *
+ * @param[in,out] job Pointer to the plan job.
+ * @param[in] result Pointer to the result of the step.
+ * @param[in] tested Number of peripherals tested by the step.
+ * @return uint8_t Returns 1 if a step remains to be run, 0 if the plan has ended.
+ */
+static uint8_t job_plan_step(TestJob* job, const TestResult* result, uint8_t tested) {
+    struct pbuf* reply;
+    uint16_t length = PROTOCOL_HEADER_SIZE + PROTOCOL_PLAN_STEP_REPORT_SIZE + PROTOCOL_RESULT_SIZE +
+                      PROTOCOL_TLV_HEADER_SIZE + PROTOCOL_TIMING_SIZE + tested * PROTOCOL_TIMING_PERIPHERAL_SIZE;
+    uint8_t* buf;
+
+    reply = ResponsePool_Alloc(length);
+    if (reply != NULL) {
+        buf = reply->payload;
+        buf += Codec_EncodeHeader(buf, PROTOCOL_OPCODE_PLAN_RUN | PROTOCOL_OPCODE_REPLY, 0);
+        Codec_PutLe32(&buf[0], job->command.test_id);
+        buf[4] = PROTOCOL_PLAN_REPORT_STEP;
+        buf[5] = job->cursor.step;
+        Codec_PutLe16(&buf[6], job->cursor.run);
+        buf += PROTOCOL_PLAN_STEP_REPORT_SIZE;
+        buf += Codec_EncodeResult(buf, result);
+        job_encode_timing(buf);
+        send_response(job->pcb, reply, &job->addr, job->port);
+    }
+    return Plan_Advance(&job->cursor, result->result == TEST_SUCCESS);
+}
+
+/**
+ * @brief Record the result of a finished command and release the job once it is done.
+ *
+ * A single command is answered right away. A batch command appends its
+ * packed result to the batch reply, which is sent after the last command.
+ * A plan step is reported right away; the plan's done report follows its
+ * last step.
+ *
+ * @param[in] job Pointer to the job whose command finished.
+ * @param[in] status Final test status (TEST_SUCCESS, TEST_FAILURE or TEST_CANCELLED).
+ */
+static void job_complete(TestJob* job, uint8_t status) {
+    TestResult result;
+    TelemetryCounters counters;
+    uint8_t streamed = job_streaming;
+    uint8_t tested = 0;
+    uint16_t length;
+    struct pbuf* reply;
+    uint8_t* buf;
+    uint8_t bit;
+
+    result.test_id = job->command.test_id;
+    result.result = status;
+    result.peripheral = job->command.peripheral;
+    memcpy(result.peripheral_results, job_lane_results, sizeof(result.peripheral_results));
+
+    for (bit = 0; bit < TEST_PERIPHERAL_COUNT; bit++) {
+        tested += (job_lane_results[bit] != 0);
+    }
+
+    if (job->plan) {
+        if (status == TEST_CANCELLED) {
+            job_plan_done(job, PROTOCOL_PLAN_CANCELLED);
+        } else if (job_plan_step(job, &result, tested)) {
+            return;
+        } else {
+            job_plan_done(job, job->cursor.stopped ? PROTOCOL_PLAN_STOPPED : PROTOCOL_PLAN_COMPLETED);
+        }
+    } else if (!job->batch) {
+        // The last telemetry datagram goes out before the final result
+        if (streamed) {
+            Telemetry_End(&counters);
+            job_streaming = 0;
+        }
+
+        length = PROTOCOL_HEADER_SIZE + PROTOCOL_RESULT_SIZE +
+                 PROTOCOL_TLV_HEADER_SIZE + PROTOCOL_TIMING_SIZE + tested * PROTOCOL_TIMING_PERIPHERAL_SIZE +
+                 PROTOCOL_TLV_HEADER_SIZE + PROTOCOL_SCHEDULE_SIZE + job_sweep_length();
+        if (streamed) {
+            length += PROTOCOL_TLV_HEADER_SIZE + PROTOCOL_SUMMARY_SIZE + tested * PROTOCOL_SUMMARY_PERIPHERAL_SIZE;
+        }
+
+        // Encode straight into a preallocated response buffer
+        reply = ResponsePool_Alloc(length);
+        if (reply != NULL) {
+            buf = reply->payload;
+            buf += Codec_EncodeHeader(buf, PROTOCOL_OPCODE_TEST | PROTOCOL_OPCODE_REPLY, 0);
+            buf += Codec_EncodeResult(buf, &result);
+            buf += job_encode_timing(buf);
+            buf += job_encode_schedule(buf, job);
+            buf += job_encode_sweep(buf);
+            if (streamed) {
+                job_encode_summary(buf, &counters);
+            }
+            ReplyCache_Complete(&job->addr, job->port, result.test_id, reply->payload, length);
+            History_Add(&job->addr, result.test_id, reply->payload, length);
+            send_response(job->pcb, reply, &job->addr, job->port);
+        } else {
+            // No reply was produced, let a retry run the test again
+            ReplyCache_Cancel(&job->addr, job->port, result.test_id);
+        }
+    } else {
+        job_batch_reply_length += Codec_EncodeResult(&job_batch_reply[job_batch_reply_length], &result);
+        job_batch_reply[PROTOCOL_HEADER_SIZE]++;
+
+        if (job->batch_remaining > 0) {
+            return;
+        }
+        send_packet(job->pcb, job_batch_reply, job_batch_reply_length, &job->addr, job->port);
+    }
+
+    job_release(job);
+    job_running = NULL;
+    job_preempting = 0;
+}
+
+/**
+ * @brief Stop the running tests of the current job.
+ *
+ * Every test still running is aborted and marked TEST_CANCELLED; tests
+ * that already finished keep their result.
+ */
+static void job_abort_lanes(void) {
+    uint8_t bit;
+
+    for (bit = 0; bit < TEST_PERIPHERAL_COUNT; bit++) {
+        if (job_active_lanes & (1U << bit)) {
+            TestRun_Abort(&job_lanes[bit]);
+            job_lane_results[bit] = TEST_CANCELLED;
+        }
+    }
+    job_active_lanes = 0;
+}
+
+/**
+ * @brief Answer a test that was cancelled before it started.
+ *
+ * @param[in] job Pointer to the queued job.
+ */
+static void job_reply_cancelled(const TestJob* job) {
+    TestResult result;
+    struct pbuf* reply;
+    uint16_t length = PROTOCOL_HEADER_SIZE + PROTOCOL_RESULT_SIZE;
+
+    memset(&result, 0, sizeof(result));
+    result.test_id = job->command.test_id;
+    result.result = TEST_CANCELLED;
+    result.peripheral = job->command.peripheral;
+
+    reply = ResponsePool_Alloc(length);
+    if (reply == NULL) {
+        ReplyCache_Cancel(&job->addr, job->port, result.test_id);
+        return;
+    }
+    Codec_EncodeHeader(reply->payload, PROTOCOL_OPCODE_TEST | PROTOCOL_OPCODE_REPLY, 0);
+    Codec_EncodeResult((uint8_t*)reply->payload + PROTOCOL_HEADER_SIZE, &result);
+    ReplyCache_Complete(&job->addr, job->port, result.test_id, reply->payload, length);
+    History_Add(&job->addr, result.test_id, reply->payload, length);
+    send_response(job->pcb, reply, &job->addr, job->port);
+}
+
+/**
+ * @brief Check whether a queued job may run now.
+ *
+ * With no job suspended or running, any queued job may run. Otherwise only
+ * an urgent job of a higher class than the given one may, provided that it
+ * leaves the peripherals and the telemetry stream of that job alone.
+ *
+ * @param[in] job Pointer to the queued job.
+ * @param[in] over Pointer to the job it would preempt, or NULL.
+ * @return uint8_t Returns 1 if the job may run.
+ */
+static uint8_t job_eligible(const TestJob* job, const TestJob* over) {
+    if (job->state != JOB_STATE_QUEUED) {
+        return 0;
+    }
+    if (over == NULL) {
+        return 1;
+    }
+    return job->priority == PROTOCOL_PRIORITY_URGENT && job->priority > over->priority &&
+           (job->command.peripheral & over->command.peripheral) == 0 &&
+           (job->flags & over->flags & PROTOCOL_FLAG_STREAM) == 0;
+}
+
+/**
+ * @brief Take a free job slot for a client.
+ *
+ * @param[in] addr Pointer to the client IP address.
+ * @param[in] port Client UDP port.
+ * @param[in] packet Set if the job will hold a reference on a received datagram.
+ * @return TestJob* Pointer to the slot, with its client fields set, or NULL if the job cannot be queued.
+ */
+static TestJob* job_alloc(const ip_addr_t* addr, u16_t port, uint8_t packet) {
+    TestJob* job;
+    Session* session;
+    uint8_t index;
+    uint8_t i;
+
+    index = Session_Open(addr, port);
+    if (index == SESSION_NONE) {
+        return NULL;
+    }
+    session = Session_Get(index);
+    if (job_count >= JOB_QUEUE_DEPTH || session->jobs >= SESSION_MAX_JOBS ||
+        (packet && job_packets >= JOB_QUEUE_MAX_PACKETS)) {
+        session->rejected++;
+        return NULL;
+    }
+
+    for (i = 0; i < JOB_QUEUE_DEPTH; i++) {
+        if (job_queue[i].state == JOB_STATE_FREE) {
+            break;
+        }
+    }
+    job = &job_queue[i];
+    ip_addr_copy(job->addr, *addr);
+    job->port = port;
+    job->session = index;
+    job->enqueued = HAL_GetTick();
+    job->sequence = job_sequence++;
+    job->cancel = 0;
+    job->state = JOB_STATE_QUEUED;
+    session->jobs++;
+    job_count++;
+    return job;
+}
+
+/**
+ * @brief Check whether a queued job may preempt the running one.
+ *
+ * @param[in] running Pointer to the running job.
+ * @return uint8_t Returns 1 if an eligible urgent job is queued.
+ */
+static uint8_t job_urgent_waiting(const TestJob* running) {
+    uint8_t i;
+
+    for (i = 0; i < JOB_QUEUE_DEPTH; i++) {
+        if (job_eligible(&job_queue[i], running)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Pick the next job to run by deficit round robin over the sessions.
+ *
+ * Only the eligible jobs of the highest priority class queued compete. The
+ * candidate of each session is its oldest one of them. Visiting the
+ * sessions from job_round_robin on, the first one whose deficit covers its
+ * candidate's cost runs it. If none does, every waiting session is credited
+ * the number of SESSION_QUANTUM rounds the closest one still needs, which
+ * is the same as running those rounds without starting anything.
+ *
+ * @param[in] over Pointer to the suspended or running job, or NULL (see job_eligible()).
+ * @return TestJob* Pointer to the job to start, or NULL if no job may run.
+ */
+static TestJob* job_schedule(const TestJob* over) {
+    TestJob* heads[SESSION_TABLE_SIZE] = { NULL };
+    TestJob* job;
+    Session* session;
+    uint64_t rounds;
+    uint64_t min_rounds = UINT64_MAX;
+    uint8_t priority = 0;
+    uint8_t index;
+    uint8_t i;
+
+    for (i = 0; i < JOB_QUEUE_DEPTH; i++) {
+        if (job_eligible(&job_queue[i], over) && job_queue[i].priority > priority) {
+            priority = job_queue[i].priority;
+        }
+    }
+    for (i = 0; i < JOB_QUEUE_DEPTH; i++) {
+        job = &job_queue[i];
+        if (job_eligible(job, over) && job->priority == priority &&
+            (heads[job->session] == NULL || (int32_t)(job->sequence - heads[job->session]->sequence) < 0)) {
+            heads[job->session] = job;
+        }
+    }
+
+    for (i = 0; i < SESSION_TABLE_SIZE; i++) {
+        index = (job_round_robin + i) % SESSION_TABLE_SIZE;
+        if (heads[index] == NULL) {
+            continue;
+        }
+        session = Session_Get(index);
+        if (heads[index]->cost <= session->deficit) {
+            min_rounds = 0;
+            break;
+        }
+        rounds = (heads[index]->cost - session->deficit + SESSION_QUANTUM - 1) / SESSION_QUANTUM;
+        if (rounds < min_rounds) {
+            min_rounds = rounds;
+        }
+    }
+    if (min_rounds == UINT64_MAX) {
+        return NULL;
+    }
+
+    for (i = 0; i < SESSION_TABLE_SIZE; i++) {
+        if (heads[i] != NULL) {
+            Session_Get(i)->deficit += min_rounds * SESSION_QUANTUM;
+        }
+    }
+    for (i = 0; i < SESSION_TABLE_SIZE; i++) {
+        index = (job_round_robin + i) % SESSION_TABLE_SIZE;
+        session = Session_Get(index);
+        if (heads[index] != NULL && heads[index]->cost <= session->deficit) {
+            session->deficit -= heads[index]->cost;
+            job_round_robin = (index + 1) % SESSION_TABLE_SIZE;
+            return heads[index];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Suspend the running job, whose tests are all at an iteration boundary.
+ *
+ * @param[in] job Pointer to the running job.
+ */
+static void job_suspend(TestJob* job) {
+    printf("Suspending Test-ID %u for an urgent test\r\n", (unsigned int)job->command.test_id);
+
+    job_saved.active_lanes = job_active_lanes;
+    memcpy(job_saved.lane_results, job_lane_results, sizeof(job_lane_results));
+    job_saved.streaming = job_streaming;
+    job_active_lanes = 0;
+    job_streaming = 0;
+    job_preempting = 0;
+
+    job->state = JOB_STATE_SUSPENDED;
+    job->suspended = HAL_GetTick();
+    job_suspended = job;
+    job_running = NULL;
+}
+
+/**
+ * @brief Resume the suspended job where it stopped.
+ */
+static void job_resume(void) {
+    TestJob* job = job_suspended;
+
+    printf("Resuming Test-ID %u\r\n", (unsigned int)job->command.test_id);
+
+    job_active_lanes = job_saved.active_lanes;
+    memcpy(job_lane_results, job_saved.lane_results, sizeof(job_lane_results));
+    job_streaming = job_saved.streaming;
+    job_saved.streaming = 0;
+
+    job->preempted += HAL_GetTick() - job->suspended;
+    job->state = JOB_STATE_RUNNING;
+    job_suspended = NULL;
+    job_running = job;
+}
+
+/**
+ * @brief Check whether no iteration of the running job is in flight.
+ *
+ * A test still in its setup or finish is not at a boundary: both run to
+ * their end first.
+ *
+ * @return uint8_t Returns 1 if every running test is between two iterations.
+ */
+static uint8_t job_at_boundary(void) {
+    uint8_t bit;
+
+    for (bit = 0; bit < TEST_PERIPHERAL_COUNT; bit++) {
+        if ((job_active_lanes & (1U << bit)) && (job_lanes[bit].armed || job_lanes[bit].stage != TEST_STAGE_RUN)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+uint8_t JobQueue_Push(const TestCommand* command, uint8_t flags, struct pbuf* p, struct udp_pcb* pcb,
+                      const ip_addr_t* addr, u16_t port) {
+    TestJob* job;
+
+    job = job_alloc(addr, port, command->pattern_length > 0);
+    if (job == NULL) {
+        return 0;
+    }
+
+    memcpy(&job->command, command, sizeof(TestCommand));
+    job->packet = NULL;
+    job->plan = 0;
+    if (command->pattern_length > 0) {
+        // Keep the datagram alive as the pattern's backing store
+        pbuf_ref(p);
+        job->packet = p;
+        job_packets++;
+    }
+    job->batch = 0;
+    job->flags = flags;
+    job->pcb = pcb;
+    job->cost = (command->iterations > 0) ? command->iterations : 1;
+    job->priority = command->options & PROTOCOL_OPTION_PRIORITY_MASK;
+    if (job->priority > PROTOCOL_PRIORITY_URGENT) {
+        job->priority = PROTOCOL_PRIORITY_URGENT;
+    }
+    return 1;
+}
+
+uint8_t JobQueue_PushBatch(struct pbuf* p, uint8_t count, uint32_t cost, struct udp_pcb* pcb,
+                           const ip_addr_t* addr, u16_t port) {
+    TestJob* job;
+
+    job = job_alloc(addr, port, 1);
+    if (job == NULL) {
+        return 0;
+    }
+
+    pbuf_ref(p);
+    job->packet = p;
+    job->plan = 0;
+    job->batch = 1;
+    job->flags = 0;
+    job->batch_offset = PROTOCOL_HEADER_SIZE + 1;
+    job->batch_remaining = count;
+    job->pcb = pcb;
+    job->cost = (cost > 0) ? cost : 1;
+    job->priority = PROTOCOL_PRIORITY_NORMAL;
+    job_packets++;
+    return 1;
+}
+
+uint8_t JobQueue_PushPlan(uint8_t slot, uint32_t run_id, struct udp_pcb* pcb, const ip_addr_t* addr, u16_t port) {
+    TestJob* job;
+
+    job = job_alloc(addr, port, 0);
+    if (job == NULL) {
+        return 0;
+    }
+
+    // Until its first step starts, the job stands for every peripheral of the plan
+    memset(&job->command, 0, sizeof(TestCommand));
+    job->command.test_id = run_id;
+    job->command.peripheral = Plan_Get(slot)->peripherals;
+    job->packet = NULL;
+    job->batch = 0;
+    job->plan = 1;
+    Plan_Begin(&job->cursor, slot);
+    job->flags = 0;
+    job->pcb = pcb;
+    job->cost = Plan_Get(slot)->cost;
+    job->priority = PROTOCOL_PRIORITY_NORMAL;
+    return 1;
+}
+
+void JobQueue_Poll(void) {
+    TestJob* job;
+    uint8_t status;
+
+    if (job_running == NULL) {
+        // Urgent jobs run first, then the suspended job resumes
+        job = job_schedule(job_suspended);
+        if (job != NULL) {
+            job->started = HAL_GetTick();
+            job->wait = job->started - job->enqueued;
+            job->preempted = 0;
+            Session_RecordWait(job->session, job->wait);
+            job_running = job;
+        } else if (job_suspended != NULL) {
+            job_resume();
+        } else {
+            return;
+        }
+    }
+
+    job = job_running;
+    if (job_streaming || job_saved.streaming) {
+        Telemetry_Poll();
+    }
+
+    if (job->cancel) {
+        printf("Cancelling Test-ID %u\r\n", (unsigned int)job->command.test_id);
+        job_abort_lanes();
+        job_complete(job, TEST_CANCELLED);
+        return;
+    }
+
+    // An urgent job waiting on other peripherals preempts at the next iteration boundary
+    if (job->state == JOB_STATE_RUNNING && job_suspended == NULL && !job_preempting) {
+        job_preempting = job_urgent_waiting(job);
+    }
+    if (job_preempting && job_at_boundary()) {
+        job_suspend(job);
+        return;
+    }
+
+    if (job->plan && job->state == JOB_STATE_RUNNING && job_active_lanes == 0 &&
+        (int32_t)(HAL_GetTick() - job->cursor.resume) < 0) {
+        // Delay between two steps of a plan
+        return;
+    }
+    if (job->state == JOB_STATE_QUEUED || job_active_lanes == 0) {
+        status = job_start(job);
+    } else {
+        status = job_step();
+    }
+
+    if (status != TEST_IN_PROGRESS) {
+        job_complete(job, status);
+    }
+}
+
+uint8_t JobQueue_Cancel(uint32_t test_id, const ip_addr_t* addr, uint32_t* completed) {
+    TestJob* job = NULL;
+    uint8_t bit;
+    uint8_t i;
+
+    for (i = 0; i < JOB_QUEUE_DEPTH; i++) {
+        if (job_queue[i].state != JOB_STATE_FREE && !job_queue[i].batch && !job_queue[i].cancel &&
+            job_queue[i].command.test_id == test_id && ip_addr_cmp(&job_queue[i].addr, addr)) {
+            job = &job_queue[i];
+            break;
+        }
+    }
+    *completed = 0;
+    if (job == NULL) {
+        return PROTOCOL_CANCEL_NOT_FOUND;
+    }
+
+    if (job->state == JOB_STATE_QUEUED) {
+        if (job->plan) {
+            job_plan_done(job, PROTOCOL_PLAN_CANCELLED);
+        } else {
+            job_reply_cancelled(job);
+        }
+        job_release(job);
+        return PROTOCOL_CANCEL_DEQUEUED;
+    }
+
+    // Iterations only complete in JobQueue_Poll(), so this count is final
+    *completed = UINT32_MAX;
+    for (bit = 0; bit < TEST_PERIPHERAL_COUNT; bit++) {
+        if ((job->command.peripheral & (1U << bit)) && job_lanes[bit].iteration < *completed) {
+            *completed = job_lanes[bit].iteration;
+        }
+    }
+    if (*completed == UINT32_MAX) {
+        *completed = 0;
+    }
+    job->cancel = 1;
+    return PROTOCOL_CANCEL_STOPPED;
+}
+
+uint8_t JobQueue_Depth(void) {
+    return job_count;
+}
+
+uint16_t JobQueue_EncodeStats(uint8_t* buf) {
+    const Session* session;
+    const TestJob* job;
+    uint32_t now = HAL_GetTick();
+    uint32_t oldest_wait;
+    uint16_t length = 2;
+    uint8_t index;
+    uint8_t i;
+
+    buf[0] = job_count;
+    buf[1] = 0;
+    for (index = 0; index < SESSION_TABLE_SIZE; index++) {
+        session = Session_Get(index);
+        if (!session->used) {
+            continue;
+        }
+
+        oldest_wait = 0;
+        for (i = 0; i < JOB_QUEUE_DEPTH; i++) {
+            job = &job_queue[i];
+            if (job->state == JOB_STATE_QUEUED && job->session == index && now - job->enqueued > oldest_wait) {
+                oldest_wait = now - job->enqueued;
+            }
+        }
+
+        Codec_PutLe32(&buf[length], ip4_addr_get_u32(ip_2_ip4(&session->addr)));
+        Codec_PutLe16(&buf[length + 4], session->port);
+        buf[length + 6] = session->jobs;
+        buf[length + 7] = (job_running != NULL && job_running->session == index);
+        Codec_PutLe32(&buf[length + 8], session->started);
+        Codec_PutLe32(&buf[length + 12], session->rejected);
+        Codec_PutLe32(&buf[length + 16], session->started ? session->total_wait / session->started : 0);
+        Codec_PutLe32(&buf[length + 20], session->max_wait);
+        Codec_PutLe32(&buf[length + 24], oldest_wait);
+        length += PROTOCOL_SESSION_STATS_SIZE;
+        buf[1]++;
+    }
+    return length;
+}
@@ -0,0 +1,177 @@
+/**
+ * @file Plan.c
+ * @brief Implementation of the board-resident test plan store.
+ *
+ * This file validates uploaded plans into a staging buffer, so that a
+ * rejected upload leaves the stored plan untouched, then copies them into
+ * a store entry. Steps keep their wire layout:
+ * peripheral (u8) | flags (u8) | repeat (u16) | iterations (u32) |
+ * delay ms (u16) | pattern length (u16) | pattern.
+ *
+ * @note The store is only used from the UDP receive callback and the main
+ * loop (lwIP runs with NO_SYS=1), so it needs no locking.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#include "Plan.h"
+#include "Codec.h"
+
+/** @brief The stored plans. */
+static Plan plan_store[PLAN_STORE_SIZE];
+
+/** @brief Upload being validated. */
+static uint8_t plan_staging[PLAN_MAX_SIZE];
+
+/**
+ * @brief Number of runs of a step (a repeat count of 0 runs it once).
+ *
+ * @param[in] step Pointer to the encoded step.
+ * @return uint16_t Number of runs.
+ */
+static uint16_t plan_runs(const uint8_t* step) {
+    uint16_t repeat = Codec_GetLe16(&step[2]);
+
+    return (repeat > 0) ? repeat : 1;
+}
+
+uint8_t Plan_Store(const struct pbuf* p, uint16_t offset, uint8_t* slot) {
+    Plan* plan;
+    uint8_t body[PROTOCOL_PLAN_UPLOAD_SIZE];
+    uint8_t peripherals = 0;
+    uint32_t cost = 0;
+    uint32_t iterations;
+    uint32_t size;
+    uint16_t position = 0;
+    uint16_t pattern_length;
+    uint8_t id;
+    uint8_t steps;
+    uint8_t i;
+
+    if (pbuf_copy_partial(p, body, sizeof(body), offset) != sizeof(body)) {
+        return PROTOCOL_ERROR_LENGTH;
+    }
+    id = body[0];
+    steps = body[1];
+    size = p->tot_len - offset - PROTOCOL_PLAN_UPLOAD_SIZE;
+    if (steps > PLAN_MAX_STEPS || size > PLAN_MAX_SIZE) {
+        return PROTOCOL_ERROR_LENGTH;
+    }
+    pbuf_copy_partial(p, plan_staging, (u16_t)size, offset + PROTOCOL_PLAN_UPLOAD_SIZE);
+
+    // Every step must be well formed and the steps must fill the datagram exactly
+    for (i = 0; i < steps; i++) {
+        if (position + PROTOCOL_PLAN_STEP_SIZE > size) {
+            return PROTOCOL_ERROR_LENGTH;
+        }
+        pattern_length = Codec_GetLe16(&plan_staging[position + 10]);
+        if (plan_staging[position] == 0 || (plan_staging[position] & ~TEST_PERIPHERAL_ALL) != 0 ||
+            pattern_length > TEST_PATTERN_MAX_LENGTH ||
+            position + PROTOCOL_PLAN_STEP_SIZE + pattern_length > size) {
+            return PROTOCOL_ERROR_LENGTH;
+        }
+        peripherals |= plan_staging[position];
+        iterations = Codec_GetLe32(&plan_staging[position + 4]);
+        iterations = ((iterations > 0) ? iterations : 1) * (uint32_t)plan_runs(&plan_staging[position]);
+        cost = (cost + iterations < cost) ? UINT32_MAX : cost + iterations;
+        position += PROTOCOL_PLAN_STEP_SIZE + pattern_length;
+    }
+    if (position != size) {
+        return PROTOCOL_ERROR_LENGTH;
+    }
+
+    // Replace the plan with the same ID, or take a free entry
+    *slot = Plan_Find(id);
+    if (*slot != PLAN_NONE && plan_store[*slot].users > 0) {
+        return PROTOCOL_ERROR_BUSY;
+    }
+    if (steps == 0) {
+        if (*slot != PLAN_NONE) {
+            plan_store[*slot].used = 0;
+        }
+        *slot = PLAN_NONE;
+        return 0;
+    }
+    for (i = 0; i < PLAN_STORE_SIZE && *slot == PLAN_NONE; i++) {
+        if (!plan_store[i].used) {
+            *slot = i;
+        }
+    }
+    if (*slot == PLAN_NONE) {
+        return PROTOCOL_ERROR_BUSY;
+    }
+
+    plan = &plan_store[*slot];
+    plan->id = id;
+    plan->used = 1;
+    plan->steps = steps;
+    plan->users = 0;
+    plan->peripherals = peripherals;
+    plan->size = (uint16_t)size;
+    plan->cost = (cost > 0) ? cost : 1;
+    memcpy(plan->data, plan_staging, size);
+    return 0;
+}
+
+uint8_t Plan_Find(uint8_t id) {
+    uint8_t i;
+
+    for (i = 0; i < PLAN_STORE_SIZE; i++) {
+        if (plan_store[i].used && plan_store[i].id == id) {
+            return i;
+        }
+    }
+    return PLAN_NONE;
+}
+
+const Plan* Plan_Get(uint8_t slot) {
+    return &plan_store[slot];
+}
+
+void Plan_Begin(PlanCursor* cursor, uint8_t slot) {
+    memset(cursor, 0, sizeof(PlanCursor));
+    cursor->slot = slot;
+    cursor->resume = HAL_GetTick();
+    plan_store[slot].users++;
+}
+
+void Plan_Release(const PlanCursor* cursor) {
+    plan_store[cursor->slot].users--;
+}
+
+const uint8_t* Plan_Step(const PlanCursor* cursor, TestCommand* command) {
+    const uint8_t* step = &plan_store[cursor->slot].data[cursor->offset];
+
+    command->peripheral = step[0];
+    command->options = 0;
+    command->iterations = Codec_GetLe32(&step[4]);
+    command->pattern_length = Codec_GetLe16(&step[10]);
+    return (command->pattern_length > 0) ? &step[PROTOCOL_PLAN_STEP_SIZE] : NULL;
+}
+
+uint8_t Plan_Advance(PlanCursor* cursor, uint8_t passed) {
+    const Plan* plan = &plan_store[cursor->slot];
+    const uint8_t* step = &plan->data[cursor->offset];
+
+    cursor->executed++;
+    if (passed) {
+        cursor->passed++;
+    } else {
+        cursor->failed++;
+        if (step[1] & PROTOCOL_PLAN_STOP_ON_FAIL) {
+            cursor->stopped = 1;
+            return 0;
+        }
+    }
+    cursor->resume = HAL_GetTick() + Codec_GetLe16(&step[8]);
+
+    cursor->run++;
+    if (cursor->run < plan_runs(step)) {
+        return 1;
+    }
+    cursor->run = 0;
+    cursor->step++;
+    cursor->offset += PROTOCOL_PLAN_STEP_SIZE + Codec_GetLe16(&step[10]);
+    return cursor->step < plan->steps;
+}
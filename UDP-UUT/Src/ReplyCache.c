@@ -0,0 +1,159 @@
+/**
+ * @file ReplyCache.c
+ * @brief Implementation of the idempotent request cache.
+ *
+ * This file implements the cache as an open-addressing hash table with a
+ * bounded probe window: a key lives in one of the REPLY_CACHE_PROBES slots
+ * following its hash, so lookups never need tombstones. When the window is
+ * full, the oldest completed entry is evicted; in-flight entries are never
+ * evicted, and a request that finds no free slot simply runs uncached.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#include "ReplyCache.h"
+
+/**
+ * @brief State of a cache entry.
+ */
+typedef enum {
+    REPLY_ENTRY_FREE = 0,   /**< Unused slot. */
+    REPLY_ENTRY_IN_FLIGHT,  /**< Request queued or running. */
+    REPLY_ENTRY_DONE        /**< Reply available. */
+} ReplyEntryState;
+
+/**
+ * @brief A cached request and its reply.
+ */
+typedef struct {
+    ip_addr_t addr;                          /**< Client IP address. */
+    u16_t port;                              /**< Client UDP port. */
+    uint32_t test_id;                        /**< Test ID of the request. */
+    ReplyEntryState state;                   /**< Entry state. */
+    uint32_t stamp;                          /**< Insertion order, for eviction. */
+    uint16_t length;                         /**< Length of the cached reply. */
+    uint8_t reply[REPLY_CACHE_REPLY_SIZE];   /**< Encoded reply. */
+} ReplyCacheEntry;
+
+/** @brief The cache table. */
+static ReplyCacheEntry reply_cache[REPLY_CACHE_SIZE];
+
+/** @brief Next insertion stamp. */
+static uint32_t reply_cache_stamp = 0;
+
+/** @brief Usage counters of the cache. */
+static ReplyCacheStats reply_cache_stats;
+
+/**
+ * @brief Hash a request key to its first slot.
+ *
+ * @param[in] addr Pointer to the client IP address.
+ * @param[in] port Client UDP port.
+ * @param[in] test_id Test ID of the request.
+ * @return uint8_t Index of the first slot of the key's probe window.
+ */
+static uint8_t reply_cache_hash(const ip_addr_t* addr, u16_t port, uint32_t test_id) {
+    uint32_t hash = ip4_addr_get_u32(ip_2_ip4(addr)) ^ ((uint32_t)port << 16) ^ test_id;
+
+    hash *= 2654435761u; // Knuth's multiplicative hash
+    return (uint8_t)((hash >> 24) & (REPLY_CACHE_SIZE - 1));
+}
+
+/**
+ * @brief Find the entry of a request.
+ *
+ * @param[in] addr Pointer to the client IP address.
+ * @param[in] port Client UDP port.
+ * @param[in] test_id Test ID of the request.
+ * @return ReplyCacheEntry* Pointer to the entry, or NULL if the request is not cached.
+ */
+static ReplyCacheEntry* reply_cache_find(const ip_addr_t* addr, u16_t port, uint32_t test_id) {
+    uint8_t first = reply_cache_hash(addr, port, test_id);
+    ReplyCacheEntry* entry;
+    uint8_t i;
+
+    for (i = 0; i < REPLY_CACHE_PROBES; i++) {
+        entry = &reply_cache[(first + i) & (REPLY_CACHE_SIZE - 1)];
+        if (entry->state != REPLY_ENTRY_FREE && entry->test_id == test_id &&
+            entry->port == port && ip_addr_cmp(&entry->addr, addr)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+ReplyCacheStatus ReplyCache_Begin(const ip_addr_t* addr, u16_t port, uint32_t test_id,
+                                  const uint8_t** reply, uint16_t* length) {
+    uint8_t first;
+    ReplyCacheEntry* entry = reply_cache_find(addr, port, test_id);
+    ReplyCacheEntry* victim = NULL;
+    uint8_t i;
+
+    if (entry != NULL) {
+        if (entry->state == REPLY_ENTRY_IN_FLIGHT) {
+            reply_cache_stats.coalesced++;
+            return REPLY_CACHE_IN_FLIGHT;
+        }
+        reply_cache_stats.hits++;
+        *reply = entry->reply;
+        *length = entry->length;
+        return REPLY_CACHE_HIT;
+    }
+
+    // New request: take a free slot, or the oldest completed one, in the probe window
+    reply_cache_stats.misses++;
+    first = reply_cache_hash(addr, port, test_id);
+    for (i = 0; i < REPLY_CACHE_PROBES; i++) {
+        entry = &reply_cache[(first + i) & (REPLY_CACHE_SIZE - 1)];
+        if (entry->state == REPLY_ENTRY_FREE) {
+            victim = entry;
+            break;
+        }
+        if (entry->state == REPLY_ENTRY_DONE &&
+            (victim == NULL || (int32_t)(entry->stamp - victim->stamp) < 0)) {
+            victim = entry;
+        }
+    }
+    if (victim == NULL) {
+        return REPLY_CACHE_MISS;
+    }
+    if (victim->state == REPLY_ENTRY_DONE) {
+        reply_cache_stats.evictions++;
+    }
+
+    ip_addr_copy(victim->addr, *addr);
+    victim->port = port;
+    victim->test_id = test_id;
+    victim->state = REPLY_ENTRY_IN_FLIGHT;
+    victim->stamp = reply_cache_stamp++;
+    victim->length = 0;
+    return REPLY_CACHE_MISS;
+}
+
+void ReplyCache_Complete(const ip_addr_t* addr, u16_t port, uint32_t test_id, const uint8_t* reply, uint16_t length) {
+    ReplyCacheEntry* entry = reply_cache_find(addr, port, test_id);
+
+    if (entry == NULL) {
+        return;
+    }
+    if (length > REPLY_CACHE_REPLY_SIZE) {
+        entry->state = REPLY_ENTRY_FREE;
+        return;
+    }
+    memcpy(entry->reply, reply, length);
+    entry->length = length;
+    entry->state = REPLY_ENTRY_DONE;
+}
+
+void ReplyCache_Cancel(const ip_addr_t* addr, u16_t port, uint32_t test_id) {
+    ReplyCacheEntry* entry = reply_cache_find(addr, port, test_id);
+
+    if (entry != NULL) {
+        entry->state = REPLY_ENTRY_FREE;
+    }
+}
+
+void ReplyCache_GetStats(ReplyCacheStats* stats) {
+    memcpy(stats, &reply_cache_stats, sizeof(ReplyCacheStats));
+}
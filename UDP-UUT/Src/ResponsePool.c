@@ -0,0 +1,76 @@
+/**
+ * @file ResponsePool.c
+ * @brief Implementation of the preallocated UDP response buffer pool.
+ *
+ * This file manages the response buffers with an lwIP memory pool, in the
+ * same way `ethernetif.c` manages its zero-copy RX_POOL. Buffers are handed
+ * out as PBUF_RAM-typed custom pbufs, so lwIP can add its headers in the
+ * headroom, and they come back through pbuf_free() and the release callback.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#include "ResponsePool.h"
+#include "lwip/memp.h"
+
+/**
+ * @brief A response buffer: custom pbuf followed by its header room and payload.
+ *
+ * The buffer must follow the pbuf in memory for pbuf_add_header() to accept
+ * headers in front of a PBUF_RAM-typed payload.
+ */
+typedef struct {
+    struct pbuf_custom pbuf_custom;
+    uint8_t buff[LWIP_MEM_ALIGN_SIZE(PBUF_TRANSPORT) + RESPONSE_POOL_PAYLOAD_SIZE];
+} ResponseBuff_t;
+
+LWIP_MEMPOOL_DECLARE(RESPONSE_POOL, RESPONSE_POOL_COUNT, sizeof(ResponseBuff_t), "Zero-copy response pool");
+
+/** @brief Usage counters of the pool. */
+static ResponsePoolStats response_pool_stats;
+
+/**
+ * @brief Release callback of a response pbuf.
+ *
+ * Called by lwIP when the last reference to the pbuf is dropped.
+ *
+ * @param[in] p Pointer to the released pbuf.
+ */
+static void response_pool_free(struct pbuf* p) {
+    LWIP_MEMPOOL_FREE(RESPONSE_POOL, (struct pbuf_custom*)p);
+    response_pool_stats.in_use--;
+}
+
+void ResponsePool_Init(void) {
+    LWIP_MEMPOOL_INIT(RESPONSE_POOL);
+    memset(&response_pool_stats, 0, sizeof(response_pool_stats));
+}
+
+struct pbuf* ResponsePool_Alloc(u16_t length) {
+    ResponseBuff_t* buffer;
+
+    if (length > RESPONSE_POOL_PAYLOAD_SIZE) {
+        response_pool_stats.oversized++;
+        return NULL;
+    }
+
+    buffer = (ResponseBuff_t*)LWIP_MEMPOOL_ALLOC(RESPONSE_POOL);
+    if (buffer == NULL) {
+        response_pool_stats.exhausted++;
+        return NULL;
+    }
+
+    buffer->pbuf_custom.custom_free_function = response_pool_free;
+    response_pool_stats.allocated++;
+    response_pool_stats.in_use++;
+    if (response_pool_stats.in_use > response_pool_stats.in_use_peak) {
+        response_pool_stats.in_use_peak = response_pool_stats.in_use;
+    }
+    return pbuf_alloced_custom(PBUF_TRANSPORT, length, PBUF_RAM, &buffer->pbuf_custom,
+                               buffer->buff, sizeof(buffer->buff));
+}
+
+void ResponsePool_GetStats(ResponsePoolStats* stats) {
+    memcpy(stats, &response_pool_stats, sizeof(ResponsePoolStats));
+}
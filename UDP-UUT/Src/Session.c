@@ -0,0 +1,72 @@
+/**
+ * @file Session.c
+ * @brief Implementation of the client session table.
+ *
+ * This file keeps one entry per client endpoint that has used the board
+ * recently. Entries are looked up linearly, the table being only a few
+ * entries long; an entry is recycled once its client has no job queued.
+ *
+ * @note The table is only used from the UDP receive callback and the main
+ * loop (lwIP runs with NO_SYS=1), so it needs no locking.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#include "Session.h"
+
+/** @brief Sessions of the known clients. */
+static Session session_table[SESSION_TABLE_SIZE];
+
+uint8_t Session_Open(const ip_addr_t* addr, u16_t port) {
+    Session* session;
+    uint8_t victim = SESSION_NONE;
+    uint8_t i;
+
+    for (i = 0; i < SESSION_TABLE_SIZE; i++) {
+        session = &session_table[i];
+        if (session->used && session->port == port && ip_addr_cmp(&session->addr, addr)) {
+            session->last_active = HAL_GetTick();
+            return i;
+        }
+    }
+
+    // New client: take a free entry, or the least recently active idle one
+    for (i = 0; i < SESSION_TABLE_SIZE; i++) {
+        session = &session_table[i];
+        if (!session->used) {
+            victim = i;
+            break;
+        }
+        if (session->jobs == 0 &&
+            (victim == SESSION_NONE ||
+             (int32_t)(session->last_active - session_table[victim].last_active) < 0)) {
+            victim = i;
+        }
+    }
+    if (victim == SESSION_NONE) {
+        return SESSION_NONE;
+    }
+
+    session = &session_table[victim];
+    memset(session, 0, sizeof(Session));
+    ip_addr_copy(session->addr, *addr);
+    session->port = port;
+    session->used = 1;
+    session->last_active = HAL_GetTick();
+    return victim;
+}
+
+Session* Session_Get(uint8_t index) {
+    return &session_table[index];
+}
+
+void Session_RecordWait(uint8_t index, uint32_t wait) {
+    Session* session = &session_table[index];
+
+    session->started++;
+    session->total_wait += wait;
+    if (wait > session->max_wait) {
+        session->max_wait = wait;
+    }
+}
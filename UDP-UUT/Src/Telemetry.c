@@ -0,0 +1,278 @@
+/**
+ * @file Telemetry.c
+ * @brief Implementation of per-iteration telemetry streaming.
+ *
+ * This file packs iteration records into TELEMETRY datagrams held in a
+ * response pool buffer and sends them to the client that requested the
+ * stream. Only the running job streams, so a single stream state is kept.
+ * Compact streams write variable-length entries into frame-sized buffers
+ * of their own and reserve room for the worst case before each record.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#include "Telemetry.h"
+#include "Codec.h"
+#include "ResponsePool.h"
+
+/** @brief Maximum number of records in one TELEMETRY datagram. */
+#define TELEMETRY_MAX_RECORDS \
+    ((RESPONSE_POOL_PAYLOAD_SIZE - PROTOCOL_HEADER_SIZE - PROTOCOL_TELEMETRY_HEADER_SIZE) / PROTOCOL_RECORD_SIZE)
+
+/** @brief Size of a full TELEMETRY datagram. */
+#define TELEMETRY_DATAGRAM_SIZE \
+    (PROTOCOL_HEADER_SIZE + PROTOCOL_TELEMETRY_HEADER_SIZE + TELEMETRY_MAX_RECORDS * PROTOCOL_RECORD_SIZE)
+
+/**
+ * @brief Room a compact record may need: the pending run of every peripheral
+ * and one more, a START entry and a SAMPLE entry.
+ */
+#define TELEMETRY_COMPACT_RESERVE \
+    ((TEST_PERIPHERAL_COUNT + 2) * (1 + PROTOCOL_VARINT_MAX_SIZE) + 1 + 2 * PROTOCOL_VARINT_MAX_SIZE)
+
+/**
+ * @brief A compact datagram buffer: custom pbuf followed by its header room and payload.
+ */
+typedef struct {
+    struct pbuf_custom pbuf_custom;
+    uint8_t buff[LWIP_MEM_ALIGN_SIZE(PBUF_TRANSPORT) + TELEMETRY_COMPACT_DATAGRAM_SIZE];
+    uint8_t busy;   /**< Set while the buffer is being filled or held by lwIP. */
+} TelemetryBuff_t;
+
+/**
+ * @brief Compact encoder state of one peripheral in the pending datagram.
+ */
+typedef struct {
+    uint8_t started;      /**< Set once the peripheral has a START entry in the datagram. */
+    uint8_t run_code;     /**< Code of the pending run. */
+    uint32_t run_length;  /**< Iterations of the pending run, 0 if there is none. */
+    uint32_t iteration;   /**< Iteration expected next. */
+    uint32_t value;       /**< Value of the last sample. */
+    uint32_t cycles;      /**< Cycles of the last sample. */
+} TelemetryLane;
+
+/**
+ * @brief State of the open stream.
+ */
+typedef struct {
+    uint8_t open;              /**< Set while a stream is open. */
+    uint32_t test_id;          /**< Test ID of the stream. */
+    struct udp_pcb* pcb;       /**< UDP control block to send on. */
+    ip_addr_t addr;            /**< Client IP address. */
+    u16_t port;                /**< Client UDP port. */
+    uint8_t compact;           /**< Set if the stream carries compact entries. */
+    uint32_t sample_interval;  /**< Sample interval of a compact stream. */
+    struct pbuf* pending;      /**< Datagram being filled, or NULL. */
+    uint32_t count;            /**< Records (iterations) in the pending datagram. */
+    uint16_t length;           /**< Bytes written to the pending compact datagram. */
+    uint32_t first_tick;       /**< Tick of the first record in the pending datagram. */
+    TelemetryLane lanes[TEST_PERIPHERAL_COUNT]; /**< Compact encoder state per peripheral bit. */
+    TelemetryCounters counters; /**< Totals of the stream. */
+} TelemetryStream;
+
+/** @brief The open stream. */
+static TelemetryStream telemetry;
+
+/** @brief Buffers of the compact datagrams. */
+static TelemetryBuff_t telemetry_compact_buffers[TELEMETRY_COMPACT_BUFFERS];
+
+/**
+ * @brief Release callback of a compact datagram buffer.
+ *
+ * @param[in] p Pointer to the released pbuf.
+ */
+static void telemetry_compact_free(struct pbuf* p) {
+    ((TelemetryBuff_t*)p)->busy = 0;
+}
+
+/**
+ * @brief Take a free compact datagram buffer.
+ *
+ * @return struct pbuf* Pointer to the pbuf, or NULL if lwIP still holds every buffer.
+ */
+static struct pbuf* telemetry_compact_alloc(void) {
+    TelemetryBuff_t* buffer;
+    uint8_t i;
+
+    for (i = 0; i < TELEMETRY_COMPACT_BUFFERS; i++) {
+        buffer = &telemetry_compact_buffers[i];
+        if (!buffer->busy) {
+            buffer->busy = 1;
+            buffer->pbuf_custom.custom_free_function = telemetry_compact_free;
+            return pbuf_alloced_custom(PBUF_TRANSPORT, TELEMETRY_COMPACT_DATAGRAM_SIZE, PBUF_RAM,
+                                       &buffer->pbuf_custom, buffer->buff, sizeof(buffer->buff));
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Write the pending run of a peripheral to the compact datagram.
+ *
+ * @param[in] bit Bit index of the peripheral.
+ */
+static void telemetry_close_run(uint8_t bit) {
+    TelemetryLane* lane = &telemetry.lanes[bit];
+    uint8_t* buf = (uint8_t*)telemetry.pending->payload + telemetry.length;
+
+    if (lane->run_length == 0) {
+        return;
+    }
+    buf[0] = (uint8_t)((PROTOCOL_COMPACT_RUN << PROTOCOL_COMPACT_KIND_SHIFT) |
+                       (lane->run_code << PROTOCOL_COMPACT_CODE_SHIFT) | bit);
+    telemetry.length += 1 + Codec_PutVarint(&buf[1], lane->run_length);
+    lane->run_length = 0;
+}
+
+/**
+ * @brief Append an iteration to the compact datagram.
+ *
+ * The iteration joins the pending run of its peripheral unless it is
+ * sampled, in which case the run is closed and a SAMPLE entry written.
+ *
+ * @param[in] bit Bit index of the peripheral.
+ * @param[in] record Pointer to the iteration record.
+ */
+static void telemetry_compact_record(uint8_t bit, const TestRecord* record) {
+    TelemetryLane* lane = &telemetry.lanes[bit];
+    uint8_t code = record->code & PROTOCOL_COMPACT_CODE_MASK;
+    uint8_t* buf;
+    uint16_t length;
+    uint8_t sampled;
+
+    // The first iteration of the peripheral in this datagram sets its position
+    if (!lane->started || record->iteration != lane->iteration) {
+        telemetry_close_run(bit);
+        buf = (uint8_t*)telemetry.pending->payload + telemetry.length;
+        buf[0] = (uint8_t)((PROTOCOL_COMPACT_START << PROTOCOL_COMPACT_KIND_SHIFT) | bit);
+        telemetry.length += 1 + Codec_PutVarint(&buf[1], record->iteration);
+        lane->started = 1;
+        lane->value = 0;
+        lane->cycles = 0;
+    }
+    lane->iteration = record->iteration + 1;
+
+    sampled = telemetry.sample_interval > 0 &&
+              (code != PROTOCOL_RECORD_PASSED || record->iteration % telemetry.sample_interval == 0);
+    if (!sampled) {
+        if (lane->run_length > 0 && lane->run_code != code) {
+            telemetry_close_run(bit);
+        }
+        lane->run_code = code;
+        lane->run_length++;
+        return;
+    }
+
+    telemetry_close_run(bit);
+    buf = (uint8_t*)telemetry.pending->payload + telemetry.length;
+    buf[0] = (uint8_t)((PROTOCOL_COMPACT_SAMPLE << PROTOCOL_COMPACT_KIND_SHIFT) |
+                       (code << PROTOCOL_COMPACT_CODE_SHIFT) | bit);
+    length = 1 + Codec_PutVarint(&buf[1], Codec_ZigZagDelta(record->value, lane->value));
+    length += Codec_PutVarint(&buf[length], Codec_ZigZagDelta(record->cycles, lane->cycles));
+    telemetry.length += length;
+    lane->value = record->value;
+    lane->cycles = record->cycles;
+}
+
+/**
+ * @brief Send the pending datagram, if any.
+ */
+static void telemetry_flush(void) {
+    uint8_t* buf;
+    uint8_t bit;
+
+    if (telemetry.pending == NULL) {
+        return;
+    }
+
+    buf = telemetry.pending->payload;
+    if (telemetry.compact) {
+        for (bit = 0; bit < TEST_PERIPHERAL_COUNT; bit++) {
+            telemetry_close_run(bit);
+        }
+        memset(telemetry.lanes, 0, sizeof(telemetry.lanes));
+        pbuf_realloc(telemetry.pending, telemetry.length);
+    } else {
+        buf[PROTOCOL_HEADER_SIZE + 8] = (uint8_t)telemetry.count;
+        pbuf_realloc(telemetry.pending, PROTOCOL_HEADER_SIZE + PROTOCOL_TELEMETRY_HEADER_SIZE +
+                                        telemetry.count * PROTOCOL_RECORD_SIZE);
+    }
+    send_response(telemetry.pcb, telemetry.pending, &telemetry.addr, telemetry.port);
+
+    telemetry.counters.datagrams++;
+    telemetry.counters.records += telemetry.count;
+    telemetry.pending = NULL;
+    telemetry.count = 0;
+}
+
+void Telemetry_Begin(const TestCommand* command, uint8_t flags, struct udp_pcb* pcb, const ip_addr_t* addr, u16_t port) {
+    memset(&telemetry, 0, sizeof(telemetry));
+    telemetry.open = 1;
+    telemetry.test_id = command->test_id;
+    telemetry.compact = (flags & PROTOCOL_FLAG_COMPACT) != 0;
+    telemetry.sample_interval = command->sample_interval;
+    telemetry.pcb = pcb;
+    ip_addr_copy(telemetry.addr, *addr);
+    telemetry.port = port;
+}
+
+void Telemetry_Record(uint8_t peripheral, const TestRecord* record) {
+    uint8_t* buf;
+
+    if (!telemetry.open) {
+        return;
+    }
+
+    if (telemetry.compact && telemetry.pending != NULL &&
+        telemetry.length + TELEMETRY_COMPACT_RESERVE > TELEMETRY_COMPACT_DATAGRAM_SIZE) {
+        telemetry_flush();
+    }
+
+    if (telemetry.pending == NULL) {
+        telemetry.pending = telemetry.compact ? telemetry_compact_alloc() : ResponsePool_Alloc(TELEMETRY_DATAGRAM_SIZE);
+        if (telemetry.pending == NULL) {
+            telemetry.counters.dropped++;
+            return;
+        }
+        buf = telemetry.pending->payload;
+        buf += Codec_EncodeHeader(buf, PROTOCOL_OPCODE_TELEMETRY | PROTOCOL_OPCODE_REPLY,
+                                  telemetry.compact ? PROTOCOL_FLAG_COMPACT : 0);
+        Codec_PutLe32(&buf[0], telemetry.test_id);
+        Codec_PutLe32(&buf[4], telemetry.counters.datagrams);
+        telemetry.length = PROTOCOL_HEADER_SIZE + PROTOCOL_TELEMETRY_COMPACT_HEADER_SIZE;
+        telemetry.first_tick = HAL_GetTick();
+    }
+
+    if (telemetry.compact) {
+        telemetry_compact_record((uint8_t)(31 - __CLZ(peripheral)), record);
+        telemetry.count++;
+        return;
+    }
+
+    buf = (uint8_t*)telemetry.pending->payload + PROTOCOL_HEADER_SIZE + PROTOCOL_TELEMETRY_HEADER_SIZE +
+          telemetry.count * PROTOCOL_RECORD_SIZE;
+    buf[0] = peripheral;
+    buf[1] = record->code;
+    Codec_PutLe32(&buf[2], record->iteration);
+    Codec_PutLe32(&buf[6], record->value);
+    Codec_PutLe32(&buf[10], record->cycles);
+
+    if (++telemetry.count == TELEMETRY_MAX_RECORDS) {
+        telemetry_flush();
+    }
+}
+
+void Telemetry_Poll(void) {
+    // Compact datagrams wait until they are full or the test ends
+    if (telemetry.pending != NULL && !telemetry.compact &&
+        HAL_GetTick() - telemetry.first_tick >= TELEMETRY_FLUSH_INTERVAL) {
+        telemetry_flush();
+    }
+}
+
+void Telemetry_End(TelemetryCounters* counters) {
+    telemetry_flush();
+    telemetry.open = 0;
+    memcpy(counters, &telemetry.counters, sizeof(TelemetryCounters));
+}
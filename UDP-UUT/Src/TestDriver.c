@@ -0,0 +1,281 @@
+/**
+ * @file TestDriver.c
+ * @brief Implementation of the generic test runner.
+ *
+ * This file drives any engine implementing the TestDriver contract: it
+ * sets the engine up, arms one iteration at a time, polls it without
+ * blocking and handles failures and timeouts in one place, so the engines
+ * only describe their peripheral-specific state machine.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#include "TestDriver.h"
+#include "Codec.h"
+
+/** @brief Registry of the test engines, indexed by test type (bit index of the peripheral). */
+static const TestDriver* const test_registry[TEST_PERIPHERAL_COUNT] = {
+    &timer_test_driver,  // TEST_PERIPHERAL_TIMER
+    &uart_test_driver,   // TEST_PERIPHERAL_UART
+    &spi_test_driver,    // TEST_PERIPHERAL_SPI
+    &i2c_test_driver,    // TEST_PERIPHERAL_I2C
+    &adc_test_driver,    // TEST_PERIPHERAL_ADC
+};
+
+void TestDriver_Init(void) {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55; // Unlock the DWT registers (Cortex-M7)
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/**
+ * @brief Describe the iteration that just completed in the context's record
+ *        and add it to the timing statistics.
+ *
+ * @param[in,out] ctx Pointer to the context of the run.
+ * @param[in] code PROTOCOL_RECORD_* outcome code.
+ */
+static void test_run_record(TestContext* ctx, uint8_t code) {
+    uint32_t cycles = (ctx->ended ? ctx->end_cycles : TEST_CYCLES()) - ctx->start_cycles;
+    TestTiming* timing = &ctx->timing;
+
+    ctx->record.iteration = ctx->iteration;
+    ctx->record.value = ctx->value;
+    ctx->record.cycles = cycles;
+    ctx->record.code = code;
+    ctx->record_ready = 1;
+
+    if (timing->count == 0 || cycles < timing->min_cycles) {
+        timing->min_cycles = cycles;
+    }
+    if (cycles > timing->max_cycles) {
+        timing->max_cycles = cycles;
+    }
+    timing->total_cycles += cycles;
+    timing->count++;
+    if (code == PROTOCOL_RECORD_PASSED) {
+        timing->bytes += ctx->bytes;
+    }
+}
+
+/**
+ * @brief Call the engine's `finish`, and end the run once it has completed.
+ *
+ * @param[in,out] ctx Pointer to the context of the run, in TEST_STAGE_FINISH or TEST_STAGE_FAIL.
+ * @return uint8_t Returns TEST_IN_PROGRESS while `finish` goes on, otherwise the final status.
+ */
+static uint8_t test_run_finish(TestContext* ctx) {
+    uint8_t status = ctx->driver->finish(ctx);
+
+    if (status == TEST_IN_PROGRESS) {
+        return TEST_IN_PROGRESS;
+    }
+    ctx->status = (ctx->stage == TEST_STAGE_FAIL) ? TEST_FAILURE : status;
+    return ctx->status;
+}
+
+/**
+ * @brief Call the engine's `setup`, and its `finish` if the setup fails.
+ *
+ * @param[in,out] ctx Pointer to the context of the run, in TEST_STAGE_SETUP.
+ * @return uint8_t Returns TEST_IN_PROGRESS while the run goes on, otherwise the final status.
+ */
+static uint8_t test_run_setup(TestContext* ctx) {
+    uint8_t status = ctx->driver->setup(ctx);
+
+    if (status == TEST_IN_PROGRESS) {
+        return TEST_IN_PROGRESS;
+    }
+    if (status != TEST_SUCCESS) {
+        ctx->stage = TEST_STAGE_FAIL;
+        return test_run_finish(ctx);
+    }
+    ctx->stage = TEST_STAGE_RUN;
+    return TEST_IN_PROGRESS;
+}
+
+const TestDriver* TestDriver_Find(uint8_t peripheral) {
+    // Exactly one known bit: its index is the test type
+    if (peripheral == 0 || (peripheral & (peripheral - 1)) != 0 || (peripheral & ~TEST_PERIPHERAL_ALL) != 0) {
+        return NULL;
+    }
+    return test_registry[31 - __CLZ(peripheral)];
+}
+
+uint16_t TestDriver_EncodeCapabilities(uint8_t* buf) {
+    const TestDriver* driver;
+    uint8_t* entry = &buf[1];
+    uint8_t type;
+
+    buf[0] = TEST_PERIPHERAL_COUNT;
+    for (type = 0; type < TEST_PERIPHERAL_COUNT; type++) {
+        driver = test_registry[type];
+        entry[0] = type;
+        entry[1] = driver->peripheral;
+        entry[2] = driver->params | ((driver->sweep != NULL) ? PROTOCOL_PARAM_SWEEP : 0);
+        Codec_PutLe16(&entry[3], driver->max_pattern);
+        Codec_PutLe32(&entry[5], driver->default_iterations);
+        Codec_PutLe32(&entry[9], driver->estimated_us);
+        memset(&entry[13], 0, PROTOCOL_CAPS_NAME_SIZE);
+        strncpy((char*)&entry[13], driver->name, PROTOCOL_CAPS_NAME_SIZE);
+        entry += PROTOCOL_CAPS_ENTRY_SIZE;
+    }
+    return (uint16_t)(entry - buf);
+}
+
+uint8_t TestRun_Begin(TestContext* ctx, const TestDriver* driver, const uint8_t* pattern,
+                      uint16_t pattern_length, uint32_t iterations) {
+    memset(ctx, 0, sizeof(TestContext));
+    ctx->driver = driver;
+    ctx->pattern = pattern;
+    ctx->pattern_length = pattern_length;
+    ctx->iterations = (iterations > 0) ? iterations : driver->default_iterations;
+    ctx->status = TEST_IN_PROGRESS;
+
+    // Engines that take no pattern ignore it
+    if (((driver->params & PROTOCOL_PARAM_PATTERN) && pattern_length > driver->max_pattern) ||
+        (pattern_length == 0 && (driver->params & PROTOCOL_PARAM_PATTERN_REQUIRED))) {
+        printf("Invalid %s pattern length: %u\r\n", driver->name, pattern_length);
+        ctx->status = TEST_FAILURE;
+        return TEST_FAILURE;
+    }
+
+    printf("Starting %s Test with %lu iterations...\r\n", driver->name, (unsigned long)ctx->iterations);
+    ctx->stage = TEST_STAGE_SETUP;
+    return test_run_setup(ctx);
+}
+
+uint8_t TestRun_Poll(TestContext* ctx) {
+    const TestDriver* driver = ctx->driver;
+    uint8_t status;
+    uint8_t code;
+
+    if (ctx->status != TEST_IN_PROGRESS) {
+        return ctx->status;
+    }
+    if (ctx->stage == TEST_STAGE_SETUP) {
+        return test_run_setup(ctx);
+    }
+    if (ctx->stage != TEST_STAGE_RUN) {
+        return test_run_finish(ctx);
+    }
+
+    if (!ctx->armed) {
+        if (ctx->iteration >= ctx->iterations) {
+            ctx->stage = TEST_STAGE_FINISH;
+            return test_run_finish(ctx);
+        }
+        ctx->deadline = HAL_GetTick() + TEST_ITERATION_TIMEOUT;
+        ctx->value = 0;
+        ctx->ended = 0;
+        ctx->start_cycles = TEST_CYCLES();
+        status = driver->start(ctx);
+        if (status == TEST_IN_PROGRESS) {
+            ctx->armed = 1;
+            return TEST_IN_PROGRESS;
+        }
+        code = PROTOCOL_RECORD_START_FAILED;
+    } else {
+        status = driver->poll(ctx);
+        code = PROTOCOL_RECORD_FAILED;
+        if (status == TEST_IN_PROGRESS) {
+            if ((int32_t)(HAL_GetTick() - ctx->deadline) < 0) {
+                return TEST_IN_PROGRESS;
+            }
+            printf("%s iteration %lu timed out\r\n", driver->name, (unsigned long)ctx->iteration + 1);
+            status = TEST_FAILURE;
+            code = PROTOCOL_RECORD_TIMEOUT;
+        }
+    }
+
+    ctx->armed = 0;
+    test_run_record(ctx, (status == TEST_FAILURE) ? code : PROTOCOL_RECORD_PASSED);
+    if (status == TEST_FAILURE) {
+        ctx->errors++;
+        driver->abort(ctx);
+        ctx->stage = TEST_STAGE_FAIL;
+        return test_run_finish(ctx);
+    }
+
+    ctx->iteration++;
+    return TEST_IN_PROGRESS;
+}
+
+void TestRun_End(TestContext* ctx, uint32_t stamp) {
+    uint32_t elapsed = stamp - ctx->start_cycles;
+
+    // A stamp "after" the start by more than half the counter range was taken before it
+    if ((int32_t)elapsed < 0) {
+        return;
+    }
+    if (!ctx->ended || elapsed > ctx->end_cycles - ctx->start_cycles) {
+        ctx->end_cycles = stamp;
+        ctx->ended = 1;
+    }
+}
+
+uint16_t TestRun_CountMismatches(const uint8_t* expected, const uint8_t* received, uint16_t length) {
+    uint16_t mismatches = 0;
+    uint32_t diff;
+    uint16_t i;
+
+    // The Cortex-M7 handles unaligned word loads in hardware
+    for (i = 0; i + 4 <= length; i += 4) {
+        diff = __UNALIGNED_UINT32_READ(&expected[i]) ^ __UNALIGNED_UINT32_READ(&received[i]);
+        if (diff != 0) {
+            mismatches += ((diff & 0x000000FFU) != 0) + ((diff & 0x0000FF00U) != 0) +
+                          ((diff & 0x00FF0000U) != 0) + ((diff & 0xFF000000U) != 0);
+        }
+    }
+    for (; i < length; i++) {
+        if (expected[i] != received[i]) {
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+uint32_t TestRun_CountBitErrors(const uint8_t* expected, const uint8_t* received, uint16_t length) {
+    uint32_t errors = 0;
+    uint16_t i;
+
+    for (i = 0; i + 4 <= length; i += 4) {
+        errors += __builtin_popcount(__UNALIGNED_UINT32_READ(&expected[i]) ^ __UNALIGNED_UINT32_READ(&received[i]));
+    }
+    for (; i < length; i++) {
+        errors += __builtin_popcount(expected[i] ^ received[i]);
+    }
+    return errors;
+}
+
+void TestRun_FillPrbs(uint8_t* buf, uint16_t length, uint16_t seed) {
+    uint16_t state = (seed & 0x7FFF) ? (seed & 0x7FFF) : 0x7FFF;
+    uint16_t feedback;
+    uint16_t i;
+    uint8_t bit;
+
+    for (i = 0; i < length; i++) {
+        buf[i] = 0;
+        for (bit = 0; bit < 8; bit++) {
+            feedback = ((state >> 14) ^ (state >> 13)) & 1;
+            state = (uint16_t)(((state << 1) | feedback) & 0x7FFF);
+            buf[i] |= (uint8_t)(feedback << bit);
+        }
+    }
+}
+
+void TestRun_Abort(TestContext* ctx) {
+    if (ctx->status != TEST_IN_PROGRESS) {
+        return;
+    }
+    if (ctx->stage != TEST_STAGE_FINISH && ctx->stage != TEST_STAGE_FAIL) {
+        ctx->driver->abort(ctx);
+    }
+    ctx->armed = 0;
+    ctx->stage = TEST_STAGE_FAIL;
+    while (test_run_finish(ctx) == TEST_IN_PROGRESS) {
+        // The job is cancelled now: the rest of the engine's report goes out in this pass
+    }
+}
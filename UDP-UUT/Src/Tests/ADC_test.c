@@ -10,6 +10,7 @@
  *
  * Ensure these connections are properly configured before running the test.
  * The test validates ADC readings against known values within an acceptable range.
+ * Conversions are interrupt-driven; the engine implements the TestDriver contract.
  *
  * @note The `hadc1` handler must be initialized before running this test.
  * Also, ensure that the DAC is generating the expected output voltage
@@ -21,6 +22,7 @@
 
 #include "ADC_test.h"
 #include "UdpUut.h"
+#include "TestDriver.h"
 
 // Pre-determined ADC results for comparison
 static const uint32_t known_adc_values[] = {
@@ -33,59 +35,135 @@ static const uint32_t acceptable_offset = 150;
 /** @brief Declare `hadc1` as an external variable. */
 extern ADC_HandleTypeDef hadc1;
 
+/** @brief Flag set by the ADC conversion complete interrupt. */
+static volatile uint8_t adc_conversion_done = 0;
+
+/** @brief Last value converted by ADC1. */
+static volatile uint32_t adc_last_value = 0;
+
+/** @brief Cycle counter when the last conversion completed. */
+static volatile uint32_t adc_done_cycles = 0;
+
+/**
+ * @brief Private state of the ADC test engine.
+ */
+typedef struct {
+    uint32_t expected;  /**< Expected value for the current iteration. */
+} AdcTestState;
+
+TEST_CONTEXT_PRIVATE_CHECK(AdcTestState);
+
 /**
- * @brief Perform ADC test by comparing readings against expected values.
+ * @brief Prepare the ADC test.
  *
- * This function starts the ADC conversion, reads the ADC value, and validates
- * it against the pre-determined known values. The test runs for a specified
- * number of iterations, and results are printed for debugging.
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_SUCCESS.
+ */
+static uint8_t adc_setup(TestContext* ctx) {
+    ctx->bytes = sizeof(uint16_t); // One 12-bit sample per iteration
+    return TEST_SUCCESS;
+}
+
+/**
+ * @brief Start one interrupt-driven ADC conversion.
  *
- * @param[in] iterations Number of iterations to sample ADC.
- * @return 1 for success, TEST_FAILURE for failure.
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_IN_PROGRESS, or TEST_FAILURE if the conversion cannot be started.
  */
-uint8_t test_adc(uint16_t iterations) {
-    printf("Starting ADC Test with %u iterations...\r\n", iterations);
-
-    uint32_t adc_value = 0;
-    uint32_t success = 1;
-
-    for (uint16_t i = 0; i < iterations; i++) {
-        // Start ADC conversion
-        HAL_ADC_Start(&hadc1);
-
-        // Wait for ADC conversion to complete
-        if (HAL_ADC_PollForConversion(&hadc1, 100) == HAL_OK) {
-            adc_value = HAL_ADC_GetValue(&hadc1);
-
-            printf("Iteration %u: ADC Value = %lu (Expected: %lu ± %lu)\r\n", i + 1, adc_value, known_adc_values[i], acceptable_offset);
-
-            // Validate the ADC value within the acceptable range
-            if (adc_value < known_adc_values[i] - acceptable_offset ||
-                adc_value > known_adc_values[i] + acceptable_offset) {
-                printf("Mismatch at iteration %u. Expected: %lu ± %lu, Got: %lu\r\n",
-                       i + 1, known_adc_values[i], acceptable_offset, adc_value);
-                success = 0; // Mark as failure
-            }
-        } else {
-            printf("ADC conversion timeout on iteration %u.\r\n", i + 1);
-            HAL_ADC_Stop(&hadc1);
-            return TEST_FAILURE; // Failure
-        }
-
-        // Stop ADC conversion
-        HAL_ADC_Stop(&hadc1);
-
-        // Add delay between iterations
-        HAL_Delay(100);
+static uint8_t adc_start(TestContext* ctx) {
+    AdcTestState* st = TEST_CONTEXT_PRIVATE(ctx, AdcTestState);
+
+    st->expected = known_adc_values[ctx->iteration % (sizeof(known_adc_values) / sizeof(known_adc_values[0]))];
+    adc_conversion_done = 0;
+    if (HAL_ADC_Start_IT(&hadc1) != HAL_OK) {
+        printf("ADC start failed on iteration %lu.\r\n", ctx->iteration + 1);
+        return TEST_FAILURE;
+    }
+    return TEST_IN_PROGRESS;
+}
+
+/**
+ * @brief Check whether the ADC conversion has completed and validate it.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_IN_PROGRESS while converting, 1 if in range, TEST_FAILURE otherwise.
+ */
+static uint8_t adc_poll(TestContext* ctx) {
+    AdcTestState* st = TEST_CONTEXT_PRIVATE(ctx, AdcTestState);
+    uint32_t adc_value;
+
+    if (!adc_conversion_done) {
+        return TEST_IN_PROGRESS;
+    }
+    TestRun_End(ctx, adc_done_cycles);
+    adc_value = adc_last_value;
+    ctx->value = adc_value;
+
+    TEST_TRACE("Iteration %lu: ADC Value = %lu (Expected: %lu ± %lu)\r\n", ctx->iteration + 1, adc_value, st->expected, acceptable_offset);
+
+    // Validate the ADC value within the acceptable range
+    if (adc_value < st->expected - acceptable_offset ||
+        adc_value > st->expected + acceptable_offset) {
+        printf("Mismatch at iteration %lu. Expected: %lu ± %lu, Got: %lu\r\n",
+               ctx->iteration + 1, st->expected, acceptable_offset, adc_value);
+        return TEST_FAILURE;
     }
+    return TEST_SUCCESS;
+}
+
+/**
+ * @brief Stop any conversion left running by the engine.
+ *
+ * @param[in] ctx Pointer to the test context.
+ */
+static void adc_abort(TestContext* ctx) {
+    HAL_ADC_Stop_IT(&hadc1);
+}
 
-    if (success) {
-        printf("ADC Test Passed for all %u iterations.\r\n", iterations);
-    } else {
+/**
+ * @brief Report the result of the ADC test.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return 1 for success, TEST_FAILURE for failure.
+ */
+static uint8_t adc_finish(TestContext* ctx) {
+    if (ctx->errors) {
         printf("ADC Test Failed.\r\n");
         return TEST_FAILURE;
     }
+    printf("ADC Test Passed for all %lu iterations.\r\n", ctx->iterations);
     printf("***********************\r\n");
     printf("\nADC Test complete.\r\n");
     return TEST_SUCCESS;
 }
+
+/** @brief ADC1 <- DAC test engine. */
+const TestDriver adc_test_driver = {
+    .peripheral = TEST_PERIPHERAL_ADC,
+    .name = "ADC",
+    .params = 0,
+    .max_pattern = 0,
+    .default_iterations = 5,
+    .estimated_us = 20, // One conversion and its interrupt
+    .setup = adc_setup,
+    .start = adc_start,
+    .poll = adc_poll,
+    .abort = adc_abort,
+    .finish = adc_finish,
+};
+
+/**
+ * @brief Callback for ADC conversion complete.
+ *
+ * Latches the converted value for the ADC test engine. The conversion is
+ * single-shot, so the ADC stops by itself after this interrupt.
+ *
+ * @param[in] hadc Pointer to the ADC handle that triggered the interrupt.
+ */
+void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc) {
+    if (hadc->Instance == ADC1) {
+        adc_done_cycles = TEST_CYCLES();
+        adc_last_value = HAL_ADC_GetValue(hadc);
+        adc_conversion_done = 1;
+    }
+}
@@ -10,6 +10,23 @@
  * - I2C2-SCL [PF1] <--> I2C4-SCL [PF14]
  *
  * Ensure these connections are properly configured before running the test.
+ * Each iteration sends the whole pattern from I2C4 (Master) to I2C2 (Slave)
+ * and verifies it byte for byte. The slave receives by DMA (DMA1 Stream2);
+ * the master transmits under interrupt control, because the only DMA stream
+ * of I2C4 TX (DMA1 Stream5) is the circular receive ring of USART2, and the
+ * UART and I2C tests may run at the same time. The engine implements the
+ * TestDriver contract.
+ *
+ * The bus is scanned once and the devices found are kept in a table, so a
+ * test does not probe all 127 addresses; a request with
+ * PROTOCOL_OPTION_RESCAN drops the table and the next test scans again.
+ * A scan probes a few addresses per main-loop pass, from the engine's
+ * `setup`.
+ *
+ * The sweep variant (PROTOCOL_OPTION_SWEEP) runs PRBS transfers at
+ * Standard, Fast and Fast-mode Plus Timing values. NACKs, arbitration
+ * losses and bus errors are counted per speed instead of ending the run,
+ * and both I2Cs are put back to their CubeMX Timing when the sweep ends.
  *
  * @author Haim
  * @date Dec 3, 2024
@@ -18,90 +35,614 @@
 #include "UdpUut.h"
 #include "I2C_test.h"
 #include "Protocol.h"
+#include "TestDriver.h"
+
+/** @brief Flag set when the I2C4 (Master) transmission completes. */
+static volatile uint8_t i2c4_tx_done = 0;
+
+/** @brief Flag set when the I2C2 (Slave) reception completes. */
+static volatile uint8_t i2c2_rx_done = 0;
+
+/** @brief HAL_I2C_ERROR_* bits reported by I2C4 (Master) since the transfer was armed. */
+static volatile uint32_t i2c4_error_code = 0;
+
+/** @brief HAL_I2C_ERROR_* bits reported by I2C2 (Slave) since the transfer was armed. */
+static volatile uint32_t i2c2_error_code = 0;
+
+/** @brief Cycle counter at the last completion or error callback of either I2C. */
+static volatile uint32_t i2c_event_cycles = 0;
+
+/** @brief Devices found by the last scan. */
+static I2cDeviceTable i2c_devices;
+
+/** @brief Byte received by I2C2 (Slave), armed so that it acknowledges a scan. */
+static uint8_t i2c_scan_rx;
+
+/** @brief Data received by I2C2 (Slave). */
+static uint8_t i2c_slave_rx[TEST_PATTERN_MAX_LENGTH];
+
+/**
+ * @brief Bus speeds of the sweep, slowest first. The sweep mode of a step is its index.
+ */
+static const struct {
+    uint32_t timing;    /**< Timing register value for a 36 MHz I2C clock. */
+    uint32_t rate;      /**< Nominal bus speed in Hz. */
+} i2c_speeds[] = {
+    {I2C_TIMING_STANDARD, 100000},
+    {I2C_TIMING_FAST, 400000},
+    {I2C_TIMING_FAST_PLUS, 1000000},
+};
+
+/** @brief Number of bus speeds of the sweep. */
+#define I2C_SPEED_COUNT (sizeof(i2c_speeds) / sizeof(i2c_speeds[0]))
+
+/**
+ * @brief Private state of the I2C test engine.
+ */
+typedef struct {
+    uint16_t nack;              /**< Transfers ended by a NACK. */
+    uint16_t arbitration;       /**< Transfers ended by an arbitration loss. */
+    uint16_t bus;               /**< Transfers ended by any other bus error. */
+    uint8_t configured;         /**< Set once `setup` has configured both I2Cs. */
+} I2cTestState;
+
+TEST_CONTEXT_PRIVATE_CHECK(I2cTestState);
+
+/**
+ * @brief Clear the completion and error flags before arming a new transfer.
+ */
+static void i2c_clear_flags(void) {
+    i2c4_tx_done = 0;
+    i2c2_rx_done = 0;
+    i2c4_error_code = 0;
+    i2c2_error_code = 0;
+}
+
+/**
+ * @brief Set the Timing of both I2Cs and the slave's own address.
+ *
+ * Both I2Cs are already initialized, so HAL_I2C_Init only rewrites their
+ * registers. Fast-mode Plus also needs the stronger drive of their pins.
+ *
+ * @param[in] timing Timing register value.
+ * @return HAL_StatusTypeDef Status of the reconfiguration.
+ */
+static HAL_StatusTypeDef i2c_configure(uint32_t timing) {
+    if (timing == I2C_TIMING_FAST_PLUS) {
+        HAL_I2CEx_EnableFastModePlus(I2C_FASTMODEPLUS_I2C2 | I2C_FASTMODEPLUS_I2C4);
+    } else {
+        HAL_I2CEx_DisableFastModePlus(I2C_FASTMODEPLUS_I2C2 | I2C_FASTMODEPLUS_I2C4);
+    }
+    hi2c4.Init.Timing = timing;
+    hi2c2.Init.Timing = timing;
+    hi2c2.Init.OwnAddress1 = I2C_SLAVE_ADDRESS << 1;
+    if (HAL_I2C_Init(I2C_4) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    return HAL_I2C_Init(I2C_2);
+}
 
 /**
- * @brief Data received from I2C4 slave.
+ * @brief Stop both I2Cs and bring them back to a clean state.
+ *
+ * A transfer cut short can leave the slave holding the bus, and an aborted
+ * master only stops after its STOP condition, so both are reinitialized.
  */
-unsigned char data_from_i2c4;
+static void i2c_recover(void) {
+    HAL_I2C_DeInit(I2C_4);
+    HAL_I2C_Init(I2C_4);
+    HAL_I2C_DeInit(I2C_2);
+    HAL_I2C_Init(I2C_2);
+    i2c_clear_flags();
+}
 
 /**
- * @brief Global variable to store the detected I2C device address.
+ * @brief Nominal bus speed of a Timing value.
+ *
+ * @param[in] timing Timing register value.
+ * @return uint32_t Speed in Hz; Standard mode for a value not in the speed list.
  */
-uint8_t address;
+static uint32_t i2c_rate(uint32_t timing) {
+    uint8_t i;
+
+    for (i = 0; i < I2C_SPEED_COUNT; i++) {
+        if (i2c_speeds[i].timing == timing) {
+            return i2c_speeds[i].rate;
+        }
+    }
+    return i2c_speeds[0].rate;
+}
 
 /**
- * @brief Scans the I2C bus for connected devices.
+ * @brief Arm one transfer from I2C4 (Master) to I2C2 (Slave).
  *
- * This function checks for devices on the specified I2C bus.
- * If a device is found, its address is printed and returned.
+ * The slave is prepared to receive before the master starts transmitting.
+ *
+ * @param[in] ctx Pointer to the test context; its deadline covers the transfer at the current speed.
+ * @param[in] data Data sent by the master; only read by the HAL.
+ * @param[in] length Length of the data.
+ * @return HAL_StatusTypeDef Status of the HAL.
+ */
+static HAL_StatusTypeDef i2c_arm(TestContext* ctx, const uint8_t* data, uint16_t length) {
+    HAL_StatusTypeDef status;
+
+    i2c_clear_flags();
+    status = HAL_I2C_Slave_Receive_DMA(I2C_2, i2c_slave_rx, length);
+    if (status != HAL_OK) {
+        return status;
+    }
+    status = HAL_I2C_Master_Transmit_IT(I2C_4, I2C_SLAVE_ADDRESS << 1, (uint8_t *)data, length);
+    if (status != HAL_OK) {
+        return status;
+    }
+
+    // Address and data take 9 clocks per byte; Standard mode needs more than the default timeout
+    ctx->deadline += (uint32_t)(((uint64_t)(length + 1) * 9 * 1000) / i2c_rate(hi2c4.Init.Timing)) + 1;
+    return HAL_OK;
+}
+
+/**
+ * @brief Classify a failed transfer.
+ *
+ * @param[in] master HAL_I2C_ERROR_* bits of the master.
+ * @param[in] slave HAL_I2C_ERROR_* bits of the slave.
+ * @return uint8_t 0 if the master was not acknowledged, 1 if arbitration was lost, 2 otherwise.
+ */
+static uint8_t i2c_error_class(uint32_t master, uint32_t slave) {
+    if (master & HAL_I2C_ERROR_AF) {
+        return 0;
+    }
+    if ((master | slave) & HAL_I2C_ERROR_ARLO) {
+        return 1;
+    }
+    return 2;
+}
+
+/**
+ * @brief Start a scan of an I2C bus.
+ *
+ * I2C2 (Slave) only acknowledges its address while a reception is armed,
+ * so it is armed for the scan and reset when the scan ends.
  *
  * @param[in] hi2c Pointer to the I2C handler.
- * @return Address of the first detected device, or 0 if no device is found.
  */
-uint8_t I2C_Scan(I2C_HandleTypeDef *hi2c) {
+static void i2c_scan_begin(I2C_HandleTypeDef *hi2c) {
     printf("Scanning I2C bus...\r\n");
-    for (uint8_t addr = 1; addr < 128; addr++) {
-        if (HAL_I2C_IsDeviceReady(hi2c, addr << 1, 1, 10) == HAL_OK) {
+    i2c_devices.bus = hi2c;
+    i2c_devices.count = 0;
+    i2c_devices.next = 1;
+    if (hi2c == I2C_4) {
+        HAL_I2C_Slave_Receive_IT(I2C_2, &i2c_scan_rx, 1);
+    }
+}
+
+/**
+ * @brief Probe the next I2C_SCAN_BATCH addresses of the bus being scanned.
+ *
+ * The devices that answer are kept in the device table.
+ */
+static void i2c_scan_step(void) {
+    I2C_HandleTypeDef *hi2c = i2c_devices.bus;
+    uint8_t end = i2c_devices.next + I2C_SCAN_BATCH;
+    uint8_t addr;
+
+    if (end > I2C_SCAN_END) {
+        end = I2C_SCAN_END;
+    }
+    for (addr = i2c_devices.next; addr < end; addr++) {
+        if (HAL_I2C_IsDeviceReady(hi2c, addr << 1, 1, I2C_SCAN_TIMEOUT) == HAL_OK) {
             printf("Device found at 0x%02X\r\n", addr);
-            return addr; // Return the first found address
+            if (i2c_devices.count < I2C_DEVICE_MAX) {
+                i2c_devices.addresses[i2c_devices.count++] = addr;
+            }
         }
     }
-    printf("No device found.\r\n");
-    return 0; // No device found
+    i2c_devices.next = end;
+    if (end < I2C_SCAN_END) {
+        return;
+    }
+
+    if (hi2c == I2C_4) {
+        HAL_I2C_DeInit(I2C_2);
+        HAL_I2C_Init(I2C_2);
+        i2c_clear_flags();
+    }
+    if (i2c_devices.count == 0) {
+        printf("No device found.\r\n");
+    }
+}
+
+const I2cDeviceTable* I2C_GetDevices(I2C_HandleTypeDef *hi2c) {
+    if (i2c_devices.bus != hi2c) {
+        i2c_scan_begin(hi2c);
+    }
+    if (i2c_devices.next < I2C_SCAN_END) {
+        i2c_scan_step();
+    }
+    return (i2c_devices.next < I2C_SCAN_END) ? NULL : &i2c_devices;
+}
+
+void I2C_ForgetDevices(void) {
+    i2c_devices.bus = NULL;
+    i2c_devices.count = 0;
+    i2c_devices.next = 0;
+}
+
+/**
+ * @brief Check in the device table that the slave answers on the bus, scanning the bus first if needed.
+ *
+ * @return uint8_t Returns TEST_IN_PROGRESS while the bus is scanned, TEST_SUCCESS if the slave was found,
+ *         TEST_FAILURE otherwise.
+ */
+static uint8_t i2c_find_slave(void) {
+    const I2cDeviceTable* devices = I2C_GetDevices(I2C_4);
+    uint8_t i;
+
+    if (devices == NULL) {
+        return TEST_IN_PROGRESS;
+    }
+    for (i = 0; i < devices->count; i++) {
+        if (devices->addresses[i] == I2C_SLAVE_ADDRESS) {
+            return TEST_SUCCESS;
+        }
+    }
+    printf("Slave 0x%02X not found on the bus (%u devices). Cannot proceed with the test.\r\n",
+           I2C_SLAVE_ADDRESS, devices->count);
+    return TEST_FAILURE;
 }
 
 /**
- * @brief Tests I2C communication by sending a bit pattern.
+ * @brief Find the slave device. The runner has checked the pattern against the descriptor.
  *
- * This function scans for a valid I2C device, then sends a specified bit
- * pattern to the detected device multiple times to test the I2C communication.
+ * The first pass configures both I2Cs; a bus scan goes on over the next passes.
  *
- * @param[in] bit_pattern Pointer to the bit pattern to send.
- * @param[in] pattern_length Length of the bit pattern.
- * @param[in] iterations Number of iterations to send the pattern.
- * @return 1 for success, or TEST_FAILURE for failure.
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_IN_PROGRESS while scanning, TEST_SUCCESS, or TEST_FAILURE if the slave does not answer.
  */
-uint8_t test_i2c(char *bit_pattern, uint8_t pattern_length, uint16_t iterations) {
-    HAL_StatusTypeDef status;
+static uint8_t i2c_setup(TestContext* ctx) {
+    I2cTestState* st = TEST_CONTEXT_PRIVATE(ctx, I2cTestState);
+    uint8_t status;
 
-    // Scan for a valid device
-    address = I2C_Scan(I2C_4);
-    if (address == 0) {
-        printf("No device found. Cannot proceed with the test.\r\n");
-        return TEST_FAILURE; // Error
+    if (!st->configured) {
+        st->nack = 0;
+        st->arbitration = 0;
+        st->bus = 0;
+        if (i2c_configure(hi2c4.Init.Timing) != HAL_OK) {
+            printf("I2C could not be configured\r\n");
+            return TEST_FAILURE;
+        }
+        st->configured = 1;
     }
+    status = i2c_find_slave();
+    if (status == TEST_SUCCESS) {
+        ctx->bytes = ctx->pattern_length;
+    }
+    return status;
+}
 
-    // Prepare slave to receive
-    HAL_I2C_Slave_Receive_IT(I2C_2, &data_from_i2c4, sizeof(data_from_i2c4));
+/**
+ * @brief Arm one I2C transfer of the whole pattern.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_IN_PROGRESS, or TEST_FAILURE if a transfer cannot be armed.
+ */
+static uint8_t i2c_start(TestContext* ctx) {
+    memset(i2c_slave_rx, 0, ctx->pattern_length);
+    if (i2c_arm(ctx, ctx->pattern, ctx->pattern_length) != HAL_OK) {
+        printf("Transmission failed at iteration %lu. Error: %lu\r\n", ctx->iteration + 1, HAL_I2C_GetError(I2C_4));
+        return TEST_FAILURE; // Error
+    }
+    return TEST_IN_PROGRESS;
+}
 
-    // Perform test iterations
-    for (uint16_t i = 0; i < iterations; i++) {
-        printf("Iteration %d/%d\r\n", i + 1, iterations);
+/**
+ * @brief Check whether the I2C transfer has completed and verify it.
+ *
+ * The value of the iteration is the number of mismatching bytes, or on an
+ * I2C error the HAL_I2C_ERROR_* bits of the slave (high half) and the
+ * master (low half).
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_IN_PROGRESS while transferring, 1 on match, TEST_FAILURE otherwise.
+ */
+static uint8_t i2c_poll(TestContext* ctx) {
+    I2cTestState* st = TEST_CONTEXT_PRIVATE(ctx, I2cTestState);
 
-        // Master transmits bit pattern to slave
-        status = HAL_I2C_Master_Transmit(I2C_4, address << 1, (uint8_t *)bit_pattern, pattern_length, HAL_MAX_DELAY);
-        if (status != HAL_OK) {
-            printf("Transmission failed at iteration %d. Error: %ld\r\n", i + 1, HAL_I2C_GetError(I2C_4));
-            return TEST_FAILURE; // Error
+    if (i2c4_error_code || i2c2_error_code) {
+        TestRun_End(ctx, i2c_event_cycles);
+        switch (i2c_error_class(i2c4_error_code, i2c2_error_code)) {
+        case 0:
+            st->nack++;
+            break;
+        case 1:
+            st->arbitration++;
+            break;
+        default:
+            st->bus++;
+            break;
         }
+        ctx->value = (i2c2_error_code << 16) | (i2c4_error_code & 0xFFFF);
+        printf("Transmission failed at iteration %lu. Master error 0x%02lX, Slave error 0x%02lX\r\n",
+               ctx->iteration + 1, i2c4_error_code, i2c2_error_code);
+        i2c_recover();
+        return TEST_FAILURE;
+    }
+    if (!i2c4_tx_done || !i2c2_rx_done) {
+        return TEST_IN_PROGRESS;
+    }
+    TestRun_End(ctx, i2c_event_cycles);
+    // Report the number of mismatching bytes
+    ctx->value = TestRun_CountMismatches(ctx->pattern, i2c_slave_rx, ctx->pattern_length);
+    if (ctx->value != 0) {
+        printf("Data mismatch at iteration %lu.\r\n", ctx->iteration + 1);
+        return TEST_FAILURE;
+    }
+    TEST_TRACE("Iteration %lu successful.\r\n", ctx->iteration + 1);
+    return TEST_SUCCESS;
+}
 
-        printf("Iteration %d successful.\r\n", i + 1);
+/**
+ * @brief Abort any I2C transfer left armed by the engine, and a bus scan cut short.
+ *
+ * @param[in] ctx Pointer to the test context.
+ */
+static void i2c_abort(TestContext* ctx) {
+    i2c_recover();
+    // The recovery dropped the reception that lets the slave answer a scan cut short
+    if (i2c_devices.next < I2C_SCAN_END) {
+        I2C_ForgetDevices();
     }
+}
 
+/**
+ * @brief Report the result of the I2C test.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return 1 for success, or TEST_FAILURE for failure.
+ */
+static uint8_t i2c_finish(TestContext* ctx) {
+    I2cTestState* st = TEST_CONTEXT_PRIVATE(ctx, I2cTestState);
+
+    if (st->nack || st->arbitration || st->bus) {
+        printf("I2C errors: NACK %u, arbitration lost %u, bus %u\r\n", st->nack, st->arbitration, st->bus);
+    }
+    if (ctx->errors) {
+        printf("I2C Test Failed.\r\n");
+        return TEST_FAILURE;
+    }
     printf("***********************\r\n");
     printf("\nI2C test completed successfully.\r\n");
     return TEST_SUCCESS; // Success
 }
 
+/**
+ * @brief Drop the device table of the I2C engines, for PROTOCOL_OPTION_RESCAN.
+ */
+static void i2c_rescan(void) {
+    I2C_ForgetDevices();
+}
+
+/** @brief PRBS data sent by the master during the sweep. */
+static uint8_t i2c_sweep_tx[I2C_SWEEP_BLOCK_SIZE];
+
+/** @brief Step table of the sweep. */
+static TestSweep i2c_sweep_table;
+
+/**
+ * @brief Private state of the I2C sweep engine.
+ */
+typedef struct {
+    uint32_t per_step;          /**< Transfers run at each speed. */
+    uint32_t saved_timing;      /**< Timing set by CubeMX, restored at the end. */
+    uint32_t clean;             /**< Fastest clean speed of the steps reported so far. */
+    uint8_t configured;         /**< Set once `setup` has built the step table and configured both I2Cs. */
+    uint8_t reported;           /**< Steps printed by `finish` so far. */
+} I2cSweepState;
+
+TEST_CONTEXT_PRIVATE_CHECK(I2cSweepState);
+
+/**
+ * @brief Prepare the speed sweep.
+ *
+ * Builds the step table from the speed list and generates the PRBS block.
+ * The requested iterations run at every step. A bus scan goes on over the
+ * next passes.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_IN_PROGRESS while scanning, TEST_SUCCESS, or TEST_FAILURE if the slave does not answer.
+ */
+static uint8_t i2c_sweep_setup(TestContext* ctx) {
+    I2cSweepState* st = TEST_CONTEXT_PRIVATE(ctx, I2cSweepState);
+    uint8_t i;
+
+    if (st->configured) {
+        return i2c_find_slave();
+    }
+    memset(&i2c_sweep_table, 0, sizeof(i2c_sweep_table));
+    for (i = 0; i < I2C_SPEED_COUNT; i++) {
+        i2c_sweep_table.steps[i].rate = i2c_speeds[i].rate;
+        i2c_sweep_table.steps[i].mode = i;
+    }
+    i2c_sweep_table.count = I2C_SPEED_COUNT;
+
+    st->saved_timing = hi2c4.Init.Timing;
+    st->per_step = ctx->iterations;
+    if (st->per_step > UINT32_MAX / i2c_sweep_table.count) {
+        st->per_step = UINT32_MAX / i2c_sweep_table.count;
+    }
+    ctx->iterations = st->per_step * i2c_sweep_table.count;
+    ctx->bytes = I2C_SWEEP_BLOCK_SIZE;
+    ctx->sweep = &i2c_sweep_table;
+    TestRun_FillPrbs(i2c_sweep_tx, I2C_SWEEP_BLOCK_SIZE, 0);
+
+    // The table is looked up at the CubeMX speed, before the first step changes it
+    if (i2c_configure(st->saved_timing) != HAL_OK) {
+        return TEST_FAILURE;
+    }
+    st->configured = 1;
+    return i2c_find_slave();
+}
+
+/**
+ * @brief Arm one sweep transfer, moving both I2Cs to the next speed first when a step begins.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_IN_PROGRESS, or TEST_FAILURE if an I2C cannot be set up or armed.
+ */
+static uint8_t i2c_sweep_start(TestContext* ctx) {
+    I2cSweepState* st = TEST_CONTEXT_PRIVATE(ctx, I2cSweepState);
+    uint32_t index = ctx->iteration / st->per_step;
+
+    if (ctx->iteration % st->per_step == 0) {
+        if (i2c_configure(i2c_speeds[index].timing) != HAL_OK) {
+            printf("I2C sweep could not set %lu Hz\r\n", i2c_speeds[index].rate);
+            return TEST_FAILURE;
+        }
+        TEST_TRACE("I2C sweep: %lu Hz (Timing 0x%08lX)\r\n", i2c_speeds[index].rate, i2c_speeds[index].timing);
+    }
+
+    if (i2c_arm(ctx, i2c_sweep_tx, I2C_SWEEP_BLOCK_SIZE) != HAL_OK) {
+        printf("I2C sweep transfer could not be armed\r\n");
+        return TEST_FAILURE;
+    }
+    return TEST_IN_PROGRESS;
+}
+
+/**
+ * @brief Check whether the sweep transfer has completed and add it to its step.
+ *
+ * A transfer that reports an error is cut short and its data is not
+ * compared; both I2Cs are reset for the next one. The value of the
+ * iteration is the number of bit errors.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_IN_PROGRESS while transferring, otherwise TEST_SUCCESS.
+ */
+static uint8_t i2c_sweep_poll(TestContext* ctx) {
+    I2cSweepState* st = TEST_CONTEXT_PRIVATE(ctx, I2cSweepState);
+    TestSweepStep* step = &i2c_sweep_table.steps[ctx->iteration / st->per_step];
+
+    if (i2c4_error_code || i2c2_error_code) {
+        TestRun_End(ctx, i2c_event_cycles);
+        step->errors[i2c_error_class(i2c4_error_code, i2c2_error_code)]++;
+        i2c_recover();
+        ctx->value = 0;
+    } else if (i2c4_tx_done && i2c2_rx_done) {
+        TestRun_End(ctx, i2c_event_cycles);
+        ctx->value = TestRun_CountBitErrors(i2c_sweep_tx, i2c_slave_rx, I2C_SWEEP_BLOCK_SIZE);
+        step->bytes += I2C_SWEEP_BLOCK_SIZE;
+        step->bit_errors += ctx->value;
+    } else {
+        return TEST_IN_PROGRESS;
+    }
+    step->transfers++;
+    step->cycles += ctx->end_cycles - ctx->start_cycles;
+    return TEST_SUCCESS;
+}
+
+/**
+ * @brief Put both I2Cs back to their CubeMX Timing and report the sweep.
+ *
+ * The table goes to the debug UART one step per main-loop pass.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_IN_PROGRESS while reporting, then 1 if every transfer completed, TEST_FAILURE otherwise.
+ */
+static uint8_t i2c_sweep_finish(TestContext* ctx) {
+    I2cSweepState* st = TEST_CONTEXT_PRIVATE(ctx, I2cSweepState);
+    const TestSweepStep* step;
+
+    if (st->reported == 0) {
+        i2c_configure(st->saved_timing);
+    }
+    if (st->reported < i2c_sweep_table.count) {
+        step = &i2c_sweep_table.steps[st->reported++];
+        printf("%7lu Hz: %lu transfers, %lu transfers/s, %lu bit errors, NACK %u ARLO %u bus %u\r\n",
+               step->rate, step->transfers,
+               step->cycles ? (uint32_t)(((uint64_t)step->transfers * SystemCoreClock) / step->cycles) : 0,
+               step->bit_errors, step->errors[0], step->errors[1], step->errors[2]);
+        if (step->transfers > 0 && step->bit_errors == 0 &&
+            step->errors[0] == 0 && step->errors[1] == 0 && step->errors[2] == 0) {
+            st->clean = step->rate;
+        }
+        return TEST_IN_PROGRESS;
+    }
+    printf("Fastest clean I2C speed: %lu Hz\r\n", st->clean);
+    return ctx->errors ? TEST_FAILURE : TEST_SUCCESS;
+}
+
+/** @brief I2C4 (Master) -> I2C2 (Slave) speed sweep engine. */
+static const TestDriver i2c_sweep_driver = {
+    .peripheral = TEST_PERIPHERAL_I2C,
+    .name = "I2C",
+    .params = 0,
+    .max_pattern = 0,
+    .default_iterations = I2C_SWEEP_DEFAULT_TRANSFERS,
+    .estimated_us = 23200, // One block in Standard mode
+    .setup = i2c_sweep_setup,
+    .start = i2c_sweep_start,
+    .poll = i2c_sweep_poll,
+    .abort = i2c_abort,
+    .finish = i2c_sweep_finish,
+    .rescan = i2c_rescan,
+};
+
+/** @brief I2C4 (Master) -> I2C2 (Slave) test engine. */
+const TestDriver i2c_test_driver = {
+    .peripheral = TEST_PERIPHERAL_I2C,
+    .name = "I2C",
+    .params = PROTOCOL_PARAM_PATTERN | PROTOCOL_PARAM_PATTERN_REQUIRED,
+    .max_pattern = TEST_PATTERN_MAX_LENGTH,
+    .default_iterations = 5,
+    .estimated_us = 92300, // Address and 1024 bytes at 100 kHz
+    .setup = i2c_setup,
+    .start = i2c_start,
+    .poll = i2c_poll,
+    .abort = i2c_abort,
+    .finish = i2c_finish,
+    .sweep = &i2c_sweep_driver,
+    .rescan = i2c_rescan,
+};
+
+/**
+ * @brief Callback function for I2C Master Transmit Complete event.
+ *
+ * @param[in] hi2c Pointer to the I2C handler.
+ */
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c) {
+    i2c_event_cycles = TEST_CYCLES();
+    if (hi2c == I2C_4) {
+        i2c4_tx_done = 1;
+    }
+}
+
 /**
  * @brief Callback function for I2C Slave Receive Complete event.
  *
- * This function is triggered when the slave I2C receives data successfully.
- * It prepares the slave for the next reception.
+ * This function is triggered when the slave I2C has received the whole
+ * pattern and flags it for verification.
  *
  * @param[in] hi2c Pointer to the I2C handler.
  */
 void HAL_I2C_SlaveRxCpltCallback(I2C_HandleTypeDef *hi2c) {
-    // Prepare for the next reception
-    HAL_I2C_Slave_Receive_IT(I2C_2, &data_from_i2c4, sizeof(data_from_i2c4));
+    i2c_event_cycles = TEST_CYCLES();
+    if (hi2c == I2C_2) {
+        i2c2_rx_done = 1;
+    }
+}
+
+/**
+ * @brief Callback function for I2C errors.
+ *
+ * Records the HAL_I2C_ERROR_* bits of the I2C that reported the error.
+ *
+ * @param[in] hi2c Pointer to the I2C handler.
+ */
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c) {
+    i2c_event_cycles = TEST_CYCLES();
+    if (hi2c == I2C_4) {
+        i2c4_error_code |= hi2c->ErrorCode;
+    } else if (hi2c == I2C_2) {
+        i2c2_error_code |= hi2c->ErrorCode;
+    }
 }
@@ -14,6 +14,20 @@
  *
  * Ensure these connections are properly configured before running the test.
  * Both SPI peripherals should be initialized in the CubeMX configuration.
+ * Each iteration is one full-duplex DMA burst: the slave is armed with the
+ * complement of the master's data, then the master clocks the whole pattern
+ * (or, without one, a 4 KB PRBS-15 block) through MOSI while the slave's
+ * data comes back on MISO, and both received buffers are verified with
+ * word-wide compares. SPI1 uses DMA2 Stream0/3 and SPI2 DMA1 Stream3/4, so
+ * the bytes never pass through the CPU. The engine implements the
+ * TestDriver contract and never waits in place.
+ *
+ * The sweep variant (PROTOCOL_OPTION_SWEEP) steps the master's baud-rate
+ * prescaler from /2 upward and moves PRBS bursts at each clock. Errors and
+ * corrupted bits are counted per clock instead of ending the run, so the
+ * SWEEP table shows the verified throughput and the fastest clock at which
+ * the slave keeps up. The prescaler is put back to its CubeMX setting when
+ * the sweep ends.
  *
  * @author Haim
  * @date Dec 3, 2024
@@ -22,78 +36,461 @@
 #include "SPI_test.h"
 #include "UdpUut.h"
 #include "Protocol.h"
+#include "TestDriver.h"
+
+/** @brief Flag set when the SPI1 (Master) transfer completes. */
+static volatile uint8_t spi1_done = 0;
+
+/** @brief Flag set when the SPI2 (Slave) transfer completes. */
+static volatile uint8_t spi2_done = 0;
+
+/** @brief HAL_SPI_ERROR_* bits reported by SPI1 (Master) since the transfer was armed. */
+static volatile uint32_t spi1_error_code = 0;
+
+/** @brief HAL_SPI_ERROR_* bits reported by SPI2 (Slave) since the transfer was armed. */
+static volatile uint32_t spi2_error_code = 0;
+
+/** @brief Cycle counter at the last completion or error callback of either SPI. */
+static volatile uint32_t spi_event_cycles = 0;
+
+/** @brief PRBS data sent by the master when no pattern is given, and by the sweep. */
+static uint8_t spi_generated[SPI_BURST_SIZE];
+
+/** @brief Data sent back by the slave: the complement of the master's data. */
+static uint8_t spi_slave_tx[SPI_BURST_SIZE];
+
+/** @brief Data received by SPI1 (Master). */
+static uint8_t spi_master_rx[SPI_BURST_SIZE];
 
-/** @brief Data received from SPI1 (Master). */
-static uint8_t data_from_spi1 = 0;
+/** @brief Data received by SPI2 (Slave). */
+static uint8_t spi_slave_rx[SPI_BURST_SIZE];
+
+/**
+ * @brief Private state of the SPI test engine.
+ */
+typedef struct {
+    const uint8_t* master_tx;   /**< Data sent by SPI1 (Master): the pattern or spi_generated. */
+    uint16_t length;            /**< Bytes moved in each direction by a burst. */
+} SpiTestState;
+
+TEST_CONTEXT_PRIVATE_CHECK(SpiTestState);
+
+/**
+ * @brief Clear the completion and error flags before arming a new burst.
+ */
+static void spi_clear_flags(void) {
+    spi1_done = 0;
+    spi2_done = 0;
+    spi1_error_code = 0;
+    spi2_error_code = 0;
+}
 
 /**
- * @brief Runs an SPI test between SPI1 (Master) and SPI2 (Slave).
+ * @brief Stop both SPIs and bring them back to a clean state.
  *
- * This function transmits a specified bit pattern from SPI1 to SPI2
- * and verifies the received data. The test runs for a given number of
- * iterations, and results are printed for debugging.
+ * A burst cut short leaves the slave part-way through a byte, which would
+ * shift every later burst by a few bits; resetting both peripherals
+ * realigns them. They are already initialized, so HAL_SPI_Init only
+ * rewrites their registers with the current settings.
  *
- * @param[in] bit_pattern Pointer to the bit pattern to transmit.
- * @param[in] pattern_length Length of the bit pattern.
- * @param[in] iterations Number of iterations for the test.
- * @return uint8_t Returns SPI_SUCCESS (1) on success, SPI_FAILURE (TEST_FAILURE) on failure.
+ * @return HAL_StatusTypeDef Status of the reinitialization.
  */
-uint8_t test_spi(const char *bit_pattern, size_t pattern_length, int iterations) {
-    uint8_t data_to_spi2 = 0;  // Data sent to slave
+static HAL_StatusTypeDef spi_resync(void) {
+    HAL_SPI_Abort(SPI_1);
+    HAL_SPI_Abort(SPI_2);
+    __HAL_RCC_SPI1_FORCE_RESET();
+    __HAL_RCC_SPI1_RELEASE_RESET();
+    __HAL_RCC_SPI2_FORCE_RESET();
+    __HAL_RCC_SPI2_RELEASE_RESET();
+    spi_clear_flags();
+    if (HAL_SPI_Init(SPI_1) != HAL_OK) {
+        return HAL_ERROR;
+    }
+    return HAL_SPI_Init(SPI_2);
+}
 
-    printf("Starting SPI Test with pattern: %s, length: %d, iterations: %d\n\r",
-           bit_pattern, (int)pattern_length, iterations);
+/**
+ * @brief SCK frequency of the master at its current prescaler.
+ *
+ * @return uint32_t Clock in Hz.
+ */
+static uint32_t spi_clock(void) {
+    return HAL_RCC_GetPCLK2Freq() >> (((hspi1.Init.BaudRatePrescaler & SPI_CR1_BR) >> SPI_CR1_BR_Pos) + 1);
+}
 
-    HAL_SPI_Receive_IT(SPI_2, &data_from_spi1, 1);
+/**
+ * @brief Arm one full-duplex DMA burst.
+ *
+ * The slave (SPI2) is armed first, so it is ready before the master (SPI1)
+ * starts clocking.
+ *
+ * @param[in] ctx Pointer to the test context; its deadline covers the burst at the current clock.
+ * @param[in] master_tx Data sent by the master; only read by the DMA.
+ * @param[in] length Bytes moved in each direction.
+ * @return HAL_StatusTypeDef Status of the HAL.
+ */
+static HAL_StatusTypeDef spi_arm(TestContext* ctx, const uint8_t* master_tx, uint16_t length) {
+    HAL_StatusTypeDef status;
 
-    for (int i = 0; i < iterations; i++) {
-        printf("\nIteration %d:\r\n", i + 1);
-        data_to_spi2++;
-        data_to_spi2 %= 255;
+    spi_clear_flags();
+    status = HAL_SPI_TransmitReceive_DMA(SPI_2, spi_slave_tx, spi_slave_rx, length);
+    if (status != HAL_OK) {
+        return status;
+    }
+    status = HAL_SPI_TransmitReceive_DMA(SPI_1, (uint8_t*)master_tx, spi_master_rx, length);
+    if (status != HAL_OK) {
+        HAL_SPI_Abort(SPI_2);
+        return status;
+    }
 
-        HAL_Delay(100);  // Delay for readability
+    // Slow clocks need more than the default timeout for a multi-kilobyte burst
+    ctx->deadline += (uint32_t)(((uint64_t)length * 8 * 1000) / spi_clock()) + 1;
+    return HAL_OK;
+}
 
-        // Transmit data from Master (SPI1) to Slave (SPI2)
-        if (HAL_SPI_Transmit(SPI_1, &data_to_spi2, 1, 100) == HAL_OK) {
-            printf("Master sent: 0x%02X\n\r", data_to_spi2);
-        } else {
-            printf("Master Transmit Error! Returning TEST_FAILURE\n\r");
-            return TEST_FAILURE;  // Return failure code
-        }
+/**
+ * @brief Fill the slave's transmit buffer with the complement of the master's data.
+ *
+ * @param[in] master_tx Data sent by the master.
+ * @param[in] length Length of the data.
+ */
+static void spi_fill_slave_tx(const uint8_t* master_tx, uint16_t length) {
+    uint16_t i;
 
-        // Receive data from Slave (SPI2)
-        if (HAL_SPI_Receive_IT(SPI_1, &data_from_spi1, 1) == HAL_OK) {
-            printf("Master received: 0x%02X\n\r", data_from_spi1);
-        } else {
-            printf("Master Receive Error! Returning TEST_FAILURE\n\r");
-            return TEST_FAILURE;  // Return failure code
-        }
+    for (i = 0; i < length; i++) {
+        spi_slave_tx[i] = (uint8_t)~master_tx[i];
+    }
+}
 
-        // Compare transmitted and received data
-        if (data_to_spi2 != data_from_spi1) {
-            printf("Mismatch! Sent: 0x%02X, Received: 0x%02X\n\r", data_to_spi2, data_from_spi1);
-            return TEST_FAILURE;  // Return failure if mismatch
-        } else {
-            printf("Match! Sent: 0x%02X, Received: 0x%02X\n\r", data_to_spi2, data_from_spi1);
-            printf("Iteration %d passed\r\n", i + 1);
-        }
+/**
+ * @brief Prepare the SPI test.
+ *
+ * The master sends the pattern, or a PRBS-15 block of SPI_BURST_SIZE bytes
+ * if none is given; the slave sends its complement, so a stuck or shorted
+ * data line cannot pass.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_SUCCESS, or TEST_FAILURE if the SPIs cannot be reset.
+ */
+static uint8_t spi_setup(TestContext* ctx) {
+    SpiTestState* st = TEST_CONTEXT_PRIVATE(ctx, SpiTestState);
+
+    if (ctx->pattern_length > 0) {
+        st->master_tx = ctx->pattern;
+        st->length = ctx->pattern_length;
+    } else {
+        TestRun_FillPrbs(spi_generated, SPI_BURST_SIZE, 0);
+        st->master_tx = spi_generated;
+        st->length = SPI_BURST_SIZE;
+    }
+    spi_fill_slave_tx(st->master_tx, st->length);
+    ctx->bytes = 2 * st->length; // One burst in each direction
+
+    if (spi_resync() != HAL_OK) {
+        printf("SPI could not be reset\r\n");
+        return TEST_FAILURE;
     }
+    printf("SPI burst length: %u bytes at %lu Hz\r\n", st->length, spi_clock());
+    return TEST_SUCCESS;
+}
+
+/**
+ * @brief Arm one full-duplex SPI burst.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_IN_PROGRESS, or TEST_FAILURE if a transfer cannot be armed.
+ */
+static uint8_t spi_start(TestContext* ctx) {
+    SpiTestState* st = TEST_CONTEXT_PRIVATE(ctx, SpiTestState);
+
+    if (spi_arm(ctx, st->master_tx, st->length) != HAL_OK) {
+        printf("SPI burst could not be armed! Returning TEST_FAILURE\r\n");
+        return TEST_FAILURE;
+    }
+    return TEST_IN_PROGRESS;
+}
+
+/**
+ * @brief Check whether the SPI burst has completed.
+ *
+ * The value of the iteration is the number of mismatching bytes received
+ * by the slave (high half) and the master (low half), or on an SPI error
+ * the HAL_SPI_ERROR_* bits of the slave (high half) and the master (low half).
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_IN_PROGRESS while transferring, 1 on match, TEST_FAILURE otherwise.
+ */
+static uint8_t spi_poll(TestContext* ctx) {
+    SpiTestState* st = TEST_CONTEXT_PRIVATE(ctx, SpiTestState);
+
+    if (spi1_error_code || spi2_error_code) {
+        TestRun_End(ctx, spi_event_cycles);
+        ctx->value = (spi2_error_code << 16) | (spi1_error_code & 0xFFFF);
+        printf("SPI Error! Master 0x%02lX, Slave 0x%02lX. Returning TEST_FAILURE\r\n",
+               spi1_error_code, spi2_error_code);
+        spi_resync();
+        return TEST_FAILURE;
+    }
+    if (!spi1_done || !spi2_done) {
+        return TEST_IN_PROGRESS;
+    }
+    TestRun_End(ctx, spi_event_cycles);
+
+    // Compare transmitted and received data in both directions
+    ctx->value = ((uint32_t)TestRun_CountMismatches(st->master_tx, spi_slave_rx, st->length) << 16) |
+                 TestRun_CountMismatches(spi_slave_tx, spi_master_rx, st->length);
+    if (ctx->value != 0) {
+        printf("Mismatch at iteration %lu! Slave got %u bad bytes, Master got %u bad bytes\r\n",
+               ctx->iteration + 1, (uint16_t)(ctx->value >> 16), (uint16_t)ctx->value);
+        return TEST_FAILURE;
+    }
+    TEST_TRACE("Iteration %lu passed\r\n", ctx->iteration + 1);
+    return TEST_SUCCESS;
+}
+
+/**
+ * @brief Abort any SPI transfer left armed by the engine.
+ *
+ * @param[in] ctx Pointer to the test context.
+ */
+static void spi_abort(TestContext* ctx) {
+    spi_resync();
+}
 
+/**
+ * @brief Report the result of the SPI test.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns SPI_SUCCESS (1) on success, SPI_FAILURE (TEST_FAILURE) on failure.
+ */
+static uint8_t spi_finish(TestContext* ctx) {
+    if (ctx->errors) {
+        printf("SPI Test Failed.\r\n");
+        return TEST_FAILURE;
+    }
     printf("***********************\r\n");
     printf("\nSPI test complete.\r\n");
-    return TEST_SUCCESS;  // Return success code
+    return TEST_SUCCESS;
+}
+
+/** @brief Step table of the sweep. */
+static TestSweep spi_sweep_table;
+
+/**
+ * @brief Private state of the SPI sweep engine.
+ */
+typedef struct {
+    uint32_t per_step;          /**< Transfers run at each prescaler. */
+    uint32_t saved_prescaler;   /**< Prescaler set by CubeMX, restored at the end. */
+    uint32_t clean;             /**< Fastest clean clock of the steps reported so far. */
+    uint8_t reported;           /**< Steps printed by `finish` so far. */
+} SpiSweepState;
+
+TEST_CONTEXT_PRIVATE_CHECK(SpiSweepState);
+
+/**
+ * @brief Add the errors reported by an SPI to a sweep step.
+ *
+ * @param[in,out] step Pointer to the step.
+ * @param[in] code HAL_SPI_ERROR_* bits.
+ */
+static void spi_sweep_count_errors(TestSweepStep* step, uint32_t code) {
+    step->errors[0] += (code & HAL_SPI_ERROR_OVR) != 0;
+    step->errors[1] += (code & HAL_SPI_ERROR_DMA) != 0;
+    step->errors[2] += (code & ~(HAL_SPI_ERROR_OVR | HAL_SPI_ERROR_DMA)) != 0;
 }
 
 /**
- * @brief Callback for SPI reception complete.
+ * @brief Prepare the prescaler sweep.
  *
- * This function handles SPI receive completion interrupt for SPI2.
- * It reinitializes the receive process to enable continuous data reception.
+ * Builds the step table from every prescaler, /2 (the fastest clock) first,
+ * and generates the PRBS burst. The requested iterations run at every step.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_SUCCESS, or TEST_FAILURE if the SPIs cannot be reset.
+ */
+static uint8_t spi_sweep_setup(TestContext* ctx) {
+    SpiSweepState* st = TEST_CONTEXT_PRIVATE(ctx, SpiSweepState);
+    uint32_t pclk = HAL_RCC_GetPCLK2Freq();
+    uint8_t i;
+
+    memset(&spi_sweep_table, 0, sizeof(spi_sweep_table));
+    for (i = 0; i < TEST_SWEEP_MAX_STEPS; i++) {
+        spi_sweep_table.steps[i].rate = pclk >> (i + 1);
+        spi_sweep_table.steps[i].mode = i + 1; // The prescaler is 2^mode
+    }
+    spi_sweep_table.count = TEST_SWEEP_MAX_STEPS;
+
+    st->saved_prescaler = hspi1.Init.BaudRatePrescaler;
+    st->per_step = ctx->iterations;
+    if (st->per_step > UINT32_MAX / spi_sweep_table.count) {
+        st->per_step = UINT32_MAX / spi_sweep_table.count;
+    }
+    ctx->iterations = st->per_step * spi_sweep_table.count;
+    ctx->bytes = 2 * SPI_BURST_SIZE;
+    ctx->sweep = &spi_sweep_table;
+    TestRun_FillPrbs(spi_generated, SPI_BURST_SIZE, 0);
+    spi_fill_slave_tx(spi_generated, SPI_BURST_SIZE);
+
+    if (spi_resync() != HAL_OK) {
+        printf("SPI could not be reset\r\n");
+        return TEST_FAILURE;
+    }
+    return TEST_SUCCESS;
+}
+
+/**
+ * @brief Arm one sweep burst, moving the master to the next prescaler first when a step begins.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_IN_PROGRESS, or TEST_FAILURE if the SPI cannot be set up or armed.
+ */
+static uint8_t spi_sweep_start(TestContext* ctx) {
+    SpiSweepState* st = TEST_CONTEXT_PRIVATE(ctx, SpiSweepState);
+    uint32_t index = ctx->iteration / st->per_step;
+
+    if (ctx->iteration % st->per_step == 0) {
+        hspi1.Init.BaudRatePrescaler = index << SPI_CR1_BR_Pos;
+        if (HAL_SPI_Init(SPI_1) != HAL_OK) {
+            printf("SPI sweep could not set prescaler /%u\r\n", 1u << spi_sweep_table.steps[index].mode);
+            return TEST_FAILURE;
+        }
+        TEST_TRACE("SPI sweep: %lu Hz, prescaler /%u\r\n", spi_sweep_table.steps[index].rate,
+                   1u << spi_sweep_table.steps[index].mode);
+    }
+
+    if (spi_arm(ctx, spi_generated, SPI_BURST_SIZE) != HAL_OK) {
+        printf("SPI sweep burst could not be armed\r\n");
+        return TEST_FAILURE;
+    }
+    return TEST_IN_PROGRESS;
+}
+
+/**
+ * @brief Check whether the sweep burst has completed and add it to its step.
+ *
+ * A burst that reports an error is cut short and its data is not compared;
+ * both SPIs are realigned for the next one. The value of the iteration is
+ * the number of bit errors in both directions.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_IN_PROGRESS while transferring, otherwise TEST_SUCCESS.
+ */
+static uint8_t spi_sweep_poll(TestContext* ctx) {
+    SpiSweepState* st = TEST_CONTEXT_PRIVATE(ctx, SpiSweepState);
+    TestSweepStep* step = &spi_sweep_table.steps[ctx->iteration / st->per_step];
+
+    if (spi1_error_code || spi2_error_code) {
+        TestRun_End(ctx, spi_event_cycles);
+        spi_sweep_count_errors(step, spi1_error_code);
+        spi_sweep_count_errors(step, spi2_error_code);
+        spi_resync();
+        ctx->value = 0;
+    } else if (spi1_done && spi2_done) {
+        TestRun_End(ctx, spi_event_cycles);
+        ctx->value = TestRun_CountBitErrors(spi_generated, spi_slave_rx, SPI_BURST_SIZE) +
+                     TestRun_CountBitErrors(spi_slave_tx, spi_master_rx, SPI_BURST_SIZE);
+        step->bytes += 2 * SPI_BURST_SIZE;
+        step->bit_errors += ctx->value;
+    } else {
+        return TEST_IN_PROGRESS;
+    }
+    step->transfers++;
+    step->cycles += ctx->end_cycles - ctx->start_cycles;
+    return TEST_SUCCESS;
+}
+
+/**
+ * @brief Put the master back to its CubeMX prescaler and report the sweep.
+ *
+ * The table goes to the debug UART one step per main-loop pass.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_IN_PROGRESS while reporting, then 1 if every transfer completed, TEST_FAILURE otherwise.
+ */
+static uint8_t spi_sweep_finish(TestContext* ctx) {
+    SpiSweepState* st = TEST_CONTEXT_PRIVATE(ctx, SpiSweepState);
+    const TestSweepStep* step;
+
+    if (st->reported == 0) {
+        hspi1.Init.BaudRatePrescaler = st->saved_prescaler;
+        HAL_SPI_Init(SPI_1);
+    }
+    if (st->reported < spi_sweep_table.count) {
+        step = &spi_sweep_table.steps[st->reported++];
+        printf("%8lu Hz /%-3u: %lu transfers, %lu bytes, %lu bit errors, OVR %u DMA %u other %u\r\n",
+               step->rate, 1u << step->mode, step->transfers, step->bytes, step->bit_errors,
+               step->errors[0], step->errors[1], step->errors[2]);
+        if (step->transfers > 0 && step->bit_errors == 0 && step->rate > st->clean &&
+            step->errors[0] == 0 && step->errors[1] == 0 && step->errors[2] == 0) {
+            st->clean = step->rate;
+        }
+        return TEST_IN_PROGRESS;
+    }
+    printf("Fastest clean SPI clock: %lu Hz\r\n", st->clean);
+    return ctx->errors ? TEST_FAILURE : TEST_SUCCESS;
+}
+
+/** @brief SPI1 (Master) <-> SPI2 (Slave) prescaler sweep engine. */
+static const TestDriver spi_sweep_driver = {
+    .peripheral = TEST_PERIPHERAL_SPI,
+    .name = "SPI",
+    .params = 0,
+    .max_pattern = 0,
+    .default_iterations = SPI_SWEEP_DEFAULT_TRANSFERS,
+    .estimated_us = 117000, // One burst at the slowest clock (/256)
+    .setup = spi_sweep_setup,
+    .start = spi_sweep_start,
+    .poll = spi_sweep_poll,
+    .abort = spi_abort,
+    .finish = spi_sweep_finish,
+};
+
+/** @brief SPI1 (Master) <-> SPI2 (Slave) test engine. */
+const TestDriver spi_test_driver = {
+    .peripheral = TEST_PERIPHERAL_SPI,
+    .name = "SPI",
+    .params = PROTOCOL_PARAM_PATTERN, // Without a pattern a PRBS block is sent
+    .max_pattern = TEST_PATTERN_MAX_LENGTH,
+    .default_iterations = 5,
+    .estimated_us = 1000, // A 4 KB burst at the CubeMX clock (/2)
+    .setup = spi_setup,
+    .start = spi_start,
+    .poll = spi_poll,
+    .abort = spi_abort,
+    .finish = spi_finish,
+    .sweep = &spi_sweep_driver,
+};
+
+/**
+ * @brief Callback for SPI full-duplex transfer complete.
+ *
+ * This function flags the completion of the SPI1 (Master) or SPI2 (Slave)
+ * side of the current burst.
  *
  * @param[in] hspi Pointer to the SPI handle that triggered the interrupt.
  */
-void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi) {
-    if (hspi == SPI_2) {
-        HAL_SPI_Receive_IT(SPI_2, &data_from_spi1, sizeof(data_from_spi1));
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi) {
+    spi_event_cycles = TEST_CYCLES();
+    if (hspi == SPI_1) {
+        spi1_done = 1;
+    } else if (hspi == SPI_2) {
+        spi2_done = 1;
+    }
+}
+
+/**
+ * @brief Callback for SPI errors.
+ *
+ * Records the HAL_SPI_ERROR_* bits of the SPI that reported the error.
+ *
+ * @param[in] hspi Pointer to the SPI handle that reported the error.
+ */
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi) {
+    spi_event_cycles = TEST_CYCLES();
+    if (hspi == SPI_1) {
+        spi1_error_code |= hspi->ErrorCode;
+    } else if (hspi == SPI_2) {
+        spi2_error_code |= hspi->ErrorCode;
     }
 }
@@ -8,6 +8,8 @@
  * @details This test validates that two timers (TIM3 and TIM2) can accurately
  * operate for a random duration and remain synchronized. The test ensures
  * that both timers generate periodic interrupts and measure time correctly.
+ * The engine implements the TestDriver contract: an iteration arms both
+ * timers and is polled until their interrupts report completion.
  *
  * @note Ensure both TIM3 and TIM2 are configured for periodic interrupts,
  * and the interrupt service routine is enabled. Random durations between
@@ -24,6 +26,7 @@
 #include "UdpUut.h"
 #include "Protocol.h"
 #include "Timer_test.h"
+#include "TestDriver.h"
 
 /** @brief Counter for TIM3 elapsed seconds. */
 volatile uint32_t tim3_seconds = 0;
@@ -40,55 +43,118 @@ volatile uint8_t tim2_done = 0;
 /** @brief Random duration for the test (1 to 10 seconds). */
 volatile uint32_t random_duration = 0;
 
+/** @brief Cycle counter when TIM3 reached the random duration. */
+static volatile uint32_t tim3_done_cycles = 0;
+
+/** @brief Cycle counter when TIM2 reached the random duration. */
+static volatile uint32_t tim2_done_cycles = 0;
+
+/** @brief Slack in milliseconds allowed on top of the random duration. */
+#define TIMER_DEADLINE_SLACK 2000
+
 /**
- * @brief Test the synchronization of TIM3 and TIM2.
- *
- * This function generates random durations and tests whether both
- * timers (TIM3 and TIM2) can accurately measure the same duration.
+ * @brief Prepare the timer synchronization test.
  *
- * @param[in] iterations Number of iterations to run the test.
- * @return uint8_t Returns 1 on success, TEST_FAILURE on failure.
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_SUCCESS.
  */
-uint8_t test_timer(uint16_t iterations) {
-    printf("Starting Timer Test with %u iterations...\r\n", iterations);
+static uint8_t timer_setup(TestContext* ctx) {
+    srand(HAL_GetTick());
+    return TEST_SUCCESS;
+}
 
-    srand(time(NULL));
-    for (uint16_t i = 0; i < iterations; i++) {
-        printf("\nIteration %d:\r\n", i + 1);
+/**
+ * @brief Arm both timers for a new random duration.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_IN_PROGRESS, or TEST_FAILURE if a timer cannot be started.
+ */
+static uint8_t timer_start(TestContext* ctx) {
+    TEST_TRACE("\nIteration %lu:\r\n", ctx->iteration + 1);
 
-        // Generate a random time duration between 1 and 10 seconds
-        random_duration = (rand() % 10) + 1;
-        printf("Random duration: %lu seconds\r\n", random_duration);
+    // Generate a random time duration between 1 and 10 seconds
+    random_duration = (rand() % 10) + 1;
+    TEST_TRACE("Random duration: %lu seconds\r\n", random_duration);
 
-        HAL_TIM_Base_Start_IT(TIM3A);  // Start TIM3 with interrupt
-        HAL_TIM_Base_Start_IT(TIM2A);  // Start TIM2 with interrupt
+    // Reset flags and counters
+    tim3_seconds = 0;
+    tim2_seconds = 0;
+    tim3_done = 0;
+    tim2_done = 0;
 
-        // Reset flags and counters
-        tim3_seconds = 0;
-        tim2_seconds = 0;
-        tim3_done = 0;
-        tim2_done = 0;
+    if (HAL_TIM_Base_Start_IT(TIM3A) != HAL_OK || HAL_TIM_Base_Start_IT(TIM2A) != HAL_OK) {
+        printf("Timer start failed\r\n");
+        return TEST_FAILURE;
+    }
+    ctx->deadline = HAL_GetTick() + random_duration * 1000 + TIMER_DEADLINE_SLACK;
+    return TEST_IN_PROGRESS;
+}
 
-        // Wait for both timers to complete the random duration
-        while (!tim3_done || !tim2_done) {
-            // Busy-wait loop to synchronize timers
-        }
+/**
+ * @brief Check whether both timers have completed the random duration.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_IN_PROGRESS while counting, 1 if synchronized, TEST_FAILURE otherwise.
+ */
+static uint8_t timer_poll(TestContext* ctx) {
+    if (!tim3_done || !tim2_done) {
+        return TEST_IN_PROGRESS;
+    }
+    TestRun_End(ctx, tim3_done_cycles);
+    TestRun_End(ctx, tim2_done_cycles);
 
-        // Compare the timers
-        if (tim3_seconds == random_duration && tim2_seconds == random_duration) {
-            printf("Timers are synchronized: TIM3 = %lu, TIM2 = %lu\r\n", tim3_seconds, tim2_seconds);
-            printf("Iteration %d passed\r\n", i + 1);
-        } else {
-            printf("Timers mismatch: TIM3 = %lu, TIM2 = %lu\r\n", tim3_seconds, tim2_seconds);
-            return TEST_FAILURE;  // Failure
-        }
+    // Compare the timers; report TIM3 seconds in the high half, TIM2 seconds in the low half
+    ctx->value = (tim3_seconds << 16) | (tim2_seconds & 0xFFFF);
+    if (tim3_seconds == random_duration && tim2_seconds == random_duration) {
+        TEST_TRACE("Timers are synchronized: TIM3 = %lu, TIM2 = %lu\r\n", tim3_seconds, tim2_seconds);
+        TEST_TRACE("Iteration %lu passed\r\n", ctx->iteration + 1);
+        return TEST_SUCCESS;
     }
+    printf("Timers mismatch: TIM3 = %lu, TIM2 = %lu\r\n", tim3_seconds, tim2_seconds);
+    return TEST_FAILURE;
+}
 
+/**
+ * @brief Stop both timers.
+ *
+ * @param[in] ctx Pointer to the test context.
+ */
+static void timer_abort(TestContext* ctx) {
+    HAL_TIM_Base_Stop_IT(TIM3A);
+    HAL_TIM_Base_Stop_IT(TIM2A);
+}
+
+/**
+ * @brief Report the result of the timer synchronization test.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns 1 on success, TEST_FAILURE on failure.
+ */
+static uint8_t timer_finish(TestContext* ctx) {
+    if (ctx->errors) {
+        printf("Timer Test Failed.\r\n");
+        return TEST_FAILURE;
+    }
     printf("***********************\r\n");
     printf("\nTimer Test complete.\r\n");
     return TEST_SUCCESS;
 }
 
+/** @brief Timer synchronization test engine. */
+const TestDriver timer_test_driver = {
+    .peripheral = TEST_PERIPHERAL_TIMER,
+    .name = "Timer",
+    .params = 0,
+    .max_pattern = 0,
+    .default_iterations = 1,
+    .estimated_us = 5500000, // Random duration of 1 to 10 s
+    .setup = timer_setup,
+    .start = timer_start,
+    .poll = timer_poll,
+    .abort = timer_abort,
+    .finish = timer_finish,
+};
+
 /**
  * @brief Callback for Timer interrupt.
  *
@@ -102,12 +168,14 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim) {
     if (htim->Instance == TIM3) {
         tim3_seconds++;
         if (tim3_seconds >= random_duration) {
+            tim3_done_cycles = TEST_CYCLES();
             tim3_done = 1;
             HAL_TIM_Base_Stop_IT(TIM3A);  // Stop TIM3
         }
     } else if (htim->Instance == TIM2) {
         tim2_seconds++;
         if (tim2_seconds >= random_duration) {
+            tim2_done_cycles = TEST_CYCLES();
             tim2_done = 1;
             HAL_TIM_Base_Stop_IT(TIM2A);  // Stop TIM2
         }
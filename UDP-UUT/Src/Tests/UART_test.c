@@ -11,7 +11,20 @@
  *
  * The test verifies data integrity over multiple iterations by transmitting
  * a bit pattern and checking the received data for mismatches or errors.
- * It also includes error handling for transmission and reception failures.
+ * Both directions run at the same time under DMA: both UARTs receive for
+ * the whole test into circular DMA rings (UartRing.c, DMA1 Stream0/5), and
+ * each iteration starts both TX streams (DMA1 Stream7/6). The received
+ * pattern is compared where the DMA wrote it, so an iteration takes one
+ * frame time at line rate and no CPU copy per byte, and bytes that arrive
+ * early or late are neither lost nor mistaken for the next iteration. The
+ * engine implements the TestDriver contract and never waits in place.
+ *
+ * The sweep variant (PROTOCOL_OPTION_SWEEP) reconfigures both UARTs through
+ * a list of baud rates, with oversampling by 16 and then by 8, and streams
+ * a PRBS-15 block in both directions at each rate. Line errors are counted
+ * per rate instead of ending the run, so the SWEEP table shows the highest
+ * clean rate and the bit-error rate of the faster ones. Both UARTs are put
+ * back to their CubeMX settings when the sweep ends.
  *
  * @author Haim
  * @date Dec 3, 2024
@@ -20,6 +33,8 @@
 #include "UART_test.h"
 #include "UdpUut.h"
 #include "Protocol.h"
+#include "TestDriver.h"
+#include "UartRing.h"
 
 // UART Test Function variables
 
@@ -35,97 +50,504 @@ volatile uint8_t Uart_5_ErrorCallback_Flag = 0;
 /** @brief Flag for UART2 error callback. */
 volatile uint8_t Uart_2_ErrorCallback_Flag = 0;
 
-/** @brief HAL status variables for UART operations. */
-volatile HAL_StatusTypeDef status2tx, status2rx, status5tx, status5rx;
+/** @brief Flag for UART5 TX complete callback. */
+volatile uint8_t UART_5_TX_Complete_Callback_Flag = 0;
+
+/** @brief Flag for UART2 TX complete callback. */
+volatile uint8_t UART_2_TX_Complete_Callback_Flag = 0;
+
+/** @brief HAL_UART_ERROR_* bits reported by the last UART5 error callback. */
+volatile uint32_t Uart_5_ErrorCode = 0;
+
+/** @brief HAL_UART_ERROR_* bits reported by the last UART2 error callback. */
+volatile uint32_t Uart_2_ErrorCode = 0;
+
+/** @brief Cycle counter at the last TX, RX or error callback of either UART. */
+static volatile uint32_t uart_event_cycles = 0;
+
+/** @brief DMA buffer of the UART5 receive ring. */
+static uint8_t uart5_rx_buffer[UART_RX_RING_SIZE];
+
+/** @brief DMA buffer of the UART2 receive ring. */
+static uint8_t uart2_rx_buffer[UART_RX_RING_SIZE];
+
+/** @brief Receive ring of UART5 (data sent by UART2). */
+static UartRing uart5_rx_ring;
+
+/** @brief Receive ring of UART2 (data sent by UART5). */
+static UartRing uart2_rx_ring;
+
+/**
+ * @brief Clear all UART callback flags before arming a new iteration.
+ */
+static void uart_clear_flags(void) {
+    UART_5_RX_Complete_Callback_Flag = 0;
+    UART_2_RX_Complete_Callback_Flag = 0;
+    UART_5_TX_Complete_Callback_Flag = 0;
+    UART_2_TX_Complete_Callback_Flag = 0;
+    Uart_5_ErrorCallback_Flag = 0;
+    Uart_2_ErrorCallback_Flag = 0;
+    Uart_5_ErrorCode = 0;
+    Uart_2_ErrorCode = 0;
+}
+
+/**
+ * @brief Compare the next bytes of a receive ring with the pattern and consume them.
+ *
+ * The ring holds the bytes in at most two pieces (before and after the end
+ * of its buffer); both are compared in place.
+ *
+ * @param[in,out] ring Pointer to the ring; at least `length` bytes must be available.
+ * @param[in] pattern Pointer to the expected data.
+ * @param[in] length Length of the pattern.
+ * @return uint16_t Number of mismatching bytes.
+ */
+static uint16_t uart_ring_compare(UartRing* ring, const uint8_t* pattern, uint16_t length) {
+    const uint8_t* data;
+    uint16_t mismatches = 0;
+    uint16_t chunk;
+
+    while (length > 0) {
+        chunk = UartRing_Peek(ring, &data);
+        if (chunk > length) {
+            chunk = length;
+        }
+        mismatches += TestRun_CountMismatches(pattern, data, chunk);
+        UartRing_Consume(ring, chunk);
+        pattern += chunk;
+        length -= chunk;
+    }
+    return mismatches;
+}
+
+/**
+ * @brief Prepare the UART test and start both receive rings.
+ *
+ * The runner has checked the pattern against the descriptor.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_SUCCESS, or TEST_FAILURE if a ring cannot be started.
+ */
+static uint8_t uart_setup(TestContext* ctx) {
+    ctx->bytes = 2 * ctx->pattern_length; // The pattern crosses the loopback in both directions
+
+    uart_clear_flags();
+    if (UartRing_Start(&uart5_rx_ring, UART_5, uart5_rx_buffer, UART_RX_RING_SIZE) != HAL_OK ||
+        UartRing_Start(&uart2_rx_ring, UART_2, uart2_rx_buffer, UART_RX_RING_SIZE) != HAL_OK) {
+        printf("UART receive rings could not be started\r\n");
+        return TEST_FAILURE;
+    }
+    return TEST_SUCCESS;
+}
+
+/**
+ * @brief Arm one UART loopback iteration.
+ *
+ * Both UARTs are already receiving into their rings; stray bytes are
+ * dropped, then both directions are transmitted at the same time by DMA.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_IN_PROGRESS, or TEST_FAILURE if a transfer cannot be armed.
+ */
+static uint8_t uart_start(TestContext* ctx) {
+    HAL_StatusTypeDef status2tx, status5tx;
+
+    uart_clear_flags();
+    UartRing_Flush(&uart5_rx_ring);
+    UartRing_Flush(&uart2_rx_ring);
+
+    // UART2 and UART5 Transmission
+    status2tx = HAL_UART_Transmit_DMA(UART_2, ctx->pattern, ctx->pattern_length);
+    status5tx = HAL_UART_Transmit_DMA(UART_5, ctx->pattern, ctx->pattern_length);
+    if (status2tx != HAL_OK || status5tx != HAL_OK) {
+        printf("UART TX failed with status: UART2 %d, UART5 %d\r\n", status2tx, status5tx);
+        return TEST_FAILURE;
+    }
+    return TEST_IN_PROGRESS;
+}
 
 /**
- * @brief Test UART communication between UART5 and UART2.
+ * @brief Check whether the UART loopback iteration has completed.
  *
- * This function transmits a specified bit pattern between UART5 and UART2
- * over multiple iterations. It verifies data integrity and handles errors
- * during transmission and reception.
+ * The value of the iteration is the number of mismatching bytes received
+ * by UART5 (high half) and UART2 (low half), or on a UART error the
+ * HAL_UART_ERROR_* bits of UART5 (high half) and UART2 (low half). An
+ * error ends the run, so these bits, in the telemetry record of the failing
+ * iteration, are the whole error report of the test.
  *
- * @param[in] bit_pattern Pointer to the bit pattern to transmit.
- * @param[in] pattern_length Length of the bit pattern.
- * @param[in] iterations Number of iterations for the test.
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_IN_PROGRESS while transferring, 1 on match, TEST_FAILURE otherwise.
+ */
+static uint8_t uart_poll(TestContext* ctx) {
+    // Error Handling and Data Verification
+    if (Uart_5_ErrorCallback_Flag == 1 || Uart_2_ErrorCallback_Flag == 1) {
+        TestRun_End(ctx, uart_event_cycles);
+        ctx->value = (Uart_5_ErrorCode << 16) | (Uart_2_ErrorCode & 0xFFFF);
+        printf("Error detected in UART5 (0x%02lX) or UART2 (0x%02lX)\r\n", Uart_5_ErrorCode, Uart_2_ErrorCode);
+        return TEST_FAILURE;
+    }
+    if (!UART_5_TX_Complete_Callback_Flag || !UART_2_TX_Complete_Callback_Flag ||
+        UartRing_Available(&uart5_rx_ring) < ctx->pattern_length ||
+        UartRing_Available(&uart2_rx_ring) < ctx->pattern_length) {
+        return TEST_IN_PROGRESS;
+    }
+    TestRun_End(ctx, uart_event_cycles);
+    TestRun_End(ctx, uart5_rx_ring.event_cycles);
+    TestRun_End(ctx, uart2_rx_ring.event_cycles);
+
+    // Compare received data; report mismatching UART5 bytes in the high half, UART2 bytes in the low half
+    ctx->value = ((uint32_t)uart_ring_compare(&uart5_rx_ring, ctx->pattern, ctx->pattern_length) << 16) |
+                 uart_ring_compare(&uart2_rx_ring, ctx->pattern, ctx->pattern_length);
+    if (ctx->value != 0) {
+        printf("Data mismatch detected at iteration %lu\r\n", ctx->iteration + 1);
+        return TEST_FAILURE;
+    }
+    TEST_TRACE("Iteration %lu passed\r\n", ctx->iteration + 1);
+    return TEST_SUCCESS;
+}
+
+/**
+ * @brief Abort any UART transfer left armed by the engine.
+ *
+ * @param[in] ctx Pointer to the test context.
+ */
+static void uart_abort(TestContext* ctx) {
+    HAL_UART_Abort(UART_5);
+    HAL_UART_Abort(UART_2);
+    uart_clear_flags();
+}
+
+/**
+ * @brief Stop the receive rings and report the result of the UART test.
+ *
+ * @param[in] ctx Pointer to the test context.
  * @return uint8_t Returns 1 on success, TEST_FAILURE on failure.
  */
-uint8_t test_uart(const char* bit_pattern, uint8_t pattern_length, uint8_t iterations) {
-    uint8_t recv_msg5_rx[UART_BUFFER_SIZE_MEDIUM] = {0};
-    uint8_t recv_msg2_rx[UART_BUFFER_SIZE_MEDIUM] = {0};
-
-    for (uint8_t i = 0; i < iterations; ++i) {
-        printf("\nIteration %d:\r\n", i + 1);
-
-        uint32_t iteration_start_time = HAL_GetTick(); // Track total time for the iteration
-
-        while (HAL_GetTick() - iteration_start_time < SHORT_TIMEOUT) { // Limit to SHORT_TIMEOUT per iteration
-            // UART2 Transmission
-            status2tx = HAL_UART_Transmit(UART_2, (uint8_t*)bit_pattern, pattern_length + 1, SHORT_TIMEOUT);
-            if (status2tx != HAL_OK) {
-                printf("UART2 TX failed with status: %d\r\n", status2tx);
-                return TEST_FAILURE;
-            }
-            HAL_Delay(SHORT_Delay);
-
-            // UART5 Transmission
-            status5tx = HAL_UART_Transmit(UART_5, (uint8_t*)bit_pattern, pattern_length + 1, SHORT_TIMEOUT);
-            if (status5tx != HAL_OK) {
-                printf("UART5 TX failed with status: %d\r\n", status5tx);
-                return TEST_FAILURE;
-            }
-            HAL_Delay(SHORT_Delay);
-
-            // UART5 Reception
-            status5rx = HAL_UART_Receive_IT(UART_5, recv_msg5_rx, pattern_length + 1);
-            if (status5rx != HAL_OK) {
-                printf("UART5 RX failed with status: %d\r\n", status5rx);
-                return TEST_FAILURE;
-            }
-
-            // UART2 Reception
-            status2rx = HAL_UART_Receive_IT(UART_2, recv_msg2_rx, pattern_length + 1);
-            if (status2rx != HAL_OK) {
-                printf("UART2 RX failed with status: %d\r\n", status2rx);
-                return TEST_FAILURE;
-            }
-
-            // Error Handling and Data Verification
-            if (Uart_5_ErrorCallback_Flag == 1 || Uart_2_ErrorCallback_Flag == 1) {
-                printf("Error detected in UART5 or UART2\r\n");
-                Uart_5_ErrorCallback_Flag = 0;
-                Uart_2_ErrorCallback_Flag = 0;
-            } else {
-                if (UART_5_RX_Complete_Callback_Flag == 1) {
-                    printf("Received message by UART5 RX: %s\r\n", recv_msg5_rx);
-                    UART_5_RX_Complete_Callback_Flag = 0;
-                }
-                if (UART_2_RX_Complete_Callback_Flag == 1) {
-                    printf("Received message by UART2 RX: %s\r\n", recv_msg2_rx);
-                    UART_2_RX_Complete_Callback_Flag = 0;
-                }
-
-                // Compare received data
-                if (strncmp(bit_pattern, (char*)recv_msg5_rx, pattern_length) == 0 &&
-                    strncmp(bit_pattern, (char*)recv_msg2_rx, pattern_length) == 0) {
-                    printf("Iteration %d passed\r\n", i + 1);
-                    break; // Exit while loop once successful
-                } else {
-                    printf("Data mismatch detected. Retrying...\r\n");
-                }
-            }
+static uint8_t uart_finish(TestContext* ctx) {
+    UartRing_Stop(&uart5_rx_ring);
+    UartRing_Stop(&uart2_rx_ring);
+    if (uart5_rx_ring.overruns || uart2_rx_ring.overruns) {
+        printf("UART receive ring overruns: UART5 %lu, UART2 %lu\r\n",
+               uart5_rx_ring.overruns, uart2_rx_ring.overruns);
+    }
+
+    if (ctx->errors) {
+        printf("UART Test Failed.\r\n");
+        return TEST_FAILURE;
+    }
+    printf("***********************\r\n");
+    printf("\nUART test complete\r\n");
+    return TEST_SUCCESS;
+}
+
+/**
+ * @brief Baud rates of the sweep, slowest first. Oversampling by 8 doubles
+ * the fastest rate the UART clock (PCLK1) can divide down to.
+ */
+static const struct {
+    uint32_t rate;          /**< Requested baud rate. */
+    uint32_t oversampling;  /**< UART_OVERSAMPLING_16 or UART_OVERSAMPLING_8. */
+} uart_sweep_rates[TEST_SWEEP_MAX_STEPS] = {
+    {115200, UART_OVERSAMPLING_16},
+    {460800, UART_OVERSAMPLING_16},
+    {921600, UART_OVERSAMPLING_16},
+    {2000000, UART_OVERSAMPLING_16},
+    {2250000, UART_OVERSAMPLING_16},
+    {3000000, UART_OVERSAMPLING_8},
+    {4000000, UART_OVERSAMPLING_8},
+    {4500000, UART_OVERSAMPLING_8},
+};
+
+/** @brief PRBS block sent by both UARTs during the sweep. */
+static uint8_t uart_sweep_tx[UART_SWEEP_BLOCK_SIZE];
+
+/** @brief Data received by UART5 during the sweep. */
+static uint8_t uart_sweep_rx5[UART_SWEEP_BLOCK_SIZE];
+
+/** @brief Data received by UART2 during the sweep. */
+static uint8_t uart_sweep_rx2[UART_SWEEP_BLOCK_SIZE];
+
+/** @brief Step table of the sweep. */
+static TestSweep uart_sweep_table;
+
+/**
+ * @brief Private state of the UART sweep engine.
+ */
+typedef struct {
+    uint32_t per_step;                          /**< Transfers run at each rate. */
+    uint32_t saved_rate;                        /**< Baud rate set by CubeMX, restored at the end. */
+    uint32_t saved_oversampling;                /**< Oversampling set by CubeMX, restored at the end. */
+    uint32_t clean;                             /**< Highest clean rate of the steps reported so far. */
+    uint8_t rate_index[TEST_SWEEP_MAX_STEPS];   /**< Entry of uart_sweep_rates run at each step. */
+    uint8_t reported;                           /**< Steps printed by `finish` so far. */
+} UartSweepState;
+
+TEST_CONTEXT_PRIVATE_CHECK(UartSweepState);
+
+/**
+ * @brief Set the baud rate and oversampling of a UART.
+ *
+ * The UART is already initialized, so HAL_UART_Init only rewrites its
+ * registers; the MSP (pins, DMA links, interrupts) is left as it is.
+ *
+ * @param[in] huart Pointer to the UART handle; no transfer may be running.
+ * @param[in] rate Baud rate.
+ * @param[in] oversampling UART_OVERSAMPLING_16 or UART_OVERSAMPLING_8.
+ * @return HAL_StatusTypeDef Status of the reconfiguration.
+ */
+static HAL_StatusTypeDef uart_sweep_configure(UART_HandleTypeDef* huart, uint32_t rate, uint32_t oversampling) {
+    huart->Init.BaudRate = rate;
+    huart->Init.OverSampling = oversampling;
+    return HAL_UART_Init(huart);
+}
+
+/**
+ * @brief Drop whatever a UART received while it was not armed, and its error flags.
+ *
+ * @param[in] huart Pointer to the UART handle.
+ */
+static void uart_sweep_flush(UART_HandleTypeDef* huart) {
+    __HAL_UART_CLEAR_FLAG(huart, UART_CLEAR_FEF | UART_CLEAR_NEF | UART_CLEAR_OREF);
+    __HAL_UART_SEND_REQ(huart, UART_RXDATA_FLUSH_REQUEST);
+}
+
+/**
+ * @brief Number of bytes a UART received in the sweep transfer that just ended.
+ *
+ * A receive error stops the RX stream, whose counter then holds the bytes
+ * that never arrived; the rest of the block is not compared.
+ *
+ * @param[in] huart Pointer to the UART handle.
+ * @param[in] complete Nonzero if the reception completed.
+ * @return uint16_t Number of bytes received.
+ */
+static uint16_t uart_sweep_received(UART_HandleTypeDef* huart, uint8_t complete) {
+    if (complete) {
+        return UART_SWEEP_BLOCK_SIZE;
+    }
+    return UART_SWEEP_BLOCK_SIZE - (uint16_t)__HAL_DMA_GET_COUNTER(huart->hdmarx);
+}
+
+/**
+ * @brief Add the errors reported by a UART to a sweep step.
+ *
+ * @param[in,out] step Pointer to the step.
+ * @param[in] code HAL_UART_ERROR_* bits.
+ */
+static void uart_sweep_count_errors(TestSweepStep* step, uint32_t code) {
+    step->errors[0] += (code & HAL_UART_ERROR_FE) != 0;
+    step->errors[1] += (code & HAL_UART_ERROR_NE) != 0;
+    step->errors[2] += (code & HAL_UART_ERROR_ORE) != 0;
+}
+
+/**
+ * @brief Prepare the baud-rate sweep.
+ *
+ * Builds the step table from the rates the UART clock can produce, and
+ * generates the PRBS block. The requested iterations run at every step.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_SUCCESS, or TEST_FAILURE if no rate can be set.
+ */
+static uint8_t uart_sweep_setup(TestContext* ctx) {
+    UartSweepState* st = TEST_CONTEXT_PRIVATE(ctx, UartSweepState);
+    TestSweepStep* step;
+    uint32_t pclk = HAL_RCC_GetPCLK1Freq();
+    uint32_t usartdiv;
+    uint8_t i;
+
+    memset(&uart_sweep_table, 0, sizeof(uart_sweep_table));
+    for (i = 0; i < TEST_SWEEP_MAX_STEPS; i++) {
+        step = &uart_sweep_table.steps[uart_sweep_table.count];
+        if (uart_sweep_rates[i].oversampling == UART_OVERSAMPLING_8) {
+            usartdiv = UART_DIV_SAMPLING8(pclk, uart_sweep_rates[i].rate);
+            step->rate = (2 * pclk) / usartdiv;
+            step->mode = 8;
+        } else {
+            usartdiv = UART_DIV_SAMPLING16(pclk, uart_sweep_rates[i].rate);
+            step->rate = pclk / usartdiv;
+            step->mode = 16;
+        }
+        // Faster than the UART clock can divide down to: leave the rate out
+        if (usartdiv < 16) {
+            memset(step, 0, sizeof(TestSweepStep));
+            continue;
         }
+        st->rate_index[uart_sweep_table.count++] = i;
+    }
+    if (uart_sweep_table.count == 0) {
+        printf("No sweep rate fits the UART clock (%lu Hz)\r\n", pclk);
+        return TEST_FAILURE;
+    }
 
-        if (HAL_GetTick() - iteration_start_time >= SHORT_TIMEOUT) {
-            printf("Iteration %d failed due to timeout\r\n", i + 1);
+    st->saved_rate = huart5.Init.BaudRate;
+    st->saved_oversampling = huart5.Init.OverSampling;
+    st->per_step = ctx->iterations;
+    if (st->per_step > UINT32_MAX / uart_sweep_table.count) {
+        st->per_step = UINT32_MAX / uart_sweep_table.count;
+    }
+    ctx->iterations = st->per_step * uart_sweep_table.count;
+    ctx->bytes = 2 * UART_SWEEP_BLOCK_SIZE;
+    ctx->sweep = &uart_sweep_table;
+    TestRun_FillPrbs(uart_sweep_tx, UART_SWEEP_BLOCK_SIZE, 0);
+    return TEST_SUCCESS;
+}
+
+/**
+ * @brief Arm one sweep transfer, moving both UARTs to the next rate first when a step begins.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_IN_PROGRESS, or TEST_FAILURE if a UART cannot be set up or armed.
+ */
+static uint8_t uart_sweep_start(TestContext* ctx) {
+    UartSweepState* st = TEST_CONTEXT_PRIVATE(ctx, UartSweepState);
+    uint8_t index = st->rate_index[ctx->iteration / st->per_step];
+    uint32_t rate = uart_sweep_rates[index].rate;
+
+    if (ctx->iteration % st->per_step == 0) {
+        if (uart_sweep_configure(UART_5, rate, uart_sweep_rates[index].oversampling) != HAL_OK ||
+            uart_sweep_configure(UART_2, rate, uart_sweep_rates[index].oversampling) != HAL_OK) {
+            printf("UART sweep could not set %lu baud\r\n", rate);
             return TEST_FAILURE;
         }
+        TEST_TRACE("UART sweep: %lu baud, oversampling by %u\r\n",
+                   uart_sweep_table.steps[ctx->iteration / st->per_step].rate,
+                   uart_sweep_table.steps[ctx->iteration / st->per_step].mode);
     }
-    printf("***********************\r\n");
-    printf("\nUART test complete\r\n");
+
+    uart_clear_flags();
+    uart_sweep_flush(UART_5);
+    uart_sweep_flush(UART_2);
+    if (HAL_UART_Receive_DMA(UART_5, uart_sweep_rx5, UART_SWEEP_BLOCK_SIZE) != HAL_OK ||
+        HAL_UART_Receive_DMA(UART_2, uart_sweep_rx2, UART_SWEEP_BLOCK_SIZE) != HAL_OK ||
+        HAL_UART_Transmit_DMA(UART_2, uart_sweep_tx, UART_SWEEP_BLOCK_SIZE) != HAL_OK ||
+        HAL_UART_Transmit_DMA(UART_5, uart_sweep_tx, UART_SWEEP_BLOCK_SIZE) != HAL_OK) {
+        printf("UART sweep transfer could not be armed\r\n");
+        return TEST_FAILURE;
+    }
+
+    // A block takes 10 bits per byte on the line; slow rates need more than the default timeout
+    ctx->deadline += (uint32_t)(((uint64_t)UART_SWEEP_BLOCK_SIZE * 10 * 1000) / rate);
+    return TEST_IN_PROGRESS;
+}
+
+/**
+ * @brief Check whether the sweep transfer has completed and add it to its step.
+ *
+ * A direction is done when its reception completed or stopped on an error.
+ * The value of the iteration is the number of bit errors in both directions.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_IN_PROGRESS while transferring, otherwise TEST_SUCCESS.
+ */
+static uint8_t uart_sweep_poll(TestContext* ctx) {
+    UartSweepState* st = TEST_CONTEXT_PRIVATE(ctx, UartSweepState);
+    TestSweepStep* step = &uart_sweep_table.steps[ctx->iteration / st->per_step];
+    uint16_t received5;
+    uint16_t received2;
+
+    if ((!UART_5_RX_Complete_Callback_Flag && !Uart_5_ErrorCallback_Flag) ||
+        (!UART_2_RX_Complete_Callback_Flag && !Uart_2_ErrorCallback_Flag) ||
+        !UART_5_TX_Complete_Callback_Flag || !UART_2_TX_Complete_Callback_Flag) {
+        return TEST_IN_PROGRESS;
+    }
+    TestRun_End(ctx, uart_event_cycles);
+
+    received5 = uart_sweep_received(UART_5, UART_5_RX_Complete_Callback_Flag);
+    received2 = uart_sweep_received(UART_2, UART_2_RX_Complete_Callback_Flag);
+    HAL_UART_AbortReceive(UART_5);
+    HAL_UART_AbortReceive(UART_2);
+
+    ctx->value = TestRun_CountBitErrors(uart_sweep_tx, uart_sweep_rx5, received5) +
+                 TestRun_CountBitErrors(uart_sweep_tx, uart_sweep_rx2, received2);
+    step->transfers++;
+    step->bytes += received5 + received2;
+    step->bit_errors += ctx->value;
+    step->cycles += ctx->end_cycles - ctx->start_cycles;
+    uart_sweep_count_errors(step, Uart_5_ErrorCode);
+    uart_sweep_count_errors(step, Uart_2_ErrorCode);
     return TEST_SUCCESS;
 }
 
+/**
+ * @brief Put both UARTs back to their CubeMX settings and report the sweep.
+ *
+ * The table goes to the debug UART one step per main-loop pass.
+ *
+ * @param[in] ctx Pointer to the test context.
+ * @return uint8_t Returns TEST_IN_PROGRESS while reporting, then 1 if every transfer completed, TEST_FAILURE otherwise.
+ */
+static uint8_t uart_sweep_finish(TestContext* ctx) {
+    UartSweepState* st = TEST_CONTEXT_PRIVATE(ctx, UartSweepState);
+    const TestSweepStep* step;
+
+    if (st->reported == 0) {
+        uart_sweep_configure(UART_5, st->saved_rate, st->saved_oversampling);
+        uart_sweep_configure(UART_2, st->saved_rate, st->saved_oversampling);
+    }
+    if (st->reported < uart_sweep_table.count) {
+        step = &uart_sweep_table.steps[st->reported++];
+        printf("%7lu baud /%u: %lu transfers, %lu bytes, %lu bit errors, FE %u NE %u ORE %u\r\n",
+               step->rate, step->mode, step->transfers, step->bytes, step->bit_errors,
+               step->errors[0], step->errors[1], step->errors[2]);
+        if (step->transfers > 0 && step->bit_errors == 0 &&
+            step->errors[0] == 0 && step->errors[1] == 0 && step->errors[2] == 0) {
+            st->clean = step->rate;
+        }
+        return TEST_IN_PROGRESS;
+    }
+    printf("Highest clean UART rate: %lu baud\r\n", st->clean);
+    return ctx->errors ? TEST_FAILURE : TEST_SUCCESS;
+}
+
+/** @brief UART5 <-> UART2 baud-rate sweep engine. */
+static const TestDriver uart_sweep_driver = {
+    .peripheral = TEST_PERIPHERAL_UART,
+    .name = "UART",
+    .params = 0,
+    .max_pattern = 0,
+    .default_iterations = UART_SWEEP_DEFAULT_TRANSFERS,
+    .estimated_us = 356000, // One block at the slowest rate
+    .setup = uart_sweep_setup,
+    .start = uart_sweep_start,
+    .poll = uart_sweep_poll,
+    .abort = uart_abort,
+    .finish = uart_sweep_finish,
+};
+
+/** @brief UART5 <-> UART2 loopback test engine. */
+const TestDriver uart_test_driver = {
+    .peripheral = TEST_PERIPHERAL_UART,
+    .name = "UART",
+    .params = PROTOCOL_PARAM_PATTERN | PROTOCOL_PARAM_PATTERN_REQUIRED,
+    .max_pattern = TEST_PATTERN_MAX_LENGTH,
+    .default_iterations = 5,
+    .estimated_us = 89000, // 1024 bytes at 115200 baud, both directions at once
+    .setup = uart_setup,
+    .start = uart_start,
+    .poll = uart_poll,
+    .abort = uart_abort,
+    .finish = uart_finish,
+    .sweep = &uart_sweep_driver,
+};
+
+/**
+ * @brief Callback for UART TX complete event.
+ *
+ * This function is triggered when a UART TX operation completes.
+ * It sets the corresponding callback flag for UART5 or UART2.
+ *
+ * @param[in] huart Pointer to the UART handle that triggered the interrupt.
+ */
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef* huart) {
+    uart_event_cycles = TEST_CYCLES();
+    if (huart->Instance == UART5) {
+        UART_5_TX_Complete_Callback_Flag = 1;
+    } else if (huart->Instance == USART2) {
+        UART_2_TX_Complete_Callback_Flag = 1;
+    }
+}
+
 /**
  * @brief Callback for UART RX complete event.
  *
@@ -135,6 +557,7 @@ uint8_t test_uart(const char* bit_pattern, uint8_t pattern_length, uint8_t itera
  * @param[in] huart Pointer to the UART handle that triggered the interrupt.
  */
 void HAL_UART_RxCpltCallback(UART_HandleTypeDef* huart) {
+    uart_event_cycles = TEST_CYCLES();
     if (huart->Instance == UART5) {
         UART_5_RX_Complete_Callback_Flag = 1;
     } else if (huart->Instance == USART2) {
@@ -146,14 +569,18 @@ void HAL_UART_RxCpltCallback(UART_HandleTypeDef* huart) {
  * @brief Callback for UART error event.
  *
  * This function is triggered when a UART error occurs.
- * It sets the corresponding error callback flag for UART5 or UART2.
+ * It records the HAL_UART_ERROR_* bits and sets the corresponding error
+ * callback flag for UART5 or UART2.
  *
  * @param[in] huart Pointer to the UART handle that triggered the error.
  */
 void HAL_UART_ErrorCallback(UART_HandleTypeDef* huart) {
+    uart_event_cycles = TEST_CYCLES();
     if (huart->Instance == UART5) {
+        Uart_5_ErrorCode |= huart->ErrorCode;
         Uart_5_ErrorCallback_Flag = 1;
     } else if (huart->Instance == USART2) {
+        Uart_2_ErrorCode |= huart->ErrorCode;
         Uart_2_ErrorCallback_Flag = 1;
     }
 }
@@ -1,13 +1,16 @@
 #include "UdpUut.h"
+#include "DebugUart.h"
 
-// printf
+// printf: queued for the main loop, see DebugUart.h
 int __io_putchar(int ch) {
-	HAL_UART_Transmit(UART_DEBUG, (uint8_t*) &ch, 1, 0xFFFF);
+	uint8_t c = (uint8_t) ch;
+
+	DebugUart_Write(&c, 1);
 	return ch;
 }
 
 int _write(int file, char *ptr, int len) {
-	HAL_UART_Transmit(UART_DEBUG, (uint8_t*) ptr, len, 0xFFFF);
+	DebugUart_Write((uint8_t*) ptr, (uint16_t) len);
 	return len;
 }
 
@@ -0,0 +1,120 @@
+/**
+ * @file UartRing.c
+ * @brief Implementation of the circular DMA UART receive ring.
+ *
+ * This file keeps a small table of the running rings, so the receive event
+ * callback finds the ring of its UART. HAL reports the DMA write offset in
+ * every event; the bytes written since the previous event, across the end
+ * of the buffer if the DMA wrapped, are added to the ring's write count.
+ * The half-transfer and transfer-complete events guarantee that the DMA
+ * never gets a whole buffer ahead of the last event.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#include "UartRing.h"
+
+/** @brief Running rings, looked up by UART handle. */
+static UartRing* uart_rings[UART_RING_MAX];
+
+/**
+ * @brief Find the table entry of a UART.
+ *
+ * @param[in] huart Pointer to the UART handle, or NULL to find a free entry.
+ * @return UartRing** Pointer to the entry, or NULL if there is none.
+ */
+static UartRing** uart_ring_slot(const UART_HandleTypeDef* huart) {
+    uint8_t i;
+
+    for (i = 0; i < UART_RING_MAX; i++) {
+        if ((huart == NULL) ? (uart_rings[i] == NULL) : (uart_rings[i] != NULL && uart_rings[i]->huart == huart)) {
+            return &uart_rings[i];
+        }
+    }
+    return NULL;
+}
+
+HAL_StatusTypeDef UartRing_Start(UartRing* ring, UART_HandleTypeDef* huart, uint8_t* buf, uint16_t size) {
+    UartRing** slot = uart_ring_slot(huart);
+    HAL_StatusTypeDef status;
+
+    if (slot == NULL && (slot = uart_ring_slot(NULL)) == NULL) {
+        return HAL_BUSY;
+    }
+    ring->huart = huart;
+    ring->buf = buf;
+    ring->size = size;
+    ring->dma_position = 0;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->overruns = 0;
+    ring->event_cycles = 0;
+    *slot = ring;
+
+    // Drop what arrived while nobody was receiving
+    __HAL_UART_CLEAR_FLAG(huart, UART_CLEAR_FEF | UART_CLEAR_NEF | UART_CLEAR_OREF | UART_CLEAR_IDLEF);
+    __HAL_UART_SEND_REQ(huart, UART_RXDATA_FLUSH_REQUEST);
+
+    status = HAL_UARTEx_ReceiveToIdle_DMA(huart, buf, size);
+    if (status != HAL_OK) {
+        *slot = NULL;
+    }
+    return status;
+}
+
+void UartRing_Stop(UartRing* ring) {
+    UartRing** slot = uart_ring_slot(ring->huart);
+
+    if (slot == NULL || *slot != ring) {
+        return;
+    }
+    HAL_UART_AbortReceive(ring->huart);
+    *slot = NULL;
+}
+
+uint32_t UartRing_Available(UartRing* ring) {
+    uint32_t head = ring->head;
+    uint32_t available = head - ring->tail;
+
+    if (available > ring->size) {
+        ring->overruns += available - ring->size;
+        ring->tail = head - ring->size;
+        available = ring->size;
+    }
+    return available;
+}
+
+uint16_t UartRing_Peek(UartRing* ring, const uint8_t** data) {
+    uint32_t available = UartRing_Available(ring);
+    uint16_t offset = (uint16_t)(ring->tail % ring->size);
+
+    *data = &ring->buf[offset];
+    return (uint16_t)((available < (uint32_t)(ring->size - offset)) ? available : (uint32_t)(ring->size - offset));
+}
+
+void UartRing_Consume(UartRing* ring, uint32_t length) {
+    ring->tail += length;
+}
+
+void UartRing_Flush(UartRing* ring) {
+    ring->tail = ring->head;
+}
+
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef* huart, uint16_t Size) {
+    UartRing** slot = uart_ring_slot(huart);
+    UartRing* ring;
+
+    if (slot == NULL) {
+        return;
+    }
+    ring = *slot;
+    ring->event_cycles = DWT->CYCCNT;
+    if (Size >= ring->dma_position) {
+        ring->head += Size - ring->dma_position;
+    } else {
+        // The DMA wrapped since the last event
+        ring->head += ring->size - ring->dma_position + Size;
+    }
+    ring->dma_position = (Size == ring->size) ? 0 : Size;
+}
@@ -20,6 +20,11 @@
 #include "UART_test.h"
 #include "ADC_test.h"
 #include "Timer_test.h"
+#include "JobQueue.h"
+#include "ResponsePool.h"
+#include "Bench.h"
+#include "TestDriver.h"
+#include "DebugUart.h"
 
 /**
  * @brief Flag indicating a callback event from the UDP server.
@@ -79,6 +84,10 @@ u16_t incomming_len = 0;
  * - Server Port: 50007
  */
 void UDP_main() {
+    ResponsePoolStats response_stats;
+    uint32_t response_exhausted = 0;
+    uint32_t pass_start;
+
     /**
      * @brief Prints a message indicating that the UDP server is running.
      */
@@ -89,6 +98,11 @@ void UDP_main() {
      */
     udpServer_init();
 
+    /**
+     * @brief Enables the cycle counter used to time test iterations.
+     */
+    TestDriver_Init();
+
     /**
      * @brief Continuous loop for processing network traffic and handling tests.
      *
@@ -96,6 +110,8 @@ void UDP_main() {
      * timeout events for the system.
      */
     while (1) {
+        pass_start = TEST_CYCLES();
+
         /**
          * @brief Processes incoming packets and passes them to the network interface.
          */
@@ -106,6 +122,24 @@ void UDP_main() {
          */
         sys_check_timeouts();
 
+        /**
+         * @brief Runs one step of the current test job, if any.
+         *
+         * Tests are executed in small resumable steps so that incoming
+         * frames keep being drained between two steps.
+         */
+        JobQueue_Poll();
+
+        /**
+         * @brief Sends the next datagrams of a running benchmark blast, if any.
+         */
+        Bench_Poll();
+
+        /**
+         * @brief Sends the next queued character of the debug output, if any.
+         */
+        DebugUart_Poll();
+
         /**
          * @brief Checks if a callback event has occurred.
          *
@@ -113,12 +147,27 @@ void UDP_main() {
          * and the system processes the command.
          */
         if (callback_flag == 1) {
-            printf("Received command for testing\r\n");
+            printf("Received command for testing (%u queued)\r\n", JobQueue_Depth());
+
+            /**
+             * @brief Reports replies dropped because the response pool was empty.
+             */
+            ResponsePool_GetStats(&response_stats);
+            if (response_stats.exhausted != response_exhausted) {
+                response_exhausted = response_stats.exhausted;
+                printf("Response pool exhausted %lu times (peak %u of %u in use)\r\n",
+                       (unsigned long)response_exhausted, response_stats.in_use_peak, RESPONSE_POOL_COUNT);
+            }
 
             /**
              * @brief Resets the callback flag after processing the command.
              */
             callback_flag = 0;
         }
+
+        /**
+         * @brief Accounts the pass as busy or idle for the benchmark's CPU load.
+         */
+        Bench_Account(pass_start);
     }
 }
@@ -3,7 +3,7 @@
  * @brief Implementation of a UDP server for executing hardware tests.
  *
  * This file contains functions for handling UDP communication, receiving test commands,
- * executing the appropriate hardware tests, and sending results back to the client.
+ * queuing them for execution, and sending results back to the client.
  *
  * @details Supported peripherals for testing:
  * - UART
@@ -21,47 +21,433 @@
 
 #include "UdpUut.h"
 #include "Protocol.h"
-#include "UART_test.h"
-#include "ADC_test.h"
-#include "Timer_test.h"
-#include "SPI_test.h"
-#include "I2C_test.h"
-
-/**
- * @brief Execute a hardware test based on the received command.
- *
- * This function determines the peripheral to test and executes the corresponding test function.
- *
- * @param[in] command Pointer to the TestCommand structure containing test parameters.
- * @return uint8_t Returns 1 on success, 0xFF on failure.
- */
-static uint8_t execute_test(TestCommand* command) {
-    printf("Executing test for Peripheral: %u, Test-ID: %u\r\n",
-           (unsigned int)command->peripheral,
-           (unsigned int)command->test_id);
-
-    switch (command->peripheral) {
-        case TEST_PERIPHERAL_UART:
-            return test_uart(command->bit_pattern, command->pattern_length, command->iterations);
-        case TEST_PERIPHERAL_ADC:
-            return test_adc(command->iterations);
-        case TEST_PERIPHERAL_TIMER:
-            return test_timer(command->iterations);
-        case TEST_PERIPHERAL_SPI:
-            return test_spi(command->bit_pattern, command->pattern_length, command->iterations);
-        case TEST_PERIPHERAL_I2C:
-            return test_i2c(command->bit_pattern, command->pattern_length, command->iterations);
+#include "JobQueue.h"
+#include "Codec.h"
+#include "ResponsePool.h"
+#include "ReplyCache.h"
+#include "History.h"
+#include "TestDriver.h"
+#include "Bench.h"
+#include "lwip/igmp.h"
+#include "lwip/ip.h"
+
+/**
+ * @brief Send an error reply for a rejected request.
+ *
+ * @param[in] upcb Pointer to the UDP control block.
+ * @param[in] error PROTOCOL_ERROR_* code.
+ * @param[in] opcode Opcode of the rejected request.
+ * @param[in] addr Pointer to the sender's IP address.
+ * @param[in] port Port number of the sender.
+ */
+static void send_error(struct udp_pcb* upcb, uint8_t error, uint8_t opcode, const ip_addr_t* addr, u16_t port) {
+    struct pbuf* reply;
+
+    printf("Rejecting request (opcode 0x%02X): error %u\r\n", opcode, error);
+    reply = ResponsePool_Alloc(PROTOCOL_HEADER_SIZE + PROTOCOL_ERROR_SIZE);
+    if (reply != NULL) {
+        Codec_EncodeError(reply->payload, error, opcode);
+        send_response(upcb, reply, addr, port);
+    }
+}
+
+/**
+ * @brief Validate a test request and queue it for execution.
+ *
+ * Retries of a request (same client endpoint and test ID) never run the
+ * test again: they get the cached reply, or are dropped while the original
+ * is still queued or running, since its reply will answer them.
+ *
+ * @param[in] upcb Pointer to the UDP control block.
+ * @param[in] p Pointer to the received datagram.
+ * @param[in] header Pointer to the decoded packet header.
+ * @param[in] addr Pointer to the sender's IP address.
+ * @param[in] port Port number of the sender.
+ */
+static void receive_test(struct udp_pcb* upcb, struct pbuf* p, const PacketHeader* header,
+                         const ip_addr_t* addr, u16_t port) {
+    TestCommand command;
+
+    const uint8_t* cached;
+    uint16_t cached_length;
+
+    if (Codec_DecodeTest(p, PROTOCOL_HEADER_SIZE, &command) == 0) {
+        send_error(upcb, PROTOCOL_ERROR_LENGTH, PROTOCOL_OPCODE_TEST, addr, port);
+        return;
+    }
+    // The reply has room for the step table of a single swept peripheral
+    if ((command.options & PROTOCOL_OPTION_SWEEP) && (command.peripheral & (command.peripheral - 1)) != 0) {
+        send_error(upcb, PROTOCOL_ERROR_SWEEP, PROTOCOL_OPCODE_TEST, addr, port);
+        return;
+    }
+
+    // A retried request is answered from the cache, or coalesced with the running test
+    switch (ReplyCache_Begin(addr, port, command.test_id, &cached, &cached_length)) {
+        case REPLY_CACHE_HIT:
+            printf("Test-ID %u already completed, resending its result\r\n", (unsigned int)command.test_id);
+            send_packet(upcb, cached, cached_length, addr, port);
+            return;
+        case REPLY_CACHE_IN_FLIGHT:
+            printf("Test-ID %u already in progress, ignoring the retry\r\n", (unsigned int)command.test_id);
+            return;
         default:
-            printf("Invalid peripheral for testing: %d\r\n", command->peripheral);
-            return 0xFF;
+            break;
+    }
+
+    // Queue the test for execution by the main loop
+    if (!JobQueue_Push(&command, header->flags, p, upcb, addr, port)) {
+        printf("Job queue full, rejecting Test-ID: %u\r\n", (unsigned int)command.test_id);
+        ReplyCache_Cancel(addr, port, command.test_id);
+        send_error(upcb, PROTOCOL_ERROR_BUSY, PROTOCOL_OPCODE_TEST, addr, port);
+        return;
     }
+    callback_flag = 1;
+}
+
+/**
+ * @brief Validate a batch request and queue it for execution.
+ *
+ * Every test request of the batch is bounds-checked against the pbuf chain,
+ * then the job queue takes a reference on the pbuf and decodes the requests
+ * out of it one by one as they are executed.
+ *
+ * @param[in] upcb Pointer to the UDP control block.
+ * @param[in] p Pointer to the received datagram.
+ * @param[in] addr Pointer to the sender's IP address.
+ * @param[in] port Port number of the sender.
+ */
+static void receive_batch(struct udp_pcb* upcb, struct pbuf* p, const ip_addr_t* addr, u16_t port) {
+    TestCommand command;
+    uint16_t offset = PROTOCOL_HEADER_SIZE + 1;
+    uint32_t cost = 0;
+    uint8_t count;
+    uint8_t i;
+
+    if (p->tot_len < offset) {
+        send_error(upcb, PROTOCOL_ERROR_LENGTH, PROTOCOL_OPCODE_BATCH, addr, port);
+        return;
+    }
+    count = pbuf_get_at(p, PROTOCOL_HEADER_SIZE);
+    if (count == 0 || count > PROTOCOL_BATCH_MAX_COMMANDS) {
+        printf("Invalid batch size: %u\r\n", count);
+        send_error(upcb, PROTOCOL_ERROR_LENGTH, PROTOCOL_OPCODE_BATCH, addr, port);
+        return;
+    }
+    for (i = 0; i < count && offset != 0; i++) {
+        offset = Codec_DecodeTest(p, offset, &command);
+        // The scheduler charges the client for every iteration of the batch
+        cost = (cost + command.iterations < cost) ? UINT32_MAX : cost + command.iterations;
+    }
+    if (offset == 0) {
+        printf("Malformed batch request %u\r\n", i);
+        send_error(upcb, PROTOCOL_ERROR_LENGTH, PROTOCOL_OPCODE_BATCH, addr, port);
+        return;
+    }
+    if (!JobQueue_PushBatch(p, count, cost, upcb, addr, port)) {
+        printf("Job queue full, rejecting batch of %u requests\r\n", count);
+        send_error(upcb, PROTOCOL_ERROR_BUSY, PROTOCOL_OPCODE_BATCH, addr, port);
+        return;
+    }
+    callback_flag = 1;
+}
+
+/**
+ * @brief Answer a request for the per-client queue statistics.
+ *
+ * @param[in] upcb Pointer to the UDP control block.
+ * @param[in] addr Pointer to the sender's IP address.
+ * @param[in] port Port number of the sender.
+ */
+static void receive_stats(struct udp_pcb* upcb, const ip_addr_t* addr, u16_t port) {
+    struct pbuf* reply;
+    uint16_t length;
+
+    reply = ResponsePool_Alloc(PROTOCOL_HEADER_SIZE + 2 + SESSION_TABLE_SIZE * PROTOCOL_SESSION_STATS_SIZE);
+    if (reply == NULL) {
+        return;
+    }
+    length = Codec_EncodeHeader(reply->payload, PROTOCOL_OPCODE_STATS | PROTOCOL_OPCODE_REPLY, 0);
+    length += JobQueue_EncodeStats((uint8_t*)reply->payload + length);
+    pbuf_realloc(reply, length);
+    send_response(upcb, reply, addr, port);
+}
+
+/**
+ * @brief Cancel a queued or running test of the sender.
+ *
+ * @param[in] upcb Pointer to the UDP control block.
+ * @param[in] p Pointer to the received datagram.
+ * @param[in] addr Pointer to the sender's IP address.
+ * @param[in] port Port number of the sender.
+ */
+static void receive_cancel(struct udp_pcb* upcb, struct pbuf* p, const ip_addr_t* addr, u16_t port) {
+    uint8_t body[PROTOCOL_CANCEL_SIZE];
+    struct pbuf* reply;
+    uint8_t* buf;
+    uint32_t test_id;
+    uint32_t completed;
+    uint8_t status;
+
+    if (pbuf_copy_partial(p, body, sizeof(body), PROTOCOL_HEADER_SIZE) != sizeof(body)) {
+        send_error(upcb, PROTOCOL_ERROR_LENGTH, PROTOCOL_OPCODE_CANCEL, addr, port);
+        return;
+    }
+    test_id = Codec_GetLe32(body);
+    status = JobQueue_Cancel(test_id, addr, &completed);
+    printf("Cancel of Test-ID %u: status %u after %lu iterations\r\n",
+           (unsigned int)test_id, status, (unsigned long)completed);
+
+    reply = ResponsePool_Alloc(PROTOCOL_HEADER_SIZE + PROTOCOL_CANCEL_REPLY_SIZE);
+    if (reply == NULL) {
+        return;
+    }
+    buf = reply->payload;
+    buf += Codec_EncodeHeader(buf, PROTOCOL_OPCODE_CANCEL | PROTOCOL_OPCODE_REPLY, 0);
+    Codec_PutLe32(&buf[0], test_id);
+    buf[4] = status;
+    Codec_PutLe32(&buf[5], completed);
+    send_response(upcb, reply, addr, port);
+}
+
+/**
+ * @brief Answer a latency probe straight from the receive callback.
+ *
+ * No job is queued and no peripheral is touched; the payload is echoed
+ * back with the cycle counter at reception and at transmission.
+ *
+ * @param[in] upcb Pointer to the UDP control block.
+ * @param[in] p Pointer to the received datagram.
+ * @param[in] rx_cycles Cycle counter when the receive callback was entered.
+ * @param[in] addr Pointer to the sender's IP address.
+ * @param[in] port Port number of the sender.
+ */
+static void receive_ping(struct udp_pcb* upcb, struct pbuf* p, uint32_t rx_cycles, const ip_addr_t* addr, u16_t port) {
+    uint16_t payload = p->tot_len - PROTOCOL_HEADER_SIZE;
+    struct pbuf* reply;
+    uint8_t* buf;
+
+    if (payload > PROTOCOL_PING_MAX_PAYLOAD) {
+        send_error(upcb, PROTOCOL_ERROR_LENGTH, PROTOCOL_OPCODE_PING, addr, port);
+        return;
+    }
+    reply = ResponsePool_Alloc(PROTOCOL_HEADER_SIZE + PROTOCOL_PING_REPLY_SIZE + payload);
+    if (reply == NULL) {
+        return;
+    }
+    buf = reply->payload;
+    buf += Codec_EncodeHeader(buf, PROTOCOL_OPCODE_PING | PROTOCOL_OPCODE_REPLY, 0);
+    Codec_PutLe32(&buf[0], rx_cycles);
+    Codec_PutLe32(&buf[8], SystemCoreClock);
+    buf[12] = JobQueue_Depth();
+    pbuf_copy_partial(p, &buf[PROTOCOL_PING_REPLY_SIZE], payload, PROTOCOL_HEADER_SIZE);
+
+    // Stamp as late as possible, right before the reply goes to lwIP
+    Codec_PutLe32(&buf[4], TEST_CYCLES());
+    send_response(upcb, reply, addr, port);
+}
+
+/**
+ * @brief Start a benchmark blast towards the sender.
+ *
+ * @param[in] upcb Pointer to the UDP control block.
+ * @param[in] p Pointer to the received datagram.
+ * @param[in] addr Pointer to the sender's IP address.
+ * @param[in] port Port number of the sender.
+ */
+static void receive_blast(struct udp_pcb* upcb, struct pbuf* p, const ip_addr_t* addr, u16_t port) {
+    uint8_t body[PROTOCOL_BLAST_SIZE];
+    uint32_t count;
+    uint16_t size;
+
+    if (pbuf_copy_partial(p, body, sizeof(body), PROTOCOL_HEADER_SIZE) != sizeof(body)) {
+        send_error(upcb, PROTOCOL_ERROR_LENGTH, PROTOCOL_OPCODE_BLAST, addr, port);
+        return;
+    }
+    count = Codec_GetLe32(&body[0]);
+    size = Codec_GetLe16(&body[4]);
+    if (count > BENCH_MAX_COUNT || size < BENCH_MIN_PAYLOAD || size > BENCH_MAX_PAYLOAD) {
+        send_error(upcb, PROTOCOL_ERROR_LENGTH, PROTOCOL_OPCODE_BLAST, addr, port);
+        return;
+    }
+    if (!Bench_StartBlast(upcb, addr, port, count, size)) {
+        send_error(upcb, PROTOCOL_ERROR_BUSY, PROTOCOL_OPCODE_BLAST, addr, port);
+    }
+}
+
+/**
+ * @brief Answer a request for the benchmark counters.
+ *
+ * @param[in] upcb Pointer to the UDP control block.
+ * @param[in] p Pointer to the received datagram.
+ * @param[in] addr Pointer to the sender's IP address.
+ * @param[in] port Port number of the sender.
+ */
+static void receive_bench(struct udp_pcb* upcb, struct pbuf* p, const ip_addr_t* addr, u16_t port) {
+    struct pbuf* reply;
+    uint8_t flags = 0;
+    uint8_t* buf;
+
+    if (p->tot_len >= PROTOCOL_HEADER_SIZE + PROTOCOL_BENCH_SIZE) {
+        flags = pbuf_get_at(p, PROTOCOL_HEADER_SIZE);
+    }
+    reply = ResponsePool_Alloc(PROTOCOL_HEADER_SIZE + PROTOCOL_BENCH_REPORT_SIZE);
+    if (reply == NULL) {
+        return;
+    }
+    buf = reply->payload;
+    buf += Codec_EncodeHeader(buf, PROTOCOL_OPCODE_BENCH | PROTOCOL_OPCODE_REPLY, 0);
+    Bench_EncodeReport(buf);
+    if (flags & PROTOCOL_BENCH_RESET) {
+        Bench_Reset();
+    }
+    send_response(upcb, reply, addr, port);
+}
+
+/**
+ * @brief Answer a request for the table of test engines.
+ *
+ * @param[in] upcb Pointer to the UDP control block.
+ * @param[in] addr Pointer to the sender's IP address.
+ * @param[in] port Port number of the sender.
+ */
+static void receive_caps(struct udp_pcb* upcb, const ip_addr_t* addr, u16_t port) {
+    struct pbuf* reply;
+    uint8_t* buf;
+
+    reply = ResponsePool_Alloc(PROTOCOL_HEADER_SIZE + 1 + TEST_PERIPHERAL_COUNT * PROTOCOL_CAPS_ENTRY_SIZE);
+    if (reply == NULL) {
+        return;
+    }
+    buf = reply->payload;
+    buf += Codec_EncodeHeader(buf, PROTOCOL_OPCODE_CAPS | PROTOCOL_OPCODE_REPLY, 0);
+    TestDriver_EncodeCapabilities(buf);
+    send_response(upcb, reply, addr, port);
+}
+
+/**
+ * @brief Answer a HISTORY request with the kept results of the sender.
+ *
+ * @param[in] upcb Pointer to the UDP control block.
+ * @param[in] p Pointer to the received datagram.
+ * @param[in] addr Pointer to the sender's IP address.
+ * @param[in] port Port number of the sender.
+ */
+static void receive_history(struct udp_pcb* upcb, struct pbuf* p, const ip_addr_t* addr, u16_t port) {
+    uint8_t body[PROTOCOL_HISTORY_SIZE];
+    struct pbuf* reply;
+    uint8_t* buf;
+    uint16_t length;
+
+    if (pbuf_copy_partial(p, body, sizeof(body), PROTOCOL_HEADER_SIZE) != sizeof(body)) {
+        send_error(upcb, PROTOCOL_ERROR_LENGTH, PROTOCOL_OPCODE_HISTORY, addr, port);
+        return;
+    }
+    reply = ResponsePool_Alloc(RESPONSE_POOL_PAYLOAD_SIZE);
+    if (reply == NULL) {
+        return;
+    }
+    buf = reply->payload;
+    length = Codec_EncodeHeader(buf, PROTOCOL_OPCODE_HISTORY | PROTOCOL_OPCODE_REPLY, 0);
+    length += History_Encode(&buf[length], RESPONSE_POOL_PAYLOAD_SIZE - length, addr,
+                             Codec_GetLe32(&body[0]), Codec_GetLe32(&body[4]));
+    pbuf_realloc(reply, length);
+    send_response(upcb, reply, addr, port);
+}
+
+/**
+ * @brief Store an uploaded test plan.
+ *
+ * @param[in] upcb Pointer to the UDP control block.
+ * @param[in] p Pointer to the received datagram.
+ * @param[in] addr Pointer to the sender's IP address.
+ * @param[in] port Port number of the sender.
+ */
+static void receive_plan_upload(struct udp_pcb* upcb, struct pbuf* p, const ip_addr_t* addr, u16_t port) {
+    const Plan* plan;
+    struct pbuf* reply;
+    uint8_t* buf;
+    uint8_t slot;
+    uint8_t error;
+
+    error = Plan_Store(p, PROTOCOL_HEADER_SIZE, &slot);
+    if (error != 0) {
+        send_error(upcb, error, PROTOCOL_OPCODE_PLAN_UPLOAD, addr, port);
+        return;
+    }
+
+    reply = ResponsePool_Alloc(PROTOCOL_HEADER_SIZE + PROTOCOL_PLAN_UPLOAD_REPLY_SIZE);
+    if (reply == NULL) {
+        return;
+    }
+    buf = reply->payload;
+    buf += Codec_EncodeHeader(buf, PROTOCOL_OPCODE_PLAN_UPLOAD | PROTOCOL_OPCODE_REPLY, 0);
+    memset(buf, 0, PROTOCOL_PLAN_UPLOAD_REPLY_SIZE);
+    buf[0] = pbuf_get_at(p, PROTOCOL_HEADER_SIZE);
+    if (slot != PLAN_NONE) {
+        plan = Plan_Get(slot);
+        printf("Stored plan %u: %u steps, %u bytes\r\n", plan->id, plan->steps, plan->size);
+        buf[1] = plan->steps;
+        Codec_PutLe16(&buf[2], plan->size);
+        Codec_PutLe32(&buf[4], plan->cost);
+    }
+    send_response(upcb, reply, addr, port);
+}
+
+/**
+ * @brief Queue a run of a stored test plan.
+ *
+ * Like test requests, a retried run is answered from the reply cache, or
+ * ignored while the original is still queued or running.
+ *
+ * @param[in] upcb Pointer to the UDP control block.
+ * @param[in] p Pointer to the received datagram.
+ * @param[in] addr Pointer to the sender's IP address.
+ * @param[in] port Port number of the sender.
+ */
+static void receive_plan_run(struct udp_pcb* upcb, struct pbuf* p, const ip_addr_t* addr, u16_t port) {
+    uint8_t body[PROTOCOL_PLAN_RUN_SIZE];
+    const uint8_t* cached;
+    uint16_t cached_length;
+    uint32_t run_id;
+    uint8_t slot;
+
+    if (pbuf_copy_partial(p, body, sizeof(body), PROTOCOL_HEADER_SIZE) != sizeof(body)) {
+        send_error(upcb, PROTOCOL_ERROR_LENGTH, PROTOCOL_OPCODE_PLAN_RUN, addr, port);
+        return;
+    }
+    run_id = Codec_GetLe32(body);
+    slot = Plan_Find(body[4]);
+    if (slot == PLAN_NONE) {
+        send_error(upcb, PROTOCOL_ERROR_NO_PLAN, PROTOCOL_OPCODE_PLAN_RUN, addr, port);
+        return;
+    }
+
+    switch (ReplyCache_Begin(addr, port, run_id, &cached, &cached_length)) {
+        case REPLY_CACHE_HIT:
+            send_packet(upcb, cached, cached_length, addr, port);
+            return;
+        case REPLY_CACHE_IN_FLIGHT:
+            return;
+        default:
+            break;
+    }
+    if (!JobQueue_PushPlan(slot, run_id, upcb, addr, port)) {
+        printf("Job queue full, rejecting plan run %u\r\n", (unsigned int)run_id);
+        ReplyCache_Cancel(addr, port, run_id);
+        send_error(upcb, PROTOCOL_ERROR_BUSY, PROTOCOL_OPCODE_PLAN_RUN, addr, port);
+        return;
+    }
+    callback_flag = 1;
 }
 
 /**
  * @brief UDP receive callback for handling incoming test commands.
  *
- * This function is triggered when a UDP packet is received. It parses the command,
- * executes the specified test, and sends the result back to the client.
+ * This function is triggered when a UDP packet is received. It decodes the
+ * request and queues it for execution by the main loop; the result is sent
+ * back to the client once the test has finished. No test code runs inside
+ * this callback, so the network stack keeps being serviced while tests are
+ * running.
  *
  * @param[in] arg Pointer to user-defined arguments (unused).
  * @param[in] upcb Pointer to the UDP control block.
@@ -70,34 +456,75 @@ static uint8_t execute_test(TestCommand* command) {
  * @param[in] port Port number of the sender.
  */
 void udp_receive_callback(void* arg, struct udp_pcb* upcb, struct pbuf* p, const ip_addr_t* addr, u16_t port) {
-    TestCommand command;
-    TestResult result;
-
-    // Parse incoming command
-    memcpy(&command, p->payload, sizeof(TestCommand));
-    pbuf_free(p);
+    uint32_t rx_cycles = TEST_CYCLES();
+    PacketHeader header;
+    uint8_t error;
 
-    // Validate pattern length
-    if (command.pattern_length != strlen(command.bit_pattern)) {
-        printf("Pattern length mismatch. Expected: %d, Received: %d\r\n", (int)strlen(command.bit_pattern), command.pattern_length);
-        result.result = 0xFF;  // Indicate error
-        result.test_id = command.test_id;
-        send_packet(upcb, &result, sizeof(TestResult), addr, port);
+    error = Codec_DecodeHeader(p, &header);
+    if (error != 0) {
+        // A malformed datagram sent to the group cannot be targeted: answering it would make the whole fleet reply
+        if (!ip_addr_ismulticast(ip_current_dest_addr())) {
+            send_error(upcb, error, (p->tot_len > 1) ? pbuf_get_at(p, 1) : 0, addr, port);
+        }
+        pbuf_free(p);
+        return;
+    }
+    // Requests sent to the multicast group may address only part of the fleet
+    if (header.targets != PROTOCOL_TARGETS_ALL && (header.targets & (1U << BOARD_INDEX)) == 0) {
+        pbuf_free(p);
         return;
     }
 
-    // Execute the test
-    result.test_id = command.test_id;
-    result.result = execute_test(&command);
-
-    // Send the result back to the client
-    send_packet(upcb, &result, sizeof(TestResult), addr, port);
+    switch (header.opcode) {
+        case PROTOCOL_OPCODE_TEST:
+            receive_test(upcb, p, &header, addr, port);
+            break;
+        case PROTOCOL_OPCODE_BATCH:
+            receive_batch(upcb, p, addr, port);
+            break;
+        case PROTOCOL_OPCODE_STATS:
+            receive_stats(upcb, addr, port);
+            break;
+        case PROTOCOL_OPCODE_CANCEL:
+            receive_cancel(upcb, p, addr, port);
+            break;
+        case PROTOCOL_OPCODE_PING:
+            receive_ping(upcb, p, rx_cycles, addr, port);
+            break;
+        case PROTOCOL_OPCODE_BLAST:
+            receive_blast(upcb, p, addr, port);
+            break;
+        case PROTOCOL_OPCODE_ECHO:
+            Bench_Echo(upcb, p, addr, port);
+            break;
+        case PROTOCOL_OPCODE_BENCH:
+            receive_bench(upcb, p, addr, port);
+            break;
+        case PROTOCOL_OPCODE_CAPS:
+            receive_caps(upcb, addr, port);
+            break;
+        case PROTOCOL_OPCODE_PLAN_UPLOAD:
+            receive_plan_upload(upcb, p, addr, port);
+            break;
+        case PROTOCOL_OPCODE_PLAN_RUN:
+            receive_plan_run(upcb, p, addr, port);
+            break;
+        case PROTOCOL_OPCODE_HISTORY:
+            receive_history(upcb, p, addr, port);
+            break;
+        default:
+            send_error(upcb, PROTOCOL_ERROR_OPCODE, header.opcode, addr, port);
+            break;
+    }
+    // Queued jobs hold their own reference on the datagram
+    pbuf_free(p);
 }
 
 /**
  * @brief Send a UDP packet to the client.
  *
- * This function sends a UDP packet containing the specified payload to the given IP address and port.
+ * This function copies the payload into a buffer of the response pool and
+ * sends it to the given IP address and port. The lwIP heap is not used.
  *
  * @param[in] pcb Pointer to the UDP control block.
  * @param[in] payload Pointer to the data to send.
@@ -107,23 +534,40 @@ void udp_receive_callback(void* arg, struct udp_pcb* upcb, struct pbuf* p, const
  * @return err_t Returns ERR_OK on success, or an error code on failure.
  */
 err_t send_packet(struct udp_pcb* pcb, const void* payload, u16_t payload_len, const ip_addr_t* ipaddr, u16_t port) {
-    err_t err;
     struct pbuf* p;
 
-    // Allocate a pbuf for the payload
-    p = pbuf_alloc(PBUF_TRANSPORT, payload_len, PBUF_RAM);
+    // Take a preallocated response buffer
+    p = ResponsePool_Alloc(payload_len);
     if (!p) {
-        // Failed to allocate pbuf
+        // Response pool exhausted
         return ERR_MEM;
     }
 
     // Copy the payload into the pbuf
     memcpy(p->payload, payload, payload_len);
 
+    return send_response(pcb, p, ipaddr, port);
+}
+
+/**
+ * @brief Send a response buffer to the client.
+ *
+ * The buffer returns to the response pool once lwIP and the Ethernet driver
+ * have released it.
+ *
+ * @param[in] pcb Pointer to the UDP control block.
+ * @param[in] p Pointer to a pbuf obtained from ResponsePool_Alloc().
+ * @param[in] ipaddr Pointer to the destination IP address.
+ * @param[in] port Destination port number.
+ * @return err_t Returns ERR_OK on success, or an error code on failure.
+ */
+err_t send_response(struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* ipaddr, u16_t port) {
+    err_t err;
+
     // Send the packet
     err = udp_sendto(pcb, p, ipaddr, port);
 
-    // Free the pbuf
+    // Drop our reference
     pbuf_free(p);
 
     return err;
@@ -133,15 +577,25 @@ err_t send_packet(struct udp_pcb* pcb, const void* payload, u16_t payload_len, c
  * @brief Initialize the UDP server.
  *
  * This function creates a UDP control block, binds it to the server port,
- * and sets a receive callback for handling incoming test commands.
+ * sets a receive callback for handling incoming test commands and joins the
+ * fleet's multicast group (MULTICAST_GROUP_ADDR).
  */
 void udpServer_init(void) {
     struct udp_pcb* upcb = udp_new(); /**< Pointer to the UDP control block. */
     err_t err = udp_bind(upcb, IP_ADDR_ANY, SERVER_PORT); /**< Bind the UDP server to SERVER_PORT. */
+    ip4_addr_t group; /**< Multicast group of the fleet. */
+
+    ResponsePool_Init();
+    Bench_Init();
 
     if (err == ERR_OK) {
         // Set a receive callback
         udp_recv(upcb, udp_receive_callback, NULL);
+        // The socket is bound to any address, so it also gets the fleet's multicast commands
+        ip4_addr_set_u32(&group, PP_HTONL(MULTICAST_GROUP_ADDR));
+        if (igmp_joingroup_netif(&gnetif, &group) != ERR_OK) {
+            printf("Failed to join multicast group %s\r\n", ip4addr_ntoa(&group));
+        }
     } else {
         // Failed to bind, remove the UDP control block
         udp_remove(upcb);
@@ -0,0 +1,552 @@
+/**
+ * @file HalStub.c
+ * @brief Mocked HAL of the host test build.
+ *
+ * This file defines the peripheral handles CubeMX defines in main.c and
+ * the HAL functions the UUT sources call, backed by a small model of the
+ * board's loopback wiring. A transfer is armed by its HAL call and moved
+ * across the wire by HalStub_Interrupts(), which then calls the same HAL
+ * callbacks as the real interrupt handlers, so the engines run unchanged.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#include "HalStub.h"
+#include "DebugUart.h"
+#include <stdarg.h>
+
+/** @brief Number of timers (TIM3, TIM2) of the model. */
+#define HAL_STUB_TIMERS 2
+
+/** @brief Simulated duration of a timer period (1 s) in nanoseconds. */
+#define HAL_STUB_TIMER_PERIOD_NS 1000000000ULL
+
+// Register blocks of the peripherals (see Stubs/stm32f7xx_hal.h)
+DWT_Type host_dwt;
+CoreDebug_Type host_core_debug;
+RCC_TypeDef host_rcc;
+USART_TypeDef host_uart5;
+USART_TypeDef host_usart2;
+USART_TypeDef host_usart3;
+SPI_TypeDef host_spi1;
+SPI_TypeDef host_spi2;
+I2C_TypeDef host_i2c2;
+I2C_TypeDef host_i2c4;
+ADC_TypeDef host_adc1;
+TIM_TypeDef host_tim2;
+TIM_TypeDef host_tim3;
+
+/** @brief DMA stream registers of the UART receive streams. */
+static DMA_Stream_TypeDef host_dma_streams[2];
+
+// Handles defined by main.c on the board
+ADC_HandleTypeDef hadc1;
+I2C_HandleTypeDef hi2c2;
+I2C_HandleTypeDef hi2c4;
+SPI_HandleTypeDef hspi1;
+SPI_HandleTypeDef hspi2;
+TIM_HandleTypeDef htim2;
+TIM_HandleTypeDef htim3;
+UART_HandleTypeDef huart5;
+UART_HandleTypeDef huart2;
+UART_HandleTypeDef huart3;
+DMA_HandleTypeDef hdma_uart5_rx;
+DMA_HandleTypeDef hdma_usart2_rx;
+
+/** @brief System core clock, as set by SystemClock_Config(). */
+uint32_t SystemCoreClock = HAL_STUB_SYSCLK;
+
+HalStubBoard hal_stub;
+
+/**
+ * @brief Model of one UART of the UART5 <-> UART2 loopback.
+ */
+typedef struct {
+    UART_HandleTypeDef* huart;  /**< Handle of the UART. */
+    const uint8_t* tx;          /**< Data of the armed transmission, NULL if none. */
+    uint16_t tx_length;         /**< Length of the armed transmission. */
+    uint8_t* rx;                /**< Receive buffer, NULL if not receiving. */
+    uint16_t rx_size;           /**< Size of the receive buffer. */
+    uint16_t rx_count;          /**< Bytes received (circular: write offset). */
+    uint8_t rx_circular;        /**< Nonzero for HAL_UARTEx_ReceiveToIdle_DMA(). */
+} HalStubUart;
+
+/**
+ * @brief Model of one side of a full-duplex transfer (SPI) or of an I2C transfer.
+ */
+typedef struct {
+    const uint8_t* tx;          /**< Data sent, NULL if none. */
+    uint8_t* rx;                /**< Receive buffer, NULL if none. */
+    uint16_t length;            /**< Length of the transfer. */
+    uint16_t address;           /**< Address sent by an I2C master. */
+    uint8_t armed;              /**< Nonzero while the transfer is armed. */
+} HalStubTransfer;
+
+/** @brief UART5 (index 0) and UART2 (index 1). */
+static HalStubUart stub_uarts[2];
+
+/** @brief SPI1 (Master) and SPI2 (Slave). */
+static HalStubTransfer stub_spi_master, stub_spi_slave;
+
+/** @brief I2C4 (Master) and I2C2 (Slave). */
+static HalStubTransfer stub_i2c_master, stub_i2c_slave;
+
+/** @brief Nonzero while an ADC conversion is running. */
+static uint8_t stub_adc_running;
+
+/** @brief TIM3 (index 0) and TIM2 (index 1): running flag and time into the current period. */
+static struct {
+    TIM_HandleTypeDef* htim;
+    uint8_t running;
+    uint64_t elapsed_ns;
+} stub_timers[HAL_STUB_TIMERS];
+
+/** @brief Simulated time in nanoseconds. */
+static uint64_t stub_time_ns;
+
+/** @brief Simulated time at which the debug UART has sent its character. */
+static uint64_t stub_debug_done_ns;
+
+/**
+ * @brief Move the simulated time forward and fire the timers that elapse.
+ *
+ * @param[in] ns Nanoseconds to advance.
+ */
+static void stub_advance_ns(uint64_t ns) {
+    uint8_t i;
+
+    // The debug UART takes the character written since the last step
+    if (host_usart3.TDR != HAL_STUB_DEBUG_IDLE) {
+        if (hal_stub.echo) {
+            fputc((int)host_usart3.TDR, stdout);
+        }
+        hal_stub.debug_chars++;
+        host_usart3.TDR = HAL_STUB_DEBUG_IDLE;
+        host_usart3.ISR &= ~USART_ISR_TXE;
+        stub_debug_done_ns = stub_time_ns + HAL_STUB_DEBUG_CHAR_NS;
+    }
+    stub_time_ns += ns;
+    if (stub_time_ns >= stub_debug_done_ns) {
+        host_usart3.ISR |= USART_ISR_TXE;
+    }
+    host_dwt.CYCCNT = (uint32_t)((stub_time_ns * (HAL_STUB_SYSCLK / 1000000U)) / 1000U);
+    for (i = 0; i < HAL_STUB_TIMERS; i++) {
+        if (!stub_timers[i].running) {
+            continue;
+        }
+        stub_timers[i].elapsed_ns += ns;
+        while (stub_timers[i].running && stub_timers[i].elapsed_ns >= HAL_STUB_TIMER_PERIOD_NS) {
+            stub_timers[i].elapsed_ns -= HAL_STUB_TIMER_PERIOD_NS;
+            HAL_TIM_PeriodElapsedCallback(stub_timers[i].htim);
+        }
+    }
+}
+
+/**
+ * @brief Copy data across a wire, applying the `corrupt` knob.
+ *
+ * @param[out] dst Receiving buffer.
+ * @param[in] src Sent data.
+ * @param[in] length Number of bytes.
+ */
+static void stub_wire_copy(uint8_t* dst, const uint8_t* src, uint16_t length) {
+    memcpy(dst, src, length);
+    if (hal_stub.corrupt && length > 0) {
+        dst[0] ^= 0x01;
+        hal_stub.corrupt = 0;
+    }
+}
+
+/**
+ * @brief Find the model of a UART.
+ *
+ * @param[in] huart Pointer to the UART handle.
+ * @return HalStubUart* The model, or NULL for a UART outside the loopback.
+ */
+static HalStubUart* stub_uart(const UART_HandleTypeDef* huart) {
+    if (huart == &huart5) {
+        return &stub_uarts[0];
+    }
+    if (huart == &huart2) {
+        return &stub_uarts[1];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Deliver the armed transmission of a UART to its peer and complete it.
+ *
+ * A circular reception reports its half-transfer, transfer-complete and
+ * idle-line events as the DMA would; a normal one completes when full.
+ *
+ * @param[in,out] uart Model of the transmitting UART.
+ */
+static void stub_uart_deliver(HalStubUart* uart) {
+    HalStubUart* peer = &stub_uarts[(uart == &stub_uarts[0]) ? 1 : 0];
+    uint16_t last_event;
+    uint16_t n;
+    uint16_t i;
+
+    if (hal_stub.error && peer->rx != NULL) {
+        peer->huart->ErrorCode = hal_stub.error;
+        hal_stub.error = 0;
+        if (!peer->rx_circular) {
+            peer->rx = NULL;
+        }
+        HAL_UART_ErrorCallback(peer->huart);
+    } else if (peer->rx != NULL && peer->rx_circular) {
+        last_event = peer->rx_count;
+        for (i = 0; i < uart->tx_length; i++) {
+            stub_wire_copy(&peer->rx[peer->rx_count++], &uart->tx[i], 1);
+            if (peer->rx_count == peer->rx_size / 2 || peer->rx_count == peer->rx_size) {
+                last_event = peer->rx_count;
+                HAL_UARTEx_RxEventCallback(peer->huart, peer->rx_count);
+                peer->rx_count %= peer->rx_size;
+                last_event %= peer->rx_size;
+            }
+        }
+        if (peer->rx_count != last_event) {
+            HAL_UARTEx_RxEventCallback(peer->huart, peer->rx_count); // Idle line
+        }
+    } else if (peer->rx != NULL) {
+        n = peer->rx_size - peer->rx_count;
+        n = (uart->tx_length < n) ? uart->tx_length : n;
+        stub_wire_copy(&peer->rx[peer->rx_count], uart->tx, n);
+        peer->rx_count += n;
+        peer->huart->hdmarx->Instance->NDTR = peer->rx_size - peer->rx_count;
+        if (peer->rx_count == peer->rx_size) {
+            peer->rx = NULL;
+            HAL_UART_RxCpltCallback(peer->huart);
+        }
+    }
+    uart->tx = NULL;
+    HAL_UART_TxCpltCallback(uart->huart);
+}
+
+void HalStub_Reset(void) {
+    memset(&hal_stub, 0, sizeof(hal_stub));
+    hal_stub.adc_value = 880;
+    stub_time_ns = 0;
+    memset(&host_dwt, 0, sizeof(host_dwt));
+    memset(&host_usart3, 0, sizeof(host_usart3));
+    host_usart3.ISR = USART_ISR_TXE;
+    host_usart3.TDR = HAL_STUB_DEBUG_IDLE;
+    stub_debug_done_ns = 0;
+
+    memset(stub_uarts, 0, sizeof(stub_uarts));
+    memset(&stub_spi_master, 0, sizeof(stub_spi_master));
+    memset(&stub_spi_slave, 0, sizeof(stub_spi_slave));
+    memset(&stub_i2c_master, 0, sizeof(stub_i2c_master));
+    memset(&stub_i2c_slave, 0, sizeof(stub_i2c_slave));
+    memset(stub_timers, 0, sizeof(stub_timers));
+    stub_adc_running = 0;
+
+    // The CubeMX settings of main.c
+    memset(&hadc1, 0, sizeof(hadc1));
+    hadc1.Instance = ADC1;
+    memset(&hi2c2, 0, sizeof(hi2c2));
+    hi2c2.Instance = I2C2;
+    hi2c2.Init.Timing = 0x00808CD2;
+    memset(&hi2c4, 0, sizeof(hi2c4));
+    hi2c4.Instance = I2C4;
+    hi2c4.Init.Timing = 0x00808CD2;
+    memset(&hspi1, 0, sizeof(hspi1));
+    hspi1.Instance = SPI1;
+    hspi1.Init.BaudRatePrescaler = SPI_BAUDRATEPRESCALER_2;
+    memset(&hspi2, 0, sizeof(hspi2));
+    hspi2.Instance = SPI2;
+    memset(&htim2, 0, sizeof(htim2));
+    htim2.Instance = TIM2;
+    memset(&htim3, 0, sizeof(htim3));
+    htim3.Instance = TIM3;
+    memset(&huart5, 0, sizeof(huart5));
+    huart5.Instance = UART5;
+    huart5.Init.BaudRate = 115200;
+    huart5.Init.OverSampling = UART_OVERSAMPLING_16;
+    huart5.hdmarx = &hdma_uart5_rx;
+    memset(&huart2, 0, sizeof(huart2));
+    huart2.Instance = USART2;
+    huart2.Init.BaudRate = 115200;
+    huart2.Init.OverSampling = UART_OVERSAMPLING_16;
+    huart2.hdmarx = &hdma_usart2_rx;
+    memset(&huart3, 0, sizeof(huart3));
+    huart3.Instance = USART3;
+    memset(&hdma_uart5_rx, 0, sizeof(hdma_uart5_rx));
+    hdma_uart5_rx.Instance = &host_dma_streams[0];
+    memset(&hdma_usart2_rx, 0, sizeof(hdma_usart2_rx));
+    hdma_usart2_rx.Instance = &host_dma_streams[1];
+
+    stub_uarts[0].huart = &huart5;
+    stub_uarts[1].huart = &huart2;
+    stub_timers[0].htim = &htim3;
+    stub_timers[1].htim = &htim2;
+}
+
+void HalStub_Advance(uint32_t us) {
+    stub_advance_ns((uint64_t)us * 1000U);
+}
+
+void HalStub_Interrupts(void) {
+    uint8_t i;
+
+    if (hal_stub.hang) {
+        return;
+    }
+
+    if (stub_adc_running) {
+        stub_adc_running = 0;
+        HAL_ADC_ConvCpltCallback(&hadc1);
+    }
+
+    for (i = 0; i < 2; i++) {
+        if (stub_uarts[i].tx != NULL) {
+            stub_uart_deliver(&stub_uarts[i]);
+        }
+    }
+
+    if (stub_spi_master.armed && stub_spi_slave.armed) {
+        stub_spi_master.armed = 0;
+        stub_spi_slave.armed = 0;
+        if (hal_stub.error) {
+            hspi1.ErrorCode = hal_stub.error;
+            hal_stub.error = 0;
+            HAL_SPI_ErrorCallback(&hspi1);
+        } else {
+            stub_wire_copy(stub_spi_slave.rx, stub_spi_master.tx, stub_spi_slave.length);
+            stub_wire_copy(stub_spi_master.rx, stub_spi_slave.tx, stub_spi_master.length);
+            HAL_SPI_TxRxCpltCallback(&hspi2);
+            HAL_SPI_TxRxCpltCallback(&hspi1);
+        }
+    }
+
+    if (stub_i2c_master.armed) {
+        stub_i2c_master.armed = 0;
+        if (hal_stub.error || !stub_i2c_slave.armed || stub_i2c_master.address != hi2c2.Init.OwnAddress1) {
+            hi2c4.ErrorCode = hal_stub.error ? hal_stub.error : HAL_I2C_ERROR_AF;
+            hal_stub.error = 0;
+            HAL_I2C_ErrorCallback(&hi2c4);
+        } else {
+            stub_i2c_slave.armed = 0;
+            stub_wire_copy(stub_i2c_slave.rx, stub_i2c_master.tx, stub_i2c_master.length);
+            HAL_I2C_SlaveRxCpltCallback(&hi2c2);
+            HAL_I2C_MasterTxCpltCallback(&hi2c4);
+        }
+    }
+}
+
+uint64_t HalStub_Micros(void) {
+    return stub_time_ns / 1000U;
+}
+
+int HalStub_Printf(const char* format, ...) {
+    char line[256];
+    va_list args;
+    int length;
+
+    va_start(args, format);
+    length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length < 0) {
+        return length;
+    }
+    if (length >= (int)sizeof(line)) {
+        length = sizeof(line) - 1;
+    }
+    // _write() of Tools.c
+    DebugUart_Write((const uint8_t*)line, (uint16_t)length);
+    return length;
+}
+
+// HAL
+
+uint32_t HAL_GetTick(void) {
+    return (uint32_t)(stub_time_ns / 1000000U);
+}
+
+uint32_t HAL_RCC_GetPCLK1Freq(void) {
+    return HAL_STUB_SYSCLK / 2;
+}
+
+uint32_t HAL_RCC_GetPCLK2Freq(void) {
+    return HAL_STUB_SYSCLK;
+}
+
+// ADC1 <- DAC
+
+HAL_StatusTypeDef HAL_ADC_Start_IT(ADC_HandleTypeDef* hadc) {
+    if (stub_adc_running) {
+        return HAL_BUSY;
+    }
+    stub_adc_running = 1;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_Stop_IT(ADC_HandleTypeDef* hadc) {
+    stub_adc_running = 0;
+    hal_stub.aborts++;
+    return HAL_OK;
+}
+
+uint32_t HAL_ADC_GetValue(ADC_HandleTypeDef* hadc) {
+    return hal_stub.adc_value;
+}
+
+// TIM3, TIM2
+
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef* htim) {
+    uint8_t i = (htim == &htim3) ? 0 : 1;
+
+    stub_timers[i].running = 1;
+    stub_timers[i].elapsed_ns = 0;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Stop_IT(TIM_HandleTypeDef* htim) {
+    stub_timers[(htim == &htim3) ? 0 : 1].running = 0;
+    return HAL_OK;
+}
+
+// UART5 <-> UART2
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef* huart) {
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef* huart, const uint8_t* pData, uint16_t Size) {
+    HalStubUart* uart = stub_uart(huart);
+
+    if (uart == NULL || uart->tx != NULL) {
+        return HAL_BUSY;
+    }
+    uart->tx = pData;
+    uart->tx_length = Size;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Receive_DMA(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size) {
+    HalStubUart* uart = stub_uart(huart);
+
+    if (uart == NULL || uart->rx != NULL) {
+        return HAL_BUSY;
+    }
+    uart->rx = pData;
+    uart->rx_size = Size;
+    uart->rx_count = 0;
+    uart->rx_circular = 0;
+    huart->hdmarx->Instance->NDTR = Size;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size) {
+    HAL_StatusTypeDef status = HAL_UART_Receive_DMA(huart, pData, Size);
+
+    if (status == HAL_OK) {
+        stub_uart(huart)->rx_circular = 1;
+    }
+    return status;
+}
+
+HAL_StatusTypeDef HAL_UART_AbortReceive(UART_HandleTypeDef* huart) {
+    HalStubUart* uart = stub_uart(huart);
+
+    if (uart != NULL) {
+        uart->rx = NULL;
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Abort(UART_HandleTypeDef* huart) {
+    HalStubUart* uart = stub_uart(huart);
+
+    if (uart != NULL) {
+        uart->tx = NULL;
+        uart->rx = NULL;
+    }
+    hal_stub.aborts++;
+    return HAL_OK;
+}
+
+// SPI1 (Master) <-> SPI2 (Slave)
+
+HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef* hspi) {
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef* hspi, uint8_t* pTxData, uint8_t* pRxData,
+                                              uint16_t Size) {
+    HalStubTransfer* side = (hspi == &hspi1) ? &stub_spi_master : &stub_spi_slave;
+
+    if (side->armed) {
+        return HAL_BUSY;
+    }
+    side->tx = pTxData;
+    side->rx = pRxData;
+    side->length = Size;
+    side->armed = 1;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Abort(SPI_HandleTypeDef* hspi) {
+    ((hspi == &hspi1) ? &stub_spi_master : &stub_spi_slave)->armed = 0;
+    hal_stub.aborts++;
+    return HAL_OK;
+}
+
+// I2C4 (Master) -> I2C2 (Slave)
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef* hi2c) {
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef* hi2c) {
+    ((hi2c == &hi2c4) ? &stub_i2c_master : &stub_i2c_slave)->armed = 0;
+    hal_stub.aborts++;
+    return HAL_OK;
+}
+
+void HAL_I2CEx_EnableFastModePlus(uint32_t ConfigFastModePlus) {
+}
+
+void HAL_I2CEx_DisableFastModePlus(uint32_t ConfigFastModePlus) {
+}
+
+uint32_t HAL_I2C_GetError(I2C_HandleTypeDef* hi2c) {
+    return hi2c->ErrorCode;
+}
+
+HAL_StatusTypeDef HAL_I2C_IsDeviceReady(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint32_t Trials,
+                                        uint32_t Timeout) {
+    hal_stub.scans++;
+    stub_advance_ns(HAL_STUB_I2C_PROBE_NS);
+    if (hi2c == &hi2c4 && stub_i2c_slave.armed && DevAddress == hi2c2.Init.OwnAddress1) {
+        return HAL_OK;
+    }
+    return HAL_ERROR;
+}
+
+HAL_StatusTypeDef HAL_I2C_Slave_Receive_DMA(I2C_HandleTypeDef* hi2c, uint8_t* pData, uint16_t Size) {
+    if (hi2c != &hi2c2 || stub_i2c_slave.armed) {
+        return HAL_BUSY;
+    }
+    stub_i2c_slave.rx = pData;
+    stub_i2c_slave.length = Size;
+    stub_i2c_slave.armed = 1;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Slave_Receive_IT(I2C_HandleTypeDef* hi2c, uint8_t* pData, uint16_t Size) {
+    return HAL_I2C_Slave_Receive_DMA(hi2c, pData, Size);
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_IT(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint8_t* pData,
+                                             uint16_t Size) {
+    if (hi2c != &hi2c4 || stub_i2c_master.armed) {
+        return HAL_BUSY;
+    }
+    stub_i2c_master.tx = pData;
+    stub_i2c_master.length = Size;
+    stub_i2c_master.address = DevAddress;
+    stub_i2c_master.armed = 1;
+    return HAL_OK;
+}
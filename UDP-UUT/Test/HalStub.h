@@ -0,0 +1,89 @@
+/**
+ * @file HalStub.h
+ * @brief Header file for the mocked HAL of the host test build.
+ *
+ * The mocks stand in for the board and its loopback wiring: UART5 <-> UART2,
+ * SPI1 (Master) <-> SPI2 (Slave), I2C4 (Master) -> I2C2 (Slave), ADC1 <- DAC
+ * and the TIM3/TIM2 second timers. Transfers armed by an engine complete
+ * when the test calls HalStub_Interrupts(), as if their interrupts had
+ * fired between two main-loop passes; the timers fire as HalStub_Advance()
+ * moves the simulated time.
+ *
+ * @details Simulated time drives HAL_GetTick() and the DWT cycle counter
+ * (72 cycles per microsecond). The only mock that takes time by itself is
+ * the address probe of an I2C scan, which waits for the acknowledge as
+ * HAL_I2C_IsDeviceReady does on the board. The debug UART (USART3) takes
+ * a character from its transmit data register, as DebugUart_Poll() writes
+ * it, and is ready for the next one 10 bits later at its baud rate.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#ifndef TEST_HAL_STUB_H_
+#define TEST_HAL_STUB_H_
+
+#include "UdpUut.h"
+
+/** @brief SYSCLK of the board, which clocks the DWT cycle counter. */
+#define HAL_STUB_SYSCLK 72000000U
+
+/** @brief Simulated duration of a debug UART character in nanoseconds (10 bits at 115200 baud). */
+#define HAL_STUB_DEBUG_CHAR_NS 86806U
+
+/** @brief Value of the debug UART's transmit data register once the model has taken its character. */
+#define HAL_STUB_DEBUG_IDLE 0x100U
+
+/** @brief Simulated duration of an I2C address probe in nanoseconds (START, address and acknowledge at 100 kHz). */
+#define HAL_STUB_I2C_PROBE_NS 100000U
+
+/**
+ * @brief Knobs and counters of the mocked board.
+ */
+typedef struct {
+    uint32_t adc_value;          /**< Value returned by the next ADC conversions. */
+    uint8_t corrupt;             /**< Flip one bit in the data of the next transfer that completes. */
+    uint32_t error;              /**< HAL_*_ERROR_* bits reported by the next transfer instead of completing. */
+    uint8_t hang;                /**< Nonzero: armed transfers never complete. */
+    uint32_t aborts;             /**< Transfers and conversions cancelled by an engine. */
+    uint32_t scans;              /**< Addresses probed on an I2C bus. */
+    uint32_t debug_chars;        /**< Characters sent by the debug UART. */
+    uint8_t echo;                /**< Nonzero to copy the debug UART output to stdout. */
+} HalStubBoard;
+
+/** @brief The mocked board. */
+extern HalStubBoard hal_stub;
+
+/**
+ * @brief Reset the simulated time, the peripherals, the handles and the knobs.
+ */
+void HalStub_Reset(void);
+
+/**
+ * @brief Move the simulated time forward, firing the timers that elapse.
+ *
+ * @param[in] us Microseconds to advance.
+ */
+void HalStub_Advance(uint32_t us);
+
+/**
+ * @brief Complete the transfers and conversions that are armed, calling their HAL callbacks.
+ */
+void HalStub_Interrupts(void);
+
+/**
+ * @brief Simulated time since HalStub_Reset().
+ *
+ * @return uint64_t Time in microseconds.
+ */
+uint64_t HalStub_Micros(void);
+
+/**
+ * @brief printf() of the UUT sources: formats into the debug UART's transmit ring.
+ *
+ * @param[in] format printf format string.
+ * @return int Number of characters written.
+ */
+int HalStub_Printf(const char* format, ...);
+
+#endif /* TEST_HAL_STUB_H_ */
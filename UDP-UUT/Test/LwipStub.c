@@ -0,0 +1,38 @@
+/**
+ * @file LwipStub.c
+ * @brief lwIP allocators of the host build.
+ *
+ * The host build links lwIP's own pbuf.c. It refers to the lwIP heap, the
+ * memory pools and TCP, which the code under test never reaches: its
+ * pbufs are PBUF_REF or custom pbufs over static buffers, as on the board.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#include "lwip/mem.h"
+#include "lwip/memp.h"
+#include "lwip/priv/tcp_priv.h"
+
+void* mem_malloc(mem_size_t size) {
+    return NULL;
+}
+
+void* mem_trim(void* mem, mem_size_t size) {
+    return mem;
+}
+
+void mem_free(void* mem) {
+}
+
+void* memp_malloc(memp_t type) {
+    return NULL;
+}
+
+void memp_free(memp_t type, void* mem) {
+}
+
+struct tcp_pcb* tcp_active_pcbs;
+
+void tcp_free_ooseq(struct tcp_pcb* pcb) {
+}
@@ -0,0 +1,66 @@
+/**
+ * @file stm32f7xx_hal.h
+ * @brief Host build wrapper of the STM32F7 HAL header.
+ *
+ * Includes the real HAL header, for its types and macros, and points the
+ * peripherals the UUT sources touch at register blocks in host memory, so
+ * register macros such as __HAL_UART_CLEAR_FLAG() and TEST_CYCLES() work
+ * on the host. The HAL functions themselves are mocked in HalStub.c, and
+ * printf queues its text for the debug UART in DebugUart.c, as Tools.c
+ * does on the board.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#ifndef TEST_STUBS_STM32F7XX_HAL_H_
+#define TEST_STUBS_STM32F7XX_HAL_H_
+
+#include_next "stm32f7xx_hal.h"
+#include <stdio.h>
+
+extern DWT_Type host_dwt;
+extern CoreDebug_Type host_core_debug;
+extern RCC_TypeDef host_rcc;
+extern USART_TypeDef host_uart5;
+extern USART_TypeDef host_usart2;
+extern USART_TypeDef host_usart3;
+extern SPI_TypeDef host_spi1;
+extern SPI_TypeDef host_spi2;
+extern I2C_TypeDef host_i2c2;
+extern I2C_TypeDef host_i2c4;
+extern ADC_TypeDef host_adc1;
+extern TIM_TypeDef host_tim2;
+extern TIM_TypeDef host_tim3;
+
+#undef DWT
+#define DWT (&host_dwt)
+#undef CoreDebug
+#define CoreDebug (&host_core_debug)
+#undef RCC
+#define RCC (&host_rcc)
+#undef UART5
+#define UART5 (&host_uart5)
+#undef USART2
+#define USART2 (&host_usart2)
+#undef USART3
+#define USART3 (&host_usart3)
+#undef SPI1
+#define SPI1 (&host_spi1)
+#undef SPI2
+#define SPI2 (&host_spi2)
+#undef I2C2
+#define I2C2 (&host_i2c2)
+#undef I2C4
+#define I2C4 (&host_i2c4)
+#undef ADC1
+#define ADC1 (&host_adc1)
+#undef TIM2
+#define TIM2 (&host_tim2)
+#undef TIM3
+#define TIM3 (&host_tim3)
+
+int HalStub_Printf(const char* format, ...);
+#define printf HalStub_Printf
+
+#endif /* TEST_STUBS_STM32F7XX_HAL_H_ */
@@ -0,0 +1,235 @@
+/**
+ * @file bench_parse.c
+ * @brief Host microbenchmark of the parse cost of a TEST request.
+ *
+ * Three receive paths are timed on the same request, built against lwIP's
+ * own pbuf.c and the UUT's Codec.c:
+ * - baseline: the original fixed TestCommand copied out of the payload and
+ *   its pattern validated with strlen() (patterns of up to 99 bytes);
+ * - copy: header and TLVs decoded, then the pattern copied into the job;
+ * - in place: header and TLVs decoded, the pattern read from the pbuf.
+ * The in-place path is also timed on a two-pbuf chain split inside the
+ * pattern, where Codec_GetPattern() gathers it into the scratch buffer.
+ *
+ * @details Each cell is the median of BENCH_RUNS runs of BENCH_COMMANDS
+ * parses, in nanoseconds per command, followed by the fastest run, which
+ * is the least disturbed by the host. The runs of the paths are
+ * interleaved.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <time.h>
+#include "HalStub.h"
+#include "Codec.h"
+
+/** @brief Number of timed runs of each cell. */
+#define BENCH_RUNS 21
+
+/** @brief Number of commands parsed per run. */
+#define BENCH_COMMANDS 200000
+
+/** @brief Size of the pattern field of the original TestCommand. */
+#define BENCH_LEGACY_PATTERN_SIZE 100
+
+/**
+ * @brief The original TestCommand, received as a raw struct.
+ */
+typedef struct {
+    uint32_t test_id;                              /**< Unique test ID to identify the command. */
+    uint8_t peripheral;                            /**< Peripheral to test. */
+    uint8_t iterations;                            /**< Number of iterations to run the test. */
+    uint8_t pattern_length;                        /**< Length of the bit pattern. */
+    char bit_pattern[BENCH_LEGACY_PATTERN_SIZE];   /**< NUL-terminated bit pattern. */
+} BenchLegacyCommand;
+
+/** @brief Receive paths of the benchmark. */
+enum {
+    BENCH_BASELINE,
+    BENCH_COPY,
+    BENCH_IN_PLACE,
+    BENCH_CHAINED,
+    BENCH_PATHS
+};
+
+/** @brief Received frame the pbufs point into. */
+static uint8_t bench_frame[1536];
+
+/** @brief Pattern storage of a job, or scratch buffer of a chained pattern. */
+static uint8_t bench_pattern[TEST_PATTERN_MAX_LENGTH];
+
+/** @brief Sink of the parse results, so that none of them is optimized out. */
+static volatile uint32_t bench_sink;
+
+// pbuf.c prints its asserts; the benchmark runs without the mocked board
+
+int HalStub_Printf(const char* format, ...) {
+    va_list args;
+    int written;
+
+    va_start(args, format);
+    written = vfprintf(stdout, format, args);
+    va_end(args);
+    return written;
+}
+
+/**
+ * @brief Monotonic time in nanoseconds.
+ *
+ * @return uint64_t Time in nanoseconds.
+ */
+static uint64_t bench_now(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * @brief Build the request received by one receive path.
+ *
+ * @param[out] head First pbuf of the datagram.
+ * @param[out] tail Second pbuf of a chained datagram.
+ * @param[in] path BENCH_* receive path.
+ * @param[in] length Pattern length.
+ */
+static void bench_build(struct pbuf* head, struct pbuf* tail, uint8_t path, uint16_t length) {
+    BenchLegacyCommand legacy;
+    uint16_t size;
+
+    memset(head, 0, sizeof(*head));
+    memset(tail, 0, sizeof(*tail));
+    head->payload = bench_frame;
+    head->type_internal = PBUF_REF;
+    head->ref = 1;
+
+    if (path == BENCH_BASELINE) {
+        memset(&legacy, 0, sizeof(legacy));
+        legacy.test_id = 1;
+        legacy.peripheral = TEST_PERIPHERAL_UART;
+        legacy.iterations = 5;
+        legacy.pattern_length = (uint8_t)length;
+        memset(legacy.bit_pattern, 'A', length);
+        memcpy(bench_frame, &legacy, sizeof(legacy));
+        head->len = head->tot_len = sizeof(legacy);
+        return;
+    }
+
+    size = Codec_EncodeHeader(bench_frame, PROTOCOL_OPCODE_TEST, 0);
+    Codec_PutLe32(&bench_frame[size], 1);
+    Codec_PutLe32(&bench_frame[size + 4], 5);
+    bench_frame[size + 8] = TEST_PERIPHERAL_UART;
+    bench_frame[size + 9] = 0;
+    Codec_PutLe16(&bench_frame[size + 10], (uint16_t)(PROTOCOL_TLV_HEADER_SIZE + length));
+    size += PROTOCOL_TEST_SIZE;
+    bench_frame[size] = PROTOCOL_TLV_PATTERN;
+    Codec_PutLe16(&bench_frame[size + 1], length);
+    size += PROTOCOL_TLV_HEADER_SIZE;
+    memset(&bench_frame[size], 'A', length);
+    size += length;
+    head->len = head->tot_len = size;
+
+    // The second pbuf starts in the middle of the pattern
+    if (path == BENCH_CHAINED) {
+        head->len = (uint16_t)(size - length / 2);
+        head->next = tail;
+        tail->payload = &bench_frame[head->len];
+        tail->type_internal = PBUF_REF;
+        tail->ref = 1;
+        tail->len = tail->tot_len = (uint16_t)(length / 2);
+    }
+}
+
+/**
+ * @brief Parse the request BENCH_COMMANDS times along one receive path.
+ *
+ * @param[in] p Received datagram.
+ * @param[in] path BENCH_* receive path.
+ * @return uint64_t Elapsed time in nanoseconds.
+ */
+static uint64_t bench_run(const struct pbuf* p, uint8_t path) {
+    BenchLegacyCommand legacy;
+    PacketHeader header;
+    TestCommand command;
+    const uint8_t* pattern;
+    uint64_t start;
+    uint32_t i;
+
+    start = bench_now();
+    for (i = 0; i < BENCH_COMMANDS; i++) {
+        if (path == BENCH_BASELINE) {
+            memcpy(&legacy, p->payload, sizeof(legacy));
+            bench_sink += (legacy.pattern_length == strlen(legacy.bit_pattern));
+        } else {
+            Codec_DecodeHeader(p, &header);
+            Codec_DecodeTest(p, PROTOCOL_HEADER_SIZE, &command);
+            if (path == BENCH_COPY) {
+                pbuf_copy_partial(p, bench_pattern, command.pattern_length, command.pattern_offset);
+                pattern = bench_pattern;
+            } else {
+                pattern = Codec_GetPattern(p, &command, bench_pattern);
+            }
+            bench_sink += pattern[command.pattern_length - 1];
+        }
+        // The next datagram is a new one: nothing may be kept from this parse
+        __asm__ volatile("" ::: "memory");
+    }
+    return bench_now() - start;
+}
+
+/**
+ * @brief Sort callback of the run times.
+ */
+static int bench_compare(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+
+    return (x > y) - (x < y);
+}
+
+int main(void) {
+    static const uint16_t lengths[] = {8, 64, 99, 1024};
+    static const char* names[BENCH_PATHS] = {"baseline", "copy", "in place", "chained"};
+    uint64_t runs[BENCH_PATHS][BENCH_RUNS];
+    struct pbuf head;
+    struct pbuf tail;
+    uint8_t path;
+    size_t l;
+    int r;
+
+    fprintf(stdout, "Parse cost per TEST request, ns (median / fastest of %d runs of %d)\n",
+            BENCH_RUNS, BENCH_COMMANDS);
+    fprintf(stdout, "pattern");
+    for (path = 0; path < BENCH_PATHS; path++) {
+        fprintf(stdout, " %17s", names[path]);
+    }
+    fputc('\n', stdout);
+
+    for (l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        // Runs of the paths are interleaved so that drifts of the host hit them alike
+        for (r = 0; r < BENCH_RUNS; r++) {
+            for (path = 0; path < BENCH_PATHS; path++) {
+                if (path == BENCH_BASELINE && lengths[l] >= BENCH_LEGACY_PATTERN_SIZE) {
+                    continue;
+                }
+                bench_build(&head, &tail, path, lengths[l]);
+                runs[path][r] = bench_run(&head, path);
+            }
+        }
+        fprintf(stdout, "%5u B", lengths[l]);
+        for (path = 0; path < BENCH_PATHS; path++) {
+            if (path == BENCH_BASELINE && lengths[l] >= BENCH_LEGACY_PATTERN_SIZE) {
+                fprintf(stdout, " %17s", "-");
+                continue;
+            }
+            qsort(runs[path], BENCH_RUNS, sizeof(runs[path][0]), bench_compare);
+            fprintf(stdout, " %8.1f / %6.1f", (double)runs[path][BENCH_RUNS / 2] / BENCH_COMMANDS,
+                    (double)runs[path][0] / BENCH_COMMANDS);
+        }
+        fputc('\n', stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,314 @@
+/**
+ * @file test_drivers.c
+ * @brief Host tests of the test engines against the TestDriver contract.
+ *
+ * Each engine is run through the generic runner on the mocked board
+ * (HalStub.c): a clean run must pass every iteration through
+ * setup/start/poll/finish, a corrupted or failing transfer must end the
+ * run through abort and finish with the right record, and TestRun_Abort()
+ * must release whatever the engine armed.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#include "HalStub.h"
+#include "TestDriver.h"
+#include "I2C_test.h"
+#include "SPI_test.h"
+
+/** @brief Simulated time a transfer takes on the wire, in microseconds. */
+#define HOST_WIRE_US 10
+
+/** @brief Simulated time of the rest of a main-loop pass, in microseconds. */
+#define HOST_PASS_US 10
+
+/** @brief Main-loop passes after which a run is considered stuck. */
+#define HOST_MAX_PASSES 2000000
+
+/** @brief Counter for TIM3 elapsed seconds (Timer_test.c). */
+extern volatile uint32_t tim3_seconds;
+
+/** @brief Number of failed checks. */
+static uint32_t failures = 0;
+
+/**
+ * @brief Check a condition and report it with its location if it does not hold.
+ *
+ * @param cond Condition that must hold.
+ */
+#define CHECK(cond)                                                                  \
+    do {                                                                             \
+        if (!(cond)) {                                                               \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                              \
+        }                                                                            \
+    } while (0)
+
+/**
+ * @brief Run a test to its end as the main loop does, with the interrupts firing between passes.
+ *
+ * @param[out] ctx Pointer to the context of the run.
+ * @param[in] driver Engine under test.
+ * @param[in] pattern Data pattern, or NULL.
+ * @param[in] iterations Number of iterations; 0 for the engine's default.
+ * @return uint8_t Final status of the run.
+ */
+static uint8_t host_run(TestContext* ctx, const TestDriver* driver, const char* pattern, uint32_t iterations) {
+    uint32_t passes = 0;
+    uint8_t status;
+
+    status = TestRun_Begin(ctx, driver, (const uint8_t*)pattern, pattern ? (uint16_t)strlen(pattern) : 0, iterations);
+    while (status == TEST_IN_PROGRESS && passes++ < HOST_MAX_PASSES) {
+        status = TestRun_Poll(ctx);
+        HalStub_Advance(HOST_WIRE_US);
+        HalStub_Interrupts();
+        HalStub_Advance(HOST_PASS_US);
+    }
+    return status;
+}
+
+/**
+ * @brief Arm the first iteration of a test and abort the run while it is in flight.
+ *
+ * @param[out] ctx Pointer to the context of the run.
+ * @param[in] driver Engine under test.
+ * @param[in] pattern Data pattern, or NULL.
+ * @return uint32_t Number of HAL aborts and deinitializations the engine made.
+ */
+static uint32_t host_abort(TestContext* ctx, const TestDriver* driver, const char* pattern) {
+    uint32_t aborts;
+
+    CHECK(TestRun_Begin(ctx, driver, (const uint8_t*)pattern, pattern ? (uint16_t)strlen(pattern) : 0, 3) ==
+          TEST_IN_PROGRESS);
+    CHECK(TestRun_Poll(ctx) == TEST_IN_PROGRESS);
+    CHECK(ctx->armed);
+    aborts = hal_stub.aborts;
+    TestRun_Abort(ctx);
+    CHECK(ctx->status == TEST_FAILURE);
+    CHECK(!ctx->armed);
+    return hal_stub.aborts - aborts;
+}
+
+/**
+ * @brief Every iteration of a clean run was timed from its arming to its completion interrupt.
+ *
+ * @param[in] ctx Pointer to the context of a finished run.
+ */
+static void check_timed_to_completion(const TestContext* ctx) {
+    const uint32_t wire = HOST_WIRE_US * (HAL_STUB_SYSCLK / 1000000U);
+
+    CHECK(ctx->timing.count == ctx->iterations);
+    CHECK(ctx->timing.min_cycles == wire);
+    CHECK(ctx->timing.max_cycles == wire);
+}
+
+static void test_adc(void) {
+    TestContext ctx;
+
+    HalStub_Reset();
+    CHECK(host_run(&ctx, &adc_test_driver, NULL, 0) == TEST_SUCCESS);
+    CHECK(ctx.iterations == adc_test_driver.default_iterations);
+    CHECK(ctx.iteration == ctx.iterations);
+    CHECK(ctx.record.code == PROTOCOL_RECORD_PASSED);
+    CHECK(ctx.record.value == hal_stub.adc_value);
+    CHECK(ctx.timing.bytes == ctx.iterations * sizeof(uint16_t));
+    check_timed_to_completion(&ctx);
+
+    // Out of range: the first iteration fails, the engine is aborted and finished
+    HalStub_Reset();
+    hal_stub.adc_value = 4000;
+    CHECK(host_run(&ctx, &adc_test_driver, NULL, 5) == TEST_FAILURE);
+    CHECK(ctx.errors == 1);
+    CHECK(ctx.iteration == 0);
+    CHECK(ctx.record.code == PROTOCOL_RECORD_FAILED);
+    CHECK(ctx.record.value == 4000);
+    CHECK(hal_stub.aborts == 1);
+
+    // A conversion that never completes times out
+    HalStub_Reset();
+    hal_stub.hang = 1;
+    CHECK(host_run(&ctx, &adc_test_driver, NULL, 1) == TEST_FAILURE);
+    CHECK(ctx.record.code == PROTOCOL_RECORD_TIMEOUT);
+    CHECK(HalStub_Micros() >= TEST_ITERATION_TIMEOUT * 1000U);
+
+    HalStub_Reset();
+    CHECK(host_abort(&ctx, &adc_test_driver, NULL) == 1);
+}
+
+static void test_timer(void) {
+    TestContext ctx;
+    uint32_t seconds;
+
+    HalStub_Reset();
+    CHECK(host_run(&ctx, &timer_test_driver, NULL, 2) == TEST_SUCCESS);
+    CHECK(ctx.iteration == 2);
+    seconds = ctx.record.value & 0xFFFF;
+    CHECK(seconds >= 1 && seconds <= 10);
+    CHECK((ctx.record.value >> 16) == seconds);
+    // Timed to the second interrupt of the last iteration, not to the poll after it
+    CHECK(ctx.record.cycles == seconds * HAL_STUB_SYSCLK);
+
+    // Aborted: both timers are stopped and count no more
+    HalStub_Reset();
+    host_abort(&ctx, &timer_test_driver, NULL);
+    HalStub_Advance(20000000);
+    CHECK(tim3_seconds == 0);
+}
+
+static void test_uart(void) {
+    TestContext ctx;
+
+    HalStub_Reset();
+    CHECK(host_run(&ctx, &uart_test_driver, "UARTTEST", 3) == TEST_SUCCESS);
+    CHECK(ctx.iteration == 3);
+    CHECK(ctx.record.value == 0);
+    CHECK(ctx.timing.bytes == 3 * 2 * 8);
+    check_timed_to_completion(&ctx);
+
+    // The pattern is required
+    HalStub_Reset();
+    CHECK(host_run(&ctx, &uart_test_driver, NULL, 3) == TEST_FAILURE);
+
+    // One flipped bit on UART5 -> UART2 is a mismatch reported in the low half
+    HalStub_Reset();
+    hal_stub.corrupt = 1;
+    CHECK(host_run(&ctx, &uart_test_driver, "UARTTEST", 3) == TEST_FAILURE);
+    CHECK(ctx.record.code == PROTOCOL_RECORD_FAILED);
+    CHECK(ctx.record.value == 1);
+
+    HalStub_Reset();
+    hal_stub.error = HAL_UART_ERROR_FE;
+    CHECK(host_run(&ctx, &uart_test_driver, "UARTTEST", 3) == TEST_FAILURE);
+    CHECK(ctx.record.code == PROTOCOL_RECORD_FAILED);
+    CHECK(ctx.record.value == HAL_UART_ERROR_FE);
+
+    HalStub_Reset();
+    CHECK(host_abort(&ctx, &uart_test_driver, "UARTTEST") == 2);
+
+    // Sweep: a bit error is counted in its step instead of ending the run
+    HalStub_Reset();
+    hal_stub.corrupt = 1;
+    CHECK(host_run(&ctx, uart_test_driver.sweep, NULL, 1) == TEST_SUCCESS);
+    CHECK(ctx.sweep != NULL && ctx.sweep->count == TEST_SWEEP_MAX_STEPS);
+    CHECK(ctx.sweep->steps[0].transfers == 1);
+    CHECK(ctx.sweep->steps[0].bit_errors == 1);
+    CHECK(ctx.sweep->steps[1].bit_errors == 0);
+    CHECK(ctx.sweep->steps[ctx.sweep->count - 1].transfers == 1);
+    CHECK(ctx.sweep->steps[0].cycles == HOST_WIRE_US * (HAL_STUB_SYSCLK / 1000000U));
+}
+
+static void test_spi(void) {
+    TestContext ctx;
+
+    // Without a pattern, a PRBS burst goes both ways
+    HalStub_Reset();
+    CHECK(host_run(&ctx, &spi_test_driver, NULL, 2) == TEST_SUCCESS);
+    CHECK(ctx.iteration == 2);
+    CHECK(ctx.timing.bytes == 2 * 2 * SPI_BURST_SIZE);
+    check_timed_to_completion(&ctx);
+
+    HalStub_Reset();
+    hal_stub.corrupt = 1;
+    CHECK(host_run(&ctx, &spi_test_driver, "SPITEST", 2) == TEST_FAILURE);
+    CHECK(ctx.record.code == PROTOCOL_RECORD_FAILED);
+    CHECK(ctx.record.value == (1U << 16));
+
+    HalStub_Reset();
+    hal_stub.error = HAL_SPI_ERROR_OVR;
+    CHECK(host_run(&ctx, &spi_test_driver, "SPITEST", 2) == TEST_FAILURE);
+    CHECK(ctx.record.value == HAL_SPI_ERROR_OVR);
+
+    HalStub_Reset();
+    CHECK(host_abort(&ctx, &spi_test_driver, "SPITEST") >= 2);
+
+    // Sweep: an overrun is counted in its step, and the SPIs are realigned
+    HalStub_Reset();
+    hal_stub.error = HAL_SPI_ERROR_OVR;
+    CHECK(host_run(&ctx, spi_test_driver.sweep, NULL, 1) == TEST_SUCCESS);
+    CHECK(ctx.sweep != NULL && ctx.sweep->count == TEST_SWEEP_MAX_STEPS);
+    CHECK(ctx.sweep->steps[0].errors[0] == 1);
+    CHECK(ctx.sweep->steps[0].bytes == 0);
+    CHECK(ctx.sweep->steps[1].bytes == 2 * SPI_BURST_SIZE);
+    CHECK(ctx.sweep->steps[1].bit_errors == 0);
+
+    // The table is reported one step per pass; an abort in the middle of it ends the run at once
+    HalStub_Reset();
+    CHECK(TestRun_Begin(&ctx, spi_test_driver.sweep, NULL, 0, 1) == TEST_IN_PROGRESS);
+    while (ctx.stage == TEST_STAGE_RUN) {
+        TestRun_Poll(&ctx);
+        HalStub_Interrupts();
+    }
+    CHECK(TestRun_Poll(&ctx) == TEST_IN_PROGRESS);
+    TestRun_Abort(&ctx);
+    CHECK(ctx.status == TEST_FAILURE);
+    CHECK(TestRun_Poll(&ctx) == TEST_FAILURE);
+}
+
+static void test_i2c(void) {
+    TestContext ctx;
+    uint32_t scans;
+
+    HalStub_Reset();
+    I2C_ForgetDevices();
+    CHECK(host_run(&ctx, &i2c_test_driver, "I2CTEST", 3) == TEST_SUCCESS);
+    CHECK(ctx.iteration == 3);
+    CHECK(hal_stub.scans == 127);
+    check_timed_to_completion(&ctx);
+
+    // The device table is kept: no scan, until a rescan drops it
+    scans = hal_stub.scans;
+    CHECK(host_run(&ctx, &i2c_test_driver, "I2CTEST", 1) == TEST_SUCCESS);
+    CHECK(hal_stub.scans == scans);
+    i2c_test_driver.rescan();
+    CHECK(host_run(&ctx, &i2c_test_driver, "I2CTEST", 1) == TEST_SUCCESS);
+    CHECK(hal_stub.scans == scans + 127);
+
+    // A scan is spread over the setup passes; one cut short is started over by the next run
+    i2c_test_driver.rescan();
+    CHECK(TestRun_Begin(&ctx, &i2c_test_driver, (const uint8_t*)"I2CTEST", 7, 1) == TEST_IN_PROGRESS);
+    CHECK(ctx.stage == TEST_STAGE_SETUP);
+    CHECK(hal_stub.scans == scans + 127 + I2C_SCAN_BATCH);
+    TestRun_Abort(&ctx);
+    CHECK(ctx.status == TEST_FAILURE);
+    scans = hal_stub.scans;
+    CHECK(host_run(&ctx, &i2c_test_driver, "I2CTEST", 1) == TEST_SUCCESS);
+    CHECK(hal_stub.scans == scans + 127);
+
+    HalStub_Reset();
+    hal_stub.error = HAL_I2C_ERROR_AF;
+    CHECK(host_run(&ctx, &i2c_test_driver, "I2CTEST", 3) == TEST_FAILURE);
+    CHECK(ctx.record.code == PROTOCOL_RECORD_FAILED);
+    CHECK(ctx.record.value == HAL_I2C_ERROR_AF);
+
+    HalStub_Reset();
+    hal_stub.corrupt = 1;
+    CHECK(host_run(&ctx, &i2c_test_driver, "I2CTEST", 3) == TEST_FAILURE);
+    CHECK(ctx.record.value == 1);
+
+    HalStub_Reset();
+    CHECK(host_abort(&ctx, &i2c_test_driver, "I2CTEST") == 2);
+
+    // Sweep: a NACK is counted in its step
+    HalStub_Reset();
+    hal_stub.error = HAL_I2C_ERROR_AF;
+    CHECK(host_run(&ctx, i2c_test_driver.sweep, NULL, 2) == TEST_SUCCESS);
+    CHECK(ctx.sweep != NULL && ctx.sweep->count == 3);
+    CHECK(ctx.sweep->steps[0].errors[0] == 1);
+    CHECK(ctx.sweep->steps[0].transfers == 2);
+    CHECK(ctx.sweep->steps[2].bytes == 2 * I2C_SWEEP_BLOCK_SIZE);
+}
+
+int main(void) {
+    test_adc();
+    test_timer();
+    test_uart();
+    test_spi();
+    test_i2c();
+    if (failures) {
+        fprintf(stderr, "%lu checks failed\n", (unsigned long)failures);
+        return 1;
+    }
+    fputs("All driver tests passed\n", stdout);
+    return 0;
+}
@@ -0,0 +1,132 @@
+/**
+ * @file test_latency.c
+ * @brief Host test of the main-loop latency while a test runs.
+ *
+ * ARP requests and pings are served by lwIP from the main loop, so while a
+ * test runs they wait at most for the rest of the current pass. Every
+ * engine is run on the mocked board (HalStub.c) and every pass is timed,
+ * from TestRun_Begin() through the setup passes, the iterations and the
+ * finish passes to the end of the run; none may take 1 ms or more.
+ *
+ * @details The engines are non-blocking by the driver contract. The model
+ * charges what would still wait in place: the address probes of an I2C bus
+ * scan, and the debug UART if printf() waited for it. Each pass also sends
+ * the next debug character, as the main loop does, and the debug output
+ * of a run must go out whole, none of it dropped from the transmit ring.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#include "HalStub.h"
+#include "TestDriver.h"
+#include "DebugUart.h"
+
+/** @brief Longest main-loop pass allowed while a test runs, in microseconds. */
+#define HOST_MAX_PASS_US 1000
+
+/** @brief Simulated time a transfer takes on the wire, in microseconds. */
+#define HOST_WIRE_US 10
+
+/** @brief Main-loop passes after which a run is considered stuck. */
+#define HOST_MAX_PASSES 2000000
+
+/** @brief Number of failed runs. */
+static uint32_t failures = 0;
+
+/**
+ * @brief Run the main loop without a test until the debug output has gone out.
+ */
+static void host_drain(void) {
+    uint32_t passes = 0;
+
+    while (DebugUart_Pending() > 0 && passes++ < HOST_MAX_PASSES) {
+        DebugUart_Poll();
+        HalStub_Advance(HOST_WIRE_US);
+    }
+}
+
+/**
+ * @brief Run a test on the mocked board and time its main-loop passes.
+ *
+ * @param[in] driver Engine under test.
+ * @param[in] pattern Data pattern, or NULL.
+ * @param[in] iterations Number of iterations.
+ */
+static void host_latency(const TestDriver* driver, const char* pattern, uint32_t iterations) {
+    TestContext ctx;
+    uint64_t worst_us;
+    uint64_t start;
+    uint64_t pass;
+    uint32_t setup_passes = 1;
+    uint32_t finish_passes = 0;
+    uint32_t passes = 0;
+    uint32_t dropped = DebugUart_Dropped();
+    uint8_t status;
+
+    HalStub_Reset();
+    start = HalStub_Micros();
+    status = TestRun_Begin(&ctx, driver, (const uint8_t*)pattern, pattern ? (uint16_t)strlen(pattern) : 0,
+                           iterations);
+    DebugUart_Poll();
+    worst_us = HalStub_Micros() - start;
+    while (status == TEST_IN_PROGRESS && passes++ < HOST_MAX_PASSES) {
+        HalStub_Advance(HOST_WIRE_US);
+        HalStub_Interrupts();
+        setup_passes += (ctx.stage == TEST_STAGE_SETUP);
+        start = HalStub_Micros();
+        status = TestRun_Poll(&ctx);
+        DebugUart_Poll();
+        pass = HalStub_Micros() - start;
+        finish_passes += (ctx.stage == TEST_STAGE_FINISH || ctx.stage == TEST_STAGE_FAIL);
+        if (pass > worst_us) {
+            worst_us = pass;
+        }
+    }
+    host_drain();
+
+    fprintf(stdout, "%-5s %-5s %7lu iterations: longest pass %4lu us (%lu setup and %lu finish passes)\n",
+            driver->name, ctx.sweep ? "sweep" : "", (unsigned long)ctx.iterations, (unsigned long)worst_us,
+            (unsigned long)setup_passes, (unsigned long)finish_passes);
+    if (status != TEST_SUCCESS || worst_us >= HOST_MAX_PASS_US || DebugUart_Dropped() != dropped) {
+        fprintf(stderr, "%s: status %u, longest pass %lu us, %lu debug characters dropped\n", driver->name, status,
+                (unsigned long)worst_us, (unsigned long)(DebugUart_Dropped() - dropped));
+        failures++;
+    }
+}
+
+int main(void) {
+    uint64_t start;
+    uint32_t length;
+
+    // One ADC line used to block for about 4.8 ms; it is queued at once and sent at the line rate
+    HalStub_Reset();
+    start = HalStub_Micros();
+    length = printf("Iteration %lu: ADC Value = %lu (Expected: %lu +- %lu)\r\n", 1UL, 880UL, 880UL, 150UL);
+    if (HalStub_Micros() - start != 0) {
+        fprintf(stderr, "debug UART: printf took %lu us\n", (unsigned long)(HalStub_Micros() - start));
+        failures++;
+    }
+    host_drain();
+    if (hal_stub.debug_chars != length ||
+        HalStub_Micros() - start < ((uint64_t)length * HAL_STUB_DEBUG_CHAR_NS) / 1000) {
+        fprintf(stderr, "debug UART model: %lu of %lu characters in %lu us\n", (unsigned long)hal_stub.debug_chars,
+                (unsigned long)length, (unsigned long)(HalStub_Micros() - start));
+        failures++;
+    }
+
+    host_latency(&adc_test_driver, NULL, 1000);
+    host_latency(&timer_test_driver, NULL, 2);
+    host_latency(&uart_test_driver, "UARTTEST", 100);
+    host_latency(&spi_test_driver, NULL, 100);
+    host_latency(&i2c_test_driver, "I2CTEST", 100);
+    host_latency(uart_test_driver.sweep, NULL, 2);
+    host_latency(spi_test_driver.sweep, NULL, 2);
+    host_latency(i2c_test_driver.sweep, NULL, 2);
+    if (failures) {
+        fprintf(stderr, "%lu latency checks failed\n", (unsigned long)failures);
+        return 1;
+    }
+    fputs("All latency tests passed\n", stdout);
+    return 0;
+}
@@ -0,0 +1,284 @@
+/**
+ * @file test_telemetry.c
+ * @brief Host test of the compact telemetry stream of a soak run.
+ *
+ * The client's soak mode (client menu 17) runs 1,000,000 ADC and SPI
+ * iterations with a compact stream sampling every 1000th iteration. The
+ * records of such a run are fed to Telemetry.c, and every datagram it
+ * sends is decoded as the client does: each datagram must fit one
+ * Ethernet frame, every iteration must be accounted for exactly once, and
+ * the whole run must fit in a handful of datagrams, however long it takes.
+ *
+ * @author Haim
+ * @date Dec 3, 2024
+ */
+
+#include "HalStub.h"
+#include "Telemetry.h"
+#include "Codec.h"
+#include "ResponsePool.h"
+
+/** @brief Iterations of the soak run (CLIENT_SOAK_ITERATIONS). */
+#define HOST_SOAK_ITERATIONS 1000000
+
+/** @brief Sample interval of the soak run (CLIENT_SOAK_SAMPLE_INTERVAL). */
+#define HOST_SOAK_SAMPLE_INTERVAL 1000
+
+/** @brief Every this many SPI iterations fails, so that runs are broken. */
+#define HOST_SOAK_FAILURE_INTERVAL 99991
+
+/** @brief Most datagrams the soak run may take. */
+#define HOST_SOAK_MAX_DATAGRAMS 12
+
+/** @brief Simulated time of one pair of iterations, in microseconds. */
+#define HOST_SOAK_PASS_US 50
+
+/**
+ * @brief Iterations decoded from the stream, per peripheral bit.
+ */
+typedef struct {
+    uint32_t passed;     /**< Iterations that passed. */
+    uint32_t failed;     /**< Iterations that did not pass. */
+    uint32_t samples;    /**< SAMPLE entries. */
+    uint32_t next;       /**< Iteration expected next. */
+    uint32_t value;      /**< Value of the last sample. */
+    uint32_t cycles;     /**< Cycles of the last sample. */
+} HostLane;
+
+/** @brief Decoded stream. */
+static struct {
+    HostLane lanes[TEST_PERIPHERAL_COUNT];
+    uint32_t datagrams;   /**< Datagrams received. */
+    uint32_t bytes;       /**< UDP payload bytes received. */
+    uint16_t largest;     /**< Largest datagram. */
+    uint32_t sequence;    /**< Sequence number expected next. */
+    uint8_t malformed;    /**< Set if a datagram did not decode. */
+} host_stream;
+
+/** @brief Number of failed checks. */
+static uint32_t failures = 0;
+
+/** @brief State of the pseudo-random noise of the records. */
+static uint32_t host_noise = 1;
+
+/**
+ * @brief Check a condition and report it with its location if it does not hold.
+ *
+ * @param cond Condition that must hold.
+ */
+#define CHECK(cond)                                                                  \
+    do {                                                                             \
+        if (!(cond)) {                                                               \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                              \
+        }                                                                            \
+    } while (0)
+
+/**
+ * @brief Value and cycles of an iteration: ADC noise and cycle jitter.
+ *
+ * @param[in] bit Peripheral bit index.
+ * @param[in] iteration Index of the iteration.
+ * @param[out] record Record receiving the value and cycles.
+ */
+static void host_measure(uint8_t bit, uint32_t iteration, TestRecord* record) {
+    host_noise = host_noise * 1103515245U + 12345U;
+    if (bit == 4) {
+        record->value = 880 - 20 + (host_noise >> 16) % 41;
+        record->cycles = 1800 + (host_noise >> 8) % 200;
+    } else {
+        record->value = 0;
+        record->cycles = 36000 + (host_noise >> 8) % 400;
+    }
+    record->iteration = iteration;
+}
+
+/**
+ * @brief Read a varint of a compact entry.
+ *
+ * @param[in,out] buf Pointer to the varint, moved past it.
+ * @param[in] end End of the datagram.
+ * @param[out] value Decoded value.
+ * @return uint8_t 1 if the varint was complete, 0 otherwise.
+ */
+static uint8_t host_varint(const uint8_t** buf, const uint8_t* end, uint32_t* value) {
+    uint8_t shift = 0;
+
+    *value = 0;
+    while (*buf < end && shift < 35) {
+        *value |= (uint32_t)(**buf & 0x7F) << shift;
+        if ((*(*buf)++ & 0x80) == 0) {
+            return 1;
+        }
+        shift += 7;
+    }
+    return 0;
+}
+
+/**
+ * @brief Undo a zig-zag delta.
+ *
+ * @param[in] delta Zig-zag encoded delta.
+ * @param[in] previous Previous value.
+ * @return uint32_t The value.
+ */
+static uint32_t host_undelta(uint32_t delta, uint32_t previous) {
+    return previous + ((delta >> 1) ^ (uint32_t)-(int32_t)(delta & 1));
+}
+
+/**
+ * @brief Decode a compact TELEMETRY datagram into host_stream.
+ *
+ * @param[in] buf Datagram.
+ * @param[in] length Datagram length.
+ */
+static void host_decode(const uint8_t* buf, uint16_t length) {
+    const uint8_t* end = &buf[length];
+    HostLane* lane;
+    uint32_t first;
+    uint32_t second;
+    uint8_t tag;
+
+    if (length < PROTOCOL_HEADER_SIZE + PROTOCOL_TELEMETRY_COMPACT_HEADER_SIZE ||
+        buf[1] != (PROTOCOL_OPCODE_TELEMETRY | PROTOCOL_OPCODE_REPLY) || !(buf[2] & PROTOCOL_FLAG_COMPACT) ||
+        Codec_GetLe32(&buf[PROTOCOL_HEADER_SIZE + 4]) != host_stream.sequence++) {
+        host_stream.malformed = 1;
+        return;
+    }
+    buf += PROTOCOL_HEADER_SIZE + PROTOCOL_TELEMETRY_COMPACT_HEADER_SIZE;
+
+    // Every datagram starts the values of each peripheral afresh
+    for (tag = 0; tag < TEST_PERIPHERAL_COUNT; tag++) {
+        host_stream.lanes[tag].value = 0;
+        host_stream.lanes[tag].cycles = 0;
+    }
+    while (buf < end) {
+        tag = *buf++;
+        lane = &host_stream.lanes[tag & PROTOCOL_COMPACT_LANE_MASK];
+        if ((tag & PROTOCOL_COMPACT_LANE_MASK) >= TEST_PERIPHERAL_COUNT || !host_varint(&buf, end, &first)) {
+            host_stream.malformed = 1;
+            return;
+        }
+        switch (tag >> PROTOCOL_COMPACT_KIND_SHIFT) {
+            case PROTOCOL_COMPACT_START:
+                if (first != lane->next) {
+                    host_stream.malformed = 1;
+                }
+                break;
+            case PROTOCOL_COMPACT_RUN:
+                if (((tag >> PROTOCOL_COMPACT_CODE_SHIFT) & PROTOCOL_COMPACT_CODE_MASK) == PROTOCOL_RECORD_PASSED) {
+                    lane->passed += first;
+                } else {
+                    lane->failed += first;
+                }
+                lane->next += first;
+                break;
+            case PROTOCOL_COMPACT_SAMPLE:
+                if (!host_varint(&buf, end, &second)) {
+                    host_stream.malformed = 1;
+                    return;
+                }
+                if (((tag >> PROTOCOL_COMPACT_CODE_SHIFT) & PROTOCOL_COMPACT_CODE_MASK) == PROTOCOL_RECORD_PASSED) {
+                    lane->passed++;
+                } else {
+                    lane->failed++;
+                }
+                lane->value = host_undelta(first, lane->value);
+                lane->cycles = host_undelta(second, lane->cycles);
+                lane->samples++;
+                lane->next++;
+                break;
+            default:
+                host_stream.malformed = 1;
+                return;
+        }
+    }
+}
+
+// Send path of Telemetry.c: the datagrams are decoded instead of sent
+
+err_t send_response(struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* ipaddr, u16_t port) {
+    host_stream.datagrams++;
+    host_stream.bytes += p->tot_len;
+    if (p->tot_len > host_stream.largest) {
+        host_stream.largest = p->tot_len;
+    }
+    host_decode(p->payload, p->tot_len);
+    pbuf_free(p);
+    return ERR_OK;
+}
+
+struct pbuf* ResponsePool_Alloc(u16_t length) {
+    // Compact streams do not use the response pool
+    failures++;
+    return NULL;
+}
+
+int main(void) {
+    TelemetryCounters counters;
+    TestCommand command;
+    TestRecord record;
+    TestRecord sampled;
+    ip_addr_t addr;
+    uint32_t expected_samples;
+    uint32_t failed = 0;
+    uint32_t i;
+
+    HalStub_Reset();
+    memset(&sampled, 0, sizeof(sampled));
+    memset(&command, 0, sizeof(command));
+    command.test_id = 17;
+    command.sample_interval = HOST_SOAK_SAMPLE_INTERVAL;
+    ip_addr_set_zero(&addr);
+    Telemetry_Begin(&command, PROTOCOL_FLAG_STREAM | PROTOCOL_FLAG_COMPACT, NULL, &addr, 5000);
+
+    // The ADC and SPI lanes complete their iterations side by side, as in a parallel job
+    for (i = 0; i < HOST_SOAK_ITERATIONS; i++) {
+        host_measure(4, i, &record);
+        record.code = PROTOCOL_RECORD_PASSED;
+        Telemetry_Record(TEST_PERIPHERAL_ADC, &record);
+        if (i % HOST_SOAK_SAMPLE_INTERVAL == 0) {
+            sampled = record;
+        }
+
+        host_measure(2, i, &record);
+        record.code = PROTOCOL_RECORD_PASSED;
+        if (i % HOST_SOAK_FAILURE_INTERVAL == HOST_SOAK_FAILURE_INTERVAL - 1) {
+            record.code = PROTOCOL_RECORD_FAILED;
+            failed++;
+        }
+        Telemetry_Record(TEST_PERIPHERAL_SPI, &record);
+
+        HalStub_Advance(HOST_SOAK_PASS_US);
+        Telemetry_Poll();
+    }
+    Telemetry_End(&counters);
+
+    expected_samples = HOST_SOAK_ITERATIONS / HOST_SOAK_SAMPLE_INTERVAL;
+    fprintf(stdout, "Soak of %u ADC+SPI iterations over %lu s: %lu datagrams, %lu bytes (largest %u), "
+            "%.4f bytes per iteration\n",
+            HOST_SOAK_ITERATIONS, (unsigned long)(HalStub_Micros() / 1000000), (unsigned long)host_stream.datagrams,
+            (unsigned long)host_stream.bytes, host_stream.largest,
+            (double)host_stream.bytes / (2.0 * HOST_SOAK_ITERATIONS));
+
+    CHECK(!host_stream.malformed);
+    CHECK(counters.datagrams == host_stream.datagrams);
+    CHECK(counters.records == 2 * HOST_SOAK_ITERATIONS);
+    CHECK(counters.dropped == 0);
+    CHECK(host_stream.largest <= TELEMETRY_COMPACT_DATAGRAM_SIZE);
+    CHECK(host_stream.datagrams <= HOST_SOAK_MAX_DATAGRAMS);
+    CHECK(host_stream.lanes[4].passed == HOST_SOAK_ITERATIONS && host_stream.lanes[4].failed == 0);
+    CHECK(host_stream.lanes[4].samples == expected_samples);
+    CHECK(host_stream.lanes[2].passed == HOST_SOAK_ITERATIONS - failed && host_stream.lanes[2].failed == failed);
+    CHECK(host_stream.lanes[2].samples == expected_samples + failed);
+
+    // The deltas add up to the last sampled ADC record
+    CHECK(host_stream.lanes[4].value == sampled.value && host_stream.lanes[4].cycles == sampled.cycles);
+
+    if (failures) {
+        fprintf(stderr, "%lu telemetry checks failed\n", (unsigned long)failures);
+        return 1;
+    }
+    fputs("All telemetry tests passed\n", stdout);
+    return 0;
+}
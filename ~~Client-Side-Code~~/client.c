@@ -19,6 +19,207 @@
 
 #include "client.h"
 
+/**
+ * @brief Write a little-endian 16-bit field.
+ */
+static void put_le16(uint8_t* buf, uint16_t value) {
+    buf[0] = (uint8_t)value;
+    buf[1] = (uint8_t)(value >> 8);
+}
+
+/**
+ * @brief Write a little-endian 32-bit field.
+ */
+static void put_le32(uint8_t* buf, uint32_t value) {
+    put_le16(&buf[0], (uint16_t)value);
+    put_le16(&buf[2], (uint16_t)(value >> 16));
+}
+
+/**
+ * @brief Read a little-endian 16-bit field.
+ */
+static uint16_t get_le16(const uint8_t* buf) {
+    return (uint16_t)(buf[0] | (buf[1] << 8));
+}
+
+/**
+ * @brief Read a little-endian 32-bit field.
+ */
+static uint32_t get_le32(const uint8_t* buf) {
+    return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+/**
+ * @brief Read an unsigned LEB128 varint.
+ *
+ * @param[in,out] position Pointer to the first byte, advanced past the varint.
+ * @param[in] end Pointer past the last readable byte.
+ * @param[out] value Pointer to the decoded value.
+ * @return int Returns 1 on success, 0 if the varint is truncated or too long.
+ */
+static int get_varint(const uint8_t** position, const uint8_t* end, uint32_t* value) {
+    *value = 0;
+    for (int shift = 0; shift < 35 && *position < end; shift += 7) {
+        uint8_t byte = *(*position)++;
+
+        *value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Apply a zig-zag encoded delta to a value.
+ */
+static uint32_t apply_zigzag(uint32_t previous, uint32_t delta) {
+    return previous + ((delta >> 1) ^ (uint32_t)-(int32_t)(delta & 1));
+}
+
+/**
+ * @brief Get the monotonic wall-clock time in seconds.
+ *
+ * clock() measures the client's CPU time, which stays near zero while the
+ * client waits for the server.
+ */
+static double wall_time(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/** @brief First test ID handed out by this client run, 0 before the first test. */
+static uint32_t first_test_id = 0;
+
+/**
+ * @brief Get a test ID that was not used before by this client.
+ *
+ * The server caches replies by client endpoint and test ID, so IDs must not
+ * repeat; they start from the current time so a restarted client does not
+ * reuse the IDs of its previous run.
+ */
+static uint32_t next_test_id(void) {
+    static uint32_t test_id = 0;
+
+    if (test_id == 0) {
+        test_id = (uint32_t)time(NULL) << 8;
+        first_test_id = test_id + 1;
+    }
+    return ++test_id;
+}
+
+/**
+ * @brief Write a request header and return its size.
+ */
+static size_t encode_header(uint8_t* buf, uint8_t opcode, uint8_t flags) {
+    buf[0] = PROTOCOL_VERSION;
+    buf[1] = opcode;
+    buf[2] = flags;
+    buf[3] = 0; // Reserved
+    return PROTOCOL_HEADER_SIZE;
+}
+
+/**
+ * @brief Look up the reply of a test in the board's result history.
+ *
+ * Sends a HISTORY request for the single test ID and waits for one
+ * datagram. A datagram other than the HISTORY reply (such as a telemetry
+ * datagram or the awaited reply itself) is returned unchanged.
+ *
+ * @param[in] test_id Test ID of the lost reply.
+ * @return ssize_t Length of the recovered or received datagram, 0 if the
+ *         board has not kept the reply, -1 if nothing arrived in time.
+ */
+static ssize_t fetch_lost_reply(int sock, struct sockaddr_in* server_addr, uint32_t test_id,
+                                uint8_t* reply, size_t size) {
+    socklen_t server_len = sizeof(*server_addr);
+    uint8_t request[PROTOCOL_HEADER_SIZE + PROTOCOL_HISTORY_SIZE];
+    const uint8_t* entry = &reply[PROTOCOL_HEADER_SIZE + PROTOCOL_HISTORY_REPLY_SIZE];
+    uint16_t length;
+
+    encode_header(request, PROTOCOL_OPCODE_HISTORY, 0);
+    put_le32(&request[PROTOCOL_HEADER_SIZE], test_id);
+    put_le32(&request[PROTOCOL_HEADER_SIZE + 4], test_id);
+    sendto(sock, request, sizeof(request), 0, (struct sockaddr*)server_addr, sizeof(*server_addr));
+
+    ssize_t received = recvfrom(sock, reply, size, 0, (struct sockaddr*)server_addr, &server_len);
+    if (received < PROTOCOL_HEADER_SIZE || reply[1] != (PROTOCOL_OPCODE_HISTORY | PROTOCOL_OPCODE_REPLY)) {
+        return received;
+    }
+    if (received < PROTOCOL_HEADER_SIZE + PROTOCOL_HISTORY_REPLY_SIZE + PROTOCOL_HISTORY_ENTRY_SIZE ||
+        reply[PROTOCOL_HEADER_SIZE] == 0) {
+        return 0;
+    }
+    length = get_le16(entry);
+    if (entry + PROTOCOL_HISTORY_ENTRY_SIZE + length > reply + received) {
+        return 0;
+    }
+    printf("Recovered the reply of test %u from the board's result history.\n", test_id);
+    memmove(reply, entry + PROTOCOL_HISTORY_ENTRY_SIZE, length);
+    return length;
+}
+
+
+/**
+ * @brief Receive a reply, resending the request when none arrives in time.
+ *
+ * The server answers a resent request from its reply cache, or ignores it
+ * while the test is still running, so resending never runs a test twice.
+ * Before a TEST request is resent, its reply is looked up in the board's
+ * result history, which outlives the reply cache entry.
+ *
+ * @param[in] request Request to resend on timeout, or NULL to only wait.
+ * @return ssize_t Length of the received datagram, or -1 if the server never answered.
+ */
+static ssize_t receive_reply(int sock, struct sockaddr_in* server_addr, uint8_t* reply, size_t size,
+                             const uint8_t* request, size_t request_length) {
+    socklen_t server_len = sizeof(*server_addr);
+
+    for (int attempt = 1; attempt <= CLIENT_MAX_RETRIES; attempt++) {
+        ssize_t received = recvfrom(sock, reply, size, 0, (struct sockaddr*)server_addr, &server_len);
+        if (received >= 0) {
+            return received;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            break;
+        }
+        if (request && request[1] == PROTOCOL_OPCODE_TEST) {
+            received = fetch_lost_reply(sock, server_addr, get_le32(&request[PROTOCOL_HEADER_SIZE]), reply, size);
+            if (received > 0) {
+                return received;
+            }
+        }
+        if (request) {
+            printf("No reply in time, resending (attempt %d)...\n", attempt);
+            sendto(sock, request, request_length, 0, (struct sockaddr*)server_addr, sizeof(*server_addr));
+        }
+    }
+    printf("No reply from the server.\n");
+    return -1;
+}
+
+/**
+ * @brief Check that a reply answers the given opcode and carries at least body_size bytes.
+ *
+ * Error replies are reported on stdout.
+ *
+ * @return int Returns 1 if the reply is usable, 0 otherwise.
+ */
+static int check_reply(const uint8_t* reply, ssize_t received, uint8_t opcode, size_t body_size) {
+    if (received >= PROTOCOL_HEADER_SIZE + 2 && reply[1] == (PROTOCOL_OPCODE_ERROR | PROTOCOL_OPCODE_REPLY)) {
+        printf("Request rejected by the server (error %u).\n", reply[PROTOCOL_HEADER_SIZE]);
+        return 0;
+    }
+    if (received < (ssize_t)(PROTOCOL_HEADER_SIZE + body_size) || reply[0] != PROTOCOL_VERSION ||
+        reply[1] != (opcode | PROTOCOL_OPCODE_REPLY)) {
+        printf("Invalid reply from the server.\n");
+        return 0;
+    }
+    return 1;
+}
+
 // Display the menu for the user
 /**
  * @brief Display the test menu for user input.
@@ -33,11 +234,85 @@ void display_menu() {
     printf("3. Timer Test\n");
     printf("4. SPI Test\n");
     printf("5. I2C Test\n");
-    printf("6. Exit\n");
+    printf("6. All Peripherals (parallel)\n");
+    printf("7. All Tests (one batch datagram)\n");
+    printf("8. UART/SPI/I2C/ADC (streamed telemetry, 100 iterations)\n");
+    printf("9. Queue Statistics (per client)\n");
+    printf("10. ADC Health Check (urgent, preempts a running test)\n");
+    printf("11. Cancel a Test (by Test-ID)\n");
+    printf("12. Ping (RTT, network and service time)\n");
+    printf("13. UDP Throughput Benchmark (blast and echo)\n");
+    printf("14. Fleet Test (multicast to a subset of boards)\n");
+    printf("15. Test Capabilities (engines, parameters, estimated durations)\n");
+    printf("16. Nightly Suite (board-resident test plan, one round trip)\n");
+    printf("17. Soak Test (ADC/SPI, 1,000,000 iterations, compact telemetry)\n");
+    printf("18. Result History (recover this session's results from the board)\n");
+    printf("19. UART Baud-Rate Sweep (highest clean rate, bit-error rate)\n");
+    printf("20. SPI Prescaler Sweep (verified Mbit/s, fastest clean clock)\n");
+    printf("21. I2C Speed Sweep (Standard/Fast/Fast-mode Plus, transfers/s)\n");
+    printf("22. I2C Test (rescan the bus first)\n");
+    printf("23. Exit\n");
     printf("=========================\n");
     printf("Enter your choice: ");
 }
 
+// Encode the body of a test request
+/**
+ * @brief Encode the body of a test request.
+ *
+ * Writes the fixed fields in little-endian order, followed by a pattern
+ * TLV when the test carries a pattern.
+ *
+ * @param[out] buf Buffer receiving the encoded body.
+ * @param[in] command Pointer to the test parameters.
+ * @return size_t Number of bytes written.
+ */
+size_t encode_test_command(uint8_t* buf, const TestCommand* command) {
+    uint16_t tlv_length = 0;
+
+    if (command->pattern_length > 0) {
+        tlv_length = PROTOCOL_TLV_HEADER_SIZE + command->pattern_length;
+    }
+    if (command->sample_interval > 0) {
+        tlv_length += PROTOCOL_TLV_HEADER_SIZE + PROTOCOL_SAMPLE_SIZE;
+    }
+
+    put_le32(&buf[0], command->test_id);
+    put_le32(&buf[4], command->iterations);
+    buf[8] = command->peripheral;
+    buf[9] = command->priority | (command->sweep ? PROTOCOL_OPTION_SWEEP : 0) |
+             (command->rescan ? PROTOCOL_OPTION_RESCAN : 0); // Options
+    put_le16(&buf[10], tlv_length);
+
+    if (command->pattern_length > 0) {
+        buf[PROTOCOL_TEST_SIZE] = PROTOCOL_TLV_PATTERN;
+        put_le16(&buf[PROTOCOL_TEST_SIZE + 1], command->pattern_length);
+        memcpy(&buf[PROTOCOL_TEST_SIZE + PROTOCOL_TLV_HEADER_SIZE], command->bit_pattern, command->pattern_length);
+    }
+    if (command->sample_interval > 0) {
+        uint8_t* tlv = &buf[PROTOCOL_TEST_SIZE + tlv_length - PROTOCOL_TLV_HEADER_SIZE - PROTOCOL_SAMPLE_SIZE];
+
+        tlv[0] = PROTOCOL_TLV_SAMPLE;
+        put_le16(&tlv[1], PROTOCOL_SAMPLE_SIZE);
+        put_le32(&tlv[PROTOCOL_TLV_HEADER_SIZE], command->sample_interval);
+    }
+    return PROTOCOL_TEST_SIZE + tlv_length;
+}
+
+// Decode an encoded test result
+/**
+ * @brief Decode an encoded test result.
+ *
+ * @param[in] buf Pointer to the encoded result.
+ * @param[out] result Pointer to the result structure to fill.
+ */
+void decode_test_result(const uint8_t* buf, TestResult* result) {
+    result->test_id = get_le32(&buf[0]);
+    result->result = buf[4];
+    result->peripheral = buf[5];
+    memcpy(result->peripheral_results, &buf[6], TEST_PERIPHERAL_COUNT);
+}
+
 // Send the test command to the server
 /**
  * @brief Send a test command to the server and handle the response.
@@ -52,6 +327,14 @@ void display_menu() {
 void send_test_command(int sock, struct sockaddr_in* server_addr) {
     TestCommand command = {0};
     TestResult result = {0};
+    uint8_t request[PROTOCOL_MAX_DATAGRAM];
+    uint8_t reply[PROTOCOL_MAX_DATAGRAM];
+    uint8_t flags = 0;
+    uint32_t expected_sequence = 0;
+    CompactTelemetry compact = {0};
+    FILE* telemetry_file = NULL;
+    ssize_t received;
+    size_t length;
     char choice[10];
     double duration = 0.0;
 
@@ -59,20 +342,64 @@ void send_test_command(int sock, struct sockaddr_in* server_addr) {
     fgets(choice, sizeof(choice), stdin);
     int option = atoi(choice);
 
-    if (option == 6) {
+    if (option == 7) {
+        send_batch_command(sock, server_addr);
+        return;
+    }
+
+    if (option == 9) {
+        query_stats(sock, server_addr);
+        return;
+    }
+
+    if (option == 11) {
+        cancel_test(sock, server_addr);
+        return;
+    }
+
+    if (option == 12) {
+        ping_server(sock, server_addr);
+        return;
+    }
+
+    if (option == 13) {
+        bench_throughput(sock, server_addr);
+        return;
+    }
+
+    if (option == 14) {
+        fleet_test(sock);
+        return;
+    }
+
+    if (option == 15) {
+        query_capabilities(sock, server_addr);
+        return;
+    }
+
+    if (option == 16) {
+        run_plan(sock, server_addr);
+        return;
+    }
+
+    if (option == 18) {
+        query_history(sock, server_addr);
+        return;
+    }
+
+    if (option == 23) {
         printf("Exiting the program...\n");
         exit(0);
     }
 
     // Prepare the test command
-    command.test_id = rand() % 10000; // Random test ID for uniqueness
+    command.test_id = next_test_id(); // Unique per request, retries reuse it
     command.iterations = 5;          // Default 5 iterations
 
     switch (option) {
         case 1: // UART Test
             command.peripheral = TEST_PERIPHERAL_UART;
-            strcpy(command.bit_pattern, "HelloUART");
-            command.pattern_length = strlen(command.bit_pattern);
+            command.bit_pattern = "HelloUART";
             break;
         case 2: // ADC Test
             command.peripheral = TEST_PERIPHERAL_ADC;
@@ -82,42 +409,1055 @@ void send_test_command(int sock, struct sockaddr_in* server_addr) {
             break;
         case 4: // SPI Test
             command.peripheral = TEST_PERIPHERAL_SPI;
-            strcpy(command.bit_pattern, "SPI_TEST");
-            command.pattern_length = strlen(command.bit_pattern);
+            command.bit_pattern = "SPI_TEST";
             break;
         case 5: // I2C Test
             command.peripheral = TEST_PERIPHERAL_I2C;
-            strcpy(command.bit_pattern, "I2CTEST");
-            command.pattern_length = strlen(command.bit_pattern);
+            command.bit_pattern = "I2CTEST";
         break;
+        case 6: // All peripherals at once
+            command.peripheral = TEST_PERIPHERAL_ALL;
+            command.bit_pattern = "PARALLEL";
+            break;
+        case 8: // Data peripherals, streaming every iteration (the timer test takes seconds per iteration)
+            command.peripheral = TEST_PERIPHERAL_ALL & ~TEST_PERIPHERAL_TIMER;
+            command.bit_pattern = "STREAMED";
+            command.iterations = 100;
+            flags = PROTOCOL_FLAG_STREAM;
+            telemetry_file = fopen("test_telemetry.csv", "a");
+            break;
+        case 17: // Long soak run: pass/fail runs plus one sampled value per 1000 iterations
+            command.peripheral = TEST_PERIPHERAL_ADC | TEST_PERIPHERAL_SPI;
+            command.bit_pattern = "SOAKTEST";
+            command.iterations = CLIENT_SOAK_ITERATIONS;
+            command.sample_interval = CLIENT_SOAK_SAMPLE_INTERVAL;
+            flags = PROTOCOL_FLAG_STREAM | PROTOCOL_FLAG_COMPACT;
+            telemetry_file = fopen("test_soak.csv", "a");
+            break;
+        case 19: // UART qualification: the board sends its own PRBS data at each rate
+            command.peripheral = TEST_PERIPHERAL_UART;
+            command.iterations = 0; // The board's default transfers per rate
+            command.sweep = 1;
+            break;
+        case 20: // SPI qualification: PRBS bursts at every prescaler from /2 upward
+            command.peripheral = TEST_PERIPHERAL_SPI;
+            command.iterations = 0; // The board's default transfers per prescaler
+            command.sweep = 1;
+            break;
+        case 21: // I2C qualification: PRBS transfers at each bus speed
+            command.peripheral = TEST_PERIPHERAL_I2C;
+            command.iterations = 0; // The board's default transfers per speed
+            command.sweep = 1;
+            break;
+        case 22: // I2C test after the board has rediscovered the devices on its bus
+            command.peripheral = TEST_PERIPHERAL_I2C;
+            command.bit_pattern = "I2CTEST";
+            command.rescan = 1;
+            break;
+        case 10: // Quick ADC check that does not wait behind a long test
+            command.peripheral = TEST_PERIPHERAL_ADC;
+            command.iterations = 1;
+            command.priority = PROTOCOL_PRIORITY_URGENT;
+            break;
 
         default:
             printf("Invalid choice! Try again.\n");
             return;
     }
+    if (command.bit_pattern) {
+        command.pattern_length = strlen(command.bit_pattern);
+    }
+
+    // Encode the request: header followed by the test body
+    encode_header(request, PROTOCOL_OPCODE_TEST, flags);
+    length = PROTOCOL_HEADER_SIZE + encode_test_command(&request[PROTOCOL_HEADER_SIZE], &command);
+
+    // A compact stream is silent until a datagram fills
+    struct timeval timeout = {(flags & PROTOCOL_FLAG_COMPACT) ? CLIENT_COMPACT_REPLY_TIMEOUT : CLIENT_REPLY_TIMEOUT, 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
 
     // Send the command to the server
-    clock_t start_time = clock(); // Start timer
-    sendto(sock, &command, sizeof(TestCommand), 0, (struct sockaddr*)server_addr, sizeof(*server_addr));
+    double start_time = wall_time(); // Start timer
+    sendto(sock, request, length, 0, (struct sockaddr*)server_addr, sizeof(*server_addr));
+    printf("Test %u sent, waiting for the result...\n", command.test_id);
 
-    // Receive the result from the server
-    socklen_t server_len = sizeof(*server_addr);
-    recvfrom(sock, &result, sizeof(TestResult), 0, (struct sockaddr*)server_addr, &server_len);
+    // Receive the result from the server, saving telemetry datagrams that precede it
+    while (1) {
+        received = receive_reply(sock, server_addr, reply, sizeof(reply), request, length);
+        if (received < PROTOCOL_HEADER_SIZE || reply[1] != (PROTOCOL_OPCODE_TELEMETRY | PROTOCOL_OPCODE_REPLY)) {
+            break;
+        }
+        if (reply[2] & PROTOCOL_FLAG_COMPACT) {
+            decode_compact_telemetry(reply, received, &expected_sequence, &compact, telemetry_file);
+        } else {
+            save_telemetry(reply, received, &expected_sequence, telemetry_file);
+        }
+    }
+    timeout.tv_sec = CLIENT_REPLY_TIMEOUT;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (telemetry_file) {
+        fclose(telemetry_file);
+    }
+    if (compact.datagrams > 0) {
+        uint32_t iterations = 0;
+
+        for (int bit = 0; bit < TEST_PERIPHERAL_COUNT; bit++) {
+            iterations += compact.passed[bit] + compact.failed[bit];
+        }
+        printf("Compact telemetry: %u iterations (%u sampled) in %u datagram(s), %llu bytes, "
+               "%.3f bytes per iteration (%d as records).\n",
+               iterations, compact.samples, compact.datagrams, (unsigned long long)compact.bytes,
+               iterations ? (double)compact.bytes / iterations : 0.0, PROTOCOL_RECORD_SIZE);
+    }
 
     // Calculate duration
-    clock_t end_time = clock();
-    duration = (double)(end_time - start_time) / CLOCKS_PER_SEC;
+    duration = wall_time() - start_time;
+
+    if (!check_reply(reply, received, PROTOCOL_OPCODE_TEST, PROTOCOL_RESULT_SIZE)) {
+        return;
+    }
+    decode_test_result(&reply[PROTOCOL_HEADER_SIZE], &result);
 
     // Print and save the result
     if (result.result == 1) {
         printf("Test %d succeeded in %.2f seconds.\n", result.test_id, duration);
+    } else if (result.result == TEST_CANCELLED) {
+        printf("Test %d was cancelled after %.2f seconds.\n", result.test_id, duration);
     } else {
         printf("Test %d failed in %.2f seconds.\n", result.test_id, duration);
     }
+    print_peripheral_results(&result);
+    print_reply_tlvs(&reply[PROTOCOL_HEADER_SIZE + PROTOCOL_RESULT_SIZE],
+                     received - PROTOCOL_HEADER_SIZE - PROTOCOL_RESULT_SIZE, &result, expected_sequence);
 
     save_test_result(&result, duration);
 }
 
+// Save a telemetry datagram
+/**
+ * @brief Save the records of a telemetry datagram to the telemetry log.
+ *
+ * Each record becomes one CSV line of `test_telemetry.csv`:
+ * test_id, sequence, peripheral, code, iteration, value, cycles.
+ * Gaps in the sequence numbers are reported as lost datagrams.
+ *
+ * @param[in] datagram Pointer to the received TELEMETRY datagram.
+ * @param[in] length Length of the datagram.
+ * @param[in,out] expected_sequence Sequence number expected next.
+ * @param[in] file Telemetry log file (may be NULL).
+ */
+void save_telemetry(const uint8_t* datagram, ssize_t length, uint32_t* expected_sequence, FILE* file) {
+    const uint8_t* body = &datagram[PROTOCOL_HEADER_SIZE];
+
+    if (length < PROTOCOL_HEADER_SIZE + PROTOCOL_TELEMETRY_HEADER_SIZE) {
+        return;
+    }
+    uint32_t test_id = get_le32(&body[0]);
+    uint32_t sequence = get_le32(&body[4]);
+    uint8_t count = body[8];
+    if (length < PROTOCOL_HEADER_SIZE + PROTOCOL_TELEMETRY_HEADER_SIZE + count * PROTOCOL_RECORD_SIZE) {
+        printf("Truncated telemetry datagram %u.\n", sequence);
+        return;
+    }
+    if (sequence != *expected_sequence) {
+        printf("Lost %u telemetry datagram(s) before sequence %u.\n", sequence - *expected_sequence, sequence);
+    }
+    *expected_sequence = sequence + 1;
+
+    for (int i = 0; i < count && file; i++) {
+        const uint8_t* record = &body[PROTOCOL_TELEMETRY_HEADER_SIZE + i * PROTOCOL_RECORD_SIZE];
+
+        fprintf(file, "%u,%u,%u,%u,%u,%u,%u\n", test_id, sequence, record[0], record[1],
+                get_le32(&record[2]), get_le32(&record[6]), get_le32(&record[10]));
+    }
+}
+
+// Decode a compact telemetry datagram
+/**
+ * @brief Decode the entries of a compact telemetry datagram.
+ *
+ * Runs and samples are counted per peripheral. Each entry becomes one CSV
+ * line of `test_soak.csv`: test_id, sequence, peripheral, code,
+ * first iteration, iterations, value, cycles (value and cycles are empty
+ * for a run). Gaps in the sequence numbers are reported as lost datagrams.
+ *
+ * @param[in] datagram Pointer to the received TELEMETRY datagram.
+ * @param[in] length Length of the datagram.
+ * @param[in,out] expected_sequence Sequence number expected next.
+ * @param[in,out] stream Pointer to the decoder state and totals.
+ * @param[in] file Telemetry log file (may be NULL).
+ */
+void decode_compact_telemetry(const uint8_t* datagram, ssize_t length, uint32_t* expected_sequence,
+                              CompactTelemetry* stream, FILE* file) {
+    const uint8_t* body = &datagram[PROTOCOL_HEADER_SIZE];
+    const uint8_t* position = &body[PROTOCOL_TELEMETRY_COMPACT_HEADER_SIZE];
+    const uint8_t* end = &datagram[length];
+
+    if (length < PROTOCOL_HEADER_SIZE + PROTOCOL_TELEMETRY_COMPACT_HEADER_SIZE) {
+        return;
+    }
+    uint32_t test_id = get_le32(&body[0]);
+    uint32_t sequence = get_le32(&body[4]);
+    if (sequence != *expected_sequence) {
+        printf("Lost %u telemetry datagram(s) before sequence %u.\n", sequence - *expected_sequence, sequence);
+    }
+    *expected_sequence = sequence + 1;
+    stream->datagrams++;
+    stream->bytes += length;
+
+    while (position < end) {
+        uint8_t tag = *position++;
+        uint8_t kind = tag >> PROTOCOL_COMPACT_KIND_SHIFT;
+        uint8_t code = (tag >> PROTOCOL_COMPACT_CODE_SHIFT) & PROTOCOL_COMPACT_CODE_MASK;
+        uint8_t bit = tag & PROTOCOL_COMPACT_LANE_MASK;
+        uint32_t first;
+        uint32_t count = 1;
+        uint32_t delta;
+
+        if (bit >= TEST_PERIPHERAL_COUNT) {
+            position = NULL;
+            break;
+        }
+        first = stream->iteration[bit];
+        if (kind == PROTOCOL_COMPACT_START) {
+            // Every datagram restarts the deltas of the peripheral
+            if (!get_varint(&position, end, &stream->iteration[bit])) {
+                position = NULL;
+                break;
+            }
+            stream->value[bit] = 0;
+            stream->cycles[bit] = 0;
+            continue;
+        } else if (kind == PROTOCOL_COMPACT_RUN) {
+            if (!get_varint(&position, end, &count)) {
+                position = NULL;
+                break;
+            }
+            if (file) {
+                fprintf(file, "%u,%u,%u,%u,%u,%u,,\n", test_id, sequence, 1U << bit, code, first, count);
+            }
+        } else if (kind == PROTOCOL_COMPACT_SAMPLE) {
+            if (!get_varint(&position, end, &delta)) {
+                position = NULL;
+                break;
+            }
+            stream->value[bit] = apply_zigzag(stream->value[bit], delta);
+            if (!get_varint(&position, end, &delta)) {
+                position = NULL;
+                break;
+            }
+            stream->cycles[bit] = apply_zigzag(stream->cycles[bit], delta);
+            stream->samples++;
+            if (file) {
+                fprintf(file, "%u,%u,%u,%u,%u,1,%u,%u\n", test_id, sequence, 1U << bit, code, first,
+                        stream->value[bit], stream->cycles[bit]);
+            }
+        } else {
+            position = NULL;
+            break;
+        }
+
+        stream->iteration[bit] = first + count;
+        if (code == 0) {
+            stream->passed[bit] += count;
+        } else {
+            stream->failed[bit] += count;
+        }
+    }
+    if (position != end) {
+        // Entries already decoded are kept, the rest of the datagram is lost
+        printf("Malformed compact telemetry datagram %u.\n", sequence);
+    }
+}
+
+// Print the TLVs of a test reply
+/**
+ * @brief Print the TLVs following a test result.
+ *
+ * Handles the cycle-counter TIMING TLV of every reply and the SUMMARY TLV
+ * of a streamed test; other TLVs are skipped.
+ *
+ * @param[in] tlvs Pointer to the TLVs following the result.
+ * @param[in] length Length of the TLV area.
+ * @param[in] result Pointer to the decoded result (for its peripheral mask).
+ * @param[in] received_datagrams Number of telemetry datagrams received.
+ */
+void print_reply_tlvs(const uint8_t* tlvs, ssize_t length, const TestResult* result, uint32_t received_datagrams) {
+    static const char* names[TEST_PERIPHERAL_COUNT] = {"Timer", "UART", "SPI", "I2C", "ADC"};
+
+    while (length >= PROTOCOL_TLV_HEADER_SIZE) {
+        uint16_t tlv_length = tlvs[1] | (tlvs[2] << 8);
+        const uint8_t* value = &tlvs[PROTOCOL_TLV_HEADER_SIZE];
+
+        if (PROTOCOL_TLV_HEADER_SIZE + tlv_length > length) {
+            break;
+        }
+        if (tlvs[0] == PROTOCOL_TLV_SUMMARY && tlv_length >= PROTOCOL_SUMMARY_SIZE) {
+            printf("  Telemetry: %u datagrams sent (%u received), %u records, %u dropped\n",
+                   get_le32(&value[0]), received_datagrams, get_le32(&value[4]), get_le32(&value[8]));
+            value += PROTOCOL_SUMMARY_SIZE;
+            for (int bit = 0; bit < TEST_PERIPHERAL_COUNT; bit++) {
+                if (!(result->peripheral & (1 << bit)) ||
+                    value + PROTOCOL_SUMMARY_PERIPHERAL_SIZE > &tlvs[PROTOCOL_TLV_HEADER_SIZE + tlv_length]) {
+                    continue;
+                }
+                printf("  %-6s: %u passed, %u errors\n", names[bit], get_le32(&value[0]), get_le32(&value[4]));
+                value += PROTOCOL_SUMMARY_PERIPHERAL_SIZE;
+            }
+        }
+        if (tlvs[0] == PROTOCOL_TLV_TIMING && tlv_length >= PROTOCOL_TIMING_SIZE) {
+            double clock_hz = get_le32(&value[0]);
+
+            value += PROTOCOL_TIMING_SIZE;
+            for (int bit = 0; bit < TEST_PERIPHERAL_COUNT; bit++) {
+                if (!(result->peripheral & (1 << bit)) ||
+                    value + PROTOCOL_TIMING_PERIPHERAL_SIZE > &tlvs[PROTOCOL_TLV_HEADER_SIZE + tlv_length]) {
+                    continue;
+                }
+                uint64_t total = get_le32(&value[16]) | ((uint64_t)get_le32(&value[20]) << 32);
+                printf("  %-6s: %u iterations, cycles min %u / max %u / mean %u (%.1f us), total %.3f ms, "
+                       "%u bytes, %u B/s\n",
+                       names[bit], get_le32(&value[0]), get_le32(&value[4]), get_le32(&value[8]),
+                       get_le32(&value[12]), get_le32(&value[12]) * 1e6 / clock_hz, total * 1e3 / clock_hz,
+                       get_le32(&value[24]), get_le32(&value[28]));
+                value += PROTOCOL_TIMING_PERIPHERAL_SIZE;
+            }
+        }
+        if (tlvs[0] == PROTOCOL_TLV_SCHEDULE && tlv_length >= PROTOCOL_SCHEDULE_SIZE) {
+            printf("  Schedule: queued %u ms, wall time %u ms, preempted %u ms\n",
+                   get_le32(&value[0]), get_le32(&value[4]), get_le32(&value[8]));
+        }
+        if (tlvs[0] == PROTOCOL_TLV_SWEEP) {
+            print_sweep(value, tlv_length);
+        }
+        tlvs += PROTOCOL_TLV_HEADER_SIZE + tlv_length;
+        length -= PROTOCOL_TLV_HEADER_SIZE + tlv_length;
+    }
+}
+
+/**
+ * @brief Print the step tables of a sweep TLV.
+ *
+ * For each swept peripheral, every step is listed with its throughput
+ * (bytes/s, verified Mbit/s and transfers/s), error counters and
+ * bit-error rate, followed by the highest rate at which every transfer
+ * arrived without any error.
+ *
+ * @param[in] value Pointer to the TLV value.
+ * @param[in] length Length of the TLV value.
+ */
+void print_sweep(const uint8_t* value, uint16_t length) {
+    static const char* names[TEST_PERIPHERAL_COUNT] = {"Timer", "UART", "SPI", "I2C", "ADC"};
+    static const char* errors[TEST_PERIPHERAL_COUNT][PROTOCOL_SWEEP_ERROR_COUNT] = {
+        [1] = {"FE", "NE", "ORE"},
+        [2] = {"OVR", "DMA", "Other"},
+        [3] = {"NACK", "ARLO", "Bus"},
+    };
+    const uint8_t* end = &value[length];
+
+    while (value + PROTOCOL_SWEEP_SIZE <= end) {
+        uint8_t type = value[0] % TEST_PERIPHERAL_COUNT;
+        uint8_t count = value[1];
+        uint32_t clean = 0;
+
+        value += PROTOCOL_SWEEP_SIZE;
+        if (value + count * PROTOCOL_SWEEP_STEP_SIZE > end) {
+            printf("  Truncated sweep table.\n");
+            return;
+        }
+        printf("  %s sweep:\n  %10s %4s %9s %10s %12s %8s %9s %6s %6s %6s %10s\n", names[type], "Rate", "Mode",
+               "Transfers", "Bytes", "Bytes/s", "Mbit/s", "Xfers/s", errors[type][0] ? errors[type][0] : "Err0",
+               errors[type][1] ? errors[type][1] : "Err1", errors[type][2] ? errors[type][2] : "Err2", "BER");
+        for (int i = 0; i < count; i++, value += PROTOCOL_SWEEP_STEP_SIZE) {
+            uint32_t rate = get_le32(&value[0]);
+            uint32_t transfers = get_le32(&value[5]);
+            uint32_t bytes = get_le32(&value[9]);
+            uint32_t bit_errors = get_le32(&value[13]);
+            uint16_t counters[PROTOCOL_SWEEP_ERROR_COUNT];
+            int failed = (transfers == 0 || bit_errors != 0);
+
+            for (int j = 0; j < PROTOCOL_SWEEP_ERROR_COUNT; j++) {
+                counters[j] = get_le16(&value[21 + 2 * j]);
+                failed |= (counters[j] != 0);
+            }
+            printf("  %10u %4u %9u %10u %12u %8.2f %9.1f %6u %6u %6u %10.3g\n", rate, value[4], transfers, bytes,
+                   get_le32(&value[17]), get_le32(&value[17]) * 8.0 / 1e6,
+                   bytes ? (double)get_le32(&value[17]) * transfers / bytes : 0.0, counters[0], counters[1], counters[2],
+                   bytes ? (double)bit_errors / (8.0 * bytes) : 0.0);
+            if (!failed && rate > clean) {
+                clean = rate;
+            }
+        }
+        if (clean > 0) {
+            printf("  Highest clean %s rate: %u bit/s\n", names[type], clean);
+        } else {
+            printf("  No clean %s rate.\n", names[type]);
+        }
+    }
+}
+
+// Send all tests in one batch datagram
+/**
+ * @brief Send every single-peripheral test in one batch datagram.
+ *
+ * The test requests are packed back to back after a count byte and the
+ * server answers with a single datagram holding one result per request,
+ * so the whole set costs one network round trip.
+ *
+ * @param[in] sock The UDP socket descriptor.
+ * @param[in] server_addr Pointer to the server's address structure.
+ */
+void send_batch_command(int sock, struct sockaddr_in* server_addr) {
+    static const uint8_t peripherals[] = {TEST_PERIPHERAL_UART, TEST_PERIPHERAL_ADC, TEST_PERIPHERAL_TIMER,
+                                          TEST_PERIPHERAL_SPI, TEST_PERIPHERAL_I2C};
+    static const char* patterns[] = {"HelloUART", NULL, NULL, "SPI_TEST", "I2CTEST"};
+    uint8_t request[PROTOCOL_MAX_DATAGRAM];
+    uint8_t reply[PROTOCOL_MAX_DATAGRAM];
+    uint8_t count = sizeof(peripherals);
+    size_t length;
+
+    // Encode the batch: header, count and one test body per peripheral
+    length = encode_header(request, PROTOCOL_OPCODE_BATCH, 0);
+    request[length++] = count;
+    for (int i = 0; i < count; i++) {
+        TestCommand command = {0};
+
+        command.test_id = next_test_id();
+        command.iterations = 5; // Default 5 iterations
+        command.peripheral = peripherals[i];
+        command.bit_pattern = patterns[i];
+        command.pattern_length = patterns[i] ? strlen(patterns[i]) : 0;
+        length += encode_test_command(&request[length], &command);
+    }
+
+    // Send the batch and wait for the single reply
+    double start_time = wall_time();
+    sendto(sock, request, length, 0, (struct sockaddr*)server_addr, sizeof(*server_addr));
+
+    // Batches are not cached by the server, so they are never resent
+    ssize_t received = receive_reply(sock, server_addr, reply, sizeof(reply), NULL, 0);
+    double duration = wall_time() - start_time;
+
+    if (!check_reply(reply, received, PROTOCOL_OPCODE_BATCH, 1)) {
+        return;
+    }
+    count = reply[PROTOCOL_HEADER_SIZE];
+    if (received < PROTOCOL_HEADER_SIZE + 1 + count * PROTOCOL_RESULT_SIZE) {
+        printf("Truncated batch reply.\n");
+        return;
+    }
+
+    // Decode one result per request
+    printf("Batch of %u tests finished in %.2f seconds.\n", count, duration);
+    for (int i = 0; i < count; i++) {
+        TestResult result = {0};
+
+        decode_test_result(&reply[PROTOCOL_HEADER_SIZE + 1 + i * PROTOCOL_RESULT_SIZE], &result);
+        printf("Test %d %s.\n", result.test_id, (result.result == 1) ? "succeeded" : "failed");
+        print_peripheral_results(&result);
+        save_test_result(&result, duration);
+    }
+}
+
+/**
+ * @brief Print the queue depth and wait times of every client of the board.
+ *
+ * @param[in] sock The UDP socket descriptor.
+ * @param[in] server_addr Pointer to the server's address structure.
+ */
+void query_stats(int sock, struct sockaddr_in* server_addr) {
+    uint8_t request[PROTOCOL_HEADER_SIZE];
+    uint8_t reply[PROTOCOL_MAX_DATAGRAM];
+    size_t length = encode_header(request, PROTOCOL_OPCODE_STATS, 0);
+
+    // A stats request has no side effect, so it is simply resent on timeout
+    sendto(sock, request, length, 0, (struct sockaddr*)server_addr, sizeof(*server_addr));
+    ssize_t received = receive_reply(sock, server_addr, reply, sizeof(reply), request, length);
+    if (!check_reply(reply, received, PROTOCOL_OPCODE_STATS, 2)) {
+        return;
+    }
+    uint8_t count = reply[PROTOCOL_HEADER_SIZE + 1];
+    if (received < PROTOCOL_HEADER_SIZE + 2 + count * PROTOCOL_SESSION_STATS_SIZE) {
+        printf("Truncated stats reply.\n");
+        return;
+    }
+
+    printf("Queue depth: %u job(s), %u client(s)\n", reply[PROTOCOL_HEADER_SIZE], count);
+    printf("%-21s %5s %4s %8s %8s %10s %10s %10s\n",
+           "Client", "Jobs", "Run", "Started", "Rejected", "Mean wait", "Max wait", "Oldest");
+    for (int i = 0; i < count; i++) {
+        const uint8_t* entry = &reply[PROTOCOL_HEADER_SIZE + 2 + i * PROTOCOL_SESSION_STATS_SIZE];
+        char client[32];
+
+        snprintf(client, sizeof(client), "%u.%u.%u.%u:%u",
+                 entry[0], entry[1], entry[2], entry[3], get_le16(&entry[4]));
+        printf("%-21s %5u %4s %8u %8u %8u ms %8u ms %8u ms\n", client, entry[6], entry[7] ? "yes" : "no",
+               get_le32(&entry[8]), get_le32(&entry[12]), get_le32(&entry[16]),
+               get_le32(&entry[20]), get_le32(&entry[24]));
+    }
+}
+
+/**
+ * @brief Print the table of test engines of the board.
+ *
+ * Each engine is listed with its parameters, default iterations and the
+ * estimated duration of one iteration, so schedules can be planned before
+ * tests are sent.
+ *
+ * @param[in] sock The UDP socket descriptor.
+ * @param[in] server_addr Pointer to the server's address structure.
+ */
+void query_capabilities(int sock, struct sockaddr_in* server_addr) {
+    uint8_t request[PROTOCOL_HEADER_SIZE];
+    uint8_t reply[PROTOCOL_MAX_DATAGRAM];
+    size_t length = encode_header(request, PROTOCOL_OPCODE_CAPS, 0);
+
+    // A capability query has no side effect, so it is simply resent on timeout
+    sendto(sock, request, length, 0, (struct sockaddr*)server_addr, sizeof(*server_addr));
+    ssize_t received = receive_reply(sock, server_addr, reply, sizeof(reply), request, length);
+    if (!check_reply(reply, received, PROTOCOL_OPCODE_CAPS, 1)) {
+        return;
+    }
+    uint8_t count = reply[PROTOCOL_HEADER_SIZE];
+    if (received < PROTOCOL_HEADER_SIZE + 1 + count * PROTOCOL_CAPS_ENTRY_SIZE) {
+        printf("Truncated capability reply.\n");
+        return;
+    }
+
+    printf("%-4s %-8s %-10s %-9s %-5s %11s %10s %14s\n",
+           "Type", "Name", "Peripheral", "Pattern", "Sweep", "Max pattern", "Iterations", "Est. per iter");
+    for (int i = 0; i < count; i++) {
+        const uint8_t* entry = &reply[PROTOCOL_HEADER_SIZE + 1 + i * PROTOCOL_CAPS_ENTRY_SIZE];
+        char name[PROTOCOL_CAPS_NAME_SIZE + 1] = {0};
+        uint32_t estimated_us = get_le32(&entry[9]);
+
+        memcpy(name, &entry[13], PROTOCOL_CAPS_NAME_SIZE);
+        printf("%-4u %-8s 0x%02X       %-9s %-5s %11u %10u %11.3f ms\n", entry[0], name, entry[1],
+               (entry[2] & PROTOCOL_PARAM_PATTERN_REQUIRED) ? "required" :
+               (entry[2] & PROTOCOL_PARAM_PATTERN) ? "optional" : "none",
+               (entry[2] & PROTOCOL_PARAM_SWEEP) ? "yes" : "no",
+               get_le16(&entry[3]), get_le32(&entry[5]), estimated_us / 1000.0);
+    }
+}
+
+/**
+ * @brief Upload the nightly suite as a board-resident plan and run it.
+ *
+ * The plan is uploaded once; running it costs one request, after which the
+ * board reports every run of every step and ends with a done report. A
+ * lost PLAN_RUN is resent: the board ignores it while the plan runs and
+ * answers it with the cached done report afterwards.
+ *
+ * @param[in] sock The UDP socket descriptor.
+ * @param[in] server_addr Pointer to the server's address structure.
+ */
+void run_plan(int sock, struct sockaddr_in* server_addr) {
+    static const PlanStep suite[] = {
+        {TEST_PERIPHERAL_UART, PROTOCOL_PLAN_STOP_ON_FAIL, 2, 5, 10, "HelloUART"},
+        {TEST_PERIPHERAL_SPI,  0,                          2, 5, 10, "SPI_TEST"},
+        {TEST_PERIPHERAL_I2C,  0,                          2, 5, 10, "I2CTEST"},
+        {TEST_PERIPHERAL_ADC,  0,                          3, 5, 0,  NULL},
+        {TEST_PERIPHERAL_ALL & ~TEST_PERIPHERAL_TIMER, 0,  1, 5, 0,  "PARALLEL"},
+    };
+    static const char* statuses[] = {"completed", "stopped by a failing step", "cancelled"};
+    uint8_t request[PROTOCOL_MAX_DATAGRAM];
+    uint8_t reply[PROTOCOL_MAX_DATAGRAM];
+    TestResult result;
+    size_t length;
+    ssize_t received;
+    uint8_t steps = sizeof(suite) / sizeof(suite[0]);
+
+    // Upload the plan: header | plan ID | step count | steps
+    length = encode_header(request, PROTOCOL_OPCODE_PLAN_UPLOAD, 0);
+    request[length++] = CLIENT_PLAN_ID;
+    request[length++] = steps;
+    for (uint8_t i = 0; i < steps; i++) {
+        uint16_t pattern_length = suite[i].pattern ? strlen(suite[i].pattern) : 0;
+
+        request[length] = suite[i].peripheral;
+        request[length + 1] = suite[i].flags;
+        put_le16(&request[length + 2], suite[i].repeat);
+        put_le32(&request[length + 4], suite[i].iterations);
+        put_le16(&request[length + 8], suite[i].delay_ms);
+        put_le16(&request[length + 10], pattern_length);
+        if (pattern_length > 0) {
+            memcpy(&request[length + PROTOCOL_PLAN_STEP_SIZE], suite[i].pattern, pattern_length);
+        }
+        length += PROTOCOL_PLAN_STEP_SIZE + pattern_length;
+    }
+    sendto(sock, request, length, 0, (struct sockaddr*)server_addr, sizeof(*server_addr));
+    received = receive_reply(sock, server_addr, reply, sizeof(reply), request, length);
+    if (!check_reply(reply, received, PROTOCOL_OPCODE_PLAN_UPLOAD, PROTOCOL_PLAN_UPLOAD_REPLY_SIZE)) {
+        return;
+    }
+    printf("Plan %u stored: %u steps, %u bytes, %u iterations.\n", reply[PROTOCOL_HEADER_SIZE],
+           reply[PROTOCOL_HEADER_SIZE + 1], get_le16(&reply[PROTOCOL_HEADER_SIZE + 2]),
+           get_le32(&reply[PROTOCOL_HEADER_SIZE + 4]));
+
+    // Run it: one request, then one report per step run
+    uint32_t run_id = next_test_id();
+    length = encode_header(request, PROTOCOL_OPCODE_PLAN_RUN, 0);
+    put_le32(&request[length], run_id);
+    request[length + 4] = CLIENT_PLAN_ID;
+    length += PROTOCOL_PLAN_RUN_SIZE;
+
+    double start_time = wall_time();
+    sendto(sock, request, length, 0, (struct sockaddr*)server_addr, sizeof(*server_addr));
+    while (1) {
+        received = receive_reply(sock, server_addr, reply, sizeof(reply), request, length);
+        if (!check_reply(reply, received, PROTOCOL_OPCODE_PLAN_RUN, PROTOCOL_PLAN_STEP_REPORT_SIZE)) {
+            return;
+        }
+        const uint8_t* body = &reply[PROTOCOL_HEADER_SIZE];
+        if (get_le32(body) != run_id) {
+            continue;
+        }
+        if (body[4] == PROTOCOL_PLAN_REPORT_DONE) {
+            if (received < PROTOCOL_HEADER_SIZE + PROTOCOL_PLAN_DONE_SIZE) {
+                printf("Truncated plan report.\n");
+                return;
+            }
+            printf("Plan run %u %s: %u runs, %u passed, %u failed, %.2f s on the board (%.2f s here).\n",
+                   run_id, (body[5] <= PROTOCOL_PLAN_CANCELLED) ? statuses[body[5]] : "ended",
+                   get_le16(&body[6]), get_le16(&body[8]), get_le16(&body[10]),
+                   get_le32(&body[12]) / 1000.0, wall_time() - start_time);
+            return;
+        }
+        if (received < PROTOCOL_HEADER_SIZE + PROTOCOL_PLAN_STEP_REPORT_SIZE + PROTOCOL_RESULT_SIZE) {
+            printf("Truncated plan report.\n");
+            return;
+        }
+        decode_test_result(&body[PROTOCOL_PLAN_STEP_REPORT_SIZE], &result);
+        printf("Step %u run %u: %s\n", body[5] + 1, get_le16(&body[6]) + 1,
+               (result.result == 1) ? "Success" : "Failure");
+        print_peripheral_results(&result);
+    }
+}
+
+/**
+ * @brief List the results of this client run kept in the board's history.
+ *
+ * Fetches every kept reply from the first test ID of this run onwards,
+ * asking again from the last returned ID while the board reports more.
+ *
+ * @param[in] sock The UDP socket descriptor.
+ * @param[in] server_addr Pointer to the server's address structure.
+ */
+void query_history(int sock, struct sockaddr_in* server_addr) {
+    uint8_t request[PROTOCOL_HEADER_SIZE + PROTOCOL_HISTORY_SIZE];
+    uint8_t reply[PROTOCOL_MAX_DATAGRAM];
+    uint32_t first = first_test_id;
+    uint32_t last = UINT32_MAX;
+    int listed = 0;
+    int more = 1;
+
+    if (first == 0) {
+        printf("No test was run yet.\n");
+        return;
+    }
+    while (more) {
+        encode_header(request, PROTOCOL_OPCODE_HISTORY, 0);
+        put_le32(&request[PROTOCOL_HEADER_SIZE], first);
+        put_le32(&request[PROTOCOL_HEADER_SIZE + 4], last);
+        sendto(sock, request, sizeof(request), 0, (struct sockaddr*)server_addr, sizeof(*server_addr));
+
+        ssize_t received = receive_reply(sock, server_addr, reply, sizeof(reply), request, sizeof(request));
+        if (!check_reply(reply, received, PROTOCOL_OPCODE_HISTORY, PROTOCOL_HISTORY_REPLY_SIZE)) {
+            return;
+        }
+        const uint8_t* entry = &reply[PROTOCOL_HEADER_SIZE + PROTOCOL_HISTORY_REPLY_SIZE];
+        const uint8_t* end = &reply[received];
+        uint8_t count = reply[PROTOCOL_HEADER_SIZE];
+        more = reply[PROTOCOL_HEADER_SIZE + 1];
+
+        for (int i = 0; i < count; i++) {
+            if (entry + PROTOCOL_HISTORY_ENTRY_SIZE > end) {
+                break;
+            }
+            uint16_t length = get_le16(entry);
+            const uint8_t* stored = entry + PROTOCOL_HISTORY_ENTRY_SIZE;
+
+            if (stored + length > end || length < PROTOCOL_HEADER_SIZE + 5) {
+                break;
+            }
+            uint32_t test_id = get_le32(&stored[PROTOCOL_HEADER_SIZE]);
+            if (stored[1] == (PROTOCOL_OPCODE_PLAN_RUN | PROTOCOL_OPCODE_REPLY)) {
+                printf("Plan run %u: status %u\n", test_id, stored[PROTOCOL_HEADER_SIZE + 5]);
+            } else {
+                uint8_t result = stored[PROTOCOL_HEADER_SIZE + 4];
+
+                printf("Test %u: %s\n", test_id, result == 1 ? "Success" :
+                       result == TEST_CANCELLED ? "Cancelled" : "Failure");
+            }
+            listed++;
+            first = test_id + 1;
+            entry = stored + length;
+        }
+        if (count == 0) {
+            more = 0;
+        }
+    }
+    printf("%d result(s) kept on the board since test %u.\n", listed, first_test_id);
+}
+
+/**
+ * @brief Ask the server to cancel a queued or running test.
+ *
+ * The test must have been sent from this host; its own client receives
+ * the partial result. The server answers with the number of iterations the
+ * test completed.
+ *
+ * @param[in] sock The UDP socket descriptor.
+ * @param[in] server_addr Pointer to the server's address structure.
+ */
+void cancel_test(int sock, struct sockaddr_in* server_addr) {
+    static const char* statuses[] = {"not found", "removed from the queue", "stopped"};
+    uint8_t request[PROTOCOL_HEADER_SIZE + 4];
+    uint8_t reply[PROTOCOL_MAX_DATAGRAM];
+    char line[32];
+    size_t length;
+
+    printf("Test-ID to cancel: ");
+    if (!fgets(line, sizeof(line), stdin)) {
+        return;
+    }
+    length = encode_header(request, PROTOCOL_OPCODE_CANCEL, 0);
+    put_le32(&request[length], (uint32_t)strtoul(line, NULL, 10));
+    length += 4;
+
+    // Cancelling twice is harmless, so the request is resent on timeout
+    sendto(sock, request, length, 0, (struct sockaddr*)server_addr, sizeof(*server_addr));
+    ssize_t received = receive_reply(sock, server_addr, reply, sizeof(reply), request, length);
+    if (!check_reply(reply, received, PROTOCOL_OPCODE_CANCEL, PROTOCOL_CANCEL_REPLY_SIZE)) {
+        return;
+    }
+    uint8_t status = reply[PROTOCOL_HEADER_SIZE + 4];
+    printf("Test %u %s, %u iterations completed.\n", get_le32(&reply[PROTOCOL_HEADER_SIZE]),
+           (status <= PROTOCOL_CANCEL_STOPPED) ? statuses[status] : "in an unknown state",
+           get_le32(&reply[PROTOCOL_HEADER_SIZE + 5]));
+}
+
+/**
+ * @brief Measure the round-trip time to the server and split it into
+ *        network time and firmware service time.
+ *
+ * Every probe carries its sequence number; the server stamps the reply
+ * with its cycle counter at reception and transmission, so the service
+ * time is measured on the board and the rest of the round trip is spent
+ * in the network and the host stack.
+ *
+ * @param[in] sock The UDP socket descriptor.
+ * @param[in] server_addr Pointer to the server's address structure.
+ */
+void ping_server(int sock, struct sockaddr_in* server_addr) {
+    uint8_t request[PROTOCOL_HEADER_SIZE + CLIENT_PING_PAYLOAD] = {0};
+    uint8_t reply[PROTOCOL_MAX_DATAGRAM];
+    double rtt_min = 1e9, rtt_max = 0.0, rtt_total = 0.0;
+    double service_min = 1e9, service_max = 0.0, service_total = 0.0;
+    unsigned int answered = 0;
+    unsigned int max_depth = 0;
+    size_t length = encode_header(request, PROTOCOL_OPCODE_PING, 0) + CLIENT_PING_PAYLOAD;
+    socklen_t server_len = sizeof(*server_addr);
+
+    // A lost probe only costs a short timeout
+    struct timeval timeout = {0, CLIENT_PING_TIMEOUT_MS * 1000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    for (uint32_t sequence = 0; sequence < CLIENT_PING_COUNT; sequence++) {
+        put_le32(&request[PROTOCOL_HEADER_SIZE], sequence);
+        double start_time = wall_time();
+        sendto(sock, request, length, 0, (struct sockaddr*)server_addr, sizeof(*server_addr));
+
+        // A lost probe is counted, not resent; late replies of earlier probes are skipped
+        ssize_t received;
+        do {
+            received = recvfrom(sock, reply, sizeof(reply), 0, (struct sockaddr*)server_addr, &server_len);
+        } while (received >= PROTOCOL_HEADER_SIZE + PROTOCOL_PING_REPLY_SIZE + 4 &&
+                 get_le32(&reply[PROTOCOL_HEADER_SIZE + PROTOCOL_PING_REPLY_SIZE]) != sequence);
+        double rtt = wall_time() - start_time;
+        if (received < 0) {
+            continue;
+        }
+        if (!check_reply(reply, received, PROTOCOL_OPCODE_PING, PROTOCOL_PING_REPLY_SIZE)) {
+            continue;
+        }
+
+        const uint8_t* body = &reply[PROTOCOL_HEADER_SIZE];
+        double service = (uint32_t)(get_le32(&body[4]) - get_le32(&body[0])) / (double)get_le32(&body[8]);
+        rtt_min = (rtt < rtt_min) ? rtt : rtt_min;
+        rtt_max = (rtt > rtt_max) ? rtt : rtt_max;
+        rtt_total += rtt;
+        service_min = (service < service_min) ? service : service_min;
+        service_max = (service > service_max) ? service : service_max;
+        service_total += service;
+        max_depth = (body[12] > max_depth) ? body[12] : max_depth;
+        answered++;
+    }
+
+    timeout.tv_sec = CLIENT_REPLY_TIMEOUT;
+    timeout.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    printf("Ping: %u of %u answered, queue depth up to %u\n", answered, CLIENT_PING_COUNT, max_depth);
+    if (answered == 0) {
+        return;
+    }
+    printf("  RTT:     min %.1f us / mean %.1f us / max %.1f us\n",
+           rtt_min * 1e6, rtt_total / answered * 1e6, rtt_max * 1e6);
+    printf("  Service: min %.2f us / mean %.2f us / max %.2f us\n",
+           service_min * 1e6, service_total / answered * 1e6, service_max * 1e6);
+    printf("  Network: mean %.1f us\n", (rtt_total - service_total) / answered * 1e6);
+}
+
+/**
+ * @brief Print a BENCH report of the server.
+ *
+ * @param[in] report Pointer to the report body.
+ */
+static void print_bench_report(const uint8_t* report) {
+    double clock_hz = get_le32(&report[4]);
+    uint32_t blast_sent = get_le32(&report[32]);
+    uint32_t blast_cycles = get_le32(&report[40]);
+
+    printf("    Board: MAC tx %u, MAC rx %u, rx to lwIP %u, missed %u, CRC errors %u, RX_POOL exhausted %u, "
+           "CPU busy %.1f %%\n",
+           get_le32(&report[8]), get_le32(&report[12]), get_le32(&report[16]), get_le32(&report[20]),
+           get_le32(&report[24]), get_le32(&report[28]), (report[48] | (report[49] << 8)) / 10.0);
+    if (blast_sent > 0 && blast_cycles > 0) {
+        printf("    Board: blast %u sent, %u failed, %.0f pps on the board clock\n",
+               blast_sent, get_le32(&report[36]), blast_sent * clock_hz / blast_cycles);
+    }
+}
+
+/**
+ * @brief Ask the server for its benchmark counters, optionally restarting them.
+ *
+ * @param[in] sock The UDP socket descriptor.
+ * @param[in] server_addr Pointer to the server's address structure.
+ * @param[in] flags PROTOCOL_BENCH_* flags.
+ * @param[out] report Buffer receiving the report body, or NULL.
+ * @return int Returns 1 if a report was received.
+ */
+static int query_bench(int sock, struct sockaddr_in* server_addr, uint8_t flags, uint8_t* report) {
+    uint8_t request[PROTOCOL_HEADER_SIZE + 1];
+    uint8_t reply[PROTOCOL_MAX_DATAGRAM];
+    socklen_t server_len = sizeof(*server_addr);
+    ssize_t received;
+
+    encode_header(request, PROTOCOL_OPCODE_BENCH, 0);
+    request[PROTOCOL_HEADER_SIZE] = flags;
+    sendto(sock, request, sizeof(request), 0, (struct sockaddr*)server_addr, sizeof(*server_addr));
+
+    // Skip stragglers of the previous run
+    do {
+        received = recvfrom(sock, reply, sizeof(reply), 0, (struct sockaddr*)server_addr, &server_len);
+    } while (received >= PROTOCOL_HEADER_SIZE && reply[1] != (PROTOCOL_OPCODE_BENCH | PROTOCOL_OPCODE_REPLY));
+    if (received < PROTOCOL_HEADER_SIZE + PROTOCOL_BENCH_REPORT_SIZE) {
+        return 0;
+    }
+    if (report) {
+        memcpy(report, &reply[PROTOCOL_HEADER_SIZE], PROTOCOL_BENCH_REPORT_SIZE);
+    }
+    return 1;
+}
+
+/**
+ * @brief Measure the server's UDP throughput for several frame sizes.
+ *
+ * For each UDP payload size the server first blasts CLIENT_BENCH_COUNT
+ * datagrams at the client, then reflects as many ECHO datagrams, kept
+ * CLIENT_BENCH_WINDOW in flight. Packets per second and goodput (UDP
+ * payload bits per second) are measured on the client; the server's
+ * counters of each run are printed next to them.
+ *
+ * @param[in] sock The UDP socket descriptor.
+ * @param[in] server_addr Pointer to the server's address structure.
+ */
+void bench_throughput(int sock, struct sockaddr_in* server_addr) {
+    static const uint16_t sizes[] = {64, 256, 512, 1024, 1472};
+    uint8_t request[PROTOCOL_MAX_DATAGRAM] = {0};
+    uint8_t reply[PROTOCOL_MAX_DATAGRAM];
+    uint8_t report[PROTOCOL_BENCH_REPORT_SIZE];
+    socklen_t server_len = sizeof(*server_addr);
+    int buffer_size = 4 * 1024 * 1024;
+
+    // Blasts arrive faster than they are read, and a lost datagram only costs a short timeout
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+    struct timeval timeout = {0, CLIENT_PING_TIMEOUT_MS * 1000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        uint16_t size = sizes[i];
+        uint32_t received_count = 0;
+        double first = 0.0, last = 0.0;
+        ssize_t received;
+
+        printf("UDP payload %u bytes:\n", size);
+
+        // Blast: the server sends, the client counts
+        query_bench(sock, server_addr, PROTOCOL_BENCH_RESET, NULL);
+        size_t length = encode_header(request, PROTOCOL_OPCODE_BLAST, 0);
+        put_le32(&request[length], CLIENT_BENCH_COUNT);
+        put_le16(&request[length + 4], size);
+        sendto(sock, request, length + 6, 0, (struct sockaddr*)server_addr, sizeof(*server_addr));
+        while ((received = recvfrom(sock, reply, sizeof(reply), 0, (struct sockaddr*)server_addr, &server_len)) >= 0) {
+            if (received >= PROTOCOL_HEADER_SIZE + PROTOCOL_BENCH_REPORT_SIZE &&
+                reply[1] == (PROTOCOL_OPCODE_BENCH | PROTOCOL_OPCODE_REPLY)) {
+                memcpy(report, &reply[PROTOCOL_HEADER_SIZE], PROTOCOL_BENCH_REPORT_SIZE);
+                break;
+            }
+            if (received == size && reply[1] == (PROTOCOL_OPCODE_BLAST | PROTOCOL_OPCODE_REPLY)) {
+                last = wall_time();
+                first = (received_count++ == 0) ? last : first;
+            }
+        }
+        if (received_count > 1 && last > first) {
+            double pps = (received_count - 1) / (last - first);
+            printf("  Blast: %u of %u received, %.0f pps, goodput %.2f Mbit/s\n",
+                   received_count, CLIENT_BENCH_COUNT, pps, pps * size * 8 / 1e6);
+        } else {
+            printf("  Blast: %u of %u received\n", received_count, CLIENT_BENCH_COUNT);
+        }
+        if (received >= 0) {
+            print_bench_report(report);
+        }
+
+        // Echo: keep a window of datagrams in flight
+        uint32_t sent = 0, echoed = 0, lost = 0;
+        query_bench(sock, server_addr, PROTOCOL_BENCH_RESET, NULL);
+        encode_header(request, PROTOCOL_OPCODE_ECHO, 0);
+        double start_time = wall_time();
+        while (echoed + lost < CLIENT_BENCH_COUNT) {
+            while (sent < CLIENT_BENCH_COUNT && sent - echoed - lost < CLIENT_BENCH_WINDOW) {
+                put_le32(&request[PROTOCOL_HEADER_SIZE], sent++);
+                sendto(sock, request, size, 0, (struct sockaddr*)server_addr, sizeof(*server_addr));
+            }
+            received = recvfrom(sock, reply, sizeof(reply), 0, (struct sockaddr*)server_addr, &server_len);
+            if (received < 0) {
+                // Everything in flight is lost
+                lost = sent - echoed;
+            } else if (received == size && reply[1] == (PROTOCOL_OPCODE_ECHO | PROTOCOL_OPCODE_REPLY)) {
+                echoed++;
+            }
+        }
+        double duration = wall_time() - start_time;
+        printf("  Echo:  %u of %u echoed, %.0f pps, goodput %.2f Mbit/s each way\n",
+               echoed, CLIENT_BENCH_COUNT, echoed / duration, echoed * size * 8 / duration / 1e6);
+        if (query_bench(sock, server_addr, 0, report)) {
+            print_bench_report(report);
+        }
+    }
+
+    timeout.tv_sec = CLIENT_REPLY_TIMEOUT;
+    timeout.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+/**
+ * @brief Run one test on a subset of the boards with a single multicast datagram.
+ *
+ * The request goes to the fleet's multicast group with the chosen target
+ * bitmap; every addressed board answers unicast, so replies are told apart
+ * by their source address. A board that has not answered when the replies
+ * stop gets the request again: boards that already completed the test
+ * answer from their reply cache instead of running it twice.
+ *
+ * @param[in] sock The UDP socket descriptor.
+ */
+void fleet_test(int sock) {
+    TestCommand command = {0};
+    TestResult result;
+    struct sockaddr_in group_addr = {0};
+    struct sockaddr_in board_addr;
+    socklen_t board_len;
+    struct in_addr answered[PROTOCOL_MAX_BOARDS];
+    uint8_t request[PROTOCOL_MAX_DATAGRAM];
+    uint8_t reply[PROTOCOL_MAX_DATAGRAM];
+    unsigned int answered_count = 0;
+    unsigned int expected = 0;
+    char line[32];
+    size_t length;
+
+    printf("Target boards (bitmap in hex, 0 for every board): ");
+    if (!fgets(line, sizeof(line), stdin)) {
+        return;
+    }
+    uint8_t targets = (uint8_t)strtoul(line, NULL, 16);
+    for (int bit = 0; bit < PROTOCOL_MAX_BOARDS; bit++) {
+        expected += (targets >> bit) & 1;
+    }
+    if (expected == 0) {
+        expected = PROTOCOL_MAX_BOARDS; // Unknown fleet size: collect until the replies stop
+    }
+
+    group_addr.sin_family = AF_INET;
+    group_addr.sin_port = htons(SERVER_PORT);
+    inet_pton(AF_INET, MULTICAST_GROUP, &group_addr.sin_addr);
+
+    command.test_id = next_test_id();
+    command.iterations = 5;
+    command.peripheral = TEST_PERIPHERAL_ALL & ~TEST_PERIPHERAL_TIMER;
+    command.bit_pattern = "FLEET";
+    command.pattern_length = strlen(command.bit_pattern);
+    encode_header(request, PROTOCOL_OPCODE_TEST, 0);
+    request[3] = targets;
+    length = PROTOCOL_HEADER_SIZE + encode_test_command(&request[PROTOCOL_HEADER_SIZE], &command);
+
+    double start_time = wall_time();
+    for (int attempt = 0; attempt <= CLIENT_FLEET_RETRIES && answered_count < expected; attempt++) {
+        if (attempt > 0) {
+            printf("%u of %u boards answered, resending (attempt %d)...\n", answered_count, expected, attempt);
+        }
+        sendto(sock, request, length, 0, (struct sockaddr*)&group_addr, sizeof(group_addr));
+
+        while (answered_count < expected) {
+            board_len = sizeof(board_addr);
+            ssize_t received = recvfrom(sock, reply, sizeof(reply), 0, (struct sockaddr*)&board_addr, &board_len);
+            if (received < 0) {
+                break;
+            }
+            if (!check_reply(reply, received, PROTOCOL_OPCODE_TEST, PROTOCOL_RESULT_SIZE)) {
+                continue;
+            }
+            decode_test_result(&reply[PROTOCOL_HEADER_SIZE], &result);
+            if (result.test_id != command.test_id) {
+                continue;
+            }
+            unsigned int known = 0;
+            while (known < answered_count && answered[known].s_addr != board_addr.sin_addr.s_addr) {
+                known++;
+            }
+            if (known < answered_count) {
+                continue; // Cached reply to a resent request
+            }
+            answered[answered_count++] = board_addr.sin_addr;
+
+            printf("Board %s: test %u %s after %.2f seconds.\n", inet_ntoa(board_addr.sin_addr), result.test_id,
+                   (result.result == 1) ? "succeeded" : "failed", wall_time() - start_time);
+            print_peripheral_results(&result);
+        }
+    }
+    printf("%u board(s) answered test %u.\n", answered_count, command.test_id);
+}
+
+// Print the per-peripheral results
+/**
+ * @brief Print the result of every peripheral tested by a command.
+ *
+ * @param[in] result Pointer to the test result structure.
+ */
+void print_peripheral_results(const TestResult* result) {
+    static const char* names[TEST_PERIPHERAL_COUNT] = {"Timer", "UART", "SPI", "I2C", "ADC"};
+
+    for (int bit = 0; bit < TEST_PERIPHERAL_COUNT; bit++) {
+        if (result->peripheral & (1 << bit)) {
+            printf("  %-6s: %s\n", names[bit],
+                   (result->peripheral_results[bit] == 1) ? "Success" :
+                   (result->peripheral_results[bit] == TEST_CANCELLED) ? "Cancelled" : "Failure");
+        }
+    }
+}
+
 // Save the test result to a log file
 /**
  * @brief Save the test result to a log file with a timestamp.
@@ -142,7 +1482,8 @@ void save_test_result(TestResult* result, double duration) {
 
     // Log the result
     fprintf(log_file, "Test-ID: %d, Timestamp: %s, Duration: %.2f seconds, Result: %s\n",
-            result->test_id, timestamp, duration, (result->result == 1) ? "Success" : "Failure");
+            result->test_id, timestamp, duration,
+            (result->result == 1) ? "Success" : (result->result == TEST_CANCELLED) ? "Cancelled" : "Failure");
 
     fclose(log_file);
 }
@@ -166,6 +1507,10 @@ int main() {
         exit(EXIT_FAILURE);
     }
 
+    // Wait at most CLIENT_REPLY_TIMEOUT seconds per datagram, then retry
+    struct timeval timeout = {CLIENT_REPLY_TIMEOUT, 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
     // Configure server address
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
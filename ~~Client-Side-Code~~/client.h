@@ -26,6 +26,8 @@
 #include <arpa/inet.h>
 #include <time.h>
 #include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
 
 /** @brief Server IP address for UDP communication. */
 #define SERVER_IP "192.168.7.2"
@@ -33,6 +35,29 @@
 /** @brief Server UDP port number. */
 #define SERVER_PORT 50007
 
+/** @brief Multicast group the fleet of boards listens on. */
+#define MULTICAST_GROUP "239.0.7.1"
+
+/** @brief Number of boards a request can address through the target bitmap. */
+#define PROTOCOL_MAX_BOARDS 8
+
+/** @brief Times a fleet request is resent while some boards have not answered. */
+#define CLIENT_FLEET_RETRIES 2
+
+/** @brief Seconds to wait for a reply before the request is resent. */
+#define CLIENT_REPLY_TIMEOUT 5
+
+/**
+ * @brief Seconds to wait for a datagram of a compact stream before the request is resent.
+ *
+ * Compact datagrams are sent only when full, about ten per million
+ * iterations, so seconds can pass between two of them.
+ */
+#define CLIENT_COMPACT_REPLY_TIMEOUT 60
+
+/** @brief Number of timeouts before the client gives up on a reply. */
+#define CLIENT_MAX_RETRIES 24
+
 /** @brief Maximum buffer size for communication. */
 #define MAX_BUFFER_SIZE 100
 
@@ -51,23 +76,330 @@
 /** @brief Bitfield for ADC peripheral. */
 #define TEST_PERIPHERAL_ADC   16
 
+/** @brief Number of peripheral bitfields. */
+#define TEST_PERIPHERAL_COUNT 5
+
+/** @brief All peripheral bitfields, tested in parallel by the server. */
+#define TEST_PERIPHERAL_ALL   0x1F
+
+/** @brief Result code of a test stopped by a CANCEL request. */
+#define TEST_CANCELLED 0xFE
+
+/** @brief Version of the wire protocol. */
+#define PROTOCOL_VERSION 1
+
+/** @brief Size of the packet header: version, opcode, flags, reserved. */
+#define PROTOCOL_HEADER_SIZE 4
+
+/** @brief Opcode of a single test request. */
+#define PROTOCOL_OPCODE_TEST  0x01
+
+/** @brief Opcode of a batch of test requests. */
+#define PROTOCOL_OPCODE_BATCH 0x02
+
+/** @brief Opcode of a telemetry datagram streamed while a test runs. */
+#define PROTOCOL_OPCODE_TELEMETRY 0x03
+
+/** @brief Opcode of a request for the per-client queue statistics. */
+#define PROTOCOL_OPCODE_STATS 0x04
+
+/** @brief Opcode of a request to cancel a queued or running test. */
+#define PROTOCOL_OPCODE_CANCEL 0x05
+
+/** @brief Opcode of a no-op latency probe. */
+#define PROTOCOL_OPCODE_PING 0x06
+
+/** @brief Opcode of a request for a burst of benchmark datagrams. */
+#define PROTOCOL_OPCODE_BLAST 0x07
+
+/** @brief Opcode of a benchmark datagram reflected by the server. */
+#define PROTOCOL_OPCODE_ECHO 0x08
+
+/** @brief Opcode of a request for the benchmark counters. */
+#define PROTOCOL_OPCODE_BENCH 0x09
+
+/** @brief Opcode of a request for the table of test engines. */
+#define PROTOCOL_OPCODE_CAPS 0x0A
+
+/** @brief Opcode of a request storing a test plan on the board. */
+#define PROTOCOL_OPCODE_PLAN_UPLOAD 0x0B
+
+/** @brief Opcode of a request running a stored test plan. */
+#define PROTOCOL_OPCODE_PLAN_RUN 0x0C
+
+/** @brief Opcode of a request for results kept in the board's history. */
+#define PROTOCOL_OPCODE_HISTORY 0x0D
+
+/** @brief Opcode of an error reply. */
+#define PROTOCOL_OPCODE_ERROR 0x7F
+
+/** @brief Bit set in the opcode of every reply. */
+#define PROTOCOL_OPCODE_REPLY 0x80
+
+/** @brief Header flag of a TEST request: stream per-iteration records. */
+#define PROTOCOL_FLAG_STREAM 0x01
+
+/** @brief Header flag of a streamed TEST request and its TELEMETRY datagrams: compact entries. */
+#define PROTOCOL_FLAG_COMPACT 0x02
+
+/** @brief Size of the fixed part of a test request. */
+#define PROTOCOL_TEST_SIZE 12
+
+/** @brief Size of a TLV header: type (1) + length (2). */
+#define PROTOCOL_TLV_HEADER_SIZE 3
+
+/** @brief TLV type carrying the data pattern of a test. */
+#define PROTOCOL_TLV_PATTERN 0x01
+
+/** @brief TLV type carrying the sample interval of compact telemetry. */
+#define PROTOCOL_TLV_SAMPLE 0x02
+
+/** @brief Size of a sample TLV value: sample interval. */
+#define PROTOCOL_SAMPLE_SIZE 4
+
+/** @brief Size of an encoded test result. */
+#define PROTOCOL_RESULT_SIZE (6 + TEST_PERIPHERAL_COUNT)
+
+/** @brief TLV type of a TEST reply carrying the totals of a streamed test. */
+#define PROTOCOL_TLV_SUMMARY 0x10
+
+/** @brief Size of the fixed part of a summary TLV. */
+#define PROTOCOL_SUMMARY_SIZE 12
+
+/** @brief Size of the per-peripheral part of a summary TLV. */
+#define PROTOCOL_SUMMARY_PERIPHERAL_SIZE 8
+
+/** @brief TLV type of a TEST reply carrying cycle-counter timing. */
+#define PROTOCOL_TLV_TIMING 0x11
+
+/** @brief Size of the fixed part of a timing TLV: core clock in Hz. */
+#define PROTOCOL_TIMING_SIZE 4
+
+/** @brief Size of the per-peripheral part of a timing TLV. */
+#define PROTOCOL_TIMING_PERIPHERAL_SIZE 32
+
+/** @brief TLV type of a TEST reply carrying the scheduling times of the test. */
+#define PROTOCOL_TLV_SCHEDULE 0x12
+
+/** @brief Size of a schedule TLV: queue wait, wall time, preempted time (ms). */
+#define PROTOCOL_SCHEDULE_SIZE 12
+
+/** @brief TLV type of a TEST reply carrying the step table of each swept peripheral. */
+#define PROTOCOL_TLV_SWEEP 0x13
+
+/** @brief Size of the per-peripheral part of a sweep TLV: type, step count. */
+#define PROTOCOL_SWEEP_SIZE 2
+
+/** @brief Number of engine-specific error counters of a sweep step. */
+#define PROTOCOL_SWEEP_ERROR_COUNT 3
+
+/** @brief Size of a sweep step: rate, mode, transfers, bytes, bit errors, bytes/s, error counters. */
+#define PROTOCOL_SWEEP_STEP_SIZE (21 + 2 * PROTOCOL_SWEEP_ERROR_COUNT)
+
+/** @brief Priority class of ordinary tests. */
+#define PROTOCOL_PRIORITY_NORMAL 0
+
+/** @brief Priority class of tests that run before queued normal ones. */
+#define PROTOCOL_PRIORITY_HIGH   1
+
+/** @brief Priority class of tests that also preempt a running lower-class test. */
+#define PROTOCOL_PRIORITY_URGENT 2
+
+/** @brief Option of a TEST request: run the sweep mode of the single named peripheral. */
+#define PROTOCOL_OPTION_SWEEP 0x04
+
+/** @brief Option of a TEST request: rediscover cached bus devices (the I2C device table) first. */
+#define PROTOCOL_OPTION_RESCAN 0x08
+
+/** @brief Size of the telemetry body header: test_id, sequence, record count. */
+#define PROTOCOL_TELEMETRY_HEADER_SIZE 9
+
+/** @brief Size of a telemetry record: peripheral, code, iteration, value, cycles. */
+#define PROTOCOL_RECORD_SIZE 14
+
+/** @brief Size of the compact telemetry body header: test_id, sequence. */
+#define PROTOCOL_TELEMETRY_COMPACT_HEADER_SIZE 8
+
+/** @brief Position of the kind in the tag of a compact entry. */
+#define PROTOCOL_COMPACT_KIND_SHIFT 6
+
+/** @brief Position of the record code in the tag of a compact entry. */
+#define PROTOCOL_COMPACT_CODE_SHIFT 3
+
+/** @brief Mask of the record code, once shifted down. */
+#define PROTOCOL_COMPACT_CODE_MASK  0x03
+
+/** @brief Mask of the peripheral bit index in the tag of a compact entry. */
+#define PROTOCOL_COMPACT_LANE_MASK  0x07
+
+/** @brief Compact entry: first iteration of a peripheral in the datagram. */
+#define PROTOCOL_COMPACT_START  0
+
+/** @brief Compact entry: a run of iterations with the same code and no values. */
+#define PROTOCOL_COMPACT_RUN    1
+
+/** @brief Compact entry: one iteration with zig-zag deltas of its value and cycles. */
+#define PROTOCOL_COMPACT_SAMPLE 2
+
+/**
+ * @brief Iterations of the soak test.
+ *
+ * The run takes minutes only with firmware built without TEST_VERBOSE:
+ * a per-iteration debug line at 115200 baud (4.8 ms for the ADC) would
+ * stretch it to about 80 minutes.
+ */
+#define CLIENT_SOAK_ITERATIONS 1000000
+
+/** @brief The soak test streams the value of every this many iterations (and of every failure). */
+#define CLIENT_SOAK_SAMPLE_INTERVAL 1000
+
+/** @brief Maximum number of test requests carried by one batch. */
+#define PROTOCOL_BATCH_MAX_COMMANDS 64
+
+/** @brief Size of a client entry of a STATS reply. */
+#define PROTOCOL_SESSION_STATS_SIZE 28
+
+/** @brief Size of a CANCEL reply body: test_id, status, completed iterations. */
+#define PROTOCOL_CANCEL_REPLY_SIZE 9
+
+/** @brief Size of the fixed part of a PING reply: rx cycles, tx cycles, core clock, queue depth. */
+#define PROTOCOL_PING_REPLY_SIZE 13
+
+/** @brief Number of probes sent by one latency measurement. */
+#define CLIENT_PING_COUNT 100
+
+/** @brief Time to wait for the reply of a latency probe before it is counted as lost. */
+#define CLIENT_PING_TIMEOUT_MS 500
+
+/** @brief Payload size of a latency probe. */
+#define CLIENT_PING_PAYLOAD 32
+
+/** @brief BENCH request flag: restart the counters and the CPU load window. */
+#define PROTOCOL_BENCH_RESET 0x01
+
+/** @brief Size of a BENCH report body. */
+#define PROTOCOL_BENCH_REPORT_SIZE 50
+
+/** @brief Datagrams per frame size in each benchmark mode. */
+#define CLIENT_BENCH_COUNT 2000
+
+/** @brief Echo datagrams kept in flight by the benchmark. */
+#define CLIENT_BENCH_WINDOW 8
+
+/** @brief Cancel status: no queued or running test of this client has the ID. */
+#define PROTOCOL_CANCEL_NOT_FOUND 0
+
+/** @brief Cancel status: the test was removed from the queue before it started. */
+#define PROTOCOL_CANCEL_DEQUEUED  1
+
+/** @brief Cancel status: the running test was stopped. */
+#define PROTOCOL_CANCEL_STOPPED   2
+
+/** @brief Size of the name field of a CAPS entry (NUL-padded). */
+#define PROTOCOL_CAPS_NAME_SIZE 8
+
+/** @brief Size of a CAPS entry: type, peripheral, parameters, max pattern, default iterations, estimated us, name. */
+#define PROTOCOL_CAPS_ENTRY_SIZE (13 + PROTOCOL_CAPS_NAME_SIZE)
+
+/** @brief CAPS parameter flag: the test takes a data pattern. */
+#define PROTOCOL_PARAM_PATTERN 0x01
+
+/** @brief CAPS parameter flag: the test cannot run without a data pattern. */
+#define PROTOCOL_PARAM_PATTERN_REQUIRED 0x02
+
+/** @brief CAPS parameter flag: the engine has a sweep mode. */
+#define PROTOCOL_PARAM_SWEEP 0x04
+
+/** @brief Size of the fixed part of a plan step. */
+#define PROTOCOL_PLAN_STEP_SIZE 12
+
+/** @brief Plan step flag: a failing run of the step ends the plan. */
+#define PROTOCOL_PLAN_STOP_ON_FAIL 0x01
+
+/** @brief Size of a PLAN_UPLOAD reply body. */
+#define PROTOCOL_PLAN_UPLOAD_REPLY_SIZE 8
+
+/** @brief Size of a PLAN_RUN body: run ID (4) + plan ID (1). */
+#define PROTOCOL_PLAN_RUN_SIZE 5
+
+/** @brief PLAN_RUN report kind: end of the plan. */
+#define PROTOCOL_PLAN_REPORT_DONE 1
+
+/** @brief Size of the fixed part of a step report. */
+#define PROTOCOL_PLAN_STEP_REPORT_SIZE 8
+
+/** @brief Size of a done report. */
+#define PROTOCOL_PLAN_DONE_SIZE 16
+
+/** @brief Plan status: the plan was cancelled. */
+#define PROTOCOL_PLAN_CANCELLED 2
+
+/** @brief Size of a HISTORY request body: first test_id, last test_id. */
+#define PROTOCOL_HISTORY_SIZE 8
+
+/** @brief Size of the fixed part of a HISTORY reply: count, more. */
+#define PROTOCOL_HISTORY_REPLY_SIZE 2
+
+/** @brief Size of the fixed part of a HISTORY entry: reply length. */
+#define PROTOCOL_HISTORY_ENTRY_SIZE 2
+
+/** @brief Plan ID under which the client stores its nightly suite. */
+#define CLIENT_PLAN_ID 1
+
+/** @brief Maximum size of a datagram (one Ethernet MTU of UDP payload). */
+#define PROTOCOL_MAX_DATAGRAM 1472
+
 /**
- * @brief Structure for sending a test command to the server.
+ * @brief Parameters of a test to send to the server.
+ *
+ * This is not a wire format; encode_test_command() packs it.
  */
 typedef struct {
     uint32_t test_id;         /**< Unique Test ID. */
+    uint32_t iterations;      /**< Number of iterations for the test. */
     uint8_t peripheral;       /**< Peripheral to test. */
-    uint8_t iterations;       /**< Number of iterations for the test. */
-    uint8_t pattern_length;   /**< Length of the test bit pattern. */
-    char bit_pattern[MAX_BUFFER_SIZE]; /**< Test bit pattern. */
+    uint8_t priority;         /**< PROTOCOL_PRIORITY_* class, sent in the options byte. */
+    uint8_t sweep;            /**< Nonzero to run the sweep mode of the peripheral (PROTOCOL_OPTION_SWEEP). */
+    uint8_t rescan;           /**< Nonzero to rescan the bus before the test (PROTOCOL_OPTION_RESCAN). */
+    uint16_t pattern_length;  /**< Length of the test bit pattern. */
+    const char* bit_pattern;  /**< Test bit pattern (may be NULL). */
+    uint32_t sample_interval; /**< Sample interval of compact telemetry, sent as a SAMPLE TLV if nonzero. */
 } TestCommand;
 
+/**
+ * @brief Decoder state and totals of a compact telemetry stream.
+ */
+typedef struct {
+    uint32_t iteration[TEST_PERIPHERAL_COUNT]; /**< Iteration expected next, per peripheral bit. */
+    uint32_t value[TEST_PERIPHERAL_COUNT];     /**< Value of the last sample, per peripheral bit. */
+    uint32_t cycles[TEST_PERIPHERAL_COUNT];    /**< Cycles of the last sample, per peripheral bit. */
+    uint32_t passed[TEST_PERIPHERAL_COUNT];    /**< Passed iterations, per peripheral bit. */
+    uint32_t failed[TEST_PERIPHERAL_COUNT];    /**< Iterations that did not pass, per peripheral bit. */
+    uint32_t samples;                          /**< Sampled iterations. */
+    uint32_t datagrams;                        /**< Compact datagrams received. */
+    uint64_t bytes;                            /**< UDP payload bytes of those datagrams. */
+} CompactTelemetry;
+
+/**
+ * @brief One step of a test plan; packed by run_plan().
+ */
+typedef struct {
+    uint8_t peripheral;       /**< Peripherals tested by the step. */
+    uint8_t flags;            /**< PROTOCOL_PLAN_STOP_ON_FAIL or 0. */
+    uint16_t repeat;          /**< Runs of the step. */
+    uint32_t iterations;      /**< Iterations of each run. */
+    uint16_t delay_ms;        /**< Delay after each run. */
+    const char* pattern;      /**< Test bit pattern (may be NULL). */
+} PlanStep;
+
 /**
  * @brief Structure for receiving test results from the server.
  */
 typedef struct {
     uint32_t test_id; /**< Unique Test ID. */
     uint8_t result;   /**< 1 for success, 0xFF for failure. */
+    uint8_t peripheral; /**< Peripherals that were tested. */
+    uint8_t peripheral_results[TEST_PERIPHERAL_COUNT]; /**< Result per peripheral bit (0 if not tested). */
 } TestResult;
 
 // Function prototypes
@@ -85,6 +417,142 @@ void display_menu();
  */
 void send_test_command(int sock, struct sockaddr_in* server_addr);
 
+/**
+ * @brief Send every single-peripheral test in one batch datagram.
+ *
+ * @param[in] sock The UDP socket descriptor.
+ * @param[in] server_addr Pointer to the server's address structure.
+ */
+void send_batch_command(int sock, struct sockaddr_in* server_addr);
+
+/**
+ * @brief Query and print the per-client queue statistics of the server.
+ *
+ * @param[in] sock The UDP socket descriptor.
+ * @param[in] server_addr Pointer to the server's address structure.
+ */
+void query_stats(int sock, struct sockaddr_in* server_addr);
+
+/**
+ * @brief Ask the server to cancel a queued or running test.
+ *
+ * @param[in] sock The UDP socket descriptor.
+ * @param[in] server_addr Pointer to the server's address structure.
+ */
+void cancel_test(int sock, struct sockaddr_in* server_addr);
+
+/**
+ * @brief Measure the round-trip time to the server and split it into
+ *        network time and firmware service time.
+ *
+ * @param[in] sock The UDP socket descriptor.
+ * @param[in] server_addr Pointer to the server's address structure.
+ */
+void ping_server(int sock, struct sockaddr_in* server_addr);
+
+/**
+ * @brief Measure the server's UDP throughput for several frame sizes.
+ *
+ * @param[in] sock The UDP socket descriptor.
+ * @param[in] server_addr Pointer to the server's address structure.
+ */
+void bench_throughput(int sock, struct sockaddr_in* server_addr);
+
+/**
+ * @brief Run a test on a subset of the boards through the multicast group.
+ *
+ * @param[in] sock The UDP socket descriptor.
+ */
+void fleet_test(int sock);
+
+/**
+ * @brief Print the table of test engines returned by the CAPS request.
+ *
+ * @param[in] sock The UDP socket descriptor.
+ * @param[in] server_addr Pointer to the server's address structure.
+ */
+void query_capabilities(int sock, struct sockaddr_in* server_addr);
+
+/**
+ * @brief Upload the nightly suite as a test plan and run it with one request.
+ *
+ * @param[in] sock The UDP socket descriptor.
+ * @param[in] server_addr Pointer to the server's address structure.
+ */
+void run_plan(int sock, struct sockaddr_in* server_addr);
+
+/**
+ * @brief List the results of this client run kept in the board's history.
+ *
+ * @param[in] sock The UDP socket descriptor.
+ * @param[in] server_addr Pointer to the server's address structure.
+ */
+void query_history(int sock, struct sockaddr_in* server_addr);
+
+/**
+ * @brief Encode the body of a test request.
+ *
+ * @param[out] buf Buffer receiving the encoded body.
+ * @param[in] command Pointer to the test parameters.
+ * @return size_t Number of bytes written.
+ */
+size_t encode_test_command(uint8_t* buf, const TestCommand* command);
+
+/**
+ * @brief Decode an encoded test result.
+ *
+ * @param[in] buf Pointer to the encoded result.
+ * @param[out] result Pointer to the result structure to fill.
+ */
+void decode_test_result(const uint8_t* buf, TestResult* result);
+
+/**
+ * @brief Save the records of a telemetry datagram to the telemetry log.
+ *
+ * @param[in] datagram Pointer to the received TELEMETRY datagram.
+ * @param[in] length Length of the datagram.
+ * @param[in,out] expected_sequence Sequence number expected next.
+ * @param[in] file Telemetry log file (may be NULL).
+ */
+void save_telemetry(const uint8_t* datagram, ssize_t length, uint32_t* expected_sequence, FILE* file);
+
+/**
+ * @brief Decode a compact telemetry datagram.
+ *
+ * @param[in] datagram Pointer to the received TELEMETRY datagram.
+ * @param[in] length Length of the datagram.
+ * @param[in,out] expected_sequence Sequence number expected next.
+ * @param[in,out] stream Pointer to the decoder state and totals.
+ * @param[in] file Telemetry log file (may be NULL).
+ */
+void decode_compact_telemetry(const uint8_t* datagram, ssize_t length, uint32_t* expected_sequence,
+                              CompactTelemetry* stream, FILE* file);
+
+/**
+ * @brief Print the TLVs (timing, stream summary) following a test result.
+ *
+ * @param[in] tlvs Pointer to the TLVs following the result.
+ * @param[in] length Length of the TLV area.
+ * @param[in] result Pointer to the decoded result.
+ * @param[in] received_datagrams Number of telemetry datagrams received.
+ */
+void print_reply_tlvs(const uint8_t* tlvs, ssize_t length, const TestResult* result, uint32_t received_datagrams);
+
+/**
+ * @brief Print the step tables of a sweep TLV and the highest clean rate of each peripheral.
+ *
+ * @param[in] value Pointer to the TLV value.
+ * @param[in] length Length of the TLV value.
+ */
+void print_sweep(const uint8_t* value, uint16_t length);
+
+/**
+ * @brief Print the result of every peripheral tested by a command.
+ *
+ * @param[in] result Pointer to the test result structure.
+ */
+void print_peripheral_results(const TestResult* result);
+
 /**
  * @brief Save the test result to a log file.
  *